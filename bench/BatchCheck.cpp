@@ -0,0 +1,220 @@
+#include "../external/midifile/include/Options.h"
+#include "../include/Constants.h"
+#include "../include/Counters.h"
+#include "../include/EventBuffer.h"
+#include "../include/Types.h"
+#include "../include/Voice.h"
+#include "../include/VoiceBatch.h"
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace smf;
+
+// Equivalence check of the batch engine: random voices are driven through
+// the same ticks and per-voice scheduling states by one MelodicVoice each
+// and by a VoiceBatch, with the scalar and the AVX2 lane pass, and the
+// recorded events and counters must be identical.
+
+static const int MAX_VOICES = 70;   // Spans several vector blocks and a padded tail
+static const int MAX_PHASES = 4;
+static const int STEPS = 400;       // Updates per trial
+static const int MAX_STEP_TICKS = 90; // Largest tick advance between updates
+
+// CheckVoice: One voice with its own buffer and counters, as a voice thread would have
+struct CheckVoice {
+    ThreadData data{};
+    unique_ptr<EventBuffer> events{new EventBuffer()};
+    unique_ptr<ThreadCounters> counters{new ThreadCounters()};
+
+    CheckVoice(int id, const SnippetTable& snippets) {
+        data.id = id;
+        data.track = id + 1;
+        data.channel = id % 16;
+        data.instrument = 0;
+        data.snippets = snippets;
+        data.events = events.get();
+        data.counters = counters.get();
+    }
+};
+
+// Trial: One random batch, its phase grid and the scheduling states of every step
+struct Trial {
+    PhaseGrid grid;
+    vector<SnippetTable> snippets;
+    vector<int> ticks;
+    vector<vector<unsigned char>> scheduled; // [step][voice]
+};
+
+/**
+ * Builds a random trial
+ * 
+ * Snippets have random lengths (some empty) and some voices have fewer
+ * snippets than phases; scheduling states flip per voice, so changes,
+ * note chaining and phase-boundary clamping all occur
+ * 
+ * @param gen Random source
+ * @return Trial
+ */
+static Trial makeTrial(mt19937& gen) {
+    Trial trial;
+    uniform_int_distribution<> voiceCount(1, MAX_VOICES);
+    uniform_int_distribution<> phaseCount(1, MAX_PHASES);
+    uniform_int_distribution<> noteCount(0, 6);
+    uniform_int_distribution<> pitch(36, 96);
+    uniform_int_distribution<> velocity(1, 127);
+    uniform_int_distribution<> duration(1, TPQ * 2);
+    uniform_int_distribution<> advance(0, MAX_STEP_TICKS);
+    uniform_real_distribution<> chance(0.0, 1.0);
+
+    trial.grid.numPhases = phaseCount(gen);
+    trial.grid.ticksPerPhase = uniform_int_distribution<>(TPQ, TPQ * 8)(gen);
+    trial.grid.totalTicks = trial.grid.ticksPerPhase * trial.grid.numPhases;
+    trial.grid.durationSec = 0;
+
+    int voices = voiceCount(gen);
+    for (int v = 0; v < voices; v++) {
+        SnippetTable table;
+        int count = uniform_int_distribution<>(1, trial.grid.numPhases)(gen);
+        for (int s = 0; s < count; s++) {
+            table.beginSnippet();
+            for (int n = noteCount(gen); n > 0; n--) {
+                table.addNote(pitch(gen), velocity(gen), duration(gen));
+            }
+        }
+        trial.snippets.push_back(table);
+    }
+
+    // Each voice keeps its state for a while, the way a detector holds it
+    vector<unsigned char> state(voices, 1);
+    double flip = chance(gen) * 0.5;
+    int tick = 0;
+    for (int step = 0; step < STEPS && tick < trial.grid.totalTicks + TPQ; step++) {
+        tick += advance(gen);
+        for (int v = 0; v < voices; v++) {
+            if (chance(gen) < flip) state[v] = !state[v];
+        }
+        trial.ticks.push_back(tick);
+        trial.scheduled.push_back(state);
+    }
+    return trial;
+}
+
+/**
+ * Drains a buffer into a list of events
+ * 
+ * @param buffer Event buffer (consumed)
+ * @return Events in recording order
+ */
+static vector<TrackEvent> drain(EventBuffer& buffer) {
+    vector<TrackEvent> events;
+    buffer.consume([&](const TrackEvent& event) { events.push_back(event); });
+    return events;
+}
+
+/**
+ * Formats an event for a mismatch report
+ * 
+ * @param event Recorded event
+ * @return Tick, type, channel, pitch and velocity
+ */
+static string describe(const TrackEvent& event) {
+    return "tick " + to_string(event.tick) + " type " + to_string(static_cast<int>(event.type)) + " channel " +
+           to_string(event.channel) + " pitch " + to_string(event.pitch) + " velocity " + to_string(event.velocity);
+}
+
+/**
+ * Runs one trial through MelodicVoice and VoiceBatch and compares them
+ * 
+ * @param trial Trial to run
+ * @param index Trial number, for the report
+ * @param events Receives the number of events compared
+ * @return True if every voice recorded the same events and counters
+ */
+static bool runTrial(const Trial& trial, int index, long long& events) {
+    vector<unique_ptr<CheckVoice>> reference, batched;
+    vector<unique_ptr<MelodicVoice>> voices;
+    vector<ThreadData*> lanes;
+    for (size_t v = 0; v < trial.snippets.size(); v++) {
+        reference.emplace_back(new CheckVoice(static_cast<int>(v), trial.snippets[v]));
+        batched.emplace_back(new CheckVoice(static_cast<int>(v), trial.snippets[v]));
+        voices.emplace_back(new MelodicVoice(reference.back()->data, trial.grid));
+        lanes.push_back(&batched.back()->data);
+    }
+    VoiceBatch batch(lanes, trial.grid);
+
+    for (size_t step = 0; step < trial.ticks.size(); step++) {
+        for (size_t v = 0; v < voices.size(); v++) {
+            voices[v]->update(trial.ticks[step], trial.scheduled[step][v] != 0);
+        }
+        batch.update(trial.ticks[step], trial.scheduled[step]);
+    }
+    int lastTick = trial.ticks.empty() ? 0 : trial.ticks.back();
+    for (auto& voice : voices) {
+        voice->finish(lastTick);
+    }
+    batch.finish(lastTick);
+
+    for (size_t v = 0; v < voices.size(); v++) {
+        vector<TrackEvent> expected = drain(*reference[v]->events);
+        vector<TrackEvent> actual = drain(*batched[v]->events);
+        events += static_cast<long long>(expected.size());
+        size_t same = 0;
+        while (same < expected.size() && same < actual.size() && expected[same].tick == actual[same].tick &&
+               expected[same].type == actual[same].type && expected[same].channel == actual[same].channel &&
+               expected[same].pitch == actual[same].pitch && expected[same].velocity == actual[same].velocity) {
+            same++;
+        }
+        if (same < expected.size() || same < actual.size()) {
+            cerr << "trial " << index << ", voice " << v << ": event " << same << " differs: MelodicVoice "
+                 << (same < expected.size() ? describe(expected[same]) : "none") << ", VoiceBatch "
+                 << (same < actual.size() ? describe(actual[same]) : "none") << endl;
+            return false;
+        }
+
+        CounterValues want = readCounters(*reference[v]->counters);
+        CounterValues got = readCounters(*batched[v]->counters);
+        if (want.transitions != got.transitions || want.notesStarted != got.notesStarted ||
+            want.notesTruncated != got.notesTruncated) {
+            cerr << "trial " << index << ", voice " << v << ": counters differ: MelodicVoice " << want.transitions
+                 << "/" << want.notesStarted << "/" << want.notesTruncated << ", VoiceBatch " << got.transitions
+                 << "/" << got.notesStarted << "/" << got.notesTruncated << " (transitions/started/truncated)" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    options.define("trials=i:500", "Random batches checked per lane pass");
+    options.define("seed=i:1", "Seed of the first trial");
+    options.process(argc, argv);
+
+    int trials = max(1, options.getInteger("trials"));
+    int seed = options.getInteger("seed");
+
+    bool ok = true;
+    for (bool avx2 : {false, true}) {
+        const char* name = avx2 ? "avx2" : "scalar";
+        if (!VoiceBatch::selectVariant(avx2)) {
+            cout << name << ": not supported on this CPU, skipped" << endl;
+            continue;
+        }
+        long long events = 0;
+        int passed = 0;
+        for (int t = 0; t < trials; t++) {
+            mt19937 gen(static_cast<unsigned>(seed + t));
+            if (!runTrial(makeTrial(gen), seed + t, events)) break;
+            passed++;
+        }
+        cout << name << ": " << passed << " of " << trials << " trials match MelodicVoice (" << events
+             << " events)" << endl;
+        ok = ok && passed == trials;
+    }
+    return ok ? 0 : 1;
+}
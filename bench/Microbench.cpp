@@ -0,0 +1,355 @@
+#include "../external/midifile/include/MidiFile.h"
+#include "../external/midifile/include/Options.h"
+#include "../include/Constants.h"
+#include "../include/Types.h"
+#include "../include/MusicGeneration.h"
+#include "../include/EventBuffer.h"
+#include "../include/MidiOutput.h"
+#include "../include/StartGate.h"
+#include "../include/Utils.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace smf;
+
+// Microbenchmarks of the generation and output primitives: each case runs
+// long enough to be timed reliably, is repeated, and the per-operation
+// times are written as JSON so runs of different commits can be compared.
+
+static const long long MIN_CASE_NS = 200000000; // Shortest timed run of one repetition
+static const int FILE_EVENTS = 1000000;        // Events in the sort and write cases
+static const int FILE_TRACKS = 16;             // Tracks the file cases spread their events over
+static const int RECORDER_THREADS_MAX = 8;     // Upper bound on threads in the recording cases
+static const int STEP_TICKS = TPQ / 4;         // Spacing of the note events in the file cases (sixteenths)
+
+// Keeps results observable so the compiler cannot drop the work
+static volatile long long sink = 0;
+
+// BenchCase: One measured operation; body runs it a number of times and returns the timed nanoseconds
+struct BenchCase {
+    string name;
+    long long itemsPerOp;                          // Items (notes, events) processed by one operation
+    function<long long(long long iterations)> body;
+};
+
+// BenchResult: The per-operation times of one case over all repetitions
+struct BenchResult {
+    string name;
+    long long iterations;
+    long long itemsPerOp;
+    vector<double> nsPerOp; // One entry per repetition, sorted
+};
+
+/**
+ * Times a loop of operations
+ * 
+ * @param iterations Number of operations
+ * @param op Operation, given its index
+ * @return Elapsed nanoseconds
+ */
+template <typename Op>
+static long long timeLoop(long long iterations, Op op) {
+    long long startNs = getMonotonicNs();
+    for (long long i = 0; i < iterations; i++) {
+        op(i);
+    }
+    return getMonotonicNs() - startNs;
+}
+
+/**
+ * Runs one recording thread per party behind a start gate and times them together
+ * 
+ * @param threads Number of recording threads
+ * @param record Recording loop of one thread, given its index
+ * @return Nanoseconds from opening the gate until every thread finished
+ */
+static long long timeThreads(int threads, const function<void(int)>& record) {
+    StartGate gate(threads);
+    vector<thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&gate, &record, t]() {
+            gate.arriveAndWait();
+            record(t);
+        });
+    }
+    gate.waitForArrivals();
+    long long startNs = getMonotonicNs();
+    gate.open();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    return getMonotonicNs() - startNs;
+}
+
+/**
+ * Builds a thread configuration and a full event buffer for one track of the file cases
+ * 
+ * @param track Track number (thread ID and channel follow it)
+ * @param events Events to record, as note-on/note-off pairs
+ * @param buffer Receives the events
+ * @return Thread configuration for the track
+ */
+static ThreadData fillTrack(int track, int events, EventBuffer& buffer) {
+    ThreadData data;
+    data.id = track - 1;
+    data.track = track;
+    data.channel = (track - 1) % 16;
+    data.isDrumThread = false;
+    buffer.reserve(events);
+    for (int i = 0; i < events / 2; i++) {
+        buffer.noteOn(i * STEP_TICKS, data.channel, 60 + i % 24, 80);
+        buffer.noteOff(i * STEP_TICKS + STEP_TICKS / 2, data.channel, 60 + i % 24);
+    }
+    return data;
+}
+
+/**
+ * Builds a MidiFile holding the events of the file cases
+ * 
+ * @param midifile File to fill (one tempo track plus FILE_TRACKS tracks)
+ * @param shuffled Whether each track's events are added in random tick order
+ */
+static void fillMidiFile(MidiFile& midifile, bool shuffled) {
+    midifile.addTracks(FILE_TRACKS);
+    midifile.setTPQ(TPQ);
+    int perTrack = FILE_EVENTS / FILE_TRACKS / 2;
+    vector<int> order(perTrack);
+    for (int i = 0; i < perTrack; i++) order[i] = i;
+    mt19937 gen(1);
+    for (int track = 1; track <= FILE_TRACKS; track++) {
+        if (shuffled) shuffle(order.begin(), order.end(), gen);
+        for (int i : order) {
+            midifile.addNoteOn(track, i * STEP_TICKS, track - 1, 60 + i % 24, 80);
+            midifile.addNoteOff(track, i * STEP_TICKS + STEP_TICKS / 2, track - 1, 60 + i % 24);
+        }
+    }
+}
+
+/**
+ * Lists every case
+ * 
+ * @param recorderThreads Threads in the recording cases
+ * @param scratchFile File the write cases write to
+ * @return Cases in report order
+ */
+static vector<BenchCase> makeCases(int recorderThreads, const string& scratchFile) {
+    vector<BenchCase> cases;
+
+    cases.push_back({"create_note_in_scale", 1, [](long long iterations) {
+        return timeLoop(iterations, [](long long i) {
+            sink = sink + createNoteInScale(MAJOR_SCALE, 4 + static_cast<int>(i % 3), static_cast<int>(i % 11), static_cast<int>(i % 12));
+        });
+    }});
+
+    cases.push_back({"select_duration", 1, [](long long iterations) {
+        mt19937 gen(1);
+        return timeLoop(iterations, [&gen](long long) {
+            sink = sink + selectDuration(gen, MELODY_DURATION_WEIGHTS);
+        });
+    }});
+
+    cases.push_back({"generate_snippet", 1, [](long long iterations) {
+        mt19937 gen(1);
+        SnippetTable table;
+        table.reserve(static_cast<int>(iterations), static_cast<int>(iterations) * SNIPPET_MAX_NOTES);
+        long long elapsedNs = timeLoop(iterations, [&gen, &table](long long i) {
+            generateSnippet(table, gen, HIGH_LOW, HIGH_HIGH, MAJOR_SCALE, static_cast<int>(i % 12), false);
+        });
+        sink = sink + table.count();
+        return elapsedNs;
+    }});
+
+    cases.push_back({"generate_drum_pattern", 1, [](long long iterations) {
+        return timeLoop(iterations, [](long long i) {
+            DrumPattern pattern = generateDrumPattern(static_cast<int>(i % 3));
+            sink = sink + pattern.kick[0];
+        });
+    }});
+
+    // The original recording path: every thread adds to one MidiFile under one mutex
+    cases.push_back({"record_midifile_mutex", recorderThreads, [recorderThreads](long long iterations) {
+        MidiFile midifile;
+        midifile.addTracks(recorderThreads);
+        mutex midiMutex;
+        return timeThreads(recorderThreads, [&](int t) {
+            for (long long i = 0; i < iterations; i++) {
+                lock_guard<mutex> lock(midiMutex);
+                midifile.addNoteOn(t + 1, static_cast<int>(i), t, 60 + static_cast<int>(i % 24), 80);
+            }
+        });
+    }});
+
+    // The current one: every thread appends to its own reserved EventBuffer
+    cases.push_back({"record_event_buffer", recorderThreads, [recorderThreads](long long iterations) {
+        vector<unique_ptr<EventBuffer>> buffers;
+        for (int t = 0; t < recorderThreads; t++) {
+            buffers.emplace_back(new EventBuffer());
+            buffers.back()->reserve(static_cast<size_t>(iterations));
+        }
+        return timeThreads(recorderThreads, [&](int t) {
+            EventBuffer& buffer = *buffers[t];
+            for (long long i = 0; i < iterations; i++) {
+                buffer.noteOn(static_cast<int>(i), t, 60 + static_cast<int>(i % 24), 80);
+            }
+        });
+    }});
+
+    cases.push_back({"sort_tracks_1m", FILE_EVENTS, [](long long iterations) {
+        long long elapsedNs = 0;
+        for (long long i = 0; i < iterations; i++) {
+            MidiFile midifile;
+            fillMidiFile(midifile, true);
+            long long startNs = getMonotonicNs();
+            midifile.sortTracks();
+            elapsedNs += getMonotonicNs() - startNs;
+        }
+        return elapsedNs;
+    }});
+
+    cases.push_back({"write_midifile_1m", FILE_EVENTS, [scratchFile](long long iterations) {
+        long long elapsedNs = 0;
+        for (long long i = 0; i < iterations; i++) {
+            MidiFile midifile;
+            fillMidiFile(midifile, false);
+            long long startNs = getMonotonicNs();
+            midifile.write(scratchFile);
+            elapsedNs += getMonotonicNs() - startNs;
+        }
+        remove(scratchFile.c_str());
+        return elapsedNs;
+    }});
+
+    // Encoding from the event buffers and the writev, as in the default output path
+    cases.push_back({"write_native_1m", FILE_EVENTS, [scratchFile](long long iterations) {
+        long long elapsedNs = 0;
+        for (long long i = 0; i < iterations; i++) {
+            vector<unique_ptr<EventBuffer>> buffers;
+            vector<ThreadData> tracks;
+            for (int track = 1; track <= FILE_TRACKS; track++) {
+                buffers.emplace_back(new EventBuffer());
+                tracks.push_back(fillTrack(track, FILE_EVENTS / FILE_TRACKS, *buffers.back()));
+            }
+            long long startNs = getMonotonicNs();
+            SmfFileWriter writer(FILE_TRACKS + 1);
+            writer.trackEncoder(0).tempo(0, TEMPO);
+            for (int t = 0; t < FILE_TRACKS; t++) {
+                writer.reserve(tracks[t].track, static_cast<size_t>(FILE_EVENTS / FILE_TRACKS) * SMF_BYTES_PER_EVENT);
+                writer.appendThread(tracks[t], *buffers[t], {});
+            }
+            writer.write(scratchFile);
+            elapsedNs += getMonotonicNs() - startNs;
+        }
+        remove(scratchFile.c_str());
+        return elapsedNs;
+    }});
+
+    return cases;
+}
+
+/**
+ * Finds an iteration count that runs for at least MIN_CASE_NS, then times each repetition
+ * 
+ * @param benchCase Case to run
+ * @param repetitions Timed repetitions
+ * @return Per-operation times
+ */
+static BenchResult runCase(const BenchCase& benchCase, int repetitions) {
+    long long iterations = 1;
+    long long elapsedNs = benchCase.body(iterations);
+    while (elapsedNs < MIN_CASE_NS) {
+        // Aim past the target from the last estimate, growing at most tenfold per step
+        long long estimate = elapsedNs > 0 ? iterations * MIN_CASE_NS / elapsedNs + 1 : iterations * 10;
+        iterations = min(iterations * 10, max(iterations + 1, estimate + estimate / 5));
+        elapsedNs = benchCase.body(iterations);
+    }
+
+    BenchResult result = {benchCase.name, iterations, benchCase.itemsPerOp, {}};
+    result.nsPerOp.push_back(static_cast<double>(elapsedNs) / iterations);
+    for (int r = 1; r < repetitions; r++) {
+        result.nsPerOp.push_back(static_cast<double>(benchCase.body(iterations)) / iterations);
+    }
+    sort(result.nsPerOp.begin(), result.nsPerOp.end());
+    return result;
+}
+
+/**
+ * Returns the median of sorted values
+ * 
+ * @param sorted Values in ascending order
+ * @return Median
+ */
+static double median(const vector<double>& sorted) {
+    size_t n = sorted.size();
+    return (n % 2) ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+/**
+ * Writes all results as JSON
+ * 
+ * @param path Output file
+ * @param commit Commit the binary was built from (may be empty)
+ * @param repetitions Repetitions of each case
+ * @param recorderThreads Threads in the recording cases
+ * @param results Results in report order
+ * @return True if the file was written
+ */
+static bool writeJson(const string& path, const string& commit, int repetitions, int recorderThreads,
+                      const vector<BenchResult>& results) {
+    ofstream out(path);
+    if (!out) return false;
+    out << "{\n  \"commit\": \"" << commit << "\",\n  \"compiler\": \"" << __VERSION__ << "\",\n  \"repetitions\": "
+        << repetitions << ",\n  \"recorder_threads\": " << recorderThreads << ",\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& result = results[i];
+        double typical = median(result.nsPerOp);
+        out << "    {\"name\": \"" << result.name << "\", \"iterations\": " << result.iterations
+            << ", \"items_per_op\": " << result.itemsPerOp << ", \"ns_per_op\": {\"min\": " << result.nsPerOp.front()
+            << ", \"median\": " << typical << ", \"max\": " << result.nsPerOp.back()
+            << "}, \"items_per_second\": " << (typical > 0 ? result.itemsPerOp * 1e9 / typical : 0) << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return static_cast<bool>(out);
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    options.define("output=s:bench_results.json", "JSON report file");
+    options.define("filter=s", "Only run cases whose name contains this text");
+    options.define("repetitions=i:5", "Timed repetitions of each case");
+    options.define("commit=s", "Commit ID recorded in the report");
+    options.process(argc, argv);
+
+    int repetitions = max(1, options.getInteger("repetitions"));
+    int recorderThreads = max(2, min(RECORDER_THREADS_MAX, static_cast<int>(thread::hardware_concurrency())));
+    string output = options.getString("output");
+    string filter = options.getString("filter");
+
+    vector<BenchResult> results;
+    for (const BenchCase& benchCase : makeCases(recorderThreads, output + ".scratch.mid")) {
+        if (!filter.empty() && benchCase.name.find(filter) == string::npos) continue;
+        results.push_back(runCase(benchCase, repetitions));
+        const BenchResult& result = results.back();
+        double typical = median(result.nsPerOp);
+        cout << result.name << ": " << typical << " ns/op (min " << result.nsPerOp.front() << ", max "
+             << result.nsPerOp.back() << ", " << result.iterations << " iterations), "
+             << result.itemsPerOp * 1e9 / typical << " items/s" << endl;
+    }
+
+    if (!writeJson(output, options.getString("commit"), repetitions, recorderThreads, results)) {
+        cerr << "Failed to write " << output << endl;
+        return 1;
+    }
+    cout << "Benchmark report " << output << " has been created." << endl;
+    return 0;
+}
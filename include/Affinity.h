@@ -0,0 +1,88 @@
+#ifndef THREAD_MUSIC_AFFINITY_H
+#define THREAD_MUSIC_AFFINITY_H
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// CpuInfo: Placement of one logical CPU in the machine topology
+struct CpuInfo {
+    int cpu;      // Logical CPU number
+    int core;     // Physical core index (SMT siblings share it)
+    int smtIndex; // Position among the SMT siblings of its core
+    int l3;       // Last-level cache domain index (CCX on AMD)
+    int numaNode; // NUMA node index
+};
+
+/**
+ * Reads the topology of the CPUs this process may run on
+ * 
+ * Uses /sys/devices/system/cpu on Linux. Elsewhere, every CPU is
+ * reported as its own core in a single cache domain and NUMA node.
+ * 
+ * @return One entry per usable logical CPU, in CPU order
+ */
+std::vector<CpuInfo> detectCpuTopology();
+
+// AffinityPolicy: Where the threads of one role are placed
+struct AffinityPolicy {
+    enum Kind {
+        None,    // Leave placement to the OS
+        Spread,  // One thread per physical core, alternating cache domains
+        Compact, // Fill the SMT siblings of each core before the next core
+        Cpu,     // Always the given CPU
+        L3,      // Round-robin over the CPUs of one cache domain
+        Numa     // Round-robin over the CPUs of one NUMA node
+    };
+    Kind kind = None;
+    int index = 0; // CPU, cache domain, or node for Cpu/L3/Numa
+};
+
+/**
+ * Parses an affinity policy from the command line
+ * 
+ * @param text "none", "spread", "compact", "cpu:N", "l3:N", or "numa:N"
+ * @param policy Receives the parsed policy
+ * @return True if the text was recognized
+ */
+bool parseAffinityPolicy(const std::string& text, AffinityPolicy& policy);
+
+/**
+ * AffinityPlanner: Assigns CPUs to threads according to per-role policies
+ * 
+ * Threads sharing a policy walk its candidate list round-robin, so for
+ * example bass threads can share one cache domain while leads spread out
+ * over the remaining cores.
+ */
+class AffinityPlanner {
+public:
+    /**
+     * @param topology Usable CPUs (see detectCpuTopology())
+     */
+    explicit AffinityPlanner(const std::vector<CpuInfo>& topology);
+
+    /**
+     * Chooses the CPU for the next thread placed with a policy
+     * 
+     * @param policy Placement policy for the thread's role
+     * @return Logical CPU number, or -1 to leave the thread unpinned
+     */
+    int assign(const AffinityPolicy& policy);
+
+private:
+    std::vector<int> candidates(const AffinityPolicy& policy) const;
+
+    std::vector<CpuInfo> topology;
+    std::map<std::pair<int, int>, int> nextIndex; // Per (kind, index) round-robin position
+};
+
+/**
+ * Pins the calling thread to one CPU
+ * 
+ * @param cpu Logical CPU number
+ * @return True on success (always false where pinning is unsupported)
+ */
+bool pinCurrentThread(int cpu);
+
+#endif // THREAD_MUSIC_AFFINITY_H
@@ -0,0 +1,27 @@
+#ifndef THREAD_MUSIC_ALLOCATION_COUNTER_H
+#define THREAD_MUSIC_ALLOCATION_COUNTER_H
+
+/**
+ * Heap allocation counting
+ * 
+ * The program replaces the global operator new, so every allocation made
+ * through new (containers, strings, the MIDI library) is counted for the
+ * calling thread and for the whole process. Counting costs one
+ * thread-local increment and one relaxed atomic add per allocation.
+ */
+
+/**
+ * Returns the number of allocations made by the calling thread
+ * 
+ * @return Calls to operator new on this thread since it started
+ */
+long long threadAllocationCount();
+
+/**
+ * Returns the number of allocations made by every thread
+ * 
+ * @return Calls to operator new since the process started
+ */
+long long processAllocationCount();
+
+#endif // THREAD_MUSIC_ALLOCATION_COUNTER_H
@@ -0,0 +1,102 @@
+#ifndef THREAD_MUSIC_BENCH_H
+#define THREAD_MUSIC_BENCH_H
+
+#include <string>
+#include <vector>
+#include "Types.h"
+#include "Histogram.h"
+
+/**
+ * BenchProbe: Per-thread measurements taken in --bench mode
+ * 
+ * Written only by its own thread while it runs and read by main after
+ * join, so no synchronization is needed. All times are nanoseconds on
+ * the monotonic clock relative to originNs.
+ */
+struct BenchProbe {
+    long long originNs = 0;           // Launch time (matches the scheduler tracer's origin)
+    Histogram loopPeriodNs;           // Time between successive loop iterations
+    Histogram overshootNs;            // Wake-up time past the requested deadline
+    Histogram recordNs;               // Time in the voice's recording section (note logic and event writes)
+    std::vector<SchedEdge> detections; // Detector state changes (starts scheduled)
+    std::vector<SchedEdge> cpuClockEdges; // Preemptions seen by the thread CPU clock during busy work
+
+    // Filled by computeDetectionLatency()
+    Histogram deschedLatencyNs;       // Ground-truth switch-out to detected descheduling
+    Histogram reschedLatencyNs;       // Ground-truth switch-in to detected scheduling
+    long long falseDetections = 0;    // Detector changes with no matching ground-truth edge
+    long long truthEdges = 0;         // Ground-truth edges available for matching
+
+    /**
+     * Marks the start of a loop iteration
+     * 
+     * @param nowNs Current monotonic time
+     */
+    void loopStarted(long long nowNs);
+
+    /**
+     * Records the detector's output for this iteration
+     * 
+     * @param nowNs Time the decision was made
+     * @param isScheduled Detector output
+     */
+    void detected(long long nowNs, bool isScheduled);
+
+    /**
+     * Samples the clocks before busy work
+     */
+    void busyStarted();
+
+    /**
+     * Samples the clocks after busy work and records any off-CPU gap as a preemption
+     */
+    void busyFinished();
+
+    /**
+     * Matches detector changes against ground-truth scheduling edges
+     * 
+     * Each detector change is paired with the latest earlier edge of the
+     * same direction that happened after the previous detector change.
+     * 
+     * @param truth Ground-truth edges in time order (tracer or cpuClockEdges)
+     */
+    void computeDetectionLatency(const std::vector<SchedEdge>& truth);
+
+private:
+    long long lastLoopNs = -1;
+    bool lastDetected = true;
+    long long busyWallNs = 0;
+    long long busyCpuNs = 0;
+};
+
+// BenchThreadInfo: Identification of a thread in the benchmark report
+struct BenchThreadInfo {
+    int id;
+    VoiceRole role;
+    const BenchProbe* probe;
+};
+
+// BenchRunInfo: Run configuration recorded in the benchmark report
+struct BenchRunInfo {
+    int threadCount;
+    int durationSec;
+    std::string timer;
+    std::string workload;
+    std::string groundTruth; // "sched-trace" or "thread-cpu-clock"
+};
+
+/**
+ * Writes the benchmark report as JSON
+ * 
+ * Contains host details, the run configuration, and loop period,
+ * sleep overshoot and detection latency histograms per thread and
+ * merged over all melodic threads.
+ * 
+ * @param path Output file
+ * @param run Run configuration
+ * @param threads Threads to report
+ * @return True if the file was written
+ */
+bool writeBenchReport(const std::string& path, const BenchRunInfo& run, const std::vector<BenchThreadInfo>& threads);
+
+#endif // THREAD_MUSIC_BENCH_H
@@ -0,0 +1,64 @@
+#ifndef THREAD_MUSIC_CHANNEL_ALLOCATOR_H
+#define THREAD_MUSIC_CHANNEL_ALLOCATOR_H
+
+#include <string>
+
+// MidiAddress: A MIDI port and a channel on it
+struct MidiAddress {
+    int port;    // MIDI port (output file with --shard files)
+    int channel; // Channel (0-15)
+};
+
+// ShardMode: How threads beyond one port's worth of channels are written
+enum class ShardMode {
+    Ports, // One file; tracks carry MIDI port meta events
+    Files  // One file per port
+};
+
+/**
+ * Parses a shard mode from the command line
+ * 
+ * @param text "ports" or "files"
+ * @param mode Receives the mode
+ * @return True if the text was recognized
+ */
+bool parseShardMode(const std::string& text, ShardMode& mode);
+
+/**
+ * ChannelAllocator: Hands out a unique (port, channel) to every melodic thread
+ * 
+ * Channel 9 is reserved for percussion on every port, which leaves 15
+ * melodic channels per port. Ports are filled one after the other, so the
+ * first 15 melodic threads keep the channels they always had on port 0.
+ */
+class ChannelAllocator {
+public:
+    static const int MELODIC_CHANNELS_PER_PORT = 15;
+
+    /**
+     * Returns the drum thread's address
+     * 
+     * @return Port 0, channel 9
+     */
+    static MidiAddress drum() { return {0, 9}; }
+
+    /**
+     * Returns the number of ports needed for a number of melodic threads
+     * 
+     * @param melodicThreads Number of melodic threads
+     * @return At least 1
+     */
+    static int portsFor(int melodicThreads);
+
+    /**
+     * Assigns the next free address
+     * 
+     * @return Address not handed out before
+     */
+    MidiAddress next();
+
+private:
+    int allocated = 0;
+};
+
+#endif // THREAD_MUSIC_CHANNEL_ALLOCATOR_H
@@ -0,0 +1,76 @@
+#ifndef THREAD_MUSIC_CONDUCTOR_H
+#define THREAD_MUSIC_CONDUCTOR_H
+
+#include <atomic>
+#include "Voice.h"
+
+/**
+ * Conductor: The one tick clock and phase grid of a performance
+ * 
+ * Every voice plays against the same origin and the same bar-aligned
+ * grid, so drum and melodic phases change on the same tick. The current
+ * beat lives on a single cache line guarded by a seqlock: voices only
+ * read it, and the first voice to observe a time past the next tick
+ * boundary publishes the new beat, so the tick conversion runs once per
+ * tick instead of once per loop iteration of every thread.
+ */
+class Conductor {
+public:
+    /**
+     * @param grid Phase layout shared by all voices
+     */
+    explicit Conductor(const PhaseGrid& grid);
+
+    Conductor(const Conductor&) = delete;
+    Conductor& operator=(const Conductor&) = delete;
+
+    /**
+     * Sets tick 0 and publishes the first beat
+     * 
+     * Call before any voice observes the conductor
+     * 
+     * @param originNs Monotonic time of tick 0
+     */
+    void start(long long originNs);
+
+    /**
+     * Returns the beat at a moment, publishing it first if the clock is behind
+     * 
+     * @param nowNs Monotonic time
+     * @return Current beat (never earlier than the last published one)
+     */
+    Beat observe(long long nowNs);
+
+    /**
+     * Returns the last published beat without advancing the clock
+     * 
+     * @return Published beat
+     */
+    Beat read() const;
+
+    const PhaseGrid& getGrid() const { return grid; }
+    long long getOriginNs() const { return originNs; }
+    long long getEndNs() const { return endNs; }                        // Monotonic time the last phase ends
+    long long getPublishCount() const { return publishCount.load(std::memory_order_relaxed); } // Beats published
+
+private:
+    // Line: The published beat; written only while sequence is odd
+    struct alignas(64) Line {
+        std::atomic<unsigned> sequence{0};
+        std::atomic<int> tick{0};
+        std::atomic<int> phase{0};
+        std::atomic<int> nextPhaseTick{0};
+        std::atomic<unsigned> epoch{0};
+        std::atomic<long long> nextTickNs{0}; // Monotonic time the published tick ends
+    };
+
+    void publish(long long nowNs);
+
+    PhaseGrid grid;
+    long long originNs = 0;
+    long long endNs = 0;
+    Line line;
+    alignas(64) std::atomic<long long> publishCount{0};
+};
+
+#endif // THREAD_MUSIC_CONDUCTOR_H
@@ -1,39 +1,120 @@
 #ifndef THREAD_MUSIC_CONSTANTS_H
 #define THREAD_MUSIC_CONSTANTS_H
 
-#include <vector>
-#include <map>
+#include <array>
+#include <cstddef>
 
 // MIDI and Musical Configuration
 const int TPQ = 480;          // Ticks Per Quarter note - higher values enable more precise timing
 const int TEMPO = 160;        // Beats Per Minute - controls playback speed
 const int BEATS_PER_BAR = 4;  // 4/4 time signature
 const int BARS_PER_PHASE = 4; // Musical structure: each phase consists of 4 bars
+const char* const END_MARKER_TEXT = "Aligned End"; // Final marker of every track (all end on the shared phase grid)
 
 // Note Duration Weights - higher values increase probability of selection
 // Controls rhythmic density in different musical parts
 
+// DurationWeight: One selectable note duration and its relative weight
+struct DurationWeight {
+    int ticks;
+    double weight;
+};
+
+// DurationTable: Selectable durations with cumulative weights, built at compile time
+struct DurationTable {
+    static constexpr int MAX_ENTRIES = 8;
+    int ticks[MAX_ENTRIES];         // Durations with a positive weight
+    double cumulative[MAX_ENTRIES]; // Running weight total up to and including each entry
+    int count;                      // Used entries
+
+    constexpr double total() const { return count > 0 ? cumulative[count - 1] : 0.0; }
+};
+
+/**
+ * Builds a cumulative duration table, dropping entries without positive weight
+ * 
+ * @param weights Durations and their weights
+ * @return Table for selectDuration()
+ */
+template <std::size_t N>
+constexpr DurationTable makeDurationTable(const DurationWeight (&weights)[N]) {
+    DurationTable table{};
+    double running = 0;
+    for (std::size_t i = 0; i < N && table.count < DurationTable::MAX_ENTRIES; i++) {
+        if (weights[i].weight <= 0) continue;
+        running += weights[i].weight;
+        table.ticks[table.count] = weights[i].ticks;
+        table.cumulative[table.count] = running;
+        table.count++;
+    }
+    return table;
+}
+
 // Melodic Parts - varied note durations for melodic interest
-const std::map<int, double> MELODY_DURATION_WEIGHTS = {
+constexpr DurationTable MELODY_DURATION_WEIGHTS = makeDurationTable({
     {TPQ / 4, 1.0}, // Sixteenth notes
     {TPQ / 2, 2.0}, // Eighth notes
     {TPQ,     2.0}, // Quarter notes
     {TPQ * 2, 1.0}  // Half notes
-};
+});
 
 // Bass Parts - longer durations for harmonic stability
-const std::map<int, double> BASS_DURATION_WEIGHTS = {
+constexpr DurationTable BASS_DURATION_WEIGHTS = makeDurationTable({
     {TPQ / 2, 1.0}, // Eighth notes
     {TPQ,     2.0}  // Quarter notes
-};
+});
 
 // Thread Scheduling Parameters
 const double SCHEDULE_THRESHOLD = 0.001; // CPU/wall time ratio for schedule detection
 const int THREAD_SLEEP_MS = 1;           // Thread sleep duration in milliseconds
+const int TIMER_SPIN_WINDOW_US = 200;    // Spin timer mode: busy-wait this long before each deadline
+const int CONDUCTOR_SPIN_RETRIES = 64;   // Beat reads retried before yielding to a preempted publisher
+
+// Adaptive scheduling detector (--detector adaptive)
+const double DETECTOR_EWMA_ALPHA = 0.25;       // Weight of the newest off-CPU fraction in the moving average
+const int DETECTOR_CALIBRATION_SAMPLES = 32;   // Samples that measure the off-CPU fraction's mean and noise
+const double DETECTOR_NOISE_DEVIATIONS = 3.0;  // Standard deviations above the mean that count as descheduled
+const int DETECTOR_MIN_STATE_MS = 20;          // Shortest scheduled or descheduled run (minimum note length)
+
+// Streaming output parameters (--stream)
+const int STREAM_FLUSH_INTERVAL_MS = 1000; // Time between incremental flushes to disk
+
+// Native output encoder parameters (--encoder native)
+const int SMF_BYTES_PER_EVENT = 5; // Note event upper bound: two-byte delta, status, pitch, velocity
+
+// Real-time output parameters (--live)
+const int LIVE_QUEUE_CAPACITY = 4096;   // Note events buffered between the threads and the output thread
+const int LIVE_LATENCY_MS = 20;         // Delay between a note reaching the output thread and being sent
+const int LIVE_POLL_INTERVAL_US = 1000; // Longest time the output thread sleeps without draining the queue
+const int LIVE_OUTPUT_PRIORITY = 50;    // SCHED_FIFO priority requested for the output thread
+
+// Ensemble parameters (--agent, --collect)
+const int ENSEMBLE_BATCH_INTERVAL_MS = 250;   // Time between event batches sent by an agent
+const int ENSEMBLE_SYNC_ROUNDS = 8;           // Clock sync exchanges; the fastest round trip sets the offset
+const int ENSEMBLE_COMPRESS_MIN_BYTES = 256;  // Smaller batches are sent uncompressed
+
+// Control socket parameters (--control)
+const int CONTROL_POLL_INTERVAL_MS = 100;        // Longest time the control thread waits before checking for stop
+const int CONTROL_MAX_CLIENTS = 8;               // Connections served at once; further ones are refused
+const std::size_t CONTROL_MAX_LINE_BYTES = 1024; // Longer command lines close the connection
+
+// Voice pool parameters (--pool)
+const int POOL_LATE_THRESHOLD_US = 1000;   // A step starting this much after its due time counts as descheduled
+const int POOL_DISPATCH_INTERVAL_US = 200; // Longest time the dispatcher sleeps between queue checks
+const std::size_t POOL_BATCH_VOICES = 64;  // Voices stepped together by the batch engine (--engine batch)
+
+// Benchmark parameters (--bench)
+const int BENCH_OFFCPU_MIN_US = 50; // Smallest busy-work stall counted as a preemption by the CPU clock
 
 // Thread work parameters - controls CPU load simulation
-const int BUSY_WORK_MIN = 500;   // Minimum work iterations
-const int BUSY_WORK_MAX = 10000; // Maximum work iterations
+const int BUSY_WORK_MIN_US = 10;  // Minimum busy work per loop in microseconds
+const int BUSY_WORK_MAX_US = 150; // Maximum busy work per loop in microseconds
+const int WORKLOAD_CALIBRATION_MS = 20;              // Time spent measuring a kernel's iteration rate
+const std::size_t WORKLOAD_BUFFER_BYTES = 16 << 20;  // Per-thread working set for stream and chase kernels
+
+// Snippet length range in notes
+const int SNIPPET_MIN_NOTES = 4;
+const int SNIPPET_MAX_NOTES = 8;
 
 // MIDI note ranges - defines instrument register boundaries
 const int BASS_LOW = 36;     // C2
@@ -51,11 +132,20 @@ const int OPEN_HAT = 46;    // Open Hi-Hat
 const int CRASH = 49;       // Crash Cymbal
 
 // Musical scales - semitone patterns from root note
-const std::vector<int> MAJOR_SCALE = {0, 2, 4, 5, 7, 9, 11}; // C major
-const std::vector<int> MINOR_SCALE = {0, 2, 3, 5, 7, 8, 10}; // C minor
-const std::vector<int> PENTA_SCALE = {0, 2, 4, 7, 9};        // C pentatonic
+// Scale: Fixed-capacity list of semitone offsets, usable in constant expressions
+struct Scale {
+    int steps[12];
+    int count;
+
+    constexpr int size() const { return count; }
+    constexpr int operator[](int index) const { return steps[index]; }
+};
+
+constexpr Scale MAJOR_SCALE = {{0, 2, 4, 5, 7, 9, 11}, 7}; // C major
+constexpr Scale MINOR_SCALE = {{0, 2, 3, 5, 7, 8, 10}, 7}; // C minor
+constexpr Scale PENTA_SCALE = {{0, 2, 4, 7, 9}, 5};        // C pentatonic
 
 // Root notes for different phases - creates harmonic progression
-const std::vector<int> PHASE_ROOTS = {0, 7, 5, 2}; // C, G, F, D
+constexpr std::array<int, 4> PHASE_ROOTS = {0, 7, 5, 2}; // C, G, F, D
 
 #endif // THREAD_MUSIC_CONSTANTS_H
\ No newline at end of file
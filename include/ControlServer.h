@@ -0,0 +1,96 @@
+#ifndef THREAD_MUSIC_CONTROL_SERVER_H
+#define THREAD_MUSIC_CONTROL_SERVER_H
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Counters.h"
+#include "Types.h"
+
+class Conductor;           // Defined in Conductor.h
+class StreamingMidiWriter; // Defined in MidiStream.h
+class ScheduleTraceRecorder; // Defined in ScheduleTrace.h
+
+// ControlTarget: What the control server reads and changes; everything must outlive the server
+struct ControlTarget {
+    const std::vector<ThreadData>* threads = nullptr;       // Thread configurations, indexed by thread ID
+    const std::vector<ThreadCounters>* counters = nullptr;  // Counters, indexed by thread ID
+    const Conductor* conductor = nullptr;                   // Started clock and phase grid
+    StreamingMidiWriter* stream = nullptr;                  // Spool writer, or nullptr without --stream
+    ScheduleTraceRecorder* trace = nullptr;                 // Trace file being recorded, or nullptr without --record-trace
+    WorkloadKind workload = WorkloadKind::SinCos;           // Kernel the run started with
+};
+
+/**
+ * ControlServer: Line-based control and metrics endpoint on a Unix socket
+ * 
+ * Runs on its own thread, never on a voice thread, and serves up to
+ * CONTROL_MAX_CLIENTS connections with poll(). Each command is one line
+ * and gets one reply line, "ok ..." or "error ...", or a JSON object for
+ * the metrics commands:
+ * 
+ *   status           Clock position, phase, active voices, kernel (JSON)
+ *   counters         Current counters of every thread (JSON)
+ *   voices [N]       Lets only melodic voices 1..N play; the rest rest
+ *   workload [KIND]  Calibrates a kernel and switches every thread to it
+ *   flush            Writes the spooled MIDI tracks (--stream) and the
+ *                    scheduling trace so far (--record-trace) now
+ *   stop             Ends the piece early, as if its time were up
+ *   tempo, phases    Report the tempo and phase count
+ * 
+ * Tempo and phase count are read-only: they define the tick grid that
+ * every voice, the output files and recorded traces share, so they are
+ * fixed when the grid is computed. Threads are bound to tracks and
+ * channels the same way, so the voice count is changed by muting
+ * voices instead of stopping their threads.
+ */
+class ControlServer {
+public:
+    /**
+     * @param path Socket path
+     * @param target State the commands read and change
+     */
+    ControlServer(const std::string& path, const ControlTarget& target);
+    ~ControlServer();
+
+    ControlServer(const ControlServer&) = delete;
+    ControlServer& operator=(const ControlServer&) = delete;
+
+    /**
+     * Creates and binds the socket, replacing a stale socket at the path
+     * 
+     * @param error Receives the reason on failure
+     * @return True on success (always false where Unix sockets are unavailable)
+     */
+    bool open(std::string& error);
+
+    /**
+     * Starts serving on the control thread
+     */
+    void start();
+
+    /**
+     * Stops the control thread, closes every connection and removes the socket
+     */
+    void stop();
+
+    long long getCommandCount() const { return commandCount.load(std::memory_order_relaxed); } // Commands handled
+
+private:
+    void serveLoop();
+    std::string handle(const std::string& line);
+    std::string statusJson() const;
+    std::string countersJson() const;
+
+    std::string path;
+    ControlTarget target;
+    int listenFd = -1;
+    std::thread server;
+    std::atomic<bool> serving{false};
+    std::atomic<long long> commandCount{0};
+    WorkloadKind workload;
+    int melodicVoices = 0;
+};
+
+#endif // THREAD_MUSIC_CONTROL_SERVER_H
@@ -0,0 +1,141 @@
+#ifndef THREAD_MUSIC_COUNTERS_H
+#define THREAD_MUSIC_COUNTERS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Types.h"
+
+/**
+ * ThreadCounters: Hot-path event counts for one thread
+ * 
+ * Each instance sits on its own cache line so threads never share one.
+ * A counter has a single writer (its thread), so add() uses a relaxed
+ * load and store instead of a locked read-modify-write; snapshot readers
+ * may see a slightly stale but never torn value.
+ */
+struct alignas(64) ThreadCounters {
+    std::atomic<long long> loops{0};          // Timing loop iterations
+    std::atomic<long long> transitions{0};    // Scheduled/descheduled changes seen by the voice
+    std::atomic<long long> notesStarted{0};   // Note-ons recorded
+    std::atomic<long long> notesTruncated{0}; // Notes cut short by a phase boundary
+    std::atomic<long long> mutexWaitNs{0};    // Time blocked on the lock workload's mutex
+    std::atomic<long long> busyNs{0};         // Time spent in busy work
+    std::atomic<long long> allocations{0};    // Heap allocations made by the playing loop
+    std::atomic<long long> detectorChanges{0}; // State changes reported by the scheduling detector
+    std::atomic<long long> legacyChanges{0};   // State changes the legacy detector made on the same samples
+    std::atomic<long long> adaptiveChanges{0}; // State changes the adaptive detector made on the same samples
+
+    /**
+     * Adds to a counter owned by the calling thread
+     * 
+     * @param counter Counter to increase
+     * @param amount Increment
+     */
+    static void add(std::atomic<long long>& counter, long long amount = 1) {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+};
+
+// CounterValues: Plain copy of a ThreadCounters at one moment
+struct CounterValues {
+    long long loops;
+    long long transitions;
+    long long notesStarted;
+    long long notesTruncated;
+    long long mutexWaitNs;
+    long long busyNs;
+    long long allocations;
+    long long detectorChanges;
+    long long legacyChanges;
+    long long adaptiveChanges;
+};
+
+/**
+ * Reads every counter of a thread
+ * 
+ * @param counters Counters to read
+ * @return Current values
+ */
+CounterValues readCounters(const ThreadCounters& counters);
+
+/**
+ * Formats counter values as a compact "name=value" text line
+ * 
+ * @param values Counter values
+ * @return Text suitable for a MIDI text event
+ */
+std::string formatCounters(const CounterValues& values);
+
+/**
+ * Writes counter values as a JSON object
+ * 
+ * @param out Destination stream
+ * @param values Counter values
+ */
+void writeCountersJson(std::ostream& out, const CounterValues& values);
+
+// CounterSnapshot: Values of all threads at one time
+struct CounterSnapshot {
+    long long timeNs;                   // Nanoseconds since originNs
+    std::vector<CounterValues> threads; // Indexed by thread ID
+};
+
+/**
+ * CounterRecorder: Takes periodic snapshots of all thread counters
+ * 
+ * Snapshots are taken on a background thread every intervalSec seconds,
+ * plus a final one in stop().
+ */
+class CounterRecorder {
+public:
+    /**
+     * @param counters One entry per thread, indexed by thread ID
+     * @param originNs Monotonic time that snapshot times are relative to
+     */
+    CounterRecorder(const std::vector<ThreadCounters>& counters, long long originNs);
+    ~CounterRecorder();
+
+    CounterRecorder(const CounterRecorder&) = delete;
+    CounterRecorder& operator=(const CounterRecorder&) = delete;
+
+    /**
+     * Starts periodic snapshots
+     * 
+     * @param intervalSec Seconds between snapshots (0 records only the final one)
+     */
+    void start(int intervalSec);
+
+    /**
+     * Stops the snapshot thread and records the final snapshot
+     */
+    void stop();
+
+    const std::vector<CounterSnapshot>& getSnapshots() const { return snapshots; }
+
+    /**
+     * Writes all snapshots as JSON
+     * 
+     * @param path Output file
+     * @param threads Thread configurations (for IDs and roles)
+     * @return True if the file was written
+     */
+    bool writeJson(const std::string& path, const std::vector<ThreadData>& threads) const;
+
+private:
+    void takeSnapshot();
+
+    const std::vector<ThreadCounters>& counters;
+    long long originNs;
+    std::vector<CounterSnapshot> snapshots;
+    std::thread sampler;
+    std::mutex stopMutex;
+    std::condition_variable stopSignal;
+    bool stopping = false;
+};
+
+#endif // THREAD_MUSIC_COUNTERS_H
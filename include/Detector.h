@@ -0,0 +1,95 @@
+#ifndef THREAD_MUSIC_DETECTOR_H
+#define THREAD_MUSIC_DETECTOR_H
+
+#include <string>
+#include "Constants.h"
+#include "Types.h"
+
+/**
+ * Parses a detector name from the command line
+ * 
+ * @param name "legacy" or "adaptive"
+ * @param kind Receives the detector
+ * @return True if the name was recognized
+ */
+bool parseDetectorKind(const std::string& name, DetectorKind& kind);
+
+/**
+ * Returns the command-line name of a detector
+ * 
+ * @param kind Detector
+ * @return "legacy" or "adaptive"
+ */
+const char* detectorKindName(DetectorKind kind);
+
+/**
+ * SchedulingDetector: Decides from CPU and wall time whether a thread is scheduled
+ * 
+ * The legacy policy compares the CPU/wall ratio of the last sample with
+ * SCHEDULE_THRESHOLD, with wall time truncated to whole milliseconds, so
+ * two samples in the same millisecond read as descheduled.
+ * 
+ * The adaptive policy measures the fraction of each sample the thread
+ * was off the CPU outside its own sleep: the wall time since the previous
+ * sample minus the CPU time it received and the time it spent in the
+ * sleep call, over the wall time. That is the time it was runnable but
+ * preempted, and it is smoothed by an EWMA. The first
+ * DETECTOR_CALIBRATION_SAMPLES samples measure the fraction's mean and
+ * noise; after them the thread turns descheduled when the EWMA rises
+ * DETECTOR_NOISE_DEVIATIONS standard deviations above the mean, and
+ * scheduled again only once it is back halfway to the mean. A state is
+ * also held for at least DETECTOR_MIN_STATE_MS, which is the shortest
+ * note (or gap) the detector can produce. The gap needs per-thread CPU
+ * time, so the adaptive policy is not used with the process clock.
+ * 
+ * Both policies are evaluated on every sample, so a run can report how
+ * many changes each would have made.
+ */
+class SchedulingDetector {
+public:
+    /**
+     * @param kind Policy that decides the reported state
+     * @param startNs Time of the first sample's predecessor, in nanoseconds since the start
+     * @param startCpuSec CPU time at startNs, in seconds
+     */
+    SchedulingDetector(DetectorKind kind, long long startNs, double startCpuSec);
+
+    /**
+     * Takes one sample and returns the detected state
+     * 
+     * @param nowNs Nanoseconds since the start of the piece
+     * @param cpuSec CPU time of the thread, in seconds
+     * @param sleptNs Time spent in sleep calls since the previous sample, in nanoseconds
+     * @return True if the thread is considered scheduled
+     */
+    bool sample(long long nowNs, double cpuSec, long long sleptNs);
+
+    long long getChanges() const { return kind == DetectorKind::Legacy ? legacyChanges : adaptiveChanges; } // Changes of the reported state
+    long long getLegacyChanges() const { return legacyChanges; }     // Changes the legacy policy made on the same samples
+    long long getAdaptiveChanges() const { return adaptiveChanges; } // Changes the adaptive policy made on the same samples
+
+private:
+    void adaptiveSample(long long wallDeltaNs, double cpuDeltaSec, long long sleptNs, long long nowNs);
+
+    DetectorKind kind;
+    bool legacyScheduled = true; // Threads start scheduled
+    bool adaptiveScheduled = true;
+    long long legacyChanges = 0;
+    long long adaptiveChanges = 0;
+
+    // Legacy state: wall time in whole milliseconds
+    long long lastNs;
+    double lastWallSec;
+    double lastCpuSec;
+
+    // Adaptive state
+    long long samples = 0;
+    double smoothed = 0;       // EWMA of the off-CPU fraction
+    double mean = 0;           // Calibration mean (Welford)
+    double squares = 0;        // Calibration sum of squared deviations
+    double offThreshold = 1.0; // No descheduling until calibrated
+    double onThreshold = 1.0;
+    long long lastChangeNs;
+};
+
+#endif // THREAD_MUSIC_DETECTOR_H
@@ -0,0 +1,190 @@
+#ifndef THREAD_MUSIC_ENSEMBLE_H
+#define THREAD_MUSIC_ENSEMBLE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "EventBuffer.h"
+#include "Types.h"
+
+// EnsembleStats: What an agent measured and sent to its collector
+struct EnsembleStats {
+    long long clockOffsetNs = 0; // Collector clock minus agent clock
+    long long roundTripNs = 0;   // Round trip of the sync exchange the offset was taken from
+    long long events = 0;        // Events sent
+    long long batches = 0;       // Batch frames sent
+    std::size_t rawBytes = 0;    // Encoded batch bytes before compression
+    std::size_t wireBytes = 0;   // Bytes written to the socket, frame headers included
+};
+
+/**
+ * Returns whether this build compresses ensemble batches (make ZLIB=1)
+ * 
+ * @return True if batches can be deflated and inflated
+ */
+bool ensembleCompressionAvailable();
+
+/**
+ * EnsembleAgent: Streams a node's events to an ensemble collector
+ * 
+ * connect() estimates the offset between the agent's and the collector's
+ * monotonic clocks NTP-style: of ENSEMBLE_SYNC_ROUNDS request/reply
+ * exchanges, the one with the shortest round trip gives the offset. The
+ * launch time is sent in collector time, and event ticks stay relative to
+ * it, so the collector can line nodes up without touching every event.
+ * 
+ * Like StreamingMidiWriter, a background thread drains the event buffers
+ * periodically; each drain becomes one batch of delta-coded varints,
+ * deflated when the build has zlib and the collector accepts it.
+ */
+class EnsembleAgent {
+public:
+    /**
+     * @param address Collector as host:port
+     * @param nodeName Name of this node in the merged file (empty uses the host name)
+     */
+    EnsembleAgent(const std::string& address, const std::string& nodeName);
+    ~EnsembleAgent();
+
+    EnsembleAgent(const EnsembleAgent&) = delete;
+    EnsembleAgent& operator=(const EnsembleAgent&) = delete;
+
+    /**
+     * Connects to the collector and estimates the clock offset
+     * 
+     * @return True on success
+     */
+    bool connect();
+
+    /**
+     * Registers a thread as the event source of one remote track
+     * 
+     * @param data Thread configuration data (events must outlive the agent)
+     */
+    void addThread(const ThreadData& data);
+
+    /**
+     * Announces the node and starts sending batches
+     * 
+     * @param launchNs Monotonic time the threads were launched at (tick 0)
+     * @param intervalMs Time between batches in milliseconds
+     */
+    void start(long long launchNs, int intervalMs);
+
+    /**
+     * Stops the sending thread, sends every remaining event and closes
+     * 
+     * Call once all writers of the event buffers have finished
+     * 
+     * @return True if every event reached the collector
+     */
+    bool stop();
+
+    bool isCompressing() const { return compress; }
+    const std::string& getAddress() const { return address; }
+    const EnsembleStats& getStats() const { return stats; }
+
+private:
+    struct Track {
+        EventBuffer* source;
+        bool isDrum;
+        int instrument;
+        std::string name;
+        std::string endMarkerText;
+        int lastTick = 0; // Events are delta-coded per track across batches
+    };
+
+    void sendLoop(int intervalMs);
+    bool sendBatch();
+    bool sendFrame(int type, const std::vector<unsigned char>& payload);
+    bool receiveFrame(int& type, std::vector<unsigned char>& payload);
+
+    std::string address;
+    std::string nodeName;
+    int socketFd = -1;
+    bool compress = false;
+    bool failed = false;
+    std::vector<Track> tracks;
+    std::thread sender;
+    std::atomic<bool> sending{false};
+    EnsembleStats stats;
+};
+
+// RemoteTrack: One track received from a node
+struct RemoteTrack {
+    bool isDrum = false;
+    int instrument = 0;
+    std::string name;
+    std::string endMarkerText;
+    std::vector<TrackEvent> events; // In node ticks, in tick order
+};
+
+// EnsembleNode: Everything received from one agent
+struct EnsembleNode {
+    std::string name;
+    long long launchNs = 0;      // Launch time in collector clock
+    long long clockOffsetNs = 0; // As estimated by the agent
+    long long roundTripNs = 0;
+    std::vector<RemoteTrack> tracks;
+    long long events = 0;
+    long long batches = 0;
+    std::size_t rawBytes = 0;
+    std::size_t wireBytes = 0;
+    bool complete = false;       // The agent ended the stream cleanly
+};
+
+/**
+ * EnsembleCollector: Receives agents and merges them into one MIDI file
+ * 
+ * Each node becomes one group of tracks (drum first) on ports of its own,
+ * so every track of the ensemble keeps a unique (port, channel). Nodes are
+ * shifted by their launch time relative to the earliest node.
+ */
+class EnsembleCollector {
+public:
+    /**
+     * @param port TCP port to listen on
+     */
+    explicit EnsembleCollector(int port);
+    ~EnsembleCollector();
+
+    EnsembleCollector(const EnsembleCollector&) = delete;
+    EnsembleCollector& operator=(const EnsembleCollector&) = delete;
+
+    /**
+     * Opens the listening socket
+     * 
+     * @return True on success
+     */
+    bool listen();
+
+    /**
+     * Accepts agents and receives their streams until every one has ended
+     * 
+     * @param nodeCount Number of agents to wait for
+     */
+    void collect(int nodeCount);
+
+    /**
+     * Writes the merged format 1 MIDI file
+     * 
+     * @param filename Output file name
+     * @return True on success
+     */
+    bool write(const std::string& filename) const;
+
+    int getTrackCount() const;
+    const std::vector<std::unique_ptr<EnsembleNode>>& getNodes() const { return nodes; }
+
+private:
+    void serve(int connection, EnsembleNode& node);
+
+    int port;
+    int listenFd = -1;
+    std::vector<std::unique_ptr<EnsembleNode>> nodes;
+};
+
+#endif // THREAD_MUSIC_ENSEMBLE_H
@@ -0,0 +1,254 @@
+#ifndef THREAD_MUSIC_EVENT_BUFFER_H
+#define THREAD_MUSIC_EVENT_BUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include "MidiRing.h"
+
+// EventType: Kinds of events a thread records while it plays
+enum class EventType : unsigned char {
+    NoteOn,      // Note start (pitch, velocity)
+    NoteOff,     // Note end (pitch)
+    PhaseMarker, // "Phase N" marker, with the zero-based phase number stored in pitch
+    EndMarker    // End-of-piece marker, text depends on the thread type
+};
+
+// TrackEvent: A single recorded event, kept as plain data until the MIDI file is assembled
+struct TrackEvent {
+    int tick;       // Absolute time in MIDI ticks
+    int channel;    // MIDI channel (0-15)
+    int pitch;      // MIDI pitch, or phase number for phase markers
+    int velocity;   // Note velocity (0-127)
+    EventType type; // Event kind
+    long long wallNs = 0; // Time the thread recorded the event, in ns since the start (0 when rendered)
+    long long cpuNs = 0;  // CPU time of the recording thread at that moment
+};
+
+/**
+ * Orders events the way MidiFile::sortTracks() does: by tick, then
+ * meta events, then note-offs, then note-ons
+ * 
+ * @return True if a belongs before b
+ */
+inline bool trackEventBefore(const TrackEvent& a, const TrackEvent& b) {
+    if (a.tick != b.tick) return a.tick < b.tick;
+    auto rank = [](EventType type) {
+        return (type == EventType::NoteOn) ? 2 : (type == EventType::NoteOff) ? 1 : 0;
+    };
+    return rank(a.type) < rank(b.type);
+}
+
+// Events per EventBuffer block
+const std::size_t EVENT_BLOCK_SIZE = 1024;
+
+// Future events (scheduled note-offs) held back per EventBuffer until their tick is reached
+const std::size_t REORDER_WINDOW = 16;
+
+/**
+ * EventBuffer: Single-writer, single-reader event log owned by one thread
+ * 
+ * Events are appended into fixed-size blocks. Each block publishes its fill
+ * count with release semantics, so one reader can drain events while the
+ * owning thread keeps writing. Drained blocks go back to a free list for
+ * the writer to reuse, which keeps memory bounded when the log is drained
+ * periodically. Blocks reserved up front mean the writer normally never
+ * allocates and never takes a lock.
+ * 
+ * Events come out in tick order. Threads record in real time, so every
+ * event is at or after the previous one, except note-offs scheduled ahead
+ * of time (noteOffLater). Those wait in a small sorted reorder window and
+ * are released when an event at or after their tick is recorded, so the
+ * MIDI tracks never need a full sort.
+ */
+class EventBuffer {
+public:
+    EventBuffer();
+    ~EventBuffer();
+
+    EventBuffer(const EventBuffer&) = delete;
+    EventBuffer& operator=(const EventBuffer&) = delete;
+
+    /**
+     * Preallocates enough blocks for a number of events
+     * 
+     * The blocks come from one contiguous arena whose pages are touched
+     * here, so the writer neither allocates nor page-faults until the
+     * reservation runs out. Call once, before the writer starts.
+     * 
+     * @param capacity Expected number of events
+     */
+    void reserve(std::size_t capacity);
+
+    /**
+     * Returns how many blocks the writer had to allocate because the
+     * reservation ran out (0 when the capacity estimate held)
+     * 
+     * @return Blocks allocated while recording
+     */
+    std::size_t overflowBlockCount() const { return overflowBlocks; }
+
+    /**
+     * Also sends every note event to a real-time output queue
+     * 
+     * Call before the writer starts. Full queues drop notes rather than block.
+     * 
+     * @param ring Queue drained by the live output thread, or nullptr
+     */
+    void setLiveOutput(MidiRing* ring) { live = ring; }
+
+    /**
+     * Sets the wall and CPU time stamped on events recorded from now on
+     * 
+     * Called by the writer once per loop iteration, before it records
+     * 
+     * @param wallNs Nanoseconds since the start
+     * @param cpuNs CPU time of the writer thread in nanoseconds
+     */
+    void setClock(long long wallNs, long long cpuNs) {
+        clockWallNs = wallNs;
+        clockCpuNs = cpuNs;
+    }
+
+    void noteOn(int tick, int channel, int pitch, int velocity) {
+        if (firstNoteWallNs < 0) firstNoteWallNs = clockWallNs;
+        if (live) sendLive(0, 0x90 | channel, pitch, velocity);
+        push({tick, channel, pitch, velocity, EventType::NoteOn, clockWallNs, clockCpuNs});
+    }
+
+    void noteOff(int tick, int channel, int pitch) {
+        if (live) sendLive(0, 0x80 | channel, pitch, 0);
+        push({tick, channel, pitch, 0, EventType::NoteOff, clockWallNs, clockCpuNs});
+    }
+
+    // Note-off for a tick that has not been reached yet
+    void noteOffLater(int tick, int channel, int pitch) {
+        if (live) sendLive(tick > lastTick ? tick - lastTick : 0, 0x80 | channel, pitch, 0);
+        defer({tick, channel, pitch, 0, EventType::NoteOff, clockWallNs, clockCpuNs});
+    }
+
+    void phaseMarker(int tick, int phase) {
+        push({tick, 0, phase, 0, EventType::PhaseMarker, clockWallNs, clockCpuNs});
+    }
+
+    // Final event of the thread: also releases every held-back note-off
+    void endMarker(int tick) {
+        push({tick, 0, 0, 0, EventType::EndMarker, clockWallNs, clockCpuNs});
+        while (deferredCount > 0) releaseFirstDeferred();
+    }
+
+    /**
+     * Returns the clock time (see setClock()) of the first note-on
+     * 
+     * Read only after the writer has finished
+     * 
+     * @return Nanoseconds since the start, or -1 if nothing was played
+     */
+    long long firstNoteNs() const { return firstNoteWallNs; }
+
+    /**
+     * Returns how many events were recorded before an already-recorded
+     * event (0 when the buffer is in tick order, as it is by construction)
+     * 
+     * Safe to read from the reader thread while the writer runs
+     * 
+     * @return Number of out-of-order events
+     */
+    std::size_t outOfOrderCount() const { return outOfOrder.load(std::memory_order_acquire); }
+
+    /**
+     * Passes every event published since the last call to a callback
+     * 
+     * Must only be called from one reader thread at a time
+     * 
+     * @param callback Called as callback(const TrackEvent&) in recording order
+     * @return Number of events consumed
+     */
+    template <typename Callback>
+    std::size_t consume(Callback&& callback) {
+        std::size_t consumed = 0;
+        while (true) {
+            std::size_t published = head->count.load(std::memory_order_acquire);
+            for (; readIndex < published; readIndex++, consumed++) {
+                callback(head->events[readIndex]);
+            }
+            // The writer links the next block only after filling this one
+            Block* next = head->next.load(std::memory_order_acquire);
+            if (readIndex < EVENT_BLOCK_SIZE || next == nullptr) break;
+            recycle(head);
+            head = next;
+            readIndex = 0;
+        }
+        return consumed;
+    }
+
+private:
+    struct Block {
+        TrackEvent events[EVENT_BLOCK_SIZE];
+        std::atomic<std::size_t> count{0};
+        std::atomic<Block*> next{nullptr};
+    };
+
+    // Records an event that happens now, after any held-back events due before it
+    void push(const TrackEvent& event) {
+        while (deferredCount > 0 && !trackEventBefore(event, deferred[0])) {
+            releaseFirstDeferred();
+        }
+        append(event);
+    }
+
+    void append(const TrackEvent& event) {
+        // Single writer, so a plain load and store; the reader sees it with the events
+        if (event.tick < lastTick) outOfOrder.store(outOfOrder.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        else lastTick = event.tick;
+        if (tailCount == EVENT_BLOCK_SIZE) advanceTail();
+        tail->events[tailCount++] = event;
+        tail->count.store(tailCount, std::memory_order_release);
+    }
+
+    void releaseFirstDeferred() {
+        append(deferred[0]);
+        deferredCount--;
+        for (std::size_t i = 0; i < deferredCount; i++) {
+            deferred[i] = deferred[i + 1];
+        }
+    }
+
+    // Live messages play on arrival; scheduled note-offs play the remaining ticks later
+    void sendLive(int delayTicks, int status, int pitch, int velocity) {
+        live->tryPush({delayTicks, static_cast<unsigned char>(status), static_cast<unsigned char>(pitch),
+                       static_cast<unsigned char>(velocity)});
+    }
+
+    void defer(const TrackEvent& event);
+
+    void advanceTail();
+    void recycle(Block* block);
+    Block* takeFreeBlock();
+    bool inArena(const Block* block) const { return block >= arena && block < arena + arenaBlocks; }
+
+    // Reader side
+    Block* head;
+    std::size_t readIndex = 0;
+
+    // Writer side
+    Block* tail;
+    std::size_t tailCount = 0;
+    int lastTick = 0;
+    std::atomic<std::size_t> outOfOrder{0};
+    TrackEvent deferred[REORDER_WINDOW];
+    std::size_t deferredCount = 0;
+    MidiRing* live = nullptr;
+    std::size_t overflowBlocks = 0;
+    long long clockWallNs = 0;
+    long long clockCpuNs = 0;
+    long long firstNoteWallNs = -1;
+
+    // Reserved blocks, allocated and freed as one
+    Block* arena = nullptr;
+    std::size_t arenaBlocks = 0;
+
+    // Drained blocks, pushed by the reader and popped by the writer
+    std::atomic<Block*> freeBlocks{nullptr};
+};
+
+#endif // THREAD_MUSIC_EVENT_BUFFER_H
@@ -0,0 +1,105 @@
+#ifndef THREAD_MUSIC_EVENT_EXPORT_H
+#define THREAD_MUSIC_EVENT_EXPORT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "EventBuffer.h"
+#include "Types.h"
+
+/**
+ * Returns whether exported columns can be deflate-compressed
+ * 
+ * @return True if built with zlib (make ZLIB=1)
+ */
+bool eventExportCompressionAvailable();
+
+/**
+ * EventExport: Columnar copy of every recorded event, for bulk analysis
+ * 
+ * Filled by the output stage from the same consume() pass that writes the
+ * MIDI file, so the event buffers are read once. Each thread is a row
+ * group with its own columns, which lets parallel shard writers add the
+ * events of different threads at the same time.
+ * 
+ * Layout (little-endian): the magic "TMEVCOL1", then u32 row group count,
+ * u32 TPQ and u32 flags (bit 0: columns may be deflated). Per row group: u32 thread
+ * ID, u8 role, u8 channel, u32 row count, then six columns in the order
+ * tick (i32), wall_ns (i64), cpu_ns (i64), type (u8, EventType), pitch
+ * (u8) and velocity (u8). Tick, wall_ns and cpu_ns hold the difference
+ * from the previous row of the group (the first row from 0), so a running
+ * sum restores them. Each column is u8 codec (0 raw, 1 deflate), u32 raw
+ * size, u32 stored size and the stored bytes.
+ */
+class EventExport {
+public:
+    /**
+     * @param threads Thread configurations, indexed by thread ID
+     */
+    explicit EventExport(const std::vector<ThreadData>& threads);
+
+    /**
+     * Reserves rows for a thread
+     * 
+     * @param thread Thread ID
+     * @param rows Expected number of events
+     */
+    void reserve(int thread, std::size_t rows);
+
+    /**
+     * Appends one event to a thread's row group
+     * 
+     * Only one caller at a time may add to the same thread
+     * 
+     * @param thread Thread ID
+     * @param event Recorded event
+     */
+    void add(int thread, const TrackEvent& event) {
+        RowGroup& group = groups[thread];
+        group.tick.push_back(event.tick - group.lastTick);
+        group.wallNs.push_back(event.wallNs - group.lastWallNs);
+        group.cpuNs.push_back(event.cpuNs - group.lastCpuNs);
+        group.type.push_back(static_cast<uint8_t>(event.type));
+        group.pitch.push_back(static_cast<uint8_t>(event.pitch));
+        group.velocity.push_back(static_cast<uint8_t>(event.velocity));
+        group.lastTick = event.tick;
+        group.lastWallNs = event.wallNs;
+        group.lastCpuNs = event.cpuNs;
+    }
+
+    /**
+     * Writes every row group
+     * 
+     * @param path Output file
+     * @return True if the file was written
+     */
+    bool write(const std::string& path) const;
+
+    /**
+     * Returns the number of exported events
+     * 
+     * @return Rows over all threads
+     */
+    std::size_t rowCount() const;
+
+private:
+    struct RowGroup {
+        int thread = 0;
+        VoiceRole role = VoiceRole::Lead;
+        int channel = 0;
+        int lastTick = 0;
+        long long lastWallNs = 0;
+        long long lastCpuNs = 0;
+        std::vector<int32_t> tick;
+        std::vector<int64_t> wallNs;
+        std::vector<int64_t> cpuNs;
+        std::vector<uint8_t> type;
+        std::vector<uint8_t> pitch;
+        std::vector<uint8_t> velocity;
+    };
+
+    std::vector<RowGroup> groups;
+};
+
+#endif // THREAD_MUSIC_EVENT_EXPORT_H
@@ -0,0 +1,62 @@
+#ifndef THREAD_MUSIC_HISTOGRAM_H
+#define THREAD_MUSIC_HISTOGRAM_H
+
+#include <array>
+#include <ostream>
+
+/**
+ * Histogram: Log-linear histogram of non-negative integer samples
+ * 
+ * Each power of two is split into HISTOGRAM_SUB_BUCKETS linear buckets,
+ * so reported percentiles are within about 6% of the true value while
+ * recording stays a constant-time array increment with no allocation.
+ */
+class Histogram {
+public:
+    /**
+     * Adds a sample (negative values count as zero)
+     * 
+     * @param value Sample, typically nanoseconds
+     */
+    void record(long long value);
+
+    /**
+     * Adds every sample of another histogram
+     * 
+     * @param other Histogram to merge
+     */
+    void merge(const Histogram& other);
+
+    /**
+     * Returns an estimate of a percentile
+     * 
+     * @param fraction Percentile as a fraction (0.99 for p99)
+     * @return Midpoint of the bucket holding that rank, clamped to the maximum (0 if empty)
+     */
+    long long percentile(double fraction) const;
+
+    long long count() const { return total; }
+    long long max() const { return largest; }
+
+    /**
+     * Writes the histogram as a JSON object
+     * 
+     * Fields: count, p50, p99, p999, max, and buckets as [lower bound, count] pairs
+     * 
+     * @param out Destination stream
+     */
+    void writeJson(std::ostream& out) const;
+
+private:
+    static const int SUB_BUCKET_BITS = 4;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+
+    static int bucketFor(long long value);
+    static long long bucketLowerBound(int bucket);
+
+    std::array<long long, 64 * SUB_BUCKETS> counts{};
+    long long total = 0;
+    long long largest = 0;
+};
+
+#endif // THREAD_MUSIC_HISTOGRAM_H
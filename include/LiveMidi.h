@@ -0,0 +1,133 @@
+#ifndef THREAD_MUSIC_LIVE_MIDI_H
+#define THREAD_MUSIC_LIVE_MIDI_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Histogram.h"
+#include "MidiRing.h"
+#include "Types.h"
+
+/**
+ * LiveMidiBackend: Destination for real-time MIDI messages
+ * 
+ * Only the live output thread calls send() once the backend is open.
+ */
+class LiveMidiBackend {
+public:
+    virtual ~LiveMidiBackend() = default;
+
+    /**
+     * Connects to the MIDI system and creates an output port
+     * 
+     * @param clientName Name shown to other MIDI applications
+     * @return True on success
+     */
+    virtual bool open(const std::string& clientName) = 0;
+
+    /**
+     * Sends one short message immediately
+     * 
+     * @param status Status byte
+     * @param data1 First data byte
+     * @param data2 Second data byte (ignored by two-byte messages)
+     */
+    virtual void send(unsigned char status, unsigned char data1, unsigned char data2) = 0;
+
+    virtual const char* name() const = 0;
+};
+
+/**
+ * Opens a real-time MIDI backend
+ * 
+ * @param name alsa, coremidi, jack, null, or auto (the first compiled-in
+ *             backend that opens, otherwise null)
+ * @param clientName Name shown to other MIDI applications
+ * @return Open backend, or nullptr if it is unknown, not compiled in, or fails to open
+ */
+std::unique_ptr<LiveMidiBackend> openLiveMidiBackend(const std::string& name, const std::string& clientName);
+
+/**
+ * Returns the backends compiled into this build
+ * 
+ * @return Comma-separated backend names
+ */
+std::string liveMidiBackendNames();
+
+/**
+ * LiveMidiOutput: Plays note events in real time while the threads run
+ * 
+ * Threads push note events into a bounded lock-free ring (see
+ * EventBuffer::setLiveOutput), which never blocks them. A dedicated output
+ * thread, raised to real-time priority when allowed, drains the ring,
+ * stamps each message with its arrival time plus a fixed latency (plus the
+ * remaining ticks of scheduled note-offs), and sends it to the backend when
+ * due. Notes that do not fit in the ring are dropped and counted.
+ */
+class LiveMidiOutput {
+public:
+    /**
+     * @param backend Open backend to play through
+     * @param timerMode Sleeping strategy of the output thread
+     */
+    LiveMidiOutput(std::unique_ptr<LiveMidiBackend> backend, TimerMode timerMode);
+    ~LiveMidiOutput();
+
+    LiveMidiOutput(const LiveMidiOutput&) = delete;
+    LiveMidiOutput& operator=(const LiveMidiOutput&) = delete;
+
+    /**
+     * Selects a channel's instrument; call before start()
+     * 
+     * @param channel MIDI channel (0-15)
+     * @param instrument General MIDI program number
+     */
+    void programChange(int channel, int instrument);
+
+    /**
+     * Starts the output thread
+     */
+    void start();
+
+    /**
+     * Stops the output thread, releases pending note-offs and silences every channel
+     * 
+     * Call once the threads have stopped writing
+     */
+    void stop();
+
+    MidiRing& queue() { return ring; }
+    const char* backendName() const { return backend->name(); }
+    long long getSentCount() const { return sent; }
+    long long getDroppedCount() const { return ring.droppedCount(); }
+    const Histogram& getLateness() const { return lateness; } // Send time minus due time, in ns
+
+private:
+    // PendingMessage: A drained message waiting for its due time
+    struct PendingMessage {
+        long long dueNs;
+        long long order; // Arrival order, keeps messages with equal due times in sequence
+        LiveMessage message;
+    };
+
+    static bool dueAfter(const PendingMessage& a, const PendingMessage& b);
+    void run();
+    void drain();
+    void sendDue(long long nowNs);
+
+    std::unique_ptr<LiveMidiBackend> backend;
+    TimerMode timerMode;
+    MidiRing ring;
+    std::thread worker;
+    std::atomic<bool> running{false};
+
+    // Output thread state
+    std::vector<PendingMessage> pending; // Min-heap on (dueNs, order)
+    long long arrivals = 0;
+    long long sent = 0;
+    Histogram lateness;
+};
+
+#endif // THREAD_MUSIC_LIVE_MIDI_H
@@ -0,0 +1,147 @@
+#ifndef THREAD_MUSIC_MIDI_OUTPUT_H
+#define THREAD_MUSIC_MIDI_OUTPUT_H
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+#include <MidiFile.h>
+#include "SmfEncoder.h"
+#include "Types.h"
+
+class EventExport;
+
+// OutputEncoder: How the final MIDI file is written
+enum class OutputEncoder {
+    Native,  // Event buffers encoded straight into MTrk bytes and written with writev
+    MidiFile // Events copied into smf::MidiFile, which sorts, converts and writes them
+};
+
+/**
+ * Parses an output encoder name from the command line
+ * 
+ * @param name "native" or "midifile"
+ * @param encoder Receives the encoder
+ * @return True if the name was recognized
+ */
+bool parseOutputEncoder(const std::string& name, OutputEncoder& encoder);
+
+/**
+ * Returns the command-line name of an output encoder
+ * 
+ * @param encoder Output encoder
+ * @return "native" or "midifile"
+ */
+const char* outputEncoderName(OutputEncoder encoder);
+
+/**
+ * Estimates how many events a thread will record during a run
+ * 
+ * Used to preallocate each thread's EventBuffer so the playback loop
+ * does not reallocate while it is being timed
+ * 
+ * @param data Thread configuration data
+ * @param durationSec Total duration in seconds
+ * @param numPhases Number of musical phases
+ * @return Suggested event capacity
+ */
+std::size_t estimateEventCapacity(const ThreadData& data, int durationSec, int numPhases);
+
+/**
+ * Returns the track name written for a thread
+ * 
+ * @param data Thread configuration data
+ * @return Track name ("Drum Track" or "Thread N", with its CPU and scheduling policy when set)
+ */
+std::string trackNameFor(const ThreadData& data);
+
+/**
+ * Copies a thread's recorded events into its MIDI track
+ * 
+ * Called from main.cpp after all threads have joined, so the
+ * MidiFile is only ever touched by a single thread
+ * 
+ * @param midifile Destination MIDI file (absolute ticks)
+ * @param data Thread configuration data (track, port and thread type)
+ * @param buffer Events recorded by the thread (consumed)
+ * @param columns Also receives every event, or nullptr
+ */
+void appendEventBuffer(smf::MidiFile& midifile, const ThreadData& data, EventBuffer& buffer,
+                       EventExport* columns = nullptr);
+
+/**
+ * SmfFileWriter: Encodes thread event buffers directly into a format 1 file
+ * 
+ * Each track is encoded into its own byte buffer, reserved up front from
+ * the thread's event estimate, with delta times and running status. The
+ * file is then written with one writev() of the MThd chunk and every MTrk
+ * header and body, so the encoded bytes are the only copy of the output
+ * and no per-event objects are created, sorted or converted.
+ * 
+ * Events must arrive in tick order, as EventBuffer provides them.
+ */
+class SmfFileWriter {
+public:
+    /**
+     * @param trackCount Number of tracks in the file
+     */
+    explicit SmfFileWriter(int trackCount);
+
+    /**
+     * Returns the encoder of a track, for events written before its thread's
+     * 
+     * @param track Track number
+     * @return Track encoder
+     */
+    SmfTrackEncoder& trackEncoder(int track) { return tracks[track].encoder; }
+
+    /**
+     * Reserves encoded bytes for a track
+     * 
+     * @param track Track number
+     * @param bytes Expected size of the track body
+     */
+    void reserve(int track, std::size_t bytes);
+
+    /**
+     * Encodes a thread's track name, port, program change and recorded events
+     * 
+     * @param data Thread configuration data (track, port and thread type)
+     * @param buffer Events recorded by the thread (consumed)
+     * @param texts Text events as (tick, text) in tick order, merged between the recorded events
+     * @param columns Also receives every recorded event, or nullptr
+     */
+    void appendThread(const ThreadData& data, EventBuffer& buffer,
+                      const std::vector<std::pair<int, std::string>>& texts, EventExport* columns = nullptr);
+
+    /**
+     * Ends every track and writes the file
+     * 
+     * @param filename Output file name
+     * @return True on success
+     */
+    bool write(const std::string& filename);
+
+    /**
+     * Returns the size of the file written by write()
+     * 
+     * @return Bytes
+     */
+    std::size_t size() const;
+
+private:
+    struct Track {
+        Track() = default;
+        Track(const Track&) = delete; // The encoder points at body
+        Track& operator=(const Track&) = delete;
+
+        unsigned char header[8] = {'M', 'T', 'r', 'k'}; // Chunk type and big-endian body length
+        std::vector<unsigned char> body;
+        SmfTrackEncoder encoder{body};
+    };
+
+    std::vector<unsigned char> fileHeader;
+    std::vector<Track> tracks;
+};
+
+#endif // THREAD_MUSIC_MIDI_OUTPUT_H
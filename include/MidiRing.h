@@ -0,0 +1,100 @@
+#ifndef THREAD_MUSIC_MIDI_RING_H
+#define THREAD_MUSIC_MIDI_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// LiveMessage: One short MIDI message for real-time output
+struct LiveMessage {
+    int delayTicks;       // Ticks between enqueueing and playing (scheduled note-offs), otherwise 0
+    unsigned char status; // Status byte with the channel in the low nibble
+    unsigned char data1;  // Pitch
+    unsigned char data2;  // Velocity
+};
+
+/**
+ * MidiRing: Bounded multi-producer, single-consumer lock-free queue
+ * 
+ * Each slot carries a sequence number (Vyukov's bounded queue): a producer
+ * claims a position with one compare-and-swap and publishes the slot with a
+ * release store, the consumer only reads published slots. A full ring
+ * rejects the message instead of waiting, so producers never block.
+ */
+class MidiRing {
+public:
+    /**
+     * @param capacity Number of slots (rounded up to a power of two)
+     */
+    explicit MidiRing(std::size_t capacity) {
+        std::size_t size = 1;
+        while (size < capacity) size <<= 1;
+        mask = size - 1;
+        slots.reset(new Slot[size]);
+        for (std::size_t i = 0; i < size; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MidiRing(const MidiRing&) = delete;
+    MidiRing& operator=(const MidiRing&) = delete;
+
+    /**
+     * Adds a message without blocking (any thread)
+     * 
+     * @param message Message to queue
+     * @return False if the ring was full and the message was dropped
+     */
+    bool tryPush(const LiveMessage& message) {
+        std::size_t position = enqueuePosition.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots[position & mask];
+            std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+            if (difference == 0) {
+                if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    slot.message = message;
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                position = enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * Takes the oldest published message (consumer thread only)
+     * 
+     * @param message Receives the message
+     * @return False if the ring is empty
+     */
+    bool tryPop(LiveMessage& message) {
+        Slot& slot = slots[dequeuePosition & mask];
+        std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != dequeuePosition + 1) return false;
+        message = slot.message;
+        slot.sequence.store(dequeuePosition + mask + 1, std::memory_order_release);
+        dequeuePosition++;
+        return true;
+    }
+
+    long long droppedCount() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<std::size_t> sequence{0};
+        LiveMessage message{};
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    std::size_t mask = 0;
+    alignas(64) std::atomic<std::size_t> enqueuePosition{0};
+    alignas(64) std::size_t dequeuePosition = 0;
+    alignas(64) std::atomic<long long> dropped{0};
+};
+
+#endif // THREAD_MUSIC_MIDI_RING_H
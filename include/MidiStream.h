@@ -0,0 +1,139 @@
+#ifndef THREAD_MUSIC_MIDI_STREAM_H
+#define THREAD_MUSIC_MIDI_STREAM_H
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "SmfEncoder.h"
+#include "Types.h"
+
+class EventExport;
+
+/**
+ * StreamingMidiWriter: Writes a multi-track MIDI file incrementally
+ * 
+ * A background thread periodically drains the thread event buffers and
+ * appends every published event to a per-track spool file (buffers publish
+ * in tick order, holding back note-offs that are not final yet). Each spool file is kept a valid single-track MIDI file (its MTrk
+ * length and end-of-track event are patched after every flush), so a
+ * crash leaves playable partial tracks behind. finish() concatenates the
+ * spools into the final format 1 file and removes them.
+ */
+class StreamingMidiWriter {
+public:
+    /**
+     * @param filename Final output file name
+     * @param trackCount Number of tracks in the output file
+     */
+    StreamingMidiWriter(const std::string& filename, int trackCount);
+    ~StreamingMidiWriter();
+
+    StreamingMidiWriter(const StreamingMidiWriter&) = delete;
+    StreamingMidiWriter& operator=(const StreamingMidiWriter&) = delete;
+
+    /**
+     * Creates the spool files
+     * 
+     * @return True on success
+     */
+    bool open();
+
+    /**
+     * Returns the encoder of a track, for header events written before start()
+     * 
+     * @param track Track number
+     * @return Track encoder
+     */
+    SmfTrackEncoder& trackEncoder(int track);
+
+    /**
+     * Registers a thread as the event source of its track and writes the
+     * track name and program change
+     * 
+     * @param data Thread configuration data (events must outlive the writer)
+     */
+    void addThread(const ThreadData& data);
+
+    /**
+     * Also passes every flushed event to a columnar export
+     * 
+     * Call before start(); the export is filled from the flushing thread
+     * 
+     * @param columns Export that outlives the writer, or nullptr
+     */
+    void setExport(EventExport* columns) { exportColumns = columns; }
+
+    /**
+     * Starts the background flushing thread
+     * 
+     * @param intervalMs Time between flushes in milliseconds
+     */
+    void start(int intervalMs);
+
+    /**
+     * Stops the flushing thread and writes every remaining event
+     * 
+     * Call once all writers of the event buffers have finished
+     */
+    void stop();
+
+    /**
+     * Asks the flushing thread for an extra flush within about 10 ms
+     * 
+     * Safe to call from any thread while the writer runs; the periodic
+     * flushes continue on their schedule
+     */
+    void requestFlush() { flushRequested.store(true, std::memory_order_release); }
+
+    long long getFlushCount() const { return flushCount.load(std::memory_order_relaxed); } // Flushes so far
+
+    /**
+     * Assembles the final MIDI file from the spools
+     * 
+     * @return True on success
+     */
+    bool finish();
+
+    int getTrackCount() const { return static_cast<int>(tracks.size()); }
+
+    /**
+     * Returns how many events arrived after a later event had already been
+     * written and were moved to that event's tick
+     * 
+     * Out-of-order events within one flush are sorted instead. Read after stop()
+     * 
+     * @return Number of moved events over all tracks
+     */
+    std::size_t getClampedCount() const;
+
+private:
+    struct TrackStream {
+        std::string spoolPath;
+        std::FILE* spool = nullptr;
+        std::vector<unsigned char> bytes;   // Encoded but not yet written
+        std::unique_ptr<SmfTrackEncoder> encoder;
+        unsigned long bodyLength = 0;       // MTrk bytes on disk, excluding end-of-track
+        EventBuffer* source = nullptr;
+        int thread = 0;                     // Thread ID of the source
+        std::string endMarkerText;
+        std::size_t sortedOutOfOrder = 0;   // Source out-of-order count already sorted for
+        std::vector<TrackEvent> pending;    // Drained events being sorted
+    };
+
+    void flushLoop(int intervalMs);
+    void flush();
+    bool writeSpool(TrackStream& track);
+
+    std::string filename;
+    std::vector<TrackStream> tracks;
+    std::thread flusher;
+    std::atomic<bool> flushing{false};
+    std::atomic<bool> flushRequested{false};
+    std::atomic<long long> flushCount{0};
+    EventExport* exportColumns = nullptr;
+};
+
+#endif // THREAD_MUSIC_MIDI_STREAM_H
@@ -2,33 +2,50 @@
 #define THREAD_MUSIC_MUSIC_GENERATION_H
 
 #include <vector>
-#include <mutex>
 #include <atomic>
+#include <random>
 #include "Types.h"
 #include "Constants.h"
 
+class Conductor;         // Defined in Conductor.h
+class WorkloadSelection; // Defined in Workload.h
+
 /**
  * Creates a MIDI note pitch within a specified scale
  * 
- * @param scale Vector of scale intervals (semitones from root)
+ * @param scale Scale intervals (semitones from root)
  * @param octave Base octave number
  * @param scaleIndex Position within the scale
  * @param rootNote Root note pitch class (0-11, where 0 is C)
  * @return MIDI note number
  */
-int createNoteInScale(const std::vector<int>& scale, int octave, int scaleIndex, int rootNote);
+int createNoteInScale(const Scale& scale, int octave, int scaleIndex, int rootNote);
+
+/**
+ * Selects a note duration based on weighted probabilities
+ * 
+ * @param gen Random number generator
+ * @param weights Precomputed cumulative weight table
+ * @return Selected duration value in MIDI ticks
+ */
+int selectDuration(std::mt19937& gen, const DurationTable& weights);
 
 /**
  * Generates a musical snippet for a thread based on its register and role
  * 
+ * Appends to the table without allocating when it has been reserved for
+ * SNIPPET_MAX_NOTES notes per snippet.
+ * 
+ * @param table Snippet table that receives the phrase as its next snippet
+ * @param gen Random number generator
  * @param lowNote Lower bound of the note range
  * @param highNote Upper bound of the note range
  * @param scale Musical scale to use for note selection
  * @param rootNote Root note of the scale
  * @param isBass Whether this snippet is for a bass instrument
- * @return Snippet containing a sequence of musical notes
  */
-Snippet generateSnippet(int lowNote, int highNote, const std::vector<int>& scale, int rootNote, bool isBass);
+void generateSnippet(SnippetTable& table, std::mt19937& gen, int lowNote, int highNote,
+                     const Scale& scale, int rootNote, bool isBass);
 
 /**
  * Generates a drum pattern appropriate for a specific musical phase
@@ -42,22 +59,46 @@ DrumPattern generateDrumPattern(int phaseNumber);
  * Thread function for the drum/rhythm thread
  * 
  * @param data Thread configuration data
- * @param durationSec Total duration in seconds
- * @param numPhases Number of musical phases
+ * @param conductor Shared tick clock and phase grid
  */
-void drumThreadFunction(ThreadData data, int durationSec, int numPhases);
+void drumThreadFunction(ThreadData data, Conductor* conductor);
 
 /**
  * Thread function for melodic instrument threads
  * 
  * @param data Thread configuration data
- * @param durationSec Total duration in seconds
- * @param numPhases Number of musical phases
+ * @param conductor Shared tick clock and phase grid
  */
-void melodicThreadFunction(ThreadData data, int durationSec, int numPhases);
+void melodicThreadFunction(ThreadData data, Conductor* conductor);
 
-// External declarations for synchronization
-extern std::mutex midi_mutex;
+/**
+ * Thread function for melodic threads whose scheduling is traced by the kernel
+ * 
+ * Runs only the busy work; publishes its thread ID through data.osTid
+ * so the scheduler tracer can attach to it
+ * 
+ * @param data Thread configuration data
+ * @param conductor Shared tick clock and phase grid (sets the end of the run)
+ */
+void tracedMelodicThreadFunction(ThreadData data, Conductor* conductor);
+
+// External declaration for stopping all threads
 extern std::atomic<bool> running;
 
+// Melodic voices with a higher thread ID rest until it is raised again (see ControlServer)
+extern std::atomic<int> activeVoices;
+
+// Busy-work kernel switched to at run time (see ControlServer)
+extern WorkloadSelection liveWorkload;
+
+/**
+ * Returns whether a voice may play notes
+ * 
+ * @param data Thread configuration data
+ * @return False while the voice is muted by activeVoices
+ */
+inline bool isVoiceActive(const ThreadData& data) {
+    return data.isDrumThread || data.id <= activeVoices.load(std::memory_order_relaxed);
+}
+
 #endif // THREAD_MUSIC_MUSIC_GENERATION_H
\ No newline at end of file
@@ -0,0 +1,99 @@
+#ifndef THREAD_MUSIC_PHASE_PROGRAM_H
+#define THREAD_MUSIC_PHASE_PROGRAM_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "Types.h"
+
+// ProgramNote: One note of a cached snippet
+struct ProgramNote {
+    int pitch;
+    int velocity;
+    int duration;
+};
+
+/**
+ * PhaseProgram: The phrases and drum patterns of a piece, by seed
+ * 
+ * Every snippet has its own generator, seeded from (seed, thread, role,
+ * phase), so a snippet does not depend on how many other snippets were
+ * generated before it: adding phases or threads keeps every existing
+ * phrase and only generates the new ones.
+ * 
+ * Generated entries can be kept in a small binary cache file, one per
+ * seed. The file also stores a fingerprint of the Constants.h values the
+ * generator depends on, and is ignored when they have changed.
+ */
+class PhaseProgram {
+public:
+    /**
+     * @param seed Phrase generator seed
+     */
+    explicit PhaseProgram(unsigned int seed);
+
+    /**
+     * Returns the default cache directory ($XDG_CACHE_HOME/thread-music or ~/.cache/thread-music)
+     * 
+     * @return Directory path, or an empty string if no home directory is known
+     */
+    static std::string defaultCacheDirectory();
+
+    /**
+     * Loads cached entries for this seed
+     * 
+     * @param directory Cache directory
+     * @return True if a matching cache file was read
+     */
+    bool load(const std::string& directory);
+
+    /**
+     * Writes every entry to the cache file if any were generated
+     * 
+     * The file is written under a temporary name and renamed, so
+     * concurrent runs never read a partial file.
+     * 
+     * @param directory Cache directory (created if missing)
+     * @return True if the cache is up to date
+     */
+    bool save(const std::string& directory) const;
+
+    /**
+     * Appends the snippet of one thread and phase to its snippet table
+     * 
+     * May be called from several threads at once for different tables
+     * 
+     * @param table Snippet table that receives the phrase as its next snippet
+     * @param thread Thread ID
+     * @param role Musical role (selects register, scale and rhythm)
+     * @param phase Phase number
+     */
+    void appendSnippet(SnippetTable& table, int thread, VoiceRole role, int phase);
+
+    /**
+     * Returns the drum pattern of a phase
+     * 
+     * @param phase Phase number
+     * @return Pattern for the drum thread
+     */
+    DrumPattern drumPattern(int phase);
+
+    long long getCachedCount() const { return cachedCount; }       // Entries served from the cache
+    long long getGeneratedCount() const { return generatedCount; } // Entries generated by this run
+
+private:
+    using Key = std::tuple<int, int, int>; // Thread, role, phase
+
+    std::string cachePath(const std::string& directory) const;
+
+    unsigned int seed;
+    std::map<Key, std::vector<ProgramNote>> snippets; // Nodes never move, so found entries are read unlocked
+    std::mutex snippetMutex;
+    std::map<int, DrumPattern> drumPatterns;
+    long long cachedCount = 0;
+    long long generatedCount = 0;
+};
+
+#endif // THREAD_MUSIC_PHASE_PROGRAM_H
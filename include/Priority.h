@@ -0,0 +1,89 @@
+#ifndef THREAD_MUSIC_PRIORITY_H
+#define THREAD_MUSIC_PRIORITY_H
+
+#include <string>
+
+// SchedPolicy: OS scheduling settings for the threads of one role
+struct SchedPolicy {
+    enum Kind {
+        Default,    // Normal time sharing (SCHED_OTHER)
+        Fifo,       // Real-time, runs until it blocks (SCHED_FIFO)
+        RoundRobin, // Real-time with a time slice (SCHED_RR)
+        Batch,      // Time sharing, treated as CPU-bound (SCHED_BATCH)
+        Idle        // Runs only when nothing else wants the CPU (SCHED_IDLE)
+    };
+    Kind kind = Default;
+    int priority = 0;        // Real-time priority for Fifo/RoundRobin (1-99)
+    bool setNice = false;    // Whether nice is applied
+    int nice = 0;            // Nice value (-20 to 19) for Default/Batch
+    std::string cgroup;      // cgroup v2 group name, empty for none
+    int cpuQuotaPercent = 0; // CPU quota of the cgroup in percent of one CPU (0 = unlimited)
+    std::string cgroupPath;  // Directory of the prepared cgroup (see prepareCgroup())
+};
+
+/**
+ * Parses a scheduling policy from the command line
+ * 
+ * The text is a comma-separated list of "default", "fifo:P", "rr:P",
+ * "batch", "idle", "nice:N" and "cgroup:NAME" or "cgroup:NAME:PERCENT",
+ * e.g. "fifo:50", "nice:-5" or "idle,cgroup:leads:50"
+ * 
+ * @param text Policy text
+ * @param policy Receives the parsed policy
+ * @return True if the text was recognized
+ */
+bool parseSchedPolicy(const std::string& text, SchedPolicy& policy);
+
+/**
+ * Formats a policy the way parseSchedPolicy() reads it
+ * 
+ * @param policy Scheduling policy
+ * @return Policy text ("default" when nothing is changed)
+ */
+std::string schedPolicyName(const SchedPolicy& policy);
+
+/**
+ * Returns whether a policy changes anything about a thread
+ * 
+ * @param policy Scheduling policy
+ * @return False for the default policy without nice or cgroup
+ */
+bool isCustomSchedPolicy(const SchedPolicy& policy);
+
+/**
+ * Creates the cgroup of a policy below this process's cgroup and sets its quota
+ * 
+ * The group is a threaded cgroup v2 child, so single threads can join
+ * it. Call once per group before the threads start; on success the
+ * directory is stored in policy.cgroupPath. Groups this call creates,
+ * and the cpu controller if it enables it, are remembered for
+ * removeCgroups().
+ * 
+ * @param policy Policy whose cgroup to prepare
+ * @param error Receives the reason on failure
+ * @return True on success (always false where cgroup v2 is unavailable)
+ */
+bool prepareCgroup(SchedPolicy& policy, std::string& error);
+
+/**
+ * Removes the cgroups prepareCgroup() created in this run
+ * 
+ * Call after every thread that joined them has exited. Removing the last
+ * threaded child turns the parent back into a normal domain, and the cpu
+ * controller is disabled again in the parents where it was enabled.
+ * 
+ * @param error Receives the groups that could not be removed
+ * @return True if everything created was removed
+ */
+bool removeCgroups(std::string& error);
+
+/**
+ * Applies a policy to the calling thread
+ * 
+ * @param policy Scheduling policy
+ * @param error Receives the reasons of any settings that failed
+ * @return True if every setting was applied (always false where unsupported)
+ */
+bool applySchedPolicy(const SchedPolicy& policy, std::string& error);
+
+#endif // THREAD_MUSIC_PRIORITY_H
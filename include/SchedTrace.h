@@ -0,0 +1,100 @@
+#ifndef THREAD_MUSIC_SCHED_TRACE_H
+#define THREAD_MUSIC_SCHED_TRACE_H
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+#include "Types.h"
+
+/**
+ * SchedTracer: Records kernel context switches of worker threads
+ * 
+ * On Linux, opens one perf event per thread with context-switch records
+ * enabled (the same hook that feeds the sched:sched_switch tracepoint)
+ * and drains the ring buffers from a dedicated, non-worker polling thread.
+ * 
+ * A thread counts as descheduled from the moment it is preempted until
+ * it is switched back in. Voluntary switches (sleeping) are ignored, so
+ * the edges describe time spent waiting for a CPU, not idle time.
+ */
+class SchedTracer {
+public:
+    /**
+     * @param originNs CLOCK_MONOTONIC time that edge timestamps are relative to
+     */
+    explicit SchedTracer(long long originNs);
+    ~SchedTracer();
+
+    SchedTracer(const SchedTracer&) = delete;
+    SchedTracer& operator=(const SchedTracer&) = delete;
+
+    /**
+     * Moves the origin of the edge timestamps
+     * 
+     * Call before start(); records are kept from attach() on and
+     * converted when they are polled
+     * 
+     * @param originNs CLOCK_MONOTONIC time that edge timestamps are relative to
+     */
+    void setOrigin(long long originNs) { this->originNs = originNs; }
+
+    /**
+     * Checks whether context-switch tracing can be used in this process
+     * 
+     * @return True if a per-thread perf event can be opened
+     */
+    static bool isAvailable();
+
+    /**
+     * Starts tracing a thread
+     * 
+     * @param tid Kernel thread ID
+     * @return Stream index for edgesFor(), or -1 on failure
+     */
+    int attach(long tid);
+
+    /**
+     * Starts the polling thread
+     */
+    void start();
+
+    /**
+     * Stops the polling thread and drains all remaining records
+     */
+    void stop();
+
+    /**
+     * Returns the scheduling edges recorded for a stream
+     * 
+     * @param index Value returned by attach()
+     * @return Edges in time order, relative to the origin
+     */
+    const std::vector<SchedEdge>& edgesFor(int index) const;
+
+    /**
+     * @return Number of records the kernel dropped because a ring buffer was full
+     */
+    unsigned long long lostRecords() const { return lost; }
+
+private:
+    struct Stream {
+        long tid;
+        int fd;
+        void* ring;
+        std::size_t ringSize;
+        bool onCpu;
+        std::vector<SchedEdge> edges;
+    };
+
+    void pollLoop();
+    void drain(Stream& stream);
+
+    long long originNs;
+    std::vector<Stream> streams;
+    std::thread poller;
+    std::atomic<bool> polling{false};
+    unsigned long long lost = 0;
+};
+
+#endif // THREAD_MUSIC_SCHED_TRACE_H
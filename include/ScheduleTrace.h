@@ -0,0 +1,243 @@
+#ifndef THREAD_MUSIC_SCHEDULE_TRACE_H
+#define THREAD_MUSIC_SCHEDULE_TRACE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Types.h"
+
+// TraceVoice: Musical configuration of one recorded thread
+struct TraceVoice {
+    int channel = 0;
+    int instrument = 0;
+    VoiceRole role = VoiceRole::Lead;
+    SnippetTable snippets; // One snippet per recorded phase (empty for the drum)
+};
+
+// ScheduleTrace: Scheduling timeline of one run, enough to re-render it offline
+struct ScheduleTrace {
+    int durationSec = 0;       // Length of the recorded run
+    int numPhases = 0;         // Phases used when recording (rendering may choose others)
+    unsigned int seed = 0;     // Phrase generator seed used when recording
+    bool kernelTraced = false; // Melodic edges come from perf events rather than sampling
+    std::vector<TraceVoice> voices; // Indexed by thread ID (empty in version 1 traces)
+    std::vector<std::vector<SchedEdge>> threads; // Indexed by thread ID; thread 0 is the drum (missed steps)
+};
+
+// TraceRecord: One interval during which a thread was off the CPU
+struct TraceRecord {
+    int thread;        // Thread ID
+    long long startNs; // Descheduled at, in ns since the start
+    long long endNs;   // Scheduled again at, or -1 if it stayed off until the end
+};
+
+/**
+ * ScheduleTraceWriter: Appends off-CPU intervals to a version 2 trace file
+ * 
+ * Layout (little-endian): the magic "TMTRACE2", then u32 thread count,
+ * duration, phases, seed and flags, then per thread u8 channel, instrument
+ * and role, u16 snippet count, and per snippet a u8 note count followed by
+ * u8 pitch, u8 velocity and u16 duration per note. Records follow until the
+ * end of the file, each as three unsigned LEB128 varints: thread ID, start
+ * minus the end of that thread's previous record, and length + 1 (0 when
+ * the interval never ends). Records of different threads may interleave.
+ */
+class ScheduleTraceWriter {
+public:
+    ~ScheduleTraceWriter();
+
+    /**
+     * Creates the file and writes the header
+     * 
+     * @param path Output file
+     * @param trace Run metadata and voices (threads is ignored)
+     * @return True on success
+     */
+    bool open(const std::string& path, const ScheduleTrace& trace);
+
+    /**
+     * Appends one off-CPU interval
+     * 
+     * @param thread Thread ID
+     * @param startNs Descheduled at (not before the thread's previous record ends)
+     * @param endNs Scheduled again at, or -1 if it stayed off until the end
+     */
+    void append(int thread, long long startNs, long long endNs);
+
+    /**
+     * Hands the records appended so far to the operating system
+     * 
+     * @return True if every write succeeded
+     */
+    bool flush();
+
+    /**
+     * Flushes and closes the file
+     * 
+     * @return True if every write succeeded
+     */
+    bool close();
+
+private:
+    std::FILE* out = nullptr;
+    std::vector<long long> lastEndNs; // Delta base per thread
+    bool ok = false;
+};
+
+// ScheduleTimeline: Scheduling changes of one thread, recorded by it and taken by a ScheduleTraceRecorder
+class ScheduleTimeline {
+public:
+    /**
+     * @param count Edges to make room for
+     */
+    void reserve(std::size_t count);
+
+    /**
+     * Records one change; called by the thread the timeline belongs to
+     * 
+     * @param timeNs Nanoseconds since the start of the piece
+     * @param onCpu True when the thread starts running
+     */
+    void record(long long timeNs, bool onCpu);
+
+    /**
+     * Moves the recorded edges out, leaving the timeline empty
+     * 
+     * @param out Receives the edges in recording order (previous contents are dropped)
+     */
+    void take(std::vector<SchedEdge>& out);
+
+private:
+    std::mutex lock;
+    std::vector<SchedEdge> edges;
+};
+
+/**
+ * ScheduleTraceRecorder: Writes the timelines of a running piece to a trace file
+ * 
+ * The header is written when the piece starts. flush() turns the edges the
+ * threads recorded since the last flush into off-CPU intervals, appends
+ * them and hands them to the operating system, so a long run can be saved
+ * without stopping it. An interval that is still open waits for the flush
+ * that sees its end; close() writes those that never ended.
+ */
+class ScheduleTraceRecorder {
+public:
+    /**
+     * Creates the file and writes the header
+     * 
+     * @param path Output file
+     * @param header Run metadata and voices (threads is ignored)
+     * @param timelines Timelines to drain, indexed by thread ID; must outlive the recorder
+     * @return True on success
+     */
+    bool open(const std::string& path, const ScheduleTrace& header, std::vector<ScheduleTimeline>& timelines);
+
+    /**
+     * Appends the edges recorded since the last flush; safe to call from any thread
+     * 
+     * @return True if every write succeeded
+     */
+    bool flush();
+
+    /**
+     * Appends a complete timeline of a thread that did not record into its ScheduleTimeline
+     * 
+     * @param thread Thread ID
+     * @param edges Edges in time order, e.g. from the kernel tracer
+     */
+    void appendEdges(int thread, const std::vector<SchedEdge>& edges);
+
+    /**
+     * Flushes, ends the intervals that are still open and closes the file
+     * 
+     * @return True if every write succeeded
+     */
+    bool close();
+
+    bool isOpen() const { return timelines != nullptr; }
+    long long getFlushCount() const { return flushes.load(std::memory_order_relaxed); }
+
+private:
+    void drain();
+
+    std::mutex lock;
+    ScheduleTraceWriter writer;
+    std::vector<ScheduleTimeline>* timelines = nullptr;
+    std::vector<unsigned char> onCpu;   // Last state written per thread
+    std::vector<long long> offSinceNs;  // Start of the open interval per thread
+    std::vector<SchedEdge> taken;       // Reused between flushes
+    std::atomic<long long> flushes{0};
+    bool ok = false;
+};
+
+/**
+ * MappedScheduleTrace: Zero-copy reader for version 2 trace files
+ * 
+ * The file is memory-mapped and records are decoded in place, so
+ * iterating a large trace costs no reads or allocations.
+ */
+class MappedScheduleTrace {
+public:
+    ~MappedScheduleTrace();
+
+    /**
+     * Maps a trace and parses its header
+     * 
+     * @param path Input file
+     * @return False if the file is missing or not a version 2 trace
+     */
+    bool open(const std::string& path);
+
+    /**
+     * Decodes the next record
+     * 
+     * @param record Receives the record
+     * @return False at the end of the records or on a corrupt record
+     */
+    bool next(TraceRecord& record);
+
+    /**
+     * Restarts iteration at the first record
+     */
+    void rewind();
+
+    const ScheduleTrace& header() const { return info; } // Metadata and voices (threads stays empty)
+    bool isCorrupt() const { return corrupt; }
+
+private:
+    const unsigned char* data = nullptr;
+    std::size_t size = 0;
+    std::size_t recordsOffset = 0;
+    std::size_t position = 0;
+    std::vector<long long> lastEndNs;
+    ScheduleTrace info;
+    bool corrupt = false;
+};
+
+/**
+ * Writes a version 2 scheduling trace, converting each timeline to off-CPU intervals
+ * 
+ * @param path Output file
+ * @param trace Trace to write
+ * @return True on success
+ */
+bool writeScheduleTrace(const std::string& path, const ScheduleTrace& trace);
+
+/**
+ * Reads a scheduling trace of either version into timelines
+ * 
+ * Version 1 files ("TMTRACE1": u32 thread count, duration, phases, seed and
+ * flags, then per thread a u32 edge count and one u64 (ns << 1) | onCpu
+ * per edge) carry no voices.
+ * 
+ * @param path Input file
+ * @param trace Receives the trace
+ * @return False if the file is missing, truncated, or not a trace
+ */
+bool readScheduleTrace(const std::string& path, ScheduleTrace& trace);
+
+#endif // THREAD_MUSIC_SCHEDULE_TRACE_H
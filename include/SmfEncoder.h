@@ -0,0 +1,88 @@
+#ifndef THREAD_MUSIC_SMF_ENCODER_H
+#define THREAD_MUSIC_SMF_ENCODER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "EventBuffer.h"
+
+/**
+ * Appends a MIDI variable-length quantity
+ * 
+ * @param out Destination bytes
+ * @param value Value to encode (up to 28 bits)
+ */
+void writeVlq(std::vector<unsigned char>& out, unsigned int value);
+
+/**
+ * Appends a big-endian 32-bit value
+ * 
+ * @param out Destination bytes
+ * @param value Value to encode
+ */
+void writeBigEndian32(std::vector<unsigned char>& out, unsigned int value);
+
+/**
+ * Appends a Standard MIDI File header chunk (MThd)
+ * 
+ * @param out Destination bytes
+ * @param format SMF format (0 or 1)
+ * @param trackCount Number of MTrk chunks that follow
+ * @param tpq Ticks per quarter note
+ */
+void writeSmfHeader(std::vector<unsigned char>& out, int format, int trackCount, int tpq);
+
+/**
+ * SmfTrackEncoder: Encodes absolute-tick events as MTrk body bytes
+ * 
+ * Converts to delta times and uses running status for channel messages.
+ * Events must be supplied in tick order. The encoder keeps its state
+ * between calls, so the output vector may be flushed and cleared at
+ * any point to stream a track out in pieces.
+ */
+class SmfTrackEncoder {
+public:
+    /**
+     * @param out Destination bytes (appended to, never cleared)
+     */
+    explicit SmfTrackEncoder(std::vector<unsigned char>& out) : out(&out) {}
+
+    void channelMessage(int tick, int status, int data1, int data2);
+    void programChange(int tick, int channel, int program);
+    void metaEvent(int tick, int type, const std::string& data);
+    void text(int tick, const std::string& text) { metaEvent(tick, 0x01, text); }
+    void trackName(int tick, const std::string& name) { metaEvent(tick, 0x03, name); }
+    void marker(int tick, const std::string& text) { metaEvent(tick, 0x06, text); }
+    void port(int tick, int number) { metaEvent(tick, 0x21, std::string(1, static_cast<char>(number))); }
+    void tempo(int tick, double bpm);
+    void timeSignature(int tick, int numerator, int denominatorPower, int clocksPerClick = 24, int num32ndsPerQuarter = 8);
+    void endOfTrack(int tick);
+
+    /**
+     * Encodes a recorded event
+     * 
+     * @param event Event to encode
+     * @param endMarkerText Text used for EventType::EndMarker
+     */
+    void trackEvent(const TrackEvent& event, const std::string& endMarkerText);
+
+    int lastTick() const { return previousTick; }
+
+    /**
+     * Returns how many events arrived before the previous event and were
+     * written at its tick instead
+     * 
+     * @return Number of clamped events
+     */
+    std::size_t clampedCount() const { return clamped; }
+
+private:
+    void writeDelta(int tick);
+
+    std::vector<unsigned char>* out;
+    int previousTick = 0;
+    int runningStatus = -1;
+    std::size_t clamped = 0;
+};
+
+#endif // THREAD_MUSIC_SMF_ENCODER_H
@@ -0,0 +1,53 @@
+#ifndef THREAD_MUSIC_START_GATE_H
+#define THREAD_MUSIC_START_GATE_H
+
+#include <condition_variable>
+#include <mutex>
+
+/**
+ * StartGate: Holds every voice thread until all of them are ready
+ * 
+ * Threads do their own setup (pinning, scheduling policy, voice and
+ * busy-work state), then wait at the gate. The launching thread waits
+ * for all of them to arrive, starts the clock and opens the gate, so the
+ * first thread no longer plays bars before the last one exists.
+ */
+class StartGate {
+public:
+    /**
+     * @param parties Number of threads that will arrive
+     */
+    explicit StartGate(int parties) : parties(parties) {}
+
+    StartGate(const StartGate&) = delete;
+    StartGate& operator=(const StartGate&) = delete;
+
+    /**
+     * Arrives at the gate and waits until it opens
+     * 
+     * Called by each party once
+     */
+    void arriveAndWait();
+
+    /**
+     * Waits until every party has arrived
+     * 
+     * @return Monotonic time the last party arrived
+     */
+    long long waitForArrivals();
+
+    /**
+     * Opens the gate; everything written before is visible to the released threads
+     */
+    void open();
+
+private:
+    std::mutex mutex;
+    std::condition_variable changed;
+    int parties;
+    int arrived = 0;
+    bool opened = false;
+    long long lastArrivalNs = 0;
+};
+
+#endif // THREAD_MUSIC_START_GATE_H
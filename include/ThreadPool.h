@@ -0,0 +1,99 @@
+#ifndef THREAD_MUSIC_THREAD_POOL_H
+#define THREAD_MUSIC_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * ThreadPool: Fixed set of workers with per-worker task deques and stealing
+ * 
+ * Tasks are spread over the workers' deques round-robin. A worker runs its
+ * own tasks newest first and, when its deque is empty, steals the oldest
+ * task of another worker, so uneven tasks still keep every core busy.
+ */
+class ThreadPool {
+public:
+    /**
+     * Starts the workers
+     * 
+     * @param workerCount Number of workers (0 or less uses every hardware thread)
+     */
+    explicit ThreadPool(int workerCount);
+
+    /**
+     * Finishes queued tasks and joins the workers
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * Queues a task
+     * 
+     * @param task Work to run on some worker
+     */
+    void submit(std::function<void()> task);
+
+    /**
+     * Queues a task on one worker's deque (other workers may still steal it)
+     * 
+     * @param worker Preferred worker index (wrapped into range)
+     * @param task Work to run
+     */
+    void submitTo(int worker, std::function<void()> task);
+
+    /**
+     * Blocks until every submitted task has finished
+     */
+    void wait();
+
+    /**
+     * Returns how many tasks wait in all deques
+     * 
+     * @return Queued tasks, not counting running ones
+     */
+    std::size_t queueDepth() const;
+
+    /**
+     * Returns the index of the calling worker
+     * 
+     * @return Worker index, or -1 if the caller is not a worker of any pool
+     */
+    static int currentWorker();
+
+    int size() const { return static_cast<int>(workers.size()); }
+    long long getStealCount() const { return steals.load(std::memory_order_relaxed); }
+
+private:
+    // WorkerQueue: One worker's tasks (the owner pops the back, thieves the front)
+    struct WorkerQueue {
+        mutable std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void enqueue(std::size_t queue, std::function<void()> task);
+    void workerLoop(int index);
+    bool popOwn(int index, std::function<void()>& task);
+    bool steal(int thief, std::function<void()>& task);
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<unsigned int> nextQueue{0};
+    std::atomic<long long> steals{0};
+
+    std::mutex stateMutex;
+    std::condition_variable workAvailable;
+    std::condition_variable allDone;
+    long long queued = 0;   // Tasks submitted but not yet taken (guarded by stateMutex)
+    long long pending = 0;  // Tasks submitted but not yet finished (guarded by stateMutex)
+    bool stopping = false;
+};
+
+#endif // THREAD_MUSIC_THREAD_POOL_H
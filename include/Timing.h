@@ -0,0 +1,74 @@
+#ifndef THREAD_MUSIC_TIMING_H
+#define THREAD_MUSIC_TIMING_H
+
+#include <string>
+#include <vector>
+#include "Types.h"
+
+/**
+ * Parses a timer mode name from the command line
+ * 
+ * @param name One of "sleep", "deadline", "timerfd", "spin"
+ * @param mode Receives the parsed mode
+ * @return True if the name was recognized
+ */
+bool parseTimerMode(const std::string& name, TimerMode& mode);
+
+/**
+ * Returns the command-line name of a timer mode
+ * 
+ * @param mode Timer mode
+ * @return Mode name
+ */
+const char* timerModeName(TimerMode mode);
+
+// TimingStats: Wake-up lateness of a thread against its requested deadlines
+struct TimingStats {
+    std::vector<long long> latenessNs; // One sample per wake-up
+    long long missedSteps = 0;         // Grid steps skipped because the thread woke too late
+
+    void record(long long lateNs) {
+        latenessNs.push_back(lateNs);
+    }
+
+    /**
+     * Returns a one-line summary (count, p50, p99, max in microseconds)
+     * 
+     * @return Human-readable report
+     */
+    std::string summary() const;
+};
+
+/**
+ * TimerEngine: Puts the calling thread to sleep until absolute deadlines
+ * 
+ * Each thread owns its own engine. Deadlines are CLOCK_MONOTONIC
+ * nanoseconds (see getMonotonicNs()).
+ */
+class TimerEngine {
+public:
+    /**
+     * @param mode Sleeping strategy
+     */
+    explicit TimerEngine(TimerMode mode);
+    ~TimerEngine();
+
+    TimerEngine(const TimerEngine&) = delete;
+    TimerEngine& operator=(const TimerEngine&) = delete;
+
+    /**
+     * Sleeps until a deadline
+     * 
+     * @param deadlineNs Absolute CLOCK_MONOTONIC deadline in nanoseconds
+     * @return How late the thread woke up, in nanoseconds (0 if not late)
+     */
+    long long sleepUntil(long long deadlineNs);
+
+private:
+    void blockUntil(long long deadlineNs);
+
+    TimerMode mode;
+    int timerFd = -1;
+};
+
+#endif // THREAD_MUSIC_TIMING_H
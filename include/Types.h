@@ -2,30 +2,59 @@
 #define THREAD_MUSIC_TYPES_H
 
 #include <vector>
+#include <atomic>
+#include <cstddef>
+#include "EventBuffer.h"
 
-// Note: Represents a single musical note in MIDI format
-struct Note {
-    int pitch;     // MIDI pitch (0-127, where 60 is middle C)
-    int velocity;  // Note volume/intensity (0-127)
-    int duration;  // Duration in MIDI ticks
-};
-
-// Snippet: A musical phrase that threads play when scheduled
-struct Snippet {
-    std::vector<Note> notes;
-    int currentNoteIndex = 0;
-    
-    // Reset to beginning of snippet for new iteration
-    void reset() {
-        currentNoteIndex = 0;
+// SnippetTable: The musical phrases of one thread, stored as flat structure-of-arrays
+// Notes of all snippets are stored back to back; snippet s owns notes offset[s]..offset[s+1]-1
+struct SnippetTable {
+    std::vector<int> pitch;    // MIDI pitch (0-127, where 60 is middle C)
+    std::vector<int> velocity; // Note volume/intensity (0-127)
+    std::vector<int> duration; // Duration in MIDI ticks
+    std::vector<int> offset = {0}; // First note of each snippet, plus the end of the last
+    std::vector<int> cursor;   // Next note of each snippet, relative to its first note
+
+    // Reserve storage so generation does not reallocate
+    void reserve(int snippets, int notes) {
+        pitch.reserve(notes);
+        velocity.reserve(notes);
+        duration.reserve(notes);
+        offset.reserve(snippets + 1);
+        cursor.reserve(snippets);
+    }
+
+    // Append a note to the snippet being built (opened by beginSnippet())
+    void addNote(int notePitch, int noteVelocity, int noteDuration) {
+        pitch.push_back(notePitch);
+        velocity.push_back(noteVelocity);
+        duration.push_back(noteDuration);
+        offset.back() = static_cast<int>(pitch.size());
+    }
+
+    // Start a new, empty snippet at the end of the table
+    void beginSnippet() {
+        offset.push_back(static_cast<int>(pitch.size()));
+        cursor.push_back(0);
+    }
+
+    // Number of snippets
+    int count() const {
+        return static_cast<int>(cursor.size());
+    }
+
+    // Reset a snippet to its beginning for a new iteration
+    void reset(int snippet) {
+        cursor[snippet] = 0;
     }
-    
-    // Get the next note in sequence and advance position
-    Note* getNextNote() {
-        if (notes.empty()) return nullptr;
-        Note* note = &notes[currentNoteIndex];
-        currentNoteIndex = (currentNoteIndex + 1) % notes.size();
-        return note;
+
+    // Get the index of the next note of a snippet and advance its position (-1 if empty)
+    int nextNote(int snippet) {
+        int length = offset[snippet + 1] - offset[snippet];
+        if (length == 0) return -1;
+        int index = offset[snippet] + cursor[snippet];
+        cursor[snippet] = (cursor[snippet] + 1) % length;
+        return index;
     }
 };
 
@@ -37,15 +66,86 @@ struct DrumPattern {
     int velocities[16] = {0};  // Velocity/intensity per step
 };
 
+// SchedEdge: A change in a thread's scheduling state
+struct SchedEdge {
+    long long timeNs; // Nanoseconds since the start of the piece
+    bool onCpu;       // True when the thread starts running, false when it is descheduled
+};
+
+// TimerMode: How threads sleep between loop iterations (see Timing.h)
+enum class TimerMode {
+    Sleep,    // std::this_thread::sleep_for, relative to now
+    Deadline, // clock_nanosleep with TIMER_ABSTIME
+    TimerFd,  // Blocking read on an absolute timerfd
+    Spin      // Sleep until shortly before the deadline, then spin with yield
+};
+
+// WorkloadKind: Synthetic busy work performed by threads between samples (see Workload.h)
+enum class WorkloadKind {
+    SinCos,       // Scalar sin*cos loop (original behavior)
+    Stream,       // Memory-bandwidth streaming over buffers larger than the caches
+    PointerChase, // Dependent loads through a random cycle (cache-miss heavy)
+    Fma,          // AVX-512 or AVX2 FMA bursts (scalar where unsupported)
+    Syscall,      // Back-to-back trivial system calls
+    Lock          // Short critical sections on a mutex shared by all threads
+};
+
+// DetectorKind: How melodic threads decide they are scheduled (see Detector.h)
+enum class DetectorKind {
+    Legacy,  // Fixed threshold on millisecond-truncated deltas (original behavior)
+    Adaptive // Calibrated hysteresis on the EWMA of the off-CPU time outside the sleep, with a minimum state length
+};
+
+struct TimingStats; // Defined in Timing.h
+struct BenchProbe;  // Defined in Bench.h
+struct ThreadCounters; // Defined in Counters.h
+struct SchedPolicy;    // Defined in Priority.h
+class StartGate;       // Defined in StartGate.h
+class ScheduleTimeline; // Defined in ScheduleTrace.h
+
+// VoiceRole: Musical role of a thread, used for per-role placement policies
+enum class VoiceRole {
+    Drum, // Rhythm thread (thread 0)
+    Bass, // Low register, harmonic foundation
+    Mid,  // Middle register, harmonic context
+    Lead  // High register, melodic interest
+};
+
+// Returns the lower-case name of a role ("drum", "bass", "mid", "lead")
+inline const char* voiceRoleName(VoiceRole role) {
+    switch (role) {
+        case VoiceRole::Drum: return "drum";
+        case VoiceRole::Bass: return "bass";
+        case VoiceRole::Mid: return "mid";
+        case VoiceRole::Lead: return "lead";
+    }
+    return "unknown";
+}
+
 // ThreadData: Configuration and state for each musical thread
 struct ThreadData {
     int id;               // Thread identifier
-    int track;            // MIDI track number
-    int channel;          // MIDI channel (0-15, with 9 reserved for drums)
+    int track;            // MIDI track number within its output file
+    int port = 0;         // MIDI port (with --shard files, also the output file)
+    int channel;          // MIDI channel (0-15, with 9 reserved for drums), unique per port
     int instrument;       // MIDI program/instrument number
-    std::vector<Snippet> snippets; // Musical phrases for each phase
+    SnippetTable snippets;   // Musical phrases for each phase (one snippet per phase)
     bool isDrumThread;    // Identifies the rhythm thread
     std::vector<DrumPattern> drumPatterns; // Rhythm patterns for each phase
+    EventBuffer* events = nullptr;         // Output buffer written only by this thread
+    std::atomic<long>* osTid = nullptr;    // Published kernel thread ID (scheduler tracing only)
+    TimerMode timerMode = TimerMode::Sleep; // Sleeping strategy between loop iterations
+    TimingStats* timing = nullptr;         // Optional wake-up lateness record
+    VoiceRole role = VoiceRole::Drum;      // Musical role (selects the affinity and scheduling policies)
+    int cpu = -1;                          // CPU the thread pins itself to (-1 = unpinned)
+    const SchedPolicy* sched = nullptr;    // OS scheduling policy the thread applies when it starts (nullptr = default)
+    WorkloadKind workload = WorkloadKind::SinCos; // Busy-work kernel run between samples
+    DetectorKind detector = DetectorKind::Legacy; // Scheduling detector of melodic threads
+    double workloadRate = 1.0;             // Calibrated kernel iterations per microsecond
+    BenchProbe* bench = nullptr;           // Optional benchmark measurements (--bench)
+    ThreadCounters* counters = nullptr;    // Optional hot-path counters
+    ScheduleTimeline* timeline = nullptr;       // Optional record of scheduling changes (--record-trace)
+    StartGate* startGate = nullptr;        // Waited at after setup, before the clock is read (nullptr = start at once)
 };
 
 #endif // THREAD_MUSIC_TYPES_H
\ No newline at end of file
@@ -2,15 +2,77 @@
 #define THREAD_MUSIC_UTILS_H
 
 #include <ctime>
+#include <pthread.h>
+
+// CpuClockMode: Which CPU clock getCpuTime() samples
+enum class CpuClockMode {
+    Thread,  // CPU time of the calling thread only (default)
+    Process  // CPU time of the whole process (original behavior)
+};
 
 /**
- * Returns the CPU time used by the current process
+ * Selects the clock used by getCpuTime()
+ * 
+ * Must be called before any worker threads are started
+ * 
+ * @param mode Per-thread or process-wide CPU time
+ */
+void setCpuClockMode(CpuClockMode mode);
+
+/**
+ * Returns the clock currently used by getCpuTime()
+ * 
+ * @return Active CPU clock mode
+ */
+CpuClockMode getCpuClockMode();
+
+/**
+ * Returns the CPU time used by the current thread or process
  * 
  * Used to detect when a thread is being scheduled by comparing
- * with wall clock time - essential for thread scheduling sonification
+ * with wall clock time - essential for thread scheduling sonification.
+ * Which clock is sampled depends on setCpuClockMode().
  * 
  * @return CPU time in seconds as a double
  */
 double getCpuTime();
 
-#endif // THREAD_MUSIC_UTILS_H
\ No newline at end of file
+/**
+ * Returns the CPU time used by the calling thread
+ * 
+ * @return CPU time in seconds as a double
+ */
+double getThreadCpuTime();
+
+/**
+ * Returns the CPU time used by another thread of this process
+ * 
+ * @param thread Native handle of the thread to sample
+ * @return CPU time in seconds as a double, or -1 if it cannot be read
+ */
+double getThreadCpuTime(pthread_t thread);
+
+/**
+ * Returns the CPU time used by the whole process
+ * 
+ * @return CPU time in seconds as a double
+ */
+double getProcessCpuTime();
+
+/**
+ * Returns the kernel thread ID of the calling thread
+ * 
+ * @return OS thread ID (gettid on Linux)
+ */
+long getCurrentThreadId();
+
+/**
+ * Returns the current CLOCK_MONOTONIC time
+ * 
+ * Same clock as std::chrono::steady_clock and kernel trace timestamps
+ * 
+ * @return Monotonic time in nanoseconds
+ */
+long long getMonotonicNs();
+
+#endif // THREAD_MUSIC_UTILS_H
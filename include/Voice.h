@@ -0,0 +1,180 @@
+#ifndef THREAD_MUSIC_VOICE_H
+#define THREAD_MUSIC_VOICE_H
+
+#include <vector>
+#include "Types.h"
+
+// PhaseGrid: Bar-aligned phase layout shared by the drum and melodic voices
+struct PhaseGrid {
+    int ticksPerPhase;    // Phase length in ticks, rounded to whole bars
+    int numPhases;        // Number of musical phases
+    int totalTicks;       // ticksPerPhase * numPhases
+    double durationSec;   // Wall-clock length of totalTicks
+};
+
+// Beat: One position on the phase grid, as published by the Conductor
+struct Beat {
+    int tick;          // Current musical position in ticks
+    int phase;         // Phase containing tick
+    int nextPhaseTick; // First tick after the phase
+    unsigned epoch;    // Phase changes published before this beat
+};
+
+/**
+ * Computes the bar-aligned phase grid
+ * 
+ * @param durationSec Requested duration in seconds
+ * @param numPhases Number of musical phases
+ * @return Phase layout with phase boundaries on complete bars
+ */
+PhaseGrid computePhaseGrid(int durationSec, int numPhases);
+
+/**
+ * Returns the phase containing a tick
+ * 
+ * @param grid Phase layout
+ * @param tick Absolute MIDI tick
+ * @return Phase number, clamped to the last phase
+ */
+int phaseAtTick(const PhaseGrid& grid, int tick);
+
+/**
+ * Converts a wall-clock offset to a MIDI tick at the fixed tempo
+ * 
+ * @param ns Nanoseconds since the start of the piece
+ * @return Absolute MIDI tick
+ */
+int ticksFromNanoseconds(long long ns);
+
+/**
+ * MelodicVoice: Note state machine for one melodic thread
+ * 
+ * Turns a sequence of (tick, scheduled) observations into note events:
+ * a note starts when the thread becomes scheduled, chains through the
+ * phase snippet while it stays scheduled, and stops when it is descheduled
+ * or the phase ends. Used by the sampling loop and by trace-driven rendering.
+ */
+class MelodicVoice {
+public:
+    /**
+     * @param data Thread configuration (snippets are advanced in place)
+     * @param grid Phase layout shared by all melodic threads
+     */
+    MelodicVoice(ThreadData& data, const PhaseGrid& grid);
+
+    /**
+     * Applies one observation of the thread's scheduling state
+     * 
+     * @param currentTick Current musical position in ticks
+     * @param isScheduled Whether the thread is currently scheduled
+     */
+    void update(int currentTick, bool isScheduled);
+
+    /**
+     * Applies one observation at a beat published by the conductor
+     * 
+     * @param beat Current tick and phase
+     * @param isScheduled Whether the thread is currently scheduled
+     */
+    void update(const Beat& beat, bool isScheduled);
+
+    /**
+     * Returns the next tick at which the voice changes on its own
+     * (current note ends or the next phase begins), assuming the
+     * scheduling state does not change
+     * 
+     * @return Tick of the next internal transition
+     */
+    int nextTransitionTick() const;
+
+    /**
+     * Ends any sounding note and writes the final marker
+     * 
+     * @param lastTick Last tick observed by the caller
+     */
+    void finish(int lastTick);
+
+    bool isScheduled() const { return wasScheduled; }
+
+private:
+    void advance(int currentTick, int newPhase, int nextPhaseTick, bool isScheduled);
+    void startNote(int tick);
+
+    ThreadData& data;
+    EventBuffer& events;
+    PhaseGrid grid;
+
+    bool wasScheduled = false;
+    bool noteIsOn = false;
+    int currentNote = -1;
+    int noteStartTick = 0;
+    int noteDuration = 0;
+    int currentPhase = -1;
+};
+
+/**
+ * Plays a melodic voice from exact scheduling edges
+ * 
+ * The voice starts scheduled at tick 0. Between edges the voice is advanced
+ * through its own note and phase transitions, so the result matches what
+ * a sampling loop with infinitely fine resolution would produce.
+ * 
+ * @param voice Voice to drive
+ * @param edges Scheduling edges in nanoseconds since the start, in time order
+ * @param grid Phase layout (defines where the piece ends)
+ */
+void playScheduleEdges(MelodicVoice& voice, const std::vector<SchedEdge>& edges, const PhaseGrid& grid);
+
+/**
+ * DrumVoice: Step sequencer for the drum thread
+ * 
+ * Plays the phase drum pattern one grid step at a time, on the same
+ * bar-aligned phase grid as the melodic voices. Used by the drum thread
+ * and by trace-driven rendering.
+ */
+class DrumVoice {
+public:
+    /**
+     * @param data Drum thread configuration
+     * @param grid Phase layout shared with the melodic voices
+     */
+    DrumVoice(ThreadData& data, const PhaseGrid& grid);
+
+    /**
+     * Plays one grid step, marking a phase change first if it starts one
+     * 
+     * @param step Step number (steps may be skipped, but not replayed)
+     */
+    void playStep(long long step);
+
+    /**
+     * Writes the final marker
+     */
+    void finish();
+
+    long long getStepNs() const { return stepNs; }     // Wall-clock length of one step
+    long long getStepCount() const { return stepCount; } // Steps that start before the end
+
+private:
+    ThreadData& data;
+    EventBuffer& events;
+    PhaseGrid grid;
+    int ticksPerStep;
+    long long stepNs;
+    long long stepCount;
+    int currentPhase = -1;
+    int currentTick = 0;
+};
+
+/**
+ * Plays a drum voice from a recorded timeline of missed steps
+ * 
+ * Steps that start inside an off interval of the timeline are skipped,
+ * exactly as the drum thread skipped them when they were recorded.
+ * 
+ * @param voice Voice to drive
+ * @param edges Off/on edges in nanoseconds since the start, in time order
+ */
+void playDrumSchedule(DrumVoice& voice, const std::vector<SchedEdge>& edges);
+
+#endif // THREAD_MUSIC_VOICE_H
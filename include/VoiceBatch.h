@@ -0,0 +1,103 @@
+#ifndef THREAD_MUSIC_VOICE_BATCH_H
+#define THREAD_MUSIC_VOICE_BATCH_H
+
+#include <cstdint>
+#include <vector>
+#include "Types.h"
+#include "Voice.h"
+
+/**
+ * VoiceBatch: Many melodic voices advanced together in vector lanes
+ * 
+ * Holds the note state of every voice as structure-of-arrays lanes, and
+ * the notes of their snippet tables in one flat table. An update applies
+ * one tick and each voice's own scheduling state to its lane the way
+ * MelodicVoice::update() does: phase changes are handled voice by voice,
+ * and everything else (note ends, phase-boundary clamping, scheduling
+ * changes and the next-note lookup) is one branch-free pass over all
+ * lanes, with AVX2 where the CPU has it.
+ * The pass writes its note events as lane arrays, which are then copied
+ * into each voice's event buffer.
+ * 
+ * A batch is single-writer: only one thread may update it at a time.
+ */
+class VoiceBatch {
+public:
+    /**
+     * @param voices Melodic thread configurations (snippet cursors are written back on finish)
+     * @param grid Phase layout shared by all voices
+     */
+    VoiceBatch(const std::vector<ThreadData*>& voices, const PhaseGrid& grid);
+
+    /**
+     * Applies one observation to every voice of the batch
+     * 
+     * @param currentTick Current musical position in ticks
+     * @param isScheduled Whether each voice is currently scheduled (nonzero), one entry per voice
+     */
+    void update(int currentTick, const std::vector<unsigned char>& isScheduled);
+
+    /**
+     * Ends any sounding notes and writes the final markers
+     * 
+     * @param lastTick Last tick observed by the caller
+     */
+    void finish(int lastTick);
+
+    int size() const { return count; }
+    const std::vector<ThreadData*>& getVoices() const { return voices; }
+
+    /**
+     * Returns the instruction set of the lane pass
+     * 
+     * @return "avx2" or "scalar"
+     */
+    static const char* variant();
+
+    /**
+     * Selects the instruction set of the lane pass, so a check can compare them
+     * 
+     * Call before any batch is updated; batches are not synchronized with it
+     * 
+     * @param avx2 True for AVX2, false for the scalar pass
+     * @return False if AVX2 was requested and the CPU does not support it
+     */
+    static bool selectVariant(bool avx2);
+
+private:
+    void changePhase(int lane, int newPhase);
+    void emit();
+
+    std::vector<ThreadData*> voices;
+    PhaseGrid grid;
+    int count;  // Voices
+    int padded; // Lanes, a multiple of the vector width
+
+    // Flat snippet notes of every voice; tableBase[lane] is where the voice's table starts
+    std::vector<int32_t> pitchTable;
+    std::vector<int32_t> velocityTable;
+    std::vector<int32_t> durationTable;
+    std::vector<int> tableBase;
+    int currentPhase = -1; // Shared by every voice, since they all see the same ticks
+
+    // Lane state; flags are 0 or -1 so they can be used as vector masks
+    std::vector<int32_t> scheduled;     // Observed state of the current update; 0 in padding lanes
+    std::vector<int32_t> wasScheduled;
+    std::vector<int32_t> noteIsOn;
+    std::vector<int32_t> currentNote;
+    std::vector<int32_t> noteStartTick;
+    std::vector<int32_t> noteDuration;
+    std::vector<int32_t> snippetBase;   // First note of the current snippet in the flat table
+    std::vector<int32_t> snippetLength; // 0 when the phase has no snippet
+    std::vector<int32_t> cursor;        // Next note, relative to snippetBase
+
+    // Events written by the last lane pass
+    std::vector<int32_t> offTick;
+    std::vector<int32_t> offNote;
+    std::vector<int32_t> onTick;
+    std::vector<int32_t> onVelocity;
+    std::vector<int32_t> eventFlags;
+    std::vector<unsigned char> blockActive; // Whether any lane of each vector block has events
+};
+
+#endif // THREAD_MUSIC_VOICE_BATCH_H
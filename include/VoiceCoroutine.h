@@ -0,0 +1,104 @@
+#ifndef THREAD_MUSIC_VOICE_COROUTINE_H
+#define THREAD_MUSIC_VOICE_COROUTINE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Types.h"
+#include "Voice.h"
+
+// VoiceEngine: How melodic voices are driven
+enum class VoiceEngine {
+    Thread,    // A loop per voice (one OS thread, pool step, or render call)
+    Coroutine, // A C++20 coroutine per voice, resumed on edges and timer expiries
+    Batch      // Pool voices advanced together in vector lanes (see VoiceBatch.h)
+};
+
+/**
+ * Parses a voice engine name from the command line
+ * 
+ * @param name "thread", "coroutine", or "batch"
+ * @param engine Receives the engine
+ * @return True if the name was recognized
+ */
+bool parseVoiceEngine(const std::string& name, VoiceEngine& engine);
+
+/**
+ * Returns whether this build has the coroutine engine (needs C++20)
+ * 
+ * @return False when built without coroutine support; the coroutine
+ *         functions below then run the thread engine instead
+ */
+bool coroutineEngineAvailable();
+
+// CoroutineStats: Cost of driving voices as coroutines
+struct CoroutineStats {
+    long long voices = 0;       // Coroutines created
+    long long resumes = 0;      // Times a coroutine was resumed
+    std::size_t frameBytes = 0; // Heap bytes of all coroutine frames
+};
+
+/**
+ * Renders melodic voices from scheduling edges on a single event loop
+ * 
+ * Every voice is a coroutine that sleeps until its next scheduling edge or
+ * its next note or phase transition, whichever comes first; the loop
+ * resumes voices in tick order. The events match playScheduleEdges().
+ * 
+ * @param voices Melodic thread configurations
+ * @param edges Scheduling edges of each voice, in nanoseconds since the start
+ * @param grid Phase layout shared by all melodic voices
+ * @return Coroutine counts and frame memory
+ */
+CoroutineStats renderWithCoroutines(const std::vector<ThreadData*>& voices,
+                                    const std::vector<const std::vector<SchedEdge>*>& edges,
+                                    const PhaseGrid& grid);
+
+/**
+ * CoroutineVoice: Melodic voice whose state lives in a suspended coroutine
+ * 
+ * Each update() resumes the coroutine with one observation; it applies the
+ * melodic note logic and suspends again. Used by pool mode, where a voice
+ * only exists between the steps that resume it.
+ */
+class CoroutineVoice {
+public:
+    /**
+     * @param data Thread configuration (snippets are advanced in place)
+     * @param grid Phase layout shared by all melodic threads
+     */
+    CoroutineVoice(ThreadData& data, const PhaseGrid& grid);
+    ~CoroutineVoice();
+
+    CoroutineVoice(const CoroutineVoice&) = delete;
+    CoroutineVoice& operator=(const CoroutineVoice&) = delete;
+
+    /**
+     * Resumes the voice with one observation of its scheduling state
+     * 
+     * @param currentTick Current musical position in ticks
+     * @param isScheduled Whether the voice is currently scheduled
+     */
+    void update(int currentTick, bool isScheduled);
+
+    /**
+     * Resumes the voice for the last time, ending its note and writing the final marker
+     * 
+     * @param lastTick Last tick observed by the caller
+     */
+    void finish(int lastTick);
+
+    /**
+     * Returns the heap bytes of all coroutine voice frames created so far
+     * 
+     * @return Total frame bytes (0 without coroutine support)
+     */
+    static std::size_t totalFrameBytes();
+
+private:
+    struct State;
+    std::unique_ptr<State> state;
+};
+
+#endif // THREAD_MUSIC_VOICE_COROUTINE_H
@@ -0,0 +1,64 @@
+#ifndef THREAD_MUSIC_VOICE_POOL_H
+#define THREAD_MUSIC_VOICE_POOL_H
+
+#include <vector>
+#include "Histogram.h"
+#include "Types.h"
+#include "VoiceCoroutine.h"
+
+class Conductor; // Defined in Conductor.h
+
+// PoolStats: How the task scheduler distributed voice steps
+struct PoolStats {
+    long long steps = 0;      // Voice steps run
+    long long lateSteps = 0;  // Steps that started too late and were played as descheduled
+    long long migrations = 0; // Steps run on another worker than the voice's previous step
+    long long steals = 0;     // Steps taken from another worker's deque
+    Histogram queueDelayNs;   // Due time to start of each step
+    Histogram queueDepth;     // Waiting steps, sampled by the dispatcher
+};
+
+/**
+ * VoicePool: Runs many melodic voices as tasks on a few worker threads
+ * 
+ * Each voice step is one iteration of the melodic loop (voice update, busy
+ * work), after which the voice is due again THREAD_SLEEP_MS later. The
+ * caller's thread acts as a dispatcher: it hands due voices to the worker
+ * that ran them last, and idle workers steal them (see ThreadPool). A step
+ * that starts more than POOL_LATE_THRESHOLD_US after its due time is played
+ * as if the voice had been descheduled from its due time until it ran, so
+ * the music follows how the task scheduler, not the OS, distributes work.
+ * With the batch engine, POOL_BATCH_VOICES voices share one task: it runs
+ * one busy-work slice per member, in an order that rotates every step, so
+ * each member starts late by its own wait. Every member keeps its own
+ * scheduled state, mute and minimum-state hold, and one VoiceBatch update
+ * then advances all their notes with that per-member mask.
+ */
+class VoicePool {
+public:
+    /**
+     * @param workerCount Worker threads (0 or less uses every hardware thread)
+     * @param timerMode Sleeping strategy of the dispatcher
+     * @param engine How each voice keeps its note state between steps
+     */
+    VoicePool(int workerCount, TimerMode timerMode, VoiceEngine engine = VoiceEngine::Thread);
+
+    /**
+     * Plays the voices until the piece ends, then writes their final events
+     * 
+     * @param voices Melodic thread configurations (events, counters and timelines are used)
+     * @param conductor Shared tick clock and phase grid
+     */
+    void run(const std::vector<ThreadData*>& voices, Conductor& conductor);
+
+    int getWorkerCount() const { return workerCount; }
+    const PoolStats& getStats() const { return stats; }
+
+private:
+    int workerCount;
+    TimerMode timerMode;
+    VoiceEngine engine;
+    PoolStats stats;
+};
+
+#endif // THREAD_MUSIC_VOICE_POOL_H
@@ -0,0 +1,146 @@
+#ifndef THREAD_MUSIC_WORKLOAD_H
+#define THREAD_MUSIC_WORKLOAD_H
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Types.h"
+
+/**
+ * Parses a workload name from the command line
+ * 
+ * @param name "sincos", "stream", "chase", "fma", "syscall", or "lock"
+ * @param kind Receives the parsed kind
+ * @return True if the name was recognized
+ */
+bool parseWorkloadKind(const std::string& name, WorkloadKind& kind);
+
+/**
+ * Returns the command-line name of a workload kind
+ * 
+ * @param kind Workload kind
+ * @return Name accepted by parseWorkloadKind()
+ */
+const char* workloadKindName(WorkloadKind kind);
+
+/**
+ * WorkloadSelection: Kernel the running threads switch to, set at run time
+ * 
+ * publish() stores a kernel and its calibrated rate under a new
+ * generation; threads compare the generation once per loop (see
+ * Workload::follow()), so a selection costs one relaxed load until it
+ * changes.
+ */
+class WorkloadSelection {
+public:
+    /**
+     * Publishes a kernel for every thread to switch to
+     * 
+     * @param kind Kernel to run
+     * @param iterationsPerUs Calibrated rate of the kernel (see Workload::calibrate())
+     */
+    void publish(WorkloadKind kind, double iterationsPerUs);
+
+    /**
+     * Reads the published kernel
+     * 
+     * @param kind Receives the kernel
+     * @param iterationsPerUs Receives its rate
+     * @return Generation of the selection (0 = nothing published)
+     */
+    unsigned read(WorkloadKind& kind, double& iterationsPerUs) const;
+
+    unsigned getGeneration() const { return generation.load(std::memory_order_acquire); }
+
+private:
+    mutable std::mutex mutex;
+    std::atomic<unsigned> generation{0};
+    WorkloadKind kind = WorkloadKind::SinCos;
+    double iterationsPerUs = 0;
+};
+
+/**
+ * Workload: One thread's instance of a busy-work kernel
+ * 
+ * Owns the kernel's working set (buffers, pointer-chase cycle), so each
+ * thread should construct its own. Work is requested in microseconds and
+ * converted to iterations with a rate measured by calibrate().
+ */
+class Workload {
+public:
+    /**
+     * Allocates the working set for a kernel
+     * 
+     * @param kind Kernel to run
+     * @param iterationsPerUs Calibrated rate (see calibrate())
+     * @param counters Optional counters receiving busy time and mutex wait time
+     */
+    Workload(WorkloadKind kind, double iterationsPerUs, ThreadCounters* counters = nullptr);
+
+    /**
+     * Runs the kernel for roughly the given time
+     * 
+     * @param targetUs Target duration in microseconds when uncontended
+     */
+    void runFor(int targetUs);
+
+    /**
+     * Runs a fixed number of kernel iterations
+     * 
+     * @param iterations Iteration count (the unit of work differs per kernel)
+     */
+    void run(long long iterations);
+
+    /**
+     * Sends busy and wait time to other counters (pool workers run many voices)
+     * 
+     * @param target Counters of the voice being run, or nullptr
+     */
+    void setCounters(ThreadCounters* target) { counters = target; }
+
+    /**
+     * Switches to the kernel last published to a selection, if it changed
+     * 
+     * Rebuilds the working set, so it only allocates when the kernel changes
+     * 
+     * @param selection Published kernel and rate
+     * @return True if the kernel was switched
+     */
+    bool follow(const WorkloadSelection& selection);
+
+    WorkloadKind getKind() const { return kind; }
+
+    /**
+     * Measures how many iterations of a kernel fit in one microsecond
+     * 
+     * Runs on the calling thread for about WORKLOAD_CALIBRATION_MS,
+     * so call it before the music threads start.
+     * 
+     * @param kind Kernel to measure
+     * @return Iterations per microsecond
+     */
+    static double calibrate(WorkloadKind kind);
+
+    /**
+     * Returns the FMA instruction set selected on this CPU
+     * 
+     * @return "avx512", "avx2", or "scalar"
+     */
+    static const char* fmaVariant();
+
+private:
+    WorkloadKind kind;
+    double iterationsPerUs;
+    ThreadCounters* counters;
+    std::vector<double> streamA;       // Stream destination
+    std::vector<double> streamB;       // Stream source
+    std::size_t streamCursor = 0;
+    std::vector<std::size_t> chaseNext; // chaseNext[i] is the next slot, one cache line apart
+    std::size_t chaseCursor = 0;
+    double sink = 0;                   // Keeps kernel results observable
+    unsigned selectionGeneration = 0;  // Last selection followed
+};
+
+#endif // THREAD_MUSIC_WORKLOAD_H
@@ -5,18 +5,47 @@
 #include <cmath>
 #include <algorithm>
 #include <ctime>
+#include <memory>
+#include <map>
+#include <random>
+#include <chrono>
 #include "external/midifile/include/MidiFile.h"
 #include "external/midifile/include/Options.h"
 #include "include/Constants.h"
 #include "include/Types.h"
 #include "include/Utils.h"
 #include "include/MusicGeneration.h"
+#include "include/MidiOutput.h"
+#include "include/EventExport.h"
+#include "include/SchedTrace.h"
+#include "include/Detector.h"
+#include "include/Voice.h"
+#include "include/Conductor.h"
+#include "include/Timing.h"
+#include "include/MidiStream.h"
+#include "include/Affinity.h"
+#include "include/Priority.h"
+#include "include/Workload.h"
+#include "include/Bench.h"
+#include "include/Counters.h"
+#include "include/ScheduleTrace.h"
+#include "include/ThreadPool.h"
+#include "include/StartGate.h"
+#include "include/LiveMidi.h"
+#include "include/ChannelAllocator.h"
+#include "include/VoicePool.h"
+#include "include/VoiceCoroutine.h"
+#include "include/VoiceBatch.h"
+#include "include/Ensemble.h"
+#include "include/AllocationCounter.h"
+#include "include/PhaseProgram.h"
+#include "include/ControlServer.h"
 
 using namespace std;
 using namespace smf;
 
-// Global MIDI file instance shared across threads
-MidiFile midifile;
+// Global MIDI files (one unless sharding by file), assembled from the thread event buffers after join
+vector<MidiFile> midifiles;
 
 int main(int argc, char* argv[]) {
     // Parse command-line options
@@ -24,8 +53,73 @@ int main(int argc, char* argv[]) {
     options.define("n|num-threads=i:4", "Number of threads to create");
     options.define("t|time=i:60", "Duration in seconds");
     options.define("p|phases=i:3", "Number of musical phases");
+    options.define("process-clock=b", "Detect scheduling with process-wide CPU time (original behavior)");
+    options.define("detector=s:legacy", "Scheduling detector: legacy (fixed CPU/wall threshold) or adaptive (hysteresis on the off-CPU time outside the sleep, minimum state length)");
+    options.define("sched-trace=b", "Trace context switches with perf instead of sampling CPU time (Linux)");
+    options.define("timer=s:sleep", "Timer engine: sleep, deadline, timerfd, or spin");
+    options.define("encoder=s:native", "Output encoder: native (direct SMF bytes, one writev) or midifile (smf::MidiFile)");
+    options.define("stream=b", "Flush finished events to disk while running instead of at the end");
+    options.define("pool=i:0", "Run the melodic voices as tasks on N worker threads (0 = one thread per voice)");
+    options.define("engine=s:thread", "Melodic voice engine for --pool and rendering: thread, coroutine, or batch (--pool only)");
+    options.define("shard=s:ports", "Threads beyond 15 melodic channels: ports (MIDI port events) or files (one file per port)");
+    options.define("agent=s", "Stream events to an ensemble collector at host:port instead of writing a file");
+    options.define("node=s", "Name of this node in the ensemble (default: host name)");
+    options.define("collect=i:0", "Run as ensemble collector on this TCP port instead of running threads");
+    options.define("nodes=i:1", "Agents the collector waits for before writing the merged file");
+    options.define("control=s", "Unix socket for live control and metrics while running (see ControlServer.h)");
+    options.define("live=s", "Also play notes in real time: alsa, coremidi, jack, null, or auto");
+    options.define("workload=s:sincos", "Busy-work kernel: sincos, stream, chase, fma, syscall, or lock");
+    options.define("bench=b", "Measure loop period, sleep overshoot and detection latency into [output].bench.json");
+    options.define("export-events=b", "Also write every recorded event as columns to [output].events.tmcol");
+    options.define("counters=b", "Write per-thread hot-path counters to [output].counters.json");
+    options.define("counters-interval=i:0", "Also snapshot the counters every N seconds (0 = only at the end)");
+    options.define("counters-midi=b", "Write counter snapshots as MIDI text events on each track");
+    options.define("seed=i:0", "Phrase generator seed (0 = random, or the recorded seed with --render-trace)");
+    options.define("program-cache=s", "Directory caching the phrases of each seed (default: ~/.cache/thread-music, none = off)");
+    options.define("record-trace=s", "Save the scheduling timeline of every thread to a binary trace file");
+    options.define("render-trace=s", "Render MIDI from a recorded trace instead of running threads");
+    options.define("render-jobs=i:0", "Worker threads for --render-trace (0 = one per CPU)");
+    options.define("pin=s:none", "CPU placement for all threads: none, spread, compact, cpu:N, l3:N, numa:N");
+    options.define("pin-drum=s", "CPU placement for the drum thread (overrides --pin)");
+    options.define("pin-bass=s", "CPU placement for bass threads (overrides --pin)");
+    options.define("pin-mid=s", "CPU placement for mid-range threads (overrides --pin)");
+    options.define("pin-lead=s", "CPU placement for lead threads (overrides --pin)");
+    options.define("priority=s:default", "OS scheduling for all threads: default, fifo:P, rr:P, batch, idle, nice:N, cgroup:NAME[:PERCENT], comma-separated");
+    options.define("priority-drum=s", "OS scheduling for the drum thread (overrides --priority)");
+    options.define("priority-bass=s", "OS scheduling for bass threads (overrides --priority)");
+    options.define("priority-mid=s", "OS scheduling for mid-range threads (overrides --priority)");
+    options.define("priority-lead=s", "OS scheduling for lead threads (overrides --priority)");
     options.process(argc, argv);
     
+    // Collector mode merges the streams of other nodes and runs no threads of its own
+    if (options.getInteger("collect") > 0) {
+        int nodeCount = max(1, options.getInteger("nodes"));
+        EnsembleCollector collector(options.getInteger("collect"));
+        if (!collector.listen()) {
+            cerr << "Could not listen on port " << options.getInteger("collect") << endl;
+            return 1;
+        }
+        cout << "Collecting from " << nodeCount << " node" << (nodeCount == 1 ? "" : "s") << " on port "
+             << options.getInteger("collect") << (ensembleCompressionAvailable() ? " (deflate)" : "") << endl;
+        collector.collect(nodeCount);
+        
+        string filename = "thread_music_ensemble_" + to_string(collector.getNodes().size()) + "nodes_" +
+                          to_string(time(nullptr)) + ".mid";
+        if (!collector.write(filename)) {
+            cerr << "Failed to write " << filename << endl;
+            return 1;
+        }
+        for (const auto& node : collector.getNodes()) {
+            cout << "Node " << node->name << ": " << node->tracks.size() << " tracks, " << node->events << " events in "
+                 << node->batches << " batches, " << node->wireBytes << " bytes on the wire (" << node->rawBytes
+                 << " encoded), clock offset " << node->clockOffsetNs / 1000.0 << " us +/- "
+                 << node->roundTripNs / 2000.0 << " us" << (node->complete ? "" : ", incomplete") << endl;
+        }
+        cout << "MIDI file " << filename << " has been created." << endl;
+        cout << "Tracks: " << collector.getTrackCount() << endl;
+        return 0;
+    }
+    
     // Extract and validate settings
     int threadCount = options.getInteger("num-threads");
     int durationSec = options.getInteger("time");
@@ -36,104 +130,369 @@ int main(int argc, char* argv[]) {
     if (durationSec <= 0) durationSec = 60;
     if (numPhases <= 0) numPhases = 3;
     
-    cout << "Creating " << threadCount << " threads for " << durationSec 
-         << " seconds with " << numPhases << " musical phases" << endl;
+    // Offline rendering takes the thread count, duration and phase count from the trace
+    string renderPath = options.getString("render-trace");
+    string recordPath = options.getString("record-trace");
+    bool render = !renderPath.empty();
+    ScheduleTrace renderTrace;
+    if (render) {
+        if (!readScheduleTrace(renderPath, renderTrace)) {
+            cerr << "Could not read scheduling trace " << renderPath << endl;
+            return 1;
+        }
+        threadCount = static_cast<int>(renderTrace.threads.size());
+        durationSec = renderTrace.durationSec;
+        
+        // The recorded phase count, unless -p asks for another
+        if (!options.getBoolean("phases") && renderTrace.numPhases > 0) numPhases = renderTrace.numPhases;
+    }
+    
+    // Recorded voices are replayed as-is unless a new seed or phase count asks for new phrases
+    bool recordedVoices = render && !renderTrace.voices.empty() && options.getInteger("seed") == 0 &&
+                          renderTrace.numPhases == numPhases;
+    
+    // Phrases are reproducible from the seed
+    unsigned int seed = static_cast<unsigned int>(options.getInteger("seed"));
+    if (seed == 0) seed = render ? renderTrace.seed : random_device{}();
+    
+    // Select the CPU clock before any thread samples it
+    setCpuClockMode(options.getBoolean("process-clock") ? CpuClockMode::Process : CpuClockMode::Thread);
     
-    // Initialize MIDI file structure
-    midifile.absoluteTicks();  // Use absolute timing
-    midifile.setTPQ(TPQ);      // Set timing resolution
+    // Timer engine used by every thread between loop iterations
+    TimerMode timerMode = TimerMode::Sleep;
+    if (!parseTimerMode(options.getString("timer"), timerMode)) {
+        cerr << "Unknown timer mode '" << options.getString("timer") << "'; using sleep" << endl;
+    }
+    
+    // Encoder of the final file (streaming and ensemble output always encode natively)
+    OutputEncoder outputEncoder = OutputEncoder::Native;
+    if (!parseOutputEncoder(options.getString("encoder"), outputEncoder)) {
+        cerr << "Unknown encoder '" << options.getString("encoder") << "'; using native" << endl;
+    }
+    
+    // Busy-work kernel, calibrated here so work is specified in microseconds on any machine
+    WorkloadKind workloadKind = WorkloadKind::SinCos;
+    if (!parseWorkloadKind(options.getString("workload"), workloadKind)) {
+        cerr << "Unknown workload '" << options.getString("workload") << "'; using sincos" << endl;
+    }
+    double workloadRate = render ? 1.0 : Workload::calibrate(workloadKind);
+    
+    // Policy that turns CPU time samples into scheduled/descheduled states
+    DetectorKind detectorKind = DetectorKind::Legacy;
+    if (!parseDetectorKind(options.getString("detector"), detectorKind)) {
+        cerr << "Unknown detector '" << options.getString("detector") << "'; using legacy" << endl;
+    }
+    // The off-CPU gap subtracts the thread's own CPU time; process-wide CPU time makes it meaningless
+    if (detectorKind == DetectorKind::Adaptive && options.getBoolean("process-clock")) {
+        cerr << "The adaptive detector needs per-thread CPU time; using legacy with --process-clock" << endl;
+        detectorKind = DetectorKind::Legacy;
+    }
     
-    // Create a track for each thread
-    for (int i = 0; i < threadCount; i++) {
-        midifile.addTrack();
+    // Kernel scheduler tracing replaces CPU time sampling in melodic threads
+    bool schedTrace = options.getBoolean("sched-trace");
+    if (schedTrace && !SchedTracer::isAvailable()) {
+        cerr << "Scheduler tracing unavailable (needs Linux perf events); falling back to sampling" << endl;
+        schedTrace = false;
     }
     
-    // Add global tempo metadata to first track
-    midifile.addTempo(0, 0, TEMPO);
-    midifile.addTimeSignature(0, 0, 4, 2, 24, 8); // 4/4 time signature
+    // Coroutine voices replace per-voice loops where voices are driven by events, not OS threads
+    VoiceEngine voiceEngine = VoiceEngine::Thread;
+    if (!parseVoiceEngine(options.getString("engine"), voiceEngine)) {
+        cerr << "Unknown voice engine '" << options.getString("engine") << "'; using thread" << endl;
+    }
+    if (voiceEngine == VoiceEngine::Coroutine && !coroutineEngineAvailable()) {
+        cerr << "Coroutine engine unavailable (built without C++20 coroutines); using thread" << endl;
+        voiceEngine = VoiceEngine::Thread;
+    }
+    if (voiceEngine == VoiceEngine::Batch && render) {
+        cerr << "The batch engine steps pooled voices on a shared clock; rendering follows each voice's own edges with the thread engine" << endl;
+        voiceEngine = VoiceEngine::Thread;
+    }
+    
+    // Pool mode multiplexes melodic voices onto a few workers; per-thread tracing does not apply
+    int poolWorkers = render ? 0 : options.getInteger("pool");
+    VoicePool voicePool(poolWorkers, timerMode, voiceEngine);
+    if (poolWorkers > 0 && schedTrace) {
+        cerr << "--sched-trace traces OS threads, not pooled voices; voices follow the pool scheduler" << endl;
+        schedTrace = false;
+    }
+    
+    if (render) {
+        cout << "Rendering " << threadCount << " threads for " << durationSec
+             << " seconds with " << numPhases << " musical phases from " << renderPath << endl;
+    } else {
+        cout << "Creating " << threadCount << " threads for " << durationSec 
+             << " seconds with " << numPhases << " musical phases" << endl;
+        cout << "Workload: " << workloadKindName(workloadKind);
+        if (workloadKind == WorkloadKind::Fma) cout << " (" << Workload::fmaVariant() << ")";
+        cout << ", " << workloadRate << " iterations/us" << endl;
+        if (poolWorkers > 0) {
+            cout << "Pool: " << threadCount - 1 << " melodic voices on " << voicePool.getWorkerCount()
+                 << " worker threads" << endl;
+        }
+    }
+    cout << "Seed: " << seed << (recordedVoices ? " (voices from the trace)" : "") << endl;
+    
+    // Every melodic thread gets its own (port, channel); ports are optionally split into files
+    ShardMode shardMode = ShardMode::Ports;
+    if (!parseShardMode(options.getString("shard"), shardMode)) {
+        cerr << "Unknown shard mode '" << options.getString("shard") << "'; using ports" << endl;
+    }
+    if (shardMode == ShardMode::Files && options.getBoolean("stream")) {
+        cerr << "--stream writes a single file; sharding by MIDI port instead" << endl;
+        shardMode = ShardMode::Ports;
+    }
+    int portCount = ChannelAllocator::portsFor(threadCount - 1);
+    int fileCount = (shardMode == ShardMode::Files) ? portCount : 1;
+    auto fileIndexFor = [&](const ThreadData& data) { return (shardMode == ShardMode::Files) ? data.port : 0; };
+    if (portCount > 1) {
+        cout << "MIDI ports: " << portCount << (fileCount > 1 ? " (one file each)" : "") << endl;
+    }
+    
+    // Startup profile: configuration setup, thread start, and time to first note
+    long long setupStartNs = getMonotonicNs();
+    
+    // Initialize MIDI file structure, with a track for each of the file's threads
+    vector<int> tracksPerFile(fileCount, 0);
+    vector<int> nextTrack(fileCount, 0);
+    tracksPerFile[0] = 1; // Drum thread
+    for (int i = 1; i < threadCount; i++) {
+        int port = (i - 1) / ChannelAllocator::MELODIC_CHANNELS_PER_PORT;
+        tracksPerFile[(shardMode == ShardMode::Files) ? port : 0]++;
+    }
+    midifiles.resize(fileCount);
+    for (int f = 0; f < fileCount; f++) {
+        midifiles[f].absoluteTicks();  // Use absolute timing
+        midifiles[f].setTPQ(TPQ);      // Set timing resolution
+        midifiles[f].addTracks(tracksPerFile[f]);
+        
+        // Add global tempo metadata to first track
+        midifiles[f].addTempo(0, 0, TEMPO);
+        midifiles[f].addTimeSignature(0, 0, 4, 2, 24, 8); // 4/4 time signature
+    }
     
     // Create thread configuration data
     vector<ThreadData> threadConfigs;
     
+    // One event buffer per thread - each is written only by its own thread
+    vector<EventBuffer> eventBuffers(threadCount);
+    
+    // Kernel thread IDs published by traced threads (0 until known)
+    vector<atomic<long>> threadIds(threadCount);
+    
     // Set up the dedicated drum thread (always thread 0)
     ThreadData drumThread;
     drumThread.id = 0;
-    drumThread.track = 0;
-    drumThread.channel = 9; // Channel 9 (10 in user interfaces) is reserved for percussion in MIDI
+    drumThread.track = nextTrack[0]++;
+    drumThread.port = ChannelAllocator::drum().port;
+    drumThread.channel = ChannelAllocator::drum().channel; // Channel 9 (10 in user interfaces) is reserved for percussion in MIDI
     drumThread.instrument = 0; // Instrument number not used for percussion channel
     drumThread.isDrumThread = true;
+    drumThread.role = VoiceRole::Drum;
+    drumThread.events = &eventBuffers[0];
+    drumThread.timerMode = timerMode;
+    drumThread.workload = workloadKind;
+    drumThread.workloadRate = workloadRate;
+    
+    // Drum steps are scheduled against deadlines, so their wake-up lateness is reported
+    TimingStats drumTiming;
+    drumTiming.latenessNs.reserve(estimateEventCapacity(drumThread, durationSec, numPhases) / 6);
+    drumThread.timing = &drumTiming;
+    
+    // Phrases and patterns come from the seed's phase program; reproducible seeds are cached across runs
+    PhaseProgram program(seed);
+    string programCache = options.getString("program-cache");
+    if (programCache.empty()) programCache = PhaseProgram::defaultCacheDirectory();
+    bool reproducible = options.getInteger("seed") != 0 || render;
+    if (programCache == "none" || !reproducible) programCache.clear();
+    if (!programCache.empty()) program.load(programCache);
     
     // Create drum patterns for each phase
     for (int phase = 0; phase < numPhases; phase++) {
-        drumThread.drumPatterns.push_back(generateDrumPattern(phase));
+        drumThread.drumPatterns.push_back(program.drumPattern(phase));
     }
     
     threadConfigs.push_back(drumThread);
     
     // Set up melodic threads with different registers and roles
+    ChannelAllocator channels;
     for (int i = 1; i < threadCount; i++) {
         ThreadData config;
         config.id = i;
-        config.track = i;
-        config.channel = (i - 1) % 15 + 1; // Spread across channels 1-16, skipping 10 (percussion)
-        if (config.channel == 9) config.channel = 16; // Skip percussion channel
+        MidiAddress address = channels.next();
+        config.port = address.port;
+        config.channel = address.channel;
+        config.track = nextTrack[fileIndexFor(config)]++;
         config.isDrumThread = false;
+        config.events = &eventBuffers[i];
+        config.osTid = &threadIds[i];
+        config.timerMode = timerMode;
+        config.workload = workloadKind;
+        config.workloadRate = workloadRate;
+        config.detector = detectorKind;
+        config.snippets.reserve(numPhases, numPhases * SNIPPET_MAX_NOTES);
         
-        // Assign instrument role and snippets based on thread ID
+        // Assign instrument role based on thread ID
         if (i % 3 == 1) {
             // Bass instruments - provide harmonic foundation
+            config.role = VoiceRole::Bass;
             config.instrument = 32 + (i % 8); // Various bass instruments
-            // Generate snippets for each phase with bass-specific patterns
-            for (int phase = 0; phase < numPhases; phase++) {
-                const vector<int>& scale = (phase % 2 == 0) ? MAJOR_SCALE : MINOR_SCALE;
-                int rootNote = PHASE_ROOTS[phase % PHASE_ROOTS.size()];
-                config.snippets.push_back(generateSnippet(BASS_LOW, BASS_HIGH, scale, rootNote, true));
-            }
         } else if (i % 3 == 2) {
             // Mid-range instruments - provide harmonic context
+            config.role = VoiceRole::Mid;
             config.instrument = 16 + (i % 8); // Various organ/guitar instruments
-            // Generate snippets for each phase with mid-range patterns
-            for (int phase = 0; phase < numPhases; phase++) {
-                const vector<int>& scale = (phase % 3 == 0) ? MAJOR_SCALE : 
-                                         (phase % 3 == 1) ? MINOR_SCALE : PENTA_SCALE;
-                int rootNote = PHASE_ROOTS[phase % PHASE_ROOTS.size()];
-                config.snippets.push_back(generateSnippet(MID_LOW, MID_HIGH, scale, rootNote, false));
-            }
         } else {
             // High-range instruments - provide melodic interest
+            config.role = VoiceRole::Lead;
             config.instrument = 80 + (i % 8); // Various lead instruments
-            // Generate snippets for each phase with lead patterns
-            for (int phase = 0; phase < numPhases; phase++) {
-                const vector<int>& scale = (phase % 3 == 0) ? PENTA_SCALE : 
-                                         (phase % 3 == 1) ? MAJOR_SCALE : MINOR_SCALE;
-                int rootNote = PHASE_ROOTS[phase % PHASE_ROOTS.size()];
-                config.snippets.push_back(generateSnippet(HIGH_LOW, HIGH_HIGH, scale, rootNote, false));
-            }
+        }
+        
+        if (recordedVoices) {
+            // Channels always come from the allocator, so they stay unique
+            const TraceVoice& voice = renderTrace.voices[i];
+            config.instrument = voice.instrument;
+            config.role = voice.role;
+            config.snippets = voice.snippets;
         }
         
         threadConfigs.push_back(config);
         
         // Set instrument for this track (Program Change message)
-        midifile.addPatchChange(config.track, 0, config.channel, config.instrument);
+        midifiles[fileIndexFor(config)].addPatchChange(config.track, 0, config.channel, config.instrument);
     }
     
-    // Create and launch threads
-    vector<thread> threads;
-    for (const auto& config : threadConfigs) {
-        if (config.isDrumThread) {
-            threads.emplace_back(drumThreadFunction, config, durationSec, numPhases);
-        } else {
-            threads.emplace_back(melodicThreadFunction, config, durationSec, numPhases);
+    // Phrases and event storage are built per thread in parallel; each task touches only its own thread
+    int setupJobs = max(1, min(threadCount, static_cast<int>(thread::hardware_concurrency())));
+    {
+        ThreadPool setup(setupJobs);
+        for (auto& config : threadConfigs) {
+            ThreadData* data = &config;
+            setup.submit([&program, data, recordedVoices, durationSec, numPhases]() {
+                // One snippet per phase, with patterns that suit the role
+                for (int phase = 0; phase < numPhases && !data->isDrumThread && !recordedVoices; phase++) {
+                    program.appendSnippet(data->snippets, data->id, data->role, phase);
+                }
+                
+                // Preallocate event storage so the playback loops never reallocate
+                data->events->reserve(estimateEventCapacity(*data, durationSec, numPhases));
+            });
         }
+        setup.wait();
     }
     
-    // Wait for all threads to complete
-    for (auto& t : threads) {
-        t.join();
+    if (!programCache.empty() && !program.save(programCache)) {
+        cerr << "Could not update the phrase cache in " << programCache << endl;
+    }
+    cout << "Phase program: " << program.getCachedCount() << " cached, " << program.getGeneratedCount()
+         << " generated" << (programCache.empty() ? "" : " (" + programCache + ")") << endl;
+    
+    // Assign CPUs per role; each thread pins itself when it starts
+    AffinityPolicy defaultPolicy;
+    if (!parseAffinityPolicy(options.getString("pin"), defaultPolicy)) {
+        cerr << "Unknown placement '" << options.getString("pin") << "'; leaving threads unpinned" << endl;
+    }
+    map<VoiceRole, AffinityPolicy> rolePolicies;
+    for (VoiceRole role : {VoiceRole::Drum, VoiceRole::Bass, VoiceRole::Mid, VoiceRole::Lead}) {
+        string optionName = string("pin-") + voiceRoleName(role);
+        string text = options.getString(optionName);
+        rolePolicies[role] = defaultPolicy;
+        if (!text.empty() && !parseAffinityPolicy(text, rolePolicies[role])) {
+            cerr << "Unknown placement '" << text << "' for --" << optionName << "; using --pin" << endl;
+            rolePolicies[role] = defaultPolicy;
+        }
+    }
+    AffinityPlanner planner(detectCpuTopology());
+    for (auto& config : threadConfigs) {
+        config.cpu = planner.assign(rolePolicies[config.role]);
+        if (config.cpu < 0 && rolePolicies[config.role].kind != AffinityPolicy::None) {
+            cerr << "No usable CPU for thread " << config.id << " (" << voiceRoleName(config.role)
+                 << "); leaving it unpinned" << endl;
+        }
     }
     
-    // Ensure MIDI events are in chronological order
-    midifile.sortTracks();
+    // Scheduling policy per role; each thread applies its own when it starts
+    SchedPolicy defaultSched;
+    if (!parseSchedPolicy(options.getString("priority"), defaultSched)) {
+        cerr << "Unknown scheduling policy '" << options.getString("priority") << "'; using default" << endl;
+    }
+    map<VoiceRole, SchedPolicy> roleSched;
+    for (VoiceRole role : {VoiceRole::Drum, VoiceRole::Bass, VoiceRole::Mid, VoiceRole::Lead}) {
+        string optionName = string("priority-") + voiceRoleName(role);
+        string text = options.getString(optionName);
+        roleSched[role] = defaultSched;
+        if (!text.empty() && !parseSchedPolicy(text, roleSched[role])) {
+            cerr << "Unknown scheduling policy '" << text << "' for --" << optionName << "; using --priority" << endl;
+            roleSched[role] = defaultSched;
+        }
+        if (poolWorkers > 0 && role != VoiceRole::Drum && isCustomSchedPolicy(roleSched[role])) {
+            cerr << "--" << optionName << " applies to voice threads; pooled voices run on the pool workers" << endl;
+            roleSched[role] = SchedPolicy();
+        }
+        string error;
+        if (!render && !roleSched[role].cgroup.empty() && !prepareCgroup(roleSched[role], error)) {
+            cerr << "cgroup " << roleSched[role].cgroup << " for " << voiceRoleName(role) << " threads: " << error
+                 << "; leaving them in the current cgroup" << endl;
+            roleSched[role].cgroup.clear();
+            roleSched[role].cpuQuotaPercent = 0;
+        }
+    }
+    bool customSched = false;
+    for (auto& config : threadConfigs) {
+        if (render) break;
+        config.sched = &roleSched[config.role];
+        customSched = customSched || isCustomSchedPolicy(roleSched[config.role]);
+    }
+    if (customSched) {
+        cout << "Scheduling:";
+        for (VoiceRole role : {VoiceRole::Drum, VoiceRole::Bass, VoiceRole::Mid, VoiceRole::Lead}) {
+            cout << " " << voiceRoleName(role) << " " << schedPolicyName(roleSched[role])
+                 << (role == VoiceRole::Lead ? "" : ",");
+        }
+        cout << endl;
+    }
+    
+    // Benchmark probes; ground truth comes from the tracer when it is available
+    bool bench = options.getBoolean("bench") && !render;
+    if (bench && poolWorkers > 0) {
+        cerr << "--bench measures one thread per voice; disabled with --pool" << endl;
+        bench = false;
+    }
+    vector<BenchProbe> benchProbes(bench ? threadCount : 0);
+    vector<ThreadCounters> threadCounters(threadCount);
+    for (auto& config : threadConfigs) {
+        if (bench) config.bench = &benchProbes[config.id];
+        config.counters = &threadCounters[config.id];
+    }
+    bool traceMelodic = !render && (schedTrace || (bench && SchedTracer::isAvailable()));
+    
+    // Scheduling timelines for --record-trace (melodic threads record detector changes)
+    // The file is written as the piece plays, so the control server's flush can save it early
+    vector<ScheduleTimeline> timelines(recordPath.empty() || render ? 0 : threadCount);
+    ScheduleTraceRecorder traceRecorder;
+    if (!timelines.empty()) {
+        ScheduleTrace header;
+        header.durationSec = durationSec;
+        header.numPhases = numPhases;
+        header.seed = seed;
+        header.kernelTraced = schedTrace;
+        for (const auto& config : threadConfigs) {
+            TraceVoice voice;
+            voice.channel = config.channel;
+            voice.instrument = config.instrument;
+            voice.role = config.role;
+            voice.snippets = config.snippets;
+            header.voices.push_back(voice);
+        }
+        if (!traceRecorder.open(recordPath, header, timelines)) {
+            cerr << "Failed to create scheduling trace " << recordPath << "; not recording" << endl;
+            timelines.clear();
+        }
+    }
+    for (auto& config : threadConfigs) {
+        if (timelines.empty() || (schedTrace && !config.isDrumThread)) continue;
+        timelines[config.id].reserve(1024);
+        config.timeline = &timelines[config.id];
+    }
     
     // Use current timestamp as unique identifier
     time_t timeNow = time(nullptr);
@@ -142,10 +501,519 @@ int main(int argc, char* argv[]) {
     string filename = "thread_music_" + to_string(threadCount) + "threads_" + 
                       to_string(durationSec) + "sec_" + to_string(numPhases) + "phases_" + 
                       to_string(timeNow) + ".mid";
-    midifile.write(filename);
+    vector<string> filenames(1, filename);
+    if (fileCount > 1) {
+        // Shards are named after the port they hold
+        filenames.clear();
+        string stem = filename.substr(0, filename.size() - 4);
+        for (int f = 0; f < fileCount; f++) {
+            filenames.push_back(stem + "_port" + to_string(f) + ".mid");
+        }
+    }
+    
+    // Ensemble agents send their events to a collector instead of writing a file
+    unique_ptr<EnsembleAgent> agent;
+    if (!options.getString("agent").empty()) {
+        agent.reset(new EnsembleAgent(options.getString("agent"), options.getString("node")));
+        if (agent->connect()) {
+            for (const auto& config : threadConfigs) {
+                agent->addThread(config);
+            }
+            const EnsembleStats& sync = agent->getStats();
+            cout << "Ensemble agent: collector " << agent->getAddress() << ", clock offset "
+                 << sync.clockOffsetNs / 1000.0 << " us +/- " << sync.roundTripNs / 2000.0 << " us"
+                 << (agent->isCompressing() ? ", deflate" : "") << endl;
+        } else {
+            cerr << "Ensemble collector unreachable; writing a local file instead" << endl;
+            agent.reset();
+        }
+    }
+    if (agent && options.getBoolean("stream")) {
+        cerr << "--stream is not used with --agent; events are streamed to the collector" << endl;
+    }
     
-    cout << "MIDI file " << filename << " has been created." << endl;
-    cout << "Tracks: " << midifile.getTrackCount() << endl;
+    // Columnar event export, filled by whichever stage drains the event buffers
+    unique_ptr<EventExport> eventExport;
+    if (options.getBoolean("export-events")) {
+        if (agent) {
+            cerr << "--export-events is not used with --agent; events are streamed to the collector" << endl;
+        } else {
+            eventExport.reset(new EventExport(threadConfigs));
+            for (const auto& config : threadConfigs) {
+                eventExport->reserve(config.id, estimateEventCapacity(config, durationSec, numPhases));
+            }
+        }
+    }
+    
+    // Streaming output writes tracks to spool files while the threads run
+    unique_ptr<StreamingMidiWriter> streamWriter;
+    if (options.getBoolean("stream") && !agent) {
+        streamWriter.reset(new StreamingMidiWriter(filename, midifiles[0].getTrackCount()));
+        if (streamWriter->open()) {
+            streamWriter->trackEncoder(0).tempo(0, TEMPO);
+            streamWriter->trackEncoder(0).timeSignature(0, 4, 2, 24, 8); // 4/4 time signature
+            for (const auto& config : threadConfigs) {
+                streamWriter->addThread(config);
+            }
+            streamWriter->setExport(eventExport.get());
+            streamWriter->start(STREAM_FLUSH_INTERVAL_MS);
+        } else {
+            cerr << "Could not create spool files for " << filename << "; writing at the end instead" << endl;
+            streamWriter.reset();
+        }
+    }
+    
+    // Real-time playback; threads only ever try to enqueue, so a slow backend cannot stall them
+    unique_ptr<LiveMidiOutput> liveOutput;
+    string liveName = options.getString("live");
+    if (!liveName.empty() && render) {
+        cerr << "--live is not supported with --render-trace; rendering to file only" << endl;
+    } else if (!liveName.empty()) {
+        unique_ptr<LiveMidiBackend> backend = openLiveMidiBackend(liveName, "thread-music");
+        if (backend) {
+            liveOutput.reset(new LiveMidiOutput(move(backend), timerMode));
+            for (auto& config : threadConfigs) {
+                // Kernel-traced melodic notes only exist after the run, so only the drum plays live then
+                if (schedTrace && !config.isDrumThread) continue;
+                config.events->setLiveOutput(&liveOutput->queue());
+                if (!config.isDrumThread) liveOutput->programChange(config.channel, config.instrument);
+            }
+            liveOutput->start();
+            cout << "Live MIDI output: " << liveOutput->backendName() << endl;
+            if (portCount > 1) {
+                cerr << "Live output has a single port; threads on ports 1 and up share its channels" << endl;
+            }
+        } else {
+            cerr << "Live MIDI backend '" << liveName << "' is unavailable (this build has: "
+                 << liveMidiBackendNames() << "); writing to file only" << endl;
+        }
+    }
+    
+    // One tick clock and phase grid for every voice; tick 0 is the moment the start gate opens
+    Conductor conductor(computePhaseGrid(durationSec, numPhases));
+    long long setupEndNs = getMonotonicNs();
+    
+    // Create the threads; each sets itself up and waits at the start gate
+    vector<thread> threads;
+    vector<ThreadData*> pooledVoices;
+    StartGate startGate(render ? 0 : (poolWorkers > 0 ? 1 : threadCount));
+    long long readyNs = setupEndNs;
+    if (!render) {
+        for (auto& config : threadConfigs) {
+            config.startGate = &startGate;
+            if (config.isDrumThread) {
+                threads.emplace_back(drumThreadFunction, config, &conductor);
+            } else if (poolWorkers > 0) {
+                pooledVoices.push_back(&config);
+            } else if (schedTrace) {
+                threads.emplace_back(tracedMelodicThreadFunction, config, &conductor);
+            } else {
+                threads.emplace_back(melodicThreadFunction, config, &conductor);
+            }
+        }
+        readyNs = startGate.waitForArrivals();
+    }
+    
+    // Attach the tracer to each melodic thread; every thread published its ID before arriving
+    SchedTracer tracer(readyNs);
+    vector<int> traceStreams(threadCount, -1);
+    if (traceMelodic) {
+        for (const auto& config : threadConfigs) {
+            if (config.isDrumThread || config.osTid->load() == 0) continue; // Pooled voices have no thread
+            traceStreams[config.id] = tracer.attach(config.osTid->load());
+            if (traceStreams[config.id] < 0) {
+                cerr << "Could not trace thread " << config.id << "; it will stay silent" << endl;
+            }
+        }
+    }
+    
+    // Tick 0 is the moment the gate opens; tracing, benchmark and counter times are relative to it
+    long long launchNs = getMonotonicNs();
+    conductor.start(launchNs);
+    tracer.setOrigin(launchNs);
+    for (auto& probe : benchProbes) {
+        probe.originNs = launchNs;
+    }
+    long long openNs = getMonotonicNs();
+    startGate.open();
+    
+    // Everything else starts once the voices play; attached threads are traced from the start
+    if (traceMelodic) tracer.start();
+    if (agent) agent->start(launchNs, ENSEMBLE_BATCH_INTERVAL_MS);
+    
+    // Counter snapshots; the final one is always taken after the threads finish
+    bool countersJson = options.getBoolean("counters");
+    bool countersMidi = options.getBoolean("counters-midi");
+    if (countersMidi && streamWriter) {
+        cerr << "--counters-midi is not supported with --stream; skipping counter text events" << endl;
+        countersMidi = false;
+    }
+    if (countersMidi && agent) {
+        cerr << "--counters-midi is not supported with --agent; skipping counter text events" << endl;
+        countersMidi = false;
+    }
+    CounterRecorder counterRecorder(threadCounters, launchNs);
+    if (countersJson || countersMidi) {
+        counterRecorder.start(options.getInteger("counters-interval"));
+    }
+    
+    // Control plane for long sessions, served from its own thread
+    unique_ptr<ControlServer> control;
+    string controlPath = options.getString("control");
+    if (!controlPath.empty() && render) {
+        cerr << "--control is not supported with --render-trace; ignoring it" << endl;
+    } else if (!controlPath.empty()) {
+        ControlTarget target;
+        target.threads = &threadConfigs;
+        target.counters = &threadCounters;
+        target.conductor = &conductor;
+        target.stream = streamWriter.get();
+        target.trace = traceRecorder.isOpen() ? &traceRecorder : nullptr;
+        target.workload = workloadKind;
+        control.reset(new ControlServer(controlPath, target));
+        string error;
+        if (control->open(error)) {
+            control->start();
+            cout << "Control socket: " << controlPath << endl;
+        } else {
+            cerr << "Could not open the control socket (" << error << "); running without it" << endl;
+            control.reset();
+        }
+    }
+    
+    long long joinedNs = 0;
+    if (render) {
+        // Re-render every thread from its recorded timeline, as fast as the CPU allows.
+        // One task per track keeps each event buffer single-writer; tracks merge below.
+        const PhaseGrid& grid = conductor.getGrid();
+        auto renderStart = chrono::steady_clock::now();
+        ThreadPool pool(min(options.getInteger("render-jobs") > 0 ? options.getInteger("render-jobs")
+                                                                  : static_cast<int>(thread::hardware_concurrency()),
+                            threadCount));
+        vector<ThreadData*> coroutineVoices;
+        vector<const vector<SchedEdge>*> coroutineEdges;
+        for (auto& config : threadConfigs) {
+            ThreadData* data = &config;
+            const vector<SchedEdge>* edges = &renderTrace.threads[config.id];
+            if (!data->isDrumThread && voiceEngine == VoiceEngine::Coroutine) {
+                coroutineVoices.push_back(data);
+                coroutineEdges.push_back(edges);
+                continue;
+            }
+            pool.submit([data, edges, &grid]() {
+                if (data->isDrumThread) {
+                    DrumVoice voice(*data, grid);
+                    playDrumSchedule(voice, *edges);
+                } else {
+                    MelodicVoice voice(*data, grid);
+                    playScheduleEdges(voice, *edges, grid);
+                }
+            });
+        }
+        
+        // Coroutine voices share one event loop on this thread while the pool plays the rest
+        CoroutineStats coroutineStats;
+        if (!coroutineVoices.empty()) {
+            coroutineStats = renderWithCoroutines(coroutineVoices, coroutineEdges, grid);
+        }
+        pool.wait();
+        double renderMs = chrono::duration<double, milli>(chrono::steady_clock::now() - renderStart).count();
+        cout << "Rendered " << threadCount << " tracks on " << pool.size() << " workers in "
+             << renderMs << " ms (" << pool.getStealCount() << " steals)" << endl;
+        if (voiceEngine == VoiceEngine::Coroutine) {
+            cout << "Coroutine engine: " << coroutineStats.voices << " voices, "
+                 << (coroutineStats.voices > 0 ? coroutineStats.frameBytes / coroutineStats.voices : 0)
+                 << " bytes per frame, " << coroutineStats.resumes << " resumes" << endl;
+        }
+        counterRecorder.stop();
+    } else {
+        // Pooled voices play on this thread's dispatcher until the piece ends
+        if (poolWorkers > 0) {
+            voicePool.run(pooledVoices, conductor);
+        }
+    
+        // Wait for all threads to complete
+        for (auto& t : threads) {
+            t.join();
+        }
+        joinedNs = getMonotonicNs();
+        if (control) control->stop();
+        if (liveOutput) liveOutput->stop();
+        counterRecorder.stop();
+        string cgroupError;
+        if (!removeCgroups(cgroupError)) {
+            cerr << "Leaving cgroups in place: " << cgroupError << endl;
+        }
+    
+        if (traceMelodic) {
+            tracer.stop();
+            if (tracer.lostRecords() > 0) {
+                cerr << "Scheduler tracing lost " << tracer.lostRecords() << " records" << endl;
+            }
+        }
+    
+        // Render traced threads from their exact scheduling edges
+        if (schedTrace) {
+            const PhaseGrid& grid = conductor.getGrid();
+            for (auto& config : threadConfigs) {
+                if (config.isDrumThread || traceStreams[config.id] < 0) continue;
+                MelodicVoice voice(config, grid);
+                playScheduleEdges(voice, tracer.edgesFor(traceStreams[config.id]), grid);
+            }
+        }
+    }
+    
+    // Finish the timelines so the run can be rendered again offline; kernel edges are only complete now
+    if (traceRecorder.isOpen()) {
+        for (const auto& config : threadConfigs) {
+            if (schedTrace && !config.isDrumThread && traceStreams[config.id] >= 0) {
+                traceRecorder.appendEdges(config.id, tracer.edgesFor(traceStreams[config.id]));
+            }
+        }
+        if (traceRecorder.close()) {
+            cout << "Scheduling trace " << recordPath << " has been created." << endl;
+        } else {
+            cerr << "Failed to write scheduling trace " << recordPath << endl;
+        }
+    }
+    
+    int trackCount = 0;
+    for (const auto& file : midifiles) {
+        trackCount += file.getTrackCount();
+    }
+    long long allocationsBeforeWrite = processAllocationCount();
+    long long writeStartNs = getMonotonicNs();
+    atomic<long long> fileWriteNs(0); // Time in the file writes alone, summed over files
+    if (agent) {
+        // Send the remaining events; the collector writes the merged file
+        bool delivered = agent->stop();
+        filenames.clear();
+        const EnsembleStats& sent = agent->getStats();
+        cout << "Ensemble: " << sent.events << " events in " << sent.batches << " batches, " << sent.wireBytes
+             << " bytes on the wire (" << sent.rawBytes << " encoded)" << (delivered ? "" : ", delivery failed") << endl;
+    } else if (streamWriter) {
+        // Write the remaining events and assemble the spools
+        streamWriter->stop();
+        if (!streamWriter->finish()) {
+            cerr << "Failed to assemble " << filename << " from its spool files" << endl;
+            return 1;
+        }
+        if (streamWriter->getClampedCount() > 0) {
+            cerr << "Warning: " << streamWriter->getClampedCount()
+                 << " events were recorded out of order after a flush and moved to a later tick" << endl;
+        }
+    } else {
+        // Fill and write one file; files share no state, so shards are written in parallel
+        auto writeNative = [&](int f) {
+            SmfFileWriter writer(midifiles[f].getTrackCount());
+            writer.trackEncoder(0).tempo(0, TEMPO);
+            writer.trackEncoder(0).timeSignature(0, 4, 2, 24, 8); // 4/4 time signature
+            for (const auto& config : threadConfigs) {
+                if (fileIndexFor(config) != f) continue;
+                writer.reserve(config.track, estimateEventCapacity(config, durationSec, numPhases) * SMF_BYTES_PER_EVENT);
+                
+                // Counter snapshots as text events at the time they were taken
+                vector<pair<int, string>> texts;
+                if (countersMidi) {
+                    for (const auto& snapshot : counterRecorder.getSnapshots()) {
+                        texts.emplace_back(ticksFromNanoseconds(snapshot.timeNs), formatCounters(snapshot.threads[config.id]));
+                    }
+                }
+                if (config.events->outOfOrderCount() > 0) {
+                    cerr << "Warning: thread " << config.id << " recorded " << config.events->outOfOrderCount()
+                         << " events out of order; sorting its track before encoding" << endl;
+                }
+                writer.appendThread(config, *config.events, texts, eventExport.get());
+            }
+            long long startNs = getMonotonicNs();
+            if (!writer.write(filenames[f])) {
+                cerr << "Failed to write " << filenames[f] << endl;
+            }
+            fileWriteNs += getMonotonicNs() - startNs;
+        };
+        auto writeFile = [&](int f) {
+            if (outputEncoder == OutputEncoder::Native) {
+                writeNative(f);
+                return;
+            }
+            MidiFile& output = midifiles[f];
+            bool ordered = !countersMidi;
+            for (const auto& config : threadConfigs) {
+                if (fileIndexFor(config) != f) continue;
+                
+                // Merge the thread's events into its track
+                appendEventBuffer(output, config, *config.events, eventExport.get());
+                ordered = ordered && config.events->outOfOrderCount() == 0;
+                
+                // Counter snapshots as text events at the time they were taken
+                if (countersMidi) {
+                    for (const auto& snapshot : counterRecorder.getSnapshots()) {
+                        output.addText(config.track, ticksFromNanoseconds(snapshot.timeNs),
+                                       formatCounters(snapshot.threads[config.id]));
+                    }
+                }
+            }
+            
+            // Buffers record in tick order, so a full sort is only needed if one did not
+            if (!ordered) {
+                output.sortTracks();
+            }
+            long long startNs = getMonotonicNs();
+            output.write(filenames[f]);
+            fileWriteNs += getMonotonicNs() - startNs;
+        };
+        if (fileCount == 1) {
+            writeFile(0);
+        } else {
+            ThreadPool writers(min(fileCount, static_cast<int>(thread::hardware_concurrency())));
+            for (int f = 0; f < fileCount; f++) {
+                writers.submit([&writeFile, f]() { writeFile(f); });
+            }
+            writers.wait();
+        }
+    }
+    
+    long long writeNs = getMonotonicNs() - writeStartNs;
+    long long writeAllocations = processAllocationCount() - allocationsBeforeWrite;
+    
+    for (const auto& name : filenames) {
+        cout << "MIDI file " << name << " has been created." << endl;
+    }
+    cout << "Tracks: " << trackCount << endl;
+    if (!agent && !streamWriter) {
+        cout << "Output (" << outputEncoderName(outputEncoder) << "): written in " << writeNs / 1000000.0 << " ms" << endl;
+    }
+    if (!render) {
+        // Time to first note is measured from the clock origin; traced melodic notes are placed afterwards
+        Histogram firstNoteNs;
+        int lastThread = -1;
+        long long lastFirstNs = -1;
+        for (const auto& config : threadConfigs) {
+            if (schedTrace && !config.isDrumThread) continue;
+            long long firstNs = config.events->firstNoteNs();
+            if (firstNs < 0) continue;
+            firstNoteNs.record(firstNs);
+            if (firstNs > lastFirstNs) {
+                lastFirstNs = firstNs;
+                lastThread = config.id;
+            }
+        }
+        cout << "Startup: configuration " << (setupEndNs - setupStartNs) / 1000000.0 << " ms on " << setupJobs
+             << " jobs, threads ready in " << (readyNs - setupEndNs) / 1000000.0 << " ms, gate opened "
+             << (openNs - launchNs) / 1000.0 << " us after tick 0";
+        if (lastThread >= 0) {
+            cout << ", first note p50 " << firstNoteNs.percentile(0.5) / 1000.0 << " us, max "
+                 << lastFirstNs / 1000.0 << " us (thread " << lastThread << ")";
+        }
+        cout << endl;
+        cout << "Teardown: joined " << max(0LL, joinedNs - conductor.getEndNs()) / 1000000.0 << " ms after the end, ";
+        if (!agent && !streamWriter) {
+            cout << "encode " << (writeNs - fileWriteNs.load()) / 1000000.0 << " ms, write "
+                 << fileWriteNs.load() / 1000000.0 << " ms" << endl;
+        } else {
+            cout << "output " << writeNs / 1000000.0 << " ms" << endl;
+        }
+        cout << "Drum timing (" << timerModeName(timerMode) << "): " << drumTiming.summary() << endl;
+    }
+    if (poolWorkers > 0) {
+        const PoolStats& pool = voicePool.getStats();
+        cout << "Pool scheduling: " << pool.steps << " steps, " << pool.lateSteps << " late, "
+             << pool.steals << " steals, " << pool.migrations << " migrations, queue delay p50 "
+             << pool.queueDelayNs.percentile(0.5) / 1000.0 << " us, p99 " << pool.queueDelayNs.percentile(0.99) / 1000.0
+             << " us, queue depth p50 " << pool.queueDepth.percentile(0.5) << ", max " << pool.queueDepth.max() << endl;
+        if (voiceEngine == VoiceEngine::Coroutine && threadCount > 1) {
+            cout << "Coroutine engine: " << threadCount - 1 << " voices, "
+                 << CoroutineVoice::totalFrameBytes() / (threadCount - 1) << " bytes per frame, "
+                 << pool.steps << " resumes" << endl;
+        }
+        if (voiceEngine == VoiceEngine::Batch && threadCount > 1) {
+            cout << "Batch engine: " << threadCount - 1 << " voices in "
+                 << (threadCount - 2) / static_cast<int>(POOL_BATCH_VOICES) + 1 << " batches ("
+                 << VoiceBatch::variant() << " lanes)" << endl;
+        }
+    }
+    if (liveOutput) {
+        const Histogram& lateness = liveOutput->getLateness();
+        cout << "Live MIDI (" << liveOutput->backendName() << "): " << liveOutput->getSentCount() << " sent, "
+             << liveOutput->getDroppedCount() << " dropped, p99 lateness "
+             << lateness.percentile(0.99) / 1000.0 << " us, max " << lateness.max() / 1000.0 << " us" << endl;
+    }
+    
+    // Run totals, so a sparse or dense result can be explained
+    CounterValues totals = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    for (const auto& counters : threadCounters) {
+        CounterValues values = readCounters(counters);
+        totals.loops += values.loops;
+        totals.transitions += values.transitions;
+        totals.notesStarted += values.notesStarted;
+        totals.notesTruncated += values.notesTruncated;
+        totals.mutexWaitNs += values.mutexWaitNs;
+        totals.busyNs += values.busyNs;
+        totals.allocations += values.allocations;
+        totals.detectorChanges += values.detectorChanges;
+        totals.legacyChanges += values.legacyChanges;
+        totals.adaptiveChanges += values.adaptiveChanges;
+    }
+    cout << "Counters: " << formatCounters(totals) << endl;
+    if (totals.legacyChanges > 0 || totals.adaptiveChanges > 0) {
+        long long saved = totals.legacyChanges - totals.adaptiveChanges;
+        cout << "Detector (" << detectorKindName(detectorKind) << "): " << totals.detectorChanges
+             << " scheduling changes; on the same samples legacy made " << totals.legacyChanges << " and adaptive "
+             << totals.adaptiveChanges << " (" << (saved >= 0 ? saved : -saved) << (saved >= 0 ? " fewer" : " more")
+             << " than legacy)" << endl;
+    }
+    size_t overflowBlocks = 0;
+    for (const auto& config : threadConfigs) {
+        overflowBlocks += config.events->overflowBlockCount();
+    }
+    cout << "Allocations: " << totals.allocations << " in playing loops (" << overflowBlocks
+         << " event blocks beyond the reservation), " << writeAllocations << " while writing output" << endl;
+    if (bench) {
+        Histogram recordNs;
+        for (const auto& probe : benchProbes) {
+            recordNs.merge(probe.recordNs);
+        }
+        cout << "Recording section: p50 " << recordNs.percentile(0.5) << " ns, p99 " << recordNs.percentile(0.99)
+             << " ns, max " << recordNs.max() << " ns" << endl;
+    }
+    if (eventExport) {
+        string exportFile = filename + ".events.tmcol";
+        if (eventExport->write(exportFile)) {
+            cout << "Event export " << exportFile << " has been created (" << eventExport->rowCount() << " events"
+                 << (eventExportCompressionAvailable() ? ", deflate" : "") << ")." << endl;
+        } else {
+            cerr << "Failed to write event export " << exportFile << endl;
+        }
+    }
+    if (countersJson) {
+        string countersFile = filename + ".counters.json";
+        if (counterRecorder.writeJson(countersFile, threadConfigs)) {
+            cout << "Counter report " << countersFile << " has been created." << endl;
+        } else {
+            cerr << "Failed to write counter report " << countersFile << endl;
+        }
+    }
+    
+    // Score the detector against ground truth and write the benchmark report
+    if (bench) {
+        vector<BenchThreadInfo> benchThreads;
+        for (const auto& config : threadConfigs) {
+            BenchProbe& probe = benchProbes[config.id];
+            if (!config.isDrumThread) {
+                bool traced = traceMelodic && traceStreams[config.id] >= 0;
+                probe.computeDetectionLatency(traced ? tracer.edgesFor(traceStreams[config.id]) : probe.cpuClockEdges);
+            }
+            benchThreads.push_back({config.id, config.role, &probe});
+        }
+        BenchRunInfo run = {threadCount, durationSec, timerModeName(timerMode), workloadKindName(workloadKind),
+                            traceMelodic ? "sched-trace" : "thread-cpu-clock"};
+        string benchFile = filename + ".bench.json";
+        if (writeBenchReport(benchFile, run, benchThreads)) {
+            cout << "Benchmark report " << benchFile << " has been created." << endl;
+        } else {
+            cerr << "Failed to write benchmark report " << benchFile << endl;
+        }
+    }
     
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,44 @@
+#include "../../include/ChannelAllocator.h"
+
+// Melodic channels in allocation order: the historical 1-8 and 10-15, then 0
+static const int MELODIC_CHANNELS[ChannelAllocator::MELODIC_CHANNELS_PER_PORT] = {
+    1, 2, 3, 4, 5, 6, 7, 8, 10, 11, 12, 13, 14, 15, 0
+};
+
+/**
+ * Parses a shard mode from the command line
+ * 
+ * @param text "ports" or "files"
+ * @param mode Receives the mode
+ * @return True if the text was recognized
+ */
+bool parseShardMode(const std::string& text, ShardMode& mode) {
+    if (text == "ports") mode = ShardMode::Ports;
+    else if (text == "files") mode = ShardMode::Files;
+    else return false;
+    return true;
+}
+
+/**
+ * Returns the number of ports needed for a number of melodic threads
+ * 
+ * @param melodicThreads Number of melodic threads
+ * @return At least 1
+ */
+int ChannelAllocator::portsFor(int melodicThreads) {
+    if (melodicThreads <= 0) return 1;
+    return (melodicThreads + MELODIC_CHANNELS_PER_PORT - 1) / MELODIC_CHANNELS_PER_PORT;
+}
+
+/**
+ * Assigns the next free address
+ * 
+ * @return Address not handed out before
+ */
+MidiAddress ChannelAllocator::next() {
+    MidiAddress address;
+    address.port = allocated / MELODIC_CHANNELS_PER_PORT;
+    address.channel = MELODIC_CHANNELS[allocated % MELODIC_CHANNELS_PER_PORT];
+    allocated++;
+    return address;
+}
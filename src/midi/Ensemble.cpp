@@ -0,0 +1,743 @@
+#include "../../include/Ensemble.h"
+#include "../../include/ChannelAllocator.h"
+#include "../../include/Constants.h"
+#include "../../include/MidiOutput.h"
+#include "../../include/SmfEncoder.h"
+#include "../../include/Utils.h"
+#include "../../include/Voice.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifdef THREAD_MUSIC_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+// Wire protocol: frames of a 1-byte type, a 4-byte little-endian length, and a payload
+enum FrameType : unsigned char {
+    FRAME_WELCOME = 1,  // Collector to agent: protocol version, capability flags
+    FRAME_SYNC_REQUEST, // Agent send time
+    FRAME_SYNC_REPLY,   // Agent send time, collector receive and send times
+    FRAME_HELLO,        // Node name, launch time, clock estimate, track descriptions
+    FRAME_BATCH,        // Flags, raw length, then (possibly deflated) per-track events
+    FRAME_END           // Total events sent
+};
+
+static const unsigned char PROTOCOL_VERSION = 1;
+static const unsigned char FLAG_DEFLATE = 0x01;
+static const std::size_t FRAME_HEADER_BYTES = 5;
+static const std::size_t MAX_FRAME_BYTES = 64 << 20;
+
+/**
+ * Appends an unsigned LEB128 varint
+ * 
+ * @param out Destination bytes
+ * @param value Value to encode
+ */
+static void putVarint(std::vector<unsigned char>& out, unsigned long long value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+/**
+ * Appends a signed value as a zigzag varint
+ * 
+ * @param out Destination bytes
+ * @param value Value to encode
+ */
+static void putSigned(std::vector<unsigned char>& out, long long value) {
+    putVarint(out, (static_cast<unsigned long long>(value) << 1) ^ static_cast<unsigned long long>(value >> 63));
+}
+
+/**
+ * Appends a length-prefixed string
+ * 
+ * @param out Destination bytes
+ * @param text String to encode
+ */
+static void putString(std::vector<unsigned char>& out, const std::string& text) {
+    putVarint(out, text.size());
+    out.insert(out.end(), text.begin(), text.end());
+}
+
+// PayloadReader: Bounds-checked decoding of a received payload
+class PayloadReader {
+public:
+    PayloadReader(const unsigned char* data, std::size_t size) : data(data), size(size) {}
+
+    bool byte(unsigned char& value) {
+        if (position >= size) return fail();
+        value = data[position++];
+        return true;
+    }
+
+    bool varint(unsigned long long& value) {
+        value = 0;
+        for (int shift = 0; shift < 64 && position < size; shift += 7) {
+            unsigned char byte = data[position++];
+            value |= static_cast<unsigned long long>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) return true;
+        }
+        return fail();
+    }
+
+    bool signedVarint(long long& value) {
+        unsigned long long raw;
+        if (!varint(raw)) return false;
+        value = static_cast<long long>(raw >> 1) ^ -static_cast<long long>(raw & 1);
+        return true;
+    }
+
+    bool string(std::string& text) {
+        unsigned long long length;
+        if (!varint(length)) return false;
+        if (length > size - position) return fail();
+        text.assign(reinterpret_cast<const char*>(data + position), length);
+        position += length;
+        return true;
+    }
+
+    bool atEnd() const { return position >= size; }
+    std::size_t offset() const { return position; }
+
+private:
+    bool fail() {
+        failed = true;
+        return false;
+    }
+
+    const unsigned char* data;
+    std::size_t size;
+    std::size_t position = 0;
+    bool failed = false;
+};
+
+/**
+ * Writes all bytes to a socket
+ * 
+ * @param fd Connected socket
+ * @param data Bytes to write
+ * @param size Number of bytes
+ * @return False if the connection failed
+ */
+static bool writeAll(int fd, const unsigned char* data, std::size_t size) {
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL; // A closed peer is reported as an error, not SIGPIPE
+#else
+    const int flags = 0;
+#endif
+    while (size > 0) {
+        ssize_t written = ::send(fd, data, size, flags);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        data += written;
+        size -= static_cast<std::size_t>(written);
+    }
+    return true;
+}
+
+/**
+ * Reads exactly the requested number of bytes from a socket
+ * 
+ * @param fd Connected socket
+ * @param data Destination
+ * @param size Number of bytes
+ * @return False at end of stream or on error
+ */
+static bool readAll(int fd, unsigned char* data, std::size_t size) {
+    while (size > 0) {
+        ssize_t got = ::recv(fd, data, size, 0);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        data += got;
+        size -= static_cast<std::size_t>(got);
+    }
+    return true;
+}
+
+/**
+ * Sends one frame
+ * 
+ * @param fd Connected socket
+ * @param type Frame type
+ * @param payload Frame payload
+ * @return Bytes written including the header, or 0 on failure
+ */
+static std::size_t writeFrame(int fd, int type, const std::vector<unsigned char>& payload) {
+    unsigned char header[FRAME_HEADER_BYTES] = {static_cast<unsigned char>(type)};
+    for (int i = 0; i < 4; i++) {
+        header[1 + i] = static_cast<unsigned char>(payload.size() >> (8 * i));
+    }
+    if (!writeAll(fd, header, sizeof(header)) || !writeAll(fd, payload.data(), payload.size())) return 0;
+    return sizeof(header) + payload.size();
+}
+
+/**
+ * Receives one frame
+ * 
+ * @param fd Connected socket
+ * @param type Receives the frame type
+ * @param payload Receives the payload
+ * @return Bytes read including the header, or 0 at end of stream or on error
+ */
+static std::size_t readFrame(int fd, int& type, std::vector<unsigned char>& payload) {
+    unsigned char header[FRAME_HEADER_BYTES];
+    if (!readAll(fd, header, sizeof(header))) return 0;
+    std::size_t length = 0;
+    for (int i = 0; i < 4; i++) {
+        length |= static_cast<std::size_t>(header[1 + i]) << (8 * i);
+    }
+    if (length > MAX_FRAME_BYTES) return 0;
+    type = header[0];
+    payload.resize(length);
+    if (!readAll(fd, payload.data(), length)) return 0;
+    return sizeof(header) + length;
+}
+
+bool ensembleCompressionAvailable() {
+#ifdef THREAD_MUSIC_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @param address Collector as host:port
+ * @param nodeName Name of this node in the merged file (empty uses the host name)
+ */
+EnsembleAgent::EnsembleAgent(const std::string& address, const std::string& nodeName)
+    : address(address), nodeName(nodeName) {
+    if (this->nodeName.empty()) {
+        char hostname[256] = "unknown";
+        gethostname(hostname, sizeof(hostname) - 1);
+        this->nodeName = hostname;
+    }
+}
+
+EnsembleAgent::~EnsembleAgent() {
+    if (sending) {
+        sending = false;
+        sender.join();
+    }
+    if (socketFd >= 0) ::close(socketFd);
+}
+
+/**
+ * Connects to the collector and estimates the clock offset
+ * 
+ * @return True on success
+ */
+bool EnsembleAgent::connect() {
+    std::size_t colon = address.rfind(':');
+    if (colon == std::string::npos || colon == 0) {
+        std::cerr << "Collector address '" << address << "' must be host:port" << std::endl;
+        return false;
+    }
+    std::string host = address.substr(0, colon);
+    std::string service = address.substr(colon + 1);
+
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* results = nullptr;
+    if (getaddrinfo(host.c_str(), service.c_str(), &hints, &results) != 0) {
+        std::cerr << "Could not resolve collector " << address << std::endl;
+        return false;
+    }
+    for (addrinfo* candidate = results; candidate && socketFd < 0; candidate = candidate->ai_next) {
+        socketFd = ::socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+        if (socketFd < 0) continue;
+        if (::connect(socketFd, candidate->ai_addr, candidate->ai_addrlen) != 0) {
+            ::close(socketFd);
+            socketFd = -1;
+        }
+    }
+    freeaddrinfo(results);
+    if (socketFd < 0) {
+        std::cerr << "Could not connect to collector " << address << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Sync replies must not wait behind Nagle's algorithm
+    int noDelay = 1;
+    setsockopt(socketFd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+#ifdef SO_NOSIGPIPE
+    int noSigPipe = 1;
+    setsockopt(socketFd, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+#endif
+
+    int type = 0;
+    std::vector<unsigned char> payload;
+    if (!receiveFrame(type, payload) || type != FRAME_WELCOME || payload.size() < 2 || payload[0] != PROTOCOL_VERSION) {
+        std::cerr << "Collector " << address << " did not answer with a known protocol version" << std::endl;
+        return false;
+    }
+    compress = (payload[1] & FLAG_DEFLATE) && ensembleCompressionAvailable();
+
+    // NTP-style offset: the exchange with the shortest round trip has the least queueing error
+    stats.roundTripNs = LLONG_MAX;
+    for (int round = 0; round < ENSEMBLE_SYNC_ROUNDS; round++) {
+        std::vector<unsigned char> request;
+        long long sentNs = getMonotonicNs();
+        putVarint(request, static_cast<unsigned long long>(sentNs));
+        if (!sendFrame(FRAME_SYNC_REQUEST, request) || !receiveFrame(type, payload) || type != FRAME_SYNC_REPLY) {
+            std::cerr << "Clock sync with collector " << address << " failed" << std::endl;
+            return false;
+        }
+        long long receivedNs = getMonotonicNs();
+
+        PayloadReader reply(payload.data(), payload.size());
+        unsigned long long echoed, collectorReceived, collectorSent;
+        if (!reply.varint(echoed) || !reply.varint(collectorReceived) || !reply.varint(collectorSent)) return false;
+        long long roundTrip = (receivedNs - sentNs) - static_cast<long long>(collectorSent - collectorReceived);
+        if (roundTrip < stats.roundTripNs) {
+            stats.roundTripNs = roundTrip;
+            stats.clockOffsetNs = ((static_cast<long long>(collectorReceived) - sentNs) +
+                                   (static_cast<long long>(collectorSent) - receivedNs)) / 2;
+        }
+    }
+    return true;
+}
+
+/**
+ * Registers a thread as the event source of one remote track
+ * 
+ * @param data Thread configuration data (events must outlive the agent)
+ */
+void EnsembleAgent::addThread(const ThreadData& data) {
+    Track track;
+    track.source = data.events;
+    track.isDrum = data.isDrumThread;
+    track.instrument = data.instrument;
+    track.name = trackNameFor(data);
+    track.endMarkerText = END_MARKER_TEXT;
+    tracks.push_back(track);
+}
+
+/**
+ * Announces the node and starts sending batches
+ * 
+ * @param launchNs Monotonic time the threads were launched at (tick 0)
+ * @param intervalMs Time between batches in milliseconds
+ */
+void EnsembleAgent::start(long long launchNs, int intervalMs) {
+    if (sending || socketFd < 0) return;
+
+    std::vector<unsigned char> hello;
+    putString(hello, nodeName);
+    putSigned(hello, launchNs + stats.clockOffsetNs);
+    putSigned(hello, stats.clockOffsetNs);
+    putVarint(hello, static_cast<unsigned long long>(stats.roundTripNs));
+    putVarint(hello, TPQ);
+    putVarint(hello, tracks.size());
+    for (const Track& track : tracks) {
+        hello.push_back(track.isDrum ? 1 : 0);
+        putVarint(hello, static_cast<unsigned long long>(track.instrument));
+        putString(hello, track.name);
+        putString(hello, track.endMarkerText);
+    }
+    if (!sendFrame(FRAME_HELLO, hello)) return;
+
+    sending = true;
+    sender = std::thread(&EnsembleAgent::sendLoop, this, intervalMs);
+}
+
+/**
+ * Stops the sending thread, sends every remaining event and closes
+ * 
+ * @return True if every event reached the collector
+ */
+bool EnsembleAgent::stop() {
+    if (sending) {
+        sending = false;
+        sender.join();
+    }
+    if (socketFd < 0) return false;
+
+    sendBatch();
+    std::vector<unsigned char> end;
+    putVarint(end, static_cast<unsigned long long>(stats.events));
+    sendFrame(FRAME_END, end);
+
+    // Wait for the collector to close, so the last batch is known to be read
+    ::shutdown(socketFd, SHUT_WR);
+    unsigned char drain[64];
+    while (::recv(socketFd, drain, sizeof(drain), 0) > 0) {}
+    ::close(socketFd);
+    socketFd = -1;
+    return !failed;
+}
+
+/**
+ * Sends batches periodically until stopped
+ * 
+ * @param intervalMs Time between batches in milliseconds
+ */
+void EnsembleAgent::sendLoop(int intervalMs) {
+    auto next = std::chrono::steady_clock::now();
+    while (sending) {
+        next += std::chrono::milliseconds(intervalMs);
+        // Sleep in short slices so stop() does not wait a whole interval
+        while (sending && std::chrono::steady_clock::now() < next) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        if (sending) sendBatch();
+    }
+}
+
+/**
+ * Drains every event buffer into one batch frame
+ * 
+ * Per track with new events: track index, event count, then for each
+ * event its tick delta, type, pitch, and (note-ons only) velocity.
+ * Channels are not sent; the collector assigns them.
+ * 
+ * @return False if the batch could not be sent
+ */
+bool EnsembleAgent::sendBatch() {
+    std::vector<unsigned char> body;
+    std::vector<unsigned char> events;
+    for (std::size_t i = 0; i < tracks.size(); i++) {
+        Track& track = tracks[i];
+        events.clear();
+        std::size_t count = track.source->consume([&](const TrackEvent& event) {
+            putSigned(events, event.tick - track.lastTick);
+            track.lastTick = event.tick;
+            events.push_back(static_cast<unsigned char>(event.type));
+            putVarint(events, static_cast<unsigned long long>(event.pitch));
+            if (event.type == EventType::NoteOn) events.push_back(static_cast<unsigned char>(event.velocity));
+        });
+        if (count == 0) continue;
+        putVarint(body, i);
+        putVarint(body, count);
+        body.insert(body.end(), events.begin(), events.end());
+        stats.events += static_cast<long long>(count);
+    }
+    if (body.empty()) return true;
+
+    std::vector<unsigned char> frame;
+    unsigned char flags = 0;
+#ifdef THREAD_MUSIC_HAVE_ZLIB
+    if (compress && body.size() >= static_cast<std::size_t>(ENSEMBLE_COMPRESS_MIN_BYTES)) {
+        uLongf packedSize = compressBound(body.size());
+        std::vector<unsigned char> packed(packedSize);
+        if (compress2(packed.data(), &packedSize, body.data(), body.size(), Z_BEST_SPEED) == Z_OK &&
+            packedSize < body.size()) {
+            packed.resize(packedSize);
+            flags = FLAG_DEFLATE;
+            frame.push_back(flags);
+            putVarint(frame, body.size());
+            frame.insert(frame.end(), packed.begin(), packed.end());
+        }
+    }
+#endif
+    if (flags == 0) {
+        frame.push_back(flags);
+        putVarint(frame, body.size());
+        frame.insert(frame.end(), body.begin(), body.end());
+    }
+
+    stats.rawBytes += body.size();
+    stats.batches++;
+    return sendFrame(FRAME_BATCH, frame);
+}
+
+/**
+ * Sends one frame, reporting the first failure
+ * 
+ * @param type Frame type
+ * @param payload Frame payload
+ * @return False if the connection has failed
+ */
+bool EnsembleAgent::sendFrame(int type, const std::vector<unsigned char>& payload) {
+    if (failed) return false;
+    std::size_t written = writeFrame(socketFd, type, payload);
+    if (written == 0) {
+        std::cerr << "Lost connection to collector " << address << "; later events are not delivered" << std::endl;
+        failed = true;
+        return false;
+    }
+    stats.wireBytes += written;
+    return true;
+}
+
+/**
+ * Receives one frame from the collector
+ * 
+ * @param type Receives the frame type
+ * @param payload Receives the payload
+ * @return False at end of stream or on error
+ */
+bool EnsembleAgent::receiveFrame(int& type, std::vector<unsigned char>& payload) {
+    return readFrame(socketFd, type, payload) > 0;
+}
+
+/**
+ * @param port TCP port to listen on
+ */
+EnsembleCollector::EnsembleCollector(int port) : port(port) {}
+
+EnsembleCollector::~EnsembleCollector() {
+    if (listenFd >= 0) ::close(listenFd);
+}
+
+/**
+ * Opens the listening socket
+ * 
+ * @return True on success
+ */
+bool EnsembleCollector::listen() {
+    listenFd = ::socket(AF_INET6, SOCK_STREAM, 0);
+    bool dualStack = listenFd >= 0;
+    if (!dualStack) listenFd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0) return false;
+
+    int reuse = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    int bound;
+    if (dualStack) {
+        // Accept IPv4 agents on the IPv6 socket as well
+        int v6Only = 0;
+        setsockopt(listenFd, IPPROTO_IPV6, IPV6_V6ONLY, &v6Only, sizeof(v6Only));
+        sockaddr_in6 local;
+        std::memset(&local, 0, sizeof(local));
+        local.sin6_family = AF_INET6;
+        local.sin6_addr = in6addr_any;
+        local.sin6_port = htons(static_cast<unsigned short>(port));
+        bound = ::bind(listenFd, reinterpret_cast<sockaddr*>(&local), sizeof(local));
+    } else {
+        sockaddr_in local;
+        std::memset(&local, 0, sizeof(local));
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(INADDR_ANY);
+        local.sin_port = htons(static_cast<unsigned short>(port));
+        bound = ::bind(listenFd, reinterpret_cast<sockaddr*>(&local), sizeof(local));
+    }
+    if (bound != 0 || ::listen(listenFd, 16) != 0) {
+        ::close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Accepts agents and receives their streams until every one has ended
+ * 
+ * Each agent is served by its own thread, so a slow node does not hold
+ * back the others.
+ * 
+ * @param nodeCount Number of agents to wait for
+ */
+void EnsembleCollector::collect(int nodeCount) {
+    std::vector<std::thread> receivers;
+    while (static_cast<int>(nodes.size()) < nodeCount) {
+        int connection = ::accept(listenFd, nullptr, nullptr);
+        if (connection < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Accepting agents failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        int noDelay = 1;
+        setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        nodes.emplace_back(new EnsembleNode());
+        receivers.emplace_back(&EnsembleCollector::serve, this, connection, std::ref(*nodes.back()));
+    }
+    for (auto& receiver : receivers) {
+        receiver.join();
+    }
+}
+
+/**
+ * Receives one agent's stream
+ * 
+ * @param connection Accepted socket (closed before returning)
+ * @param node Receives the node's description and events
+ */
+void EnsembleCollector::serve(int connection, EnsembleNode& node) {
+    std::vector<unsigned char> welcome = {PROTOCOL_VERSION,
+                                          static_cast<unsigned char>(ensembleCompressionAvailable() ? FLAG_DEFLATE : 0)};
+    writeFrame(connection, FRAME_WELCOME, welcome);
+
+    std::vector<int> lastTick;
+    unsigned long long remoteTpq = TPQ;
+    int type = 0;
+    std::vector<unsigned char> payload;
+    std::vector<unsigned char> inflated;
+    bool valid = true;
+    while (valid) {
+        std::size_t frameBytes = readFrame(connection, type, payload);
+        if (frameBytes == 0) break;
+        long long receivedNs = getMonotonicNs();
+        node.wireBytes += frameBytes;
+        PayloadReader reader(payload.data(), payload.size());
+
+        if (type == FRAME_SYNC_REQUEST) {
+            unsigned long long sentNs;
+            valid = reader.varint(sentNs);
+            std::vector<unsigned char> reply;
+            putVarint(reply, sentNs);
+            putVarint(reply, static_cast<unsigned long long>(receivedNs));
+            putVarint(reply, static_cast<unsigned long long>(getMonotonicNs()));
+            valid = valid && writeFrame(connection, FRAME_SYNC_REPLY, reply) > 0;
+        } else if (type == FRAME_HELLO) {
+            unsigned long long roundTrip = 0, trackCount = 0;
+            valid = reader.string(node.name) && reader.signedVarint(node.launchNs) &&
+                    reader.signedVarint(node.clockOffsetNs) && reader.varint(roundTrip) &&
+                    reader.varint(remoteTpq) && reader.varint(trackCount) && remoteTpq > 0;
+            node.roundTripNs = static_cast<long long>(roundTrip);
+            for (unsigned long long i = 0; valid && i < trackCount; i++) {
+                RemoteTrack track;
+                unsigned char isDrum = 0;
+                unsigned long long instrument = 0;
+                valid = reader.byte(isDrum) && reader.varint(instrument) &&
+                        reader.string(track.name) && reader.string(track.endMarkerText);
+                track.isDrum = isDrum != 0;
+                track.instrument = static_cast<int>(instrument & 0x7F);
+                node.tracks.push_back(std::move(track));
+            }
+            lastTick.assign(node.tracks.size(), 0);
+        } else if (type == FRAME_BATCH) {
+            unsigned char flags = 0;
+            unsigned long long rawLength = 0;
+            valid = reader.byte(flags) && reader.varint(rawLength) && rawLength <= MAX_FRAME_BYTES;
+            const unsigned char* body = payload.data() + reader.offset();
+            std::size_t bodySize = payload.size() - reader.offset();
+            if (valid && (flags & FLAG_DEFLATE)) {
+#ifdef THREAD_MUSIC_HAVE_ZLIB
+                inflated.resize(rawLength);
+                uLongf inflatedSize = rawLength;
+                valid = uncompress(inflated.data(), &inflatedSize, body, bodySize) == Z_OK && inflatedSize == rawLength;
+                body = inflated.data();
+                bodySize = inflatedSize;
+#else
+                valid = false;
+#endif
+            }
+            node.rawBytes += bodySize;
+            node.batches++;
+
+            PayloadReader events(body, bodySize);
+            while (valid && !events.atEnd()) {
+                unsigned long long trackIndex, count;
+                valid = events.varint(trackIndex) && events.varint(count) && trackIndex < node.tracks.size();
+                for (unsigned long long i = 0; valid && i < count; i++) {
+                    long long delta;
+                    unsigned char kind;
+                    unsigned long long pitch;
+                    unsigned char velocity = 0;
+                    valid = events.signedVarint(delta) && events.byte(kind) && events.varint(pitch) &&
+                            kind <= static_cast<unsigned char>(EventType::EndMarker);
+                    if (valid && kind == static_cast<unsigned char>(EventType::NoteOn)) valid = events.byte(velocity);
+                    if (!valid) break;
+
+                    lastTick[trackIndex] += static_cast<int>(delta);
+                    TrackEvent event;
+                    event.tick = static_cast<int>(static_cast<long long>(lastTick[trackIndex]) * TPQ / static_cast<long long>(remoteTpq));
+                    event.channel = 0;
+                    event.pitch = static_cast<int>(pitch);
+                    event.velocity = velocity;
+                    event.type = static_cast<EventType>(kind);
+                    node.tracks[trackIndex].events.push_back(event);
+                    node.events++;
+                }
+            }
+        } else if (type == FRAME_END) {
+            unsigned long long sent;
+            valid = reader.varint(sent);
+            node.complete = valid && static_cast<long long>(sent) == node.events;
+            break;
+        }
+    }
+    if (!valid) {
+        std::cerr << "Malformed stream from node '" << node.name << "'; keeping the events received before it" << std::endl;
+    }
+    ::close(connection);
+}
+
+/**
+ * Writes the merged format 1 MIDI file
+ * 
+ * @param filename Output file name
+ * @return True on success
+ */
+bool EnsembleCollector::write(const std::string& filename) const {
+    // The earliest node starts at tick 0; the others are shifted by their launch offset
+    long long originNs = LLONG_MAX;
+    for (const auto& node : nodes) {
+        if (!node->tracks.empty()) originNs = std::min(originNs, node->launchNs);
+    }
+
+    std::vector<std::vector<unsigned char>> chunks;
+    int basePort = 0;
+    for (const auto& node : nodes) {
+        if (node->tracks.empty()) continue;
+        int shiftTicks = ticksFromNanoseconds(node->launchNs - originNs);
+
+        // Every node gets ports of its own, so addresses never collide across nodes
+        ChannelAllocator channels;
+        int melodicTracks = 0;
+        for (const RemoteTrack& track : node->tracks) {
+            MidiAddress address = track.isDrum ? ChannelAllocator::drum() : channels.next();
+            if (!track.isDrum) melodicTracks++;
+            address.port += basePort;
+
+            chunks.emplace_back();
+            SmfTrackEncoder encoder(chunks.back());
+            if (chunks.size() == 1) {
+                encoder.tempo(0, TEMPO);
+                encoder.timeSignature(0, 4, 2, 24, 8); // 4/4 time signature
+            }
+            encoder.trackName(0, node->name + ": " + track.name);
+            if (address.port > 0) encoder.port(0, address.port);
+            if (!track.isDrum) encoder.programChange(0, address.channel, track.instrument);
+            for (TrackEvent event : track.events) {
+                event.tick += shiftTicks;
+                event.channel = address.channel;
+                encoder.trackEvent(event, track.endMarkerText);
+            }
+            encoder.endOfTrack(encoder.lastTick());
+        }
+        basePort += ChannelAllocator::portsFor(melodicTracks);
+    }
+
+    std::FILE* out = std::fopen(filename.c_str(), "wb");
+    if (!out) return false;
+    std::vector<unsigned char> bytes;
+    writeSmfHeader(bytes, 1, static_cast<int>(chunks.size()), TPQ);
+    for (const auto& chunk : chunks) {
+        bytes.insert(bytes.end(), {'M', 'T', 'r', 'k'});
+        writeBigEndian32(bytes, static_cast<unsigned int>(chunk.size()));
+        bytes.insert(bytes.end(), chunk.begin(), chunk.end());
+    }
+    bool ok = std::fwrite(bytes.data(), 1, bytes.size(), out) == bytes.size();
+    ok = (std::fclose(out) == 0) && ok;
+    return ok;
+}
+
+/**
+ * Returns the number of tracks in the merged file
+ * 
+ * @return Tracks over all nodes
+ */
+int EnsembleCollector::getTrackCount() const {
+    int count = 0;
+    for (const auto& node : nodes) {
+        count += static_cast<int>(node->tracks.size());
+    }
+    return count;
+}
@@ -0,0 +1,107 @@
+#include "../../include/EventBuffer.h"
+#include <algorithm>
+
+EventBuffer::EventBuffer() {
+    head = tail = new Block();
+}
+
+EventBuffer::~EventBuffer() {
+    Block* block = head;
+    while (block) {
+        Block* next = block->next.load(std::memory_order_relaxed);
+        if (!inArena(block)) delete block;
+        block = next;
+    }
+    block = freeBlocks.load(std::memory_order_relaxed);
+    while (block) {
+        Block* next = block->next.load(std::memory_order_relaxed);
+        if (!inArena(block)) delete block;
+        block = next;
+    }
+    delete[] arena;
+}
+
+/**
+ * Preallocates enough blocks for a number of events
+ * 
+ * @param capacity Expected number of events
+ */
+void EventBuffer::reserve(std::size_t capacity) {
+    std::size_t blocks = (capacity + EVENT_BLOCK_SIZE - 1) / EVENT_BLOCK_SIZE;
+    if (arena || blocks <= 1) return; // The first block already exists
+
+    arenaBlocks = blocks - 1;
+    arena = new Block[arenaBlocks];
+
+    // Touch every page now rather than on the first write to it
+    const std::size_t eventsPerPage = std::max<std::size_t>(1, 4096 / sizeof(TrackEvent));
+    for (std::size_t i = arenaBlocks; i-- > 0;) {
+        for (std::size_t e = 0; e < EVENT_BLOCK_SIZE; e += eventsPerPage) {
+            arena[i].events[e] = TrackEvent();
+        }
+        recycle(&arena[i]);
+    }
+}
+
+/**
+ * Moves the writer to a fresh block once the current one is full
+ */
+void EventBuffer::advanceTail() {
+    Block* block = takeFreeBlock();
+    if (!block) {
+        block = new Block();  // Reservation exhausted
+        overflowBlocks++;
+    }
+    tail->next.store(block, std::memory_order_release);
+    tail = block;
+    tailCount = 0;
+}
+
+/**
+ * Returns a drained block to the free list
+ * 
+ * @param block Block the reader has finished with
+ */
+void EventBuffer::recycle(Block* block) {
+    block->count.store(0, std::memory_order_relaxed);
+    Block* top = freeBlocks.load(std::memory_order_relaxed);
+    do {
+        block->next.store(top, std::memory_order_relaxed);
+    } while (!freeBlocks.compare_exchange_weak(top, block, std::memory_order_release, std::memory_order_relaxed));
+}
+
+/**
+ * Pops a block from the free list
+ * 
+ * Only the writer pops, so the list cannot suffer from ABA
+ * 
+ * @return A recycled block, or nullptr if none are available
+ */
+EventBuffer::Block* EventBuffer::takeFreeBlock() {
+    Block* top = freeBlocks.load(std::memory_order_acquire);
+    while (top && !freeBlocks.compare_exchange_weak(top, top->next.load(std::memory_order_relaxed),
+                                                    std::memory_order_acquire, std::memory_order_acquire)) {
+    }
+    if (top) top->next.store(nullptr, std::memory_order_relaxed);
+    return top;
+}
+
+/**
+ * Holds a future event in the reorder window until its tick is reached
+ * 
+ * If the window is full, its earliest event is released early; that only
+ * breaks ordering if a later event lands before it (counted in outOfOrderCount)
+ * 
+ * @param event Event with a tick ahead of the thread's current position
+ */
+void EventBuffer::defer(const TrackEvent& event) {
+    if (deferredCount == REORDER_WINDOW) releaseFirstDeferred();
+
+    std::size_t position = deferredCount;
+    while (position > 0 && trackEventBefore(event, deferred[position - 1])) {
+        deferred[position] = deferred[position - 1];
+        position--;
+    }
+    deferred[position] = event;
+    deferredCount++;
+}
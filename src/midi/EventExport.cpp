@@ -0,0 +1,159 @@
+#include "../../include/EventExport.h"
+#include "../../include/Constants.h"
+#include <cstdio>
+
+#ifdef THREAD_MUSIC_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+static const char EXPORT_MAGIC[8] = {'T', 'M', 'E', 'V', 'C', 'O', 'L', '1'};
+static const unsigned int EXPORT_FLAG_DEFLATE = 1;
+
+enum ColumnCodec : unsigned char {
+    CODEC_RAW = 0,
+    CODEC_DEFLATE = 1
+};
+
+/**
+ * Appends an unsigned value as little-endian bytes
+ * 
+ * @param out Destination bytes
+ * @param value Value to encode
+ * @param bytes Number of bytes to write
+ */
+static void writeLittleEndian(std::vector<unsigned char>& out, unsigned long long value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out.push_back(static_cast<unsigned char>(value >> (8 * i)));
+    }
+}
+
+/**
+ * Appends one column: codec, raw size, stored size and the stored bytes
+ * 
+ * Deflate is used when available and it makes the column smaller
+ * 
+ * @param out Destination bytes
+ * @param raw Little-endian column values
+ */
+static void writeColumn(std::vector<unsigned char>& out, const std::vector<unsigned char>& raw) {
+#ifdef THREAD_MUSIC_HAVE_ZLIB
+    uLongf packedSize = compressBound(raw.size());
+    std::vector<unsigned char> packed(packedSize);
+    if (!raw.empty() && compress2(packed.data(), &packedSize, raw.data(), raw.size(), Z_BEST_SPEED) == Z_OK &&
+        packedSize < raw.size()) {
+        out.push_back(CODEC_DEFLATE);
+        writeLittleEndian(out, raw.size(), 4);
+        writeLittleEndian(out, packedSize, 4);
+        out.insert(out.end(), packed.begin(), packed.begin() + packedSize);
+        return;
+    }
+#endif
+    out.push_back(CODEC_RAW);
+    writeLittleEndian(out, raw.size(), 4);
+    writeLittleEndian(out, raw.size(), 4);
+    out.insert(out.end(), raw.begin(), raw.end());
+}
+
+/**
+ * Appends one fixed-width column
+ * 
+ * @param out Destination bytes
+ * @param values Column values
+ * @param raw Scratch buffer for the uncompressed column
+ */
+template <typename T>
+static void writeValues(std::vector<unsigned char>& out, const std::vector<T>& values, std::vector<unsigned char>& raw) {
+    raw.clear();
+    raw.reserve(values.size() * sizeof(T));
+    for (T value : values) {
+        writeLittleEndian(raw, static_cast<unsigned long long>(value), sizeof(T));
+    }
+    writeColumn(out, raw);
+}
+
+/**
+ * Returns whether exported columns can be deflate-compressed
+ * 
+ * @return True if built with zlib (make ZLIB=1)
+ */
+bool eventExportCompressionAvailable() {
+#ifdef THREAD_MUSIC_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @param threads Thread configurations, indexed by thread ID
+ */
+EventExport::EventExport(const std::vector<ThreadData>& threads) : groups(threads.size()) {
+    for (const ThreadData& data : threads) {
+        RowGroup& group = groups[data.id];
+        group.thread = data.id;
+        group.role = data.role;
+        group.channel = data.channel;
+    }
+}
+
+/**
+ * Reserves rows for a thread
+ * 
+ * @param thread Thread ID
+ * @param rows Expected number of events
+ */
+void EventExport::reserve(int thread, std::size_t rows) {
+    RowGroup& group = groups[thread];
+    group.tick.reserve(rows);
+    group.wallNs.reserve(rows);
+    group.cpuNs.reserve(rows);
+    group.type.reserve(rows);
+    group.pitch.reserve(rows);
+    group.velocity.reserve(rows);
+}
+
+/**
+ * Writes every row group
+ * 
+ * @param path Output file
+ * @return True if the file was written
+ */
+bool EventExport::write(const std::string& path) const {
+    std::vector<unsigned char> bytes(EXPORT_MAGIC, EXPORT_MAGIC + sizeof(EXPORT_MAGIC));
+    writeLittleEndian(bytes, groups.size(), 4);
+    writeLittleEndian(bytes, TPQ, 4);
+    writeLittleEndian(bytes, eventExportCompressionAvailable() ? EXPORT_FLAG_DEFLATE : 0, 4);
+
+    std::vector<unsigned char> raw;
+    for (const RowGroup& group : groups) {
+        writeLittleEndian(bytes, group.thread, 4);
+        writeLittleEndian(bytes, static_cast<int>(group.role), 1);
+        writeLittleEndian(bytes, group.channel, 1);
+        writeLittleEndian(bytes, group.tick.size(), 4);
+        writeValues(bytes, group.tick, raw);
+        writeValues(bytes, group.wallNs, raw);
+        writeValues(bytes, group.cpuNs, raw);
+        writeValues(bytes, group.type, raw);
+        writeValues(bytes, group.pitch, raw);
+        writeValues(bytes, group.velocity, raw);
+    }
+
+    std::FILE* out = std::fopen(path.c_str(), "wb");
+    if (!out) return false;
+    bool ok = std::fwrite(bytes.data(), 1, bytes.size(), out) == bytes.size();
+    ok = (std::fclose(out) == 0) && ok;
+    return ok;
+}
+
+/**
+ * Returns the number of exported events
+ * 
+ * @return Rows over all threads
+ */
+std::size_t EventExport::rowCount() const {
+    std::size_t rows = 0;
+    for (const RowGroup& group : groups) {
+        rows += group.tick.size();
+    }
+    return rows;
+}
@@ -0,0 +1,342 @@
+#include "../../include/LiveMidi.h"
+#include "../../include/Constants.h"
+#include "../../include/Timing.h"
+#include "../../include/Utils.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+
+#ifdef THREAD_MUSIC_HAVE_ALSA
+#include <alsa/asoundlib.h>
+#endif
+#ifdef THREAD_MUSIC_HAVE_JACK
+#include <jack/jack.h>
+#include <jack/midiport.h>
+#endif
+#ifdef __APPLE__
+#include <CoreMIDI/CoreMIDI.h>
+#endif
+
+#if defined(THREAD_MUSIC_HAVE_JACK) || defined(__APPLE__)
+/**
+ * Returns the length of a short MIDI message
+ * 
+ * @param status Status byte
+ * @return 2 for program change and channel pressure, otherwise 3
+ */
+static int messageLength(unsigned char status) {
+    unsigned char kind = status & 0xf0;
+    return (kind == 0xc0 || kind == 0xd0) ? 2 : 3;
+}
+#endif
+
+// NullMidiBackend: Accepts and discards every message (for measuring the output path)
+class NullMidiBackend : public LiveMidiBackend {
+public:
+    bool open(const std::string&) override { return true; }
+    void send(unsigned char, unsigned char, unsigned char) override {}
+    const char* name() const override { return "null"; }
+};
+
+#ifdef THREAD_MUSIC_HAVE_ALSA
+// AlsaMidiBackend: ALSA sequencer client with one readable port; events go out directly
+class AlsaMidiBackend : public LiveMidiBackend {
+public:
+    ~AlsaMidiBackend() override {
+        if (seq) snd_seq_close(seq);
+    }
+
+    bool open(const std::string& clientName) override {
+        if (snd_seq_open(&seq, "default", SND_SEQ_OPEN_OUTPUT, 0) < 0) {
+            seq = nullptr;
+            return false;
+        }
+        snd_seq_set_client_name(seq, clientName.c_str());
+        port = snd_seq_create_simple_port(seq, "out", SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ,
+                                          SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+        return port >= 0;
+    }
+
+    void send(unsigned char status, unsigned char data1, unsigned char data2) override {
+        snd_seq_event_t event;
+        snd_seq_ev_clear(&event);
+        snd_seq_ev_set_source(&event, port);
+        snd_seq_ev_set_subs(&event);
+        snd_seq_ev_set_direct(&event);
+        int channel = status & 0x0f;
+        switch (status & 0xf0) {
+            case 0x90: snd_seq_ev_set_noteon(&event, channel, data1, data2); break;
+            case 0x80: snd_seq_ev_set_noteoff(&event, channel, data1, data2); break;
+            case 0xb0: snd_seq_ev_set_controller(&event, channel, data1, data2); break;
+            case 0xc0: snd_seq_ev_set_pgmchange(&event, channel, data1); break;
+            default: return;
+        }
+        snd_seq_event_output_direct(seq, &event);
+    }
+
+    const char* name() const override { return "alsa"; }
+
+private:
+    snd_seq_t* seq = nullptr;
+    int port = -1;
+};
+#endif
+
+#ifdef THREAD_MUSIC_HAVE_JACK
+// JackMidiBackend: JACK MIDI output port; messages are handed to the process callback through a ring
+class JackMidiBackend : public LiveMidiBackend {
+public:
+    ~JackMidiBackend() override {
+        if (client) jack_client_close(client);
+    }
+
+    bool open(const std::string& clientName) override {
+        client = jack_client_open(clientName.c_str(), JackNoStartServer, nullptr);
+        if (!client) return false;
+        port = jack_port_register(client, "out", JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput, 0);
+        if (!port) return false;
+        jack_set_process_callback(client, &JackMidiBackend::process, this);
+        return jack_activate(client) == 0;
+    }
+
+    void send(unsigned char status, unsigned char data1, unsigned char data2) override {
+        outbox.tryPush({0, status, data1, data2});
+    }
+
+    const char* name() const override { return "jack"; }
+
+private:
+    // Runs on the JACK thread: writes every queued message at the start of the period
+    static int process(jack_nframes_t frames, void* arg) {
+        JackMidiBackend* self = static_cast<JackMidiBackend*>(arg);
+        void* buffer = jack_port_get_buffer(self->port, frames);
+        jack_midi_clear_buffer(buffer);
+        LiveMessage message;
+        while (self->outbox.tryPop(message)) {
+            int length = messageLength(message.status);
+            jack_midi_data_t* out = jack_midi_event_reserve(buffer, 0, length);
+            if (!out) break;
+            out[0] = message.status;
+            out[1] = message.data1;
+            if (length > 2) out[2] = message.data2;
+        }
+        return 0;
+    }
+
+    jack_client_t* client = nullptr;
+    jack_port_t* port = nullptr;
+    MidiRing outbox{LIVE_QUEUE_CAPACITY};
+};
+#endif
+
+#ifdef __APPLE__
+// CoreMidiBackend: Virtual CoreMIDI source that other applications can connect to
+class CoreMidiBackend : public LiveMidiBackend {
+public:
+    ~CoreMidiBackend() override {
+        if (source) MIDIEndpointDispose(source);
+        if (client) MIDIClientDispose(client);
+    }
+
+    bool open(const std::string& clientName) override {
+        CFStringRef name = CFStringCreateWithCString(nullptr, clientName.c_str(), kCFStringEncodingUTF8);
+        OSStatus status = MIDIClientCreate(name, nullptr, nullptr, &client);
+        if (status == noErr) status = MIDISourceCreate(client, name, &source);
+        CFRelease(name);
+        return status == noErr;
+    }
+
+    void send(unsigned char status, unsigned char data1, unsigned char data2) override {
+        Byte message[3] = {status, data1, data2};
+        Byte storage[64];
+        MIDIPacketList* list = reinterpret_cast<MIDIPacketList*>(storage);
+        MIDIPacket* packet = MIDIPacketListInit(list);
+        packet = MIDIPacketListAdd(list, sizeof(storage), packet, 0, messageLength(status), message);
+        if (packet) MIDIReceived(source, list);
+    }
+
+    const char* name() const override { return "coremidi"; }
+
+private:
+    MIDIClientRef client = 0;
+    MIDIEndpointRef source = 0;
+};
+#endif
+
+/**
+ * Creates a backend by name without opening it
+ * 
+ * @param name Backend name
+ * @return Backend, or nullptr if it is unknown or not compiled in
+ */
+static std::unique_ptr<LiveMidiBackend> createLiveMidiBackend(const std::string& name) {
+    if (name == "null") return std::unique_ptr<LiveMidiBackend>(new NullMidiBackend());
+#ifdef THREAD_MUSIC_HAVE_ALSA
+    if (name == "alsa") return std::unique_ptr<LiveMidiBackend>(new AlsaMidiBackend());
+#endif
+#ifdef THREAD_MUSIC_HAVE_JACK
+    if (name == "jack") return std::unique_ptr<LiveMidiBackend>(new JackMidiBackend());
+#endif
+#ifdef __APPLE__
+    if (name == "coremidi") return std::unique_ptr<LiveMidiBackend>(new CoreMidiBackend());
+#endif
+    return nullptr;
+}
+
+/**
+ * Returns the backends compiled into this build
+ * 
+ * @return Comma-separated backend names
+ */
+std::string liveMidiBackendNames() {
+    std::string names;
+#ifdef __APPLE__
+    names += "coremidi, ";
+#endif
+#ifdef THREAD_MUSIC_HAVE_ALSA
+    names += "alsa, ";
+#endif
+#ifdef THREAD_MUSIC_HAVE_JACK
+    names += "jack, ";
+#endif
+    return names + "null";
+}
+
+/**
+ * Opens a real-time MIDI backend
+ * 
+ * @param name alsa, coremidi, jack, null, or auto
+ * @param clientName Name shown to other MIDI applications
+ * @return Open backend, or nullptr if it is unknown, not compiled in, or fails to open
+ */
+std::unique_ptr<LiveMidiBackend> openLiveMidiBackend(const std::string& name, const std::string& clientName) {
+    std::vector<std::string> candidates;
+    if (name == "auto") {
+        candidates = {"coremidi", "alsa", "jack", "null"};
+    } else {
+        candidates = {name};
+    }
+    for (const std::string& candidate : candidates) {
+        std::unique_ptr<LiveMidiBackend> backend = createLiveMidiBackend(candidate);
+        if (backend && backend->open(clientName)) return backend;
+    }
+    return nullptr;
+}
+
+/**
+ * @param backend Open backend to play through
+ * @param timerMode Sleeping strategy of the output thread
+ */
+LiveMidiOutput::LiveMidiOutput(std::unique_ptr<LiveMidiBackend> backend, TimerMode timerMode)
+    : backend(std::move(backend)), timerMode(timerMode), ring(LIVE_QUEUE_CAPACITY) {
+    pending.reserve(LIVE_QUEUE_CAPACITY);
+}
+
+LiveMidiOutput::~LiveMidiOutput() {
+    stop();
+}
+
+/**
+ * Selects a channel's instrument; call before start()
+ * 
+ * @param channel MIDI channel (0-15)
+ * @param instrument General MIDI program number
+ */
+void LiveMidiOutput::programChange(int channel, int instrument) {
+    backend->send(static_cast<unsigned char>(0xc0 | channel), static_cast<unsigned char>(instrument), 0);
+}
+
+/**
+ * Starts the output thread
+ */
+void LiveMidiOutput::start() {
+    if (running.exchange(true)) return;
+    worker = std::thread(&LiveMidiOutput::run, this);
+
+    // Real-time priority keeps playback steady, but needs privileges; normal priority still works
+    sched_param param{};
+    param.sched_priority = std::min(LIVE_OUTPUT_PRIORITY, sched_get_priority_max(SCHED_FIFO));
+    if (pthread_setschedparam(worker.native_handle(), SCHED_FIFO, &param) != 0) {
+        std::cerr << "Could not give the live MIDI output thread real-time priority; using normal priority"
+                  << std::endl;
+    }
+}
+
+/**
+ * Stops the output thread, releases pending note-offs and silences every channel
+ */
+void LiveMidiOutput::stop() {
+    if (!running.exchange(false)) return;
+    worker.join();
+
+    // Notes still waiting would sound after the piece ended; only let them stop
+    drain();
+    for (const PendingMessage& entry : pending) {
+        if ((entry.message.status & 0xf0) == 0x80) {
+            backend->send(entry.message.status, entry.message.data1, entry.message.data2);
+            sent++;
+        }
+    }
+    pending.clear();
+    for (int channel = 0; channel < 16; channel++) {
+        backend->send(static_cast<unsigned char>(0xb0 | channel), 123, 0); // All notes off
+    }
+}
+
+/**
+ * Heap order of pending messages: earliest due time first, then arrival order
+ * 
+ * @return True if a is sent after b
+ */
+bool LiveMidiOutput::dueAfter(const PendingMessage& a, const PendingMessage& b) {
+    return a.dueNs != b.dueNs ? a.dueNs > b.dueNs : a.order > b.order;
+}
+
+/**
+ * Moves every queued message into the pending heap, stamped with its due time
+ */
+void LiveMidiOutput::drain() {
+    double nsPerTick = 60e9 / (TEMPO * TPQ);
+    long long arrivalNs = getMonotonicNs() + LIVE_LATENCY_MS * 1000000LL;
+    LiveMessage message;
+    while (ring.tryPop(message)) {
+        long long dueNs = arrivalNs + std::llround(message.delayTicks * nsPerTick);
+        pending.push_back({dueNs, arrivals++, message});
+        std::push_heap(pending.begin(), pending.end(), dueAfter);
+    }
+}
+
+/**
+ * Sends every pending message that is due
+ * 
+ * @param nowNs Current monotonic time
+ */
+void LiveMidiOutput::sendDue(long long nowNs) {
+    while (!pending.empty() && pending.front().dueNs <= nowNs) {
+        const LiveMessage& message = pending.front().message;
+        backend->send(message.status, message.data1, message.data2);
+        lateness.record(getMonotonicNs() - pending.front().dueNs);
+        sent++;
+        std::pop_heap(pending.begin(), pending.end(), dueAfter);
+        pending.pop_back();
+    }
+}
+
+/**
+ * Output thread: drains the ring and sends messages when they are due
+ */
+void LiveMidiOutput::run() {
+    TimerEngine timer(timerMode);
+    while (running.load(std::memory_order_acquire)) {
+        drain();
+        long long nowNs = getMonotonicNs();
+        sendDue(nowNs);
+
+        // Wake for the next message, but often enough to drain the ring
+        long long wakeNs = nowNs + LIVE_POLL_INTERVAL_US * 1000LL;
+        if (!pending.empty()) wakeNs = std::min(wakeNs, pending.front().dueNs);
+        timer.sleepUntil(wakeNs);
+    }
+}
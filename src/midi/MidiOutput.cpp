@@ -0,0 +1,230 @@
+#include "../../include/MidiOutput.h"
+#include "../../include/Constants.h"
+#include "../../include/EventExport.h"
+#include "../../include/Priority.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace smf;
+
+/**
+ * Parses an output encoder name from the command line
+ * 
+ * @param name "native" or "midifile"
+ * @param encoder Receives the encoder
+ * @return True if the name was recognized
+ */
+bool parseOutputEncoder(const std::string& name, OutputEncoder& encoder) {
+    if (name == "native") encoder = OutputEncoder::Native;
+    else if (name == "midifile") encoder = OutputEncoder::MidiFile;
+    else return false;
+    return true;
+}
+
+/**
+ * Returns the command-line name of an output encoder
+ * 
+ * @param encoder Output encoder
+ * @return "native" or "midifile"
+ */
+const char* outputEncoderName(OutputEncoder encoder) {
+    return encoder == OutputEncoder::Native ? "native" : "midifile";
+}
+
+/**
+ * Estimates how many events a thread will record during a run
+ * 
+ * Drum threads are bounded by the step grid. Melodic threads are sized for
+ * back-to-back sixteenth notes; heavier scheduling flicker simply grows the buffer.
+ * 
+ * @param data Thread configuration data
+ * @param durationSec Total duration in seconds
+ * @param numPhases Number of musical phases
+ * @return Suggested event capacity
+ */
+std::size_t estimateEventCapacity(const ThreadData& data, int durationSec, int numPhases) {
+    double totalTicks = durationSec * (TPQ * (TEMPO / 60.0));
+    std::size_t phaseEvents = static_cast<std::size_t>(std::max(numPhases, 0)) * 3 + 1;
+
+    if (data.isDrumThread) {
+        int ticksPerStep = std::max(1, (BEATS_PER_BAR * TPQ) / 4);
+        // Up to kick, snare, and hi-hat per step, each with a note-on and note-off
+        return static_cast<std::size_t>(totalTicks / ticksPerStep + 1) * 6 + phaseEvents;
+    }
+
+    int shortestNote = std::max(1, TPQ / 4);
+    return static_cast<std::size_t>(totalTicks / shortestNote + 1) * 2 + phaseEvents;
+}
+
+/**
+ * Returns the track name written for a thread
+ * 
+ * @param data Thread configuration data
+ * @return Track name ("Drum Track" or "Thread N"), followed by " [cpu C]" when pinned
+ *         and by the scheduling policy when it is not the default
+ */
+std::string trackNameFor(const ThreadData& data) {
+    std::string name = data.isDrumThread ? "Drum Track" : "Thread " + std::to_string(data.id);
+    if (data.cpu >= 0) name += " [cpu " + std::to_string(data.cpu) + "]";
+    if (data.sched && isCustomSchedPolicy(*data.sched)) name += " [" + schedPolicyName(*data.sched) + "]";
+    return name;
+}
+
+/**
+ * Copies a thread's recorded events into its MIDI track
+ * 
+ * @param midifile Destination MIDI file (absolute ticks)
+ * @param data Thread configuration data (track, port and thread type)
+ * @param buffer Events recorded by the thread (consumed)
+ * @param columns Also receives every event, or nullptr
+ */
+void appendEventBuffer(MidiFile& midifile, const ThreadData& data, EventBuffer& buffer, EventExport* columns) {
+    midifile.addTrackName(data.track, 0, trackNameFor(data));
+    if (data.port > 0) {
+        // MIDI port meta event; tracks without one play on port 0
+        midifile.addMetaEvent(data.track, 0, 0x21, std::string(1, static_cast<char>(data.port)));
+    }
+
+    buffer.consume([&](const TrackEvent& event) {
+        if (columns) columns->add(data.id, event);
+        switch (event.type) {
+            case EventType::NoteOn:
+                midifile.addNoteOn(data.track, event.tick, event.channel, event.pitch, event.velocity);
+                break;
+            case EventType::NoteOff:
+                midifile.addNoteOff(data.track, event.tick, event.channel, event.pitch);
+                break;
+            case EventType::PhaseMarker:
+                midifile.addMarker(data.track, event.tick, "Phase " + std::to_string(event.pitch + 1));
+                break;
+            case EventType::EndMarker:
+                midifile.addMarker(data.track, event.tick, END_MARKER_TEXT);
+                break;
+        }
+    });
+}
+
+/**
+ * @param trackCount Number of tracks in the file
+ */
+SmfFileWriter::SmfFileWriter(int trackCount) : tracks(trackCount) {
+    writeSmfHeader(fileHeader, 1, trackCount, TPQ);
+}
+
+/**
+ * Reserves encoded bytes for a track
+ * 
+ * @param track Track number
+ * @param bytes Expected size of the track body
+ */
+void SmfFileWriter::reserve(int track, std::size_t bytes) {
+    tracks[track].body.reserve(bytes);
+}
+
+/**
+ * Encodes a thread's track name, port, program change and recorded events
+ * 
+ * Text events are placed before recorded events at the same tick, the
+ * way MidiFile::sortTracks() orders meta events. A buffer that recorded
+ * events out of order is sorted first, since the encoder writes deltas
+ * 
+ * @param data Thread configuration data (track, port and thread type)
+ * @param buffer Events recorded by the thread (consumed)
+ * @param texts Text events as (tick, text) in tick order, merged between the recorded events
+ * @param columns Also receives every recorded event, or nullptr
+ */
+void SmfFileWriter::appendThread(const ThreadData& data, EventBuffer& buffer,
+                                 const std::vector<std::pair<int, std::string>>& texts, EventExport* columns) {
+    SmfTrackEncoder& encoder = tracks[data.track].encoder;
+    encoder.trackName(0, trackNameFor(data));
+    if (data.port > 0) encoder.port(0, data.port);
+    if (!data.isDrumThread) encoder.programChange(0, data.channel, data.instrument);
+
+    const std::string endMarkerText = END_MARKER_TEXT;
+    std::size_t nextText = 0;
+    auto encode = [&](const TrackEvent& event) {
+        for (; nextText < texts.size() && texts[nextText].first <= event.tick; nextText++) {
+            encoder.text(texts[nextText].first, texts[nextText].second);
+        }
+        encoder.trackEvent(event, endMarkerText);
+        if (columns) columns->add(data.id, event);
+    };
+    if (buffer.outOfOrderCount() == 0) {
+        buffer.consume(encode);
+    } else {
+        std::vector<TrackEvent> sorted;
+        buffer.consume([&](const TrackEvent& event) { sorted.push_back(event); });
+        std::stable_sort(sorted.begin(), sorted.end(), trackEventBefore);
+        for (const TrackEvent& event : sorted) {
+            encode(event);
+        }
+    }
+    for (; nextText < texts.size(); nextText++) {
+        encoder.text(texts[nextText].first, texts[nextText].second);
+    }
+}
+
+/**
+ * Ends every track and writes the file
+ * 
+ * @param filename Output file name
+ * @return True on success
+ */
+bool SmfFileWriter::write(const std::string& filename) {
+    std::vector<struct iovec> chunks;
+    chunks.reserve(tracks.size() * 2 + 1);
+    chunks.push_back({fileHeader.data(), fileHeader.size()});
+    for (Track& track : tracks) {
+        track.encoder.endOfTrack(track.encoder.lastTick());
+        unsigned int length = static_cast<unsigned int>(track.body.size());
+        for (int i = 0; i < 4; i++) {
+            track.header[4 + i] = (length >> (24 - 8 * i)) & 0xFF;
+        }
+        chunks.push_back({track.header, sizeof(track.header)});
+        chunks.push_back({track.body.data(), track.body.size()});
+    }
+
+    int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+
+    // writev takes at most IOV_MAX chunks and may write less than asked
+    std::size_t first = 0;
+    bool ok = true;
+    while (ok && first < chunks.size()) {
+        int count = static_cast<int>(std::min<std::size_t>(chunks.size() - first, IOV_MAX));
+        ssize_t written = ::writev(fd, &chunks[first], count);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) {
+            ok = false;
+            break;
+        }
+        std::size_t remaining = static_cast<std::size_t>(written);
+        while (first < chunks.size() && remaining >= chunks[first].iov_len) {
+            remaining -= chunks[first].iov_len;
+            first++;
+        }
+        if (remaining > 0) {
+            chunks[first].iov_base = static_cast<unsigned char*>(chunks[first].iov_base) + remaining;
+            chunks[first].iov_len -= remaining;
+        }
+    }
+    ok = (::close(fd) == 0) && ok;
+    return ok;
+}
+
+/**
+ * Returns the size of the file written by write()
+ * 
+ * @return Bytes
+ */
+std::size_t SmfFileWriter::size() const {
+    std::size_t bytes = fileHeader.size();
+    for (const Track& track : tracks) {
+        bytes += sizeof(track.header) + track.body.size();
+    }
+    return bytes;
+}
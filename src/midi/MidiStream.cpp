@@ -0,0 +1,226 @@
+#include "../../include/MidiStream.h"
+#include "../../include/Constants.h"
+#include "../../include/EventExport.h"
+#include "../../include/MidiOutput.h"
+#include <algorithm>
+#include <chrono>
+
+// Spool layout: MThd chunk (14 bytes), then "MTrk" and its 4-byte length
+static const long SPOOL_LENGTH_OFFSET = 18;
+static const long SPOOL_BODY_OFFSET = 22;
+static const unsigned char END_OF_TRACK[] = {0x00, 0xFF, 0x2F, 0x00};
+
+StreamingMidiWriter::StreamingMidiWriter(const std::string& filename, int trackCount)
+    : filename(filename), tracks(trackCount) {
+    for (int i = 0; i < trackCount; i++) {
+        tracks[i].spoolPath = filename + ".track" + std::to_string(i) + ".part";
+        tracks[i].encoder.reset(new SmfTrackEncoder(tracks[i].bytes));
+    }
+}
+
+StreamingMidiWriter::~StreamingMidiWriter() {
+    stop();
+    for (TrackStream& track : tracks) {
+        if (track.spool) std::fclose(track.spool);
+    }
+}
+
+/**
+ * Creates the spool files
+ * 
+ * @return True on success
+ */
+bool StreamingMidiWriter::open() {
+    for (TrackStream& track : tracks) {
+        track.spool = std::fopen(track.spoolPath.c_str(), "w+b");
+        if (!track.spool) return false;
+
+        std::vector<unsigned char> header;
+        writeSmfHeader(header, 0, 1, TPQ);
+        header.insert(header.end(), {'M', 'T', 'r', 'k'});
+        writeBigEndian32(header, sizeof(END_OF_TRACK));
+        header.insert(header.end(), END_OF_TRACK, END_OF_TRACK + sizeof(END_OF_TRACK));
+        if (std::fwrite(header.data(), 1, header.size(), track.spool) != header.size()) return false;
+    }
+    return true;
+}
+
+/**
+ * Returns the encoder of a track, for header events written before start()
+ * 
+ * @param track Track number
+ * @return Track encoder
+ */
+SmfTrackEncoder& StreamingMidiWriter::trackEncoder(int track) {
+    return *tracks[track].encoder;
+}
+
+/**
+ * Registers a thread as the event source of its track
+ * 
+ * @param data Thread configuration data (events must outlive the writer)
+ */
+void StreamingMidiWriter::addThread(const ThreadData& data) {
+    TrackStream& track = tracks[data.track];
+    track.source = data.events;
+    track.thread = data.id;
+    track.endMarkerText = END_MARKER_TEXT;
+    track.encoder->trackName(0, trackNameFor(data));
+    if (data.port > 0) track.encoder->port(0, data.port);
+    if (!data.isDrumThread) {
+        track.encoder->programChange(0, data.channel, data.instrument);
+    }
+}
+
+/**
+ * Starts the background flushing thread
+ * 
+ * @param intervalMs Time between flushes in milliseconds
+ */
+void StreamingMidiWriter::start(int intervalMs) {
+    if (flushing) return;
+    flushing = true;
+    flusher = std::thread(&StreamingMidiWriter::flushLoop, this, intervalMs);
+}
+
+/**
+ * Stops the flushing thread and writes every remaining event
+ */
+void StreamingMidiWriter::stop() {
+    if (flushing) {
+        flushing = false;
+        flusher.join();
+    }
+    flush();
+}
+
+/**
+ * Flushes periodically until stopped
+ * 
+ * @param intervalMs Time between flushes in milliseconds
+ */
+void StreamingMidiWriter::flushLoop(int intervalMs) {
+    auto next = std::chrono::steady_clock::now();
+    while (flushing) {
+        next += std::chrono::milliseconds(intervalMs);
+        // Sleep in short slices so stop() does not wait a whole interval
+        while (flushing && std::chrono::steady_clock::now() < next) {
+            if (flushRequested.exchange(false, std::memory_order_acquire)) flush();
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        if (flushing) flush();
+    }
+}
+
+/**
+ * Drains all event buffers and writes every published event
+ * 
+ * Event buffers publish in tick order and hold back note-offs that are
+ * not yet final, so the publish position is the safe watermark and
+ * drained events can be encoded straight away. If a buffer recorded
+ * events out of order since the last flush, the drained events are
+ * sorted first; an event before one already on disk is clamped by the encoder.
+ */
+void StreamingMidiWriter::flush() {
+    for (TrackStream& track : tracks) {
+        if (track.source) {
+            auto encode = [&](const TrackEvent& event) {
+                track.encoder->trackEvent(event, track.endMarkerText);
+                if (exportColumns) exportColumns->add(track.thread, event);
+            };
+
+            // Read before draining, so every event it counts is in this flush or an earlier one
+            std::size_t outOfOrder = track.source->outOfOrderCount();
+            if (outOfOrder == track.sortedOutOfOrder) {
+                track.source->consume(encode);
+            } else {
+                track.pending.clear();
+                track.source->consume([&](const TrackEvent& event) { track.pending.push_back(event); });
+                std::stable_sort(track.pending.begin(), track.pending.end(), trackEventBefore);
+                for (const TrackEvent& event : track.pending) {
+                    encode(event);
+                }
+                track.sortedOutOfOrder = outOfOrder;
+            }
+        }
+
+        if (!track.bytes.empty()) {
+            writeSpool(track);
+        }
+    }
+    flushCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @return Number of events moved to a later tick over all tracks
+ */
+std::size_t StreamingMidiWriter::getClampedCount() const {
+    std::size_t clamped = 0;
+    for (const TrackStream& track : tracks) {
+        clamped += track.encoder->clampedCount();
+    }
+    return clamped;
+}
+
+/**
+ * Appends encoded bytes to a spool and patches its MTrk length
+ * 
+ * @param track Track to write
+ * @return True on success
+ */
+bool StreamingMidiWriter::writeSpool(TrackStream& track) {
+    if (!track.spool) return false;
+
+    // Overwrite the previous end-of-track event, then re-append it
+    std::fseek(track.spool, SPOOL_BODY_OFFSET + static_cast<long>(track.bodyLength), SEEK_SET);
+    bool ok = std::fwrite(track.bytes.data(), 1, track.bytes.size(), track.spool) == track.bytes.size();
+    ok = ok && std::fwrite(END_OF_TRACK, 1, sizeof(END_OF_TRACK), track.spool) == sizeof(END_OF_TRACK);
+    if (ok) track.bodyLength += track.bytes.size();
+    track.bytes.clear();
+
+    std::vector<unsigned char> length;
+    writeBigEndian32(length, static_cast<unsigned int>(track.bodyLength + sizeof(END_OF_TRACK)));
+    std::fseek(track.spool, SPOOL_LENGTH_OFFSET, SEEK_SET);
+    ok = ok && std::fwrite(length.data(), 1, length.size(), track.spool) == length.size();
+    std::fflush(track.spool);
+    return ok;
+}
+
+/**
+ * Assembles the final MIDI file from the spools
+ * 
+ * @return True on success
+ */
+bool StreamingMidiWriter::finish() {
+    std::FILE* out = std::fopen(filename.c_str(), "wb");
+    if (!out) return false;
+
+    std::vector<unsigned char> header;
+    writeSmfHeader(header, 1, static_cast<int>(tracks.size()), TPQ);
+    bool ok = std::fwrite(header.data(), 1, header.size(), out) == header.size();
+
+    std::vector<unsigned char> copyBuffer(64 * 1024);
+    for (TrackStream& track : tracks) {
+        if (!track.spool) {
+            ok = false;
+            break;
+        }
+
+        // Same MTrk chunk as in the spool: "MTrk", length, body, end-of-track
+        unsigned long chunkLength = 8 + track.bodyLength + sizeof(END_OF_TRACK);
+        std::fseek(track.spool, SPOOL_BODY_OFFSET - 8, SEEK_SET);
+        while (ok && chunkLength > 0) {
+            std::size_t want = std::min<unsigned long>(chunkLength, copyBuffer.size());
+            std::size_t got = std::fread(copyBuffer.data(), 1, want, track.spool);
+            ok = got == want && std::fwrite(copyBuffer.data(), 1, got, out) == got;
+            chunkLength -= got;
+        }
+
+        std::fclose(track.spool);
+        track.spool = nullptr;
+        if (ok) std::remove(track.spoolPath.c_str());
+    }
+
+    ok = (std::fclose(out) == 0) && ok;
+    return ok;
+}
@@ -0,0 +1,145 @@
+#include "../../include/SmfEncoder.h"
+
+/**
+ * Appends a MIDI variable-length quantity
+ * 
+ * @param out Destination bytes
+ * @param value Value to encode (up to 28 bits)
+ */
+void writeVlq(std::vector<unsigned char>& out, unsigned int value) {
+    unsigned char bytes[5];
+    int count = 0;
+    bytes[count++] = value & 0x7F;
+    while (value >>= 7) {
+        bytes[count++] = 0x80 | (value & 0x7F);
+    }
+    while (count > 0) {
+        out.push_back(bytes[--count]);
+    }
+}
+
+/**
+ * Appends a big-endian 32-bit value
+ * 
+ * @param out Destination bytes
+ * @param value Value to encode
+ */
+void writeBigEndian32(std::vector<unsigned char>& out, unsigned int value) {
+    out.push_back((value >> 24) & 0xFF);
+    out.push_back((value >> 16) & 0xFF);
+    out.push_back((value >> 8) & 0xFF);
+    out.push_back(value & 0xFF);
+}
+
+/**
+ * Appends a Standard MIDI File header chunk (MThd)
+ * 
+ * @param out Destination bytes
+ * @param format SMF format (0 or 1)
+ * @param trackCount Number of MTrk chunks that follow
+ * @param tpq Ticks per quarter note
+ */
+void writeSmfHeader(std::vector<unsigned char>& out, int format, int trackCount, int tpq) {
+    const char magic[] = {'M', 'T', 'h', 'd'};
+    out.insert(out.end(), magic, magic + 4);
+    writeBigEndian32(out, 6);
+    out.push_back((format >> 8) & 0xFF);
+    out.push_back(format & 0xFF);
+    out.push_back((trackCount >> 8) & 0xFF);
+    out.push_back(trackCount & 0xFF);
+    out.push_back((tpq >> 8) & 0xFF);
+    out.push_back(tpq & 0xFF);
+}
+
+/**
+ * Writes the delta time from the previous event
+ * 
+ * @param tick Absolute tick of the next event
+ */
+void SmfTrackEncoder::writeDelta(int tick) {
+    int delta = tick - previousTick;
+    if (delta < 0) {
+        delta = 0;  // Out-of-order input is clamped rather than corrupting the track
+        clamped++;
+    } else {
+        previousTick = tick;
+    }
+    writeVlq(*out, static_cast<unsigned int>(delta));
+}
+
+void SmfTrackEncoder::channelMessage(int tick, int status, int data1, int data2) {
+    writeDelta(tick);
+    if (status != runningStatus) {
+        out->push_back(static_cast<unsigned char>(status));
+        runningStatus = status;
+    }
+    out->push_back(static_cast<unsigned char>(data1 & 0x7F));
+    out->push_back(static_cast<unsigned char>(data2 & 0x7F));
+}
+
+void SmfTrackEncoder::programChange(int tick, int channel, int program) {
+    writeDelta(tick);
+    int status = 0xC0 | (channel & 0x0F);
+    if (status != runningStatus) {
+        out->push_back(static_cast<unsigned char>(status));
+        runningStatus = status;
+    }
+    out->push_back(static_cast<unsigned char>(program & 0x7F));
+}
+
+void SmfTrackEncoder::metaEvent(int tick, int type, const std::string& data) {
+    writeDelta(tick);
+    out->push_back(0xFF);
+    out->push_back(static_cast<unsigned char>(type));
+    writeVlq(*out, static_cast<unsigned int>(data.size()));
+    out->insert(out->end(), data.begin(), data.end());
+    runningStatus = -1;  // Meta events cancel running status
+}
+
+void SmfTrackEncoder::tempo(int tick, double bpm) {
+    unsigned int microsecondsPerQuarter = static_cast<unsigned int>(60000000.0 / bpm + 0.5);
+    std::string data;
+    data.push_back(static_cast<char>((microsecondsPerQuarter >> 16) & 0xFF));
+    data.push_back(static_cast<char>((microsecondsPerQuarter >> 8) & 0xFF));
+    data.push_back(static_cast<char>(microsecondsPerQuarter & 0xFF));
+    metaEvent(tick, 0x51, data);
+}
+
+void SmfTrackEncoder::timeSignature(int tick, int numerator, int denominatorPower, int clocksPerClick, int num32ndsPerQuarter) {
+    std::string data;
+    data.push_back(static_cast<char>(numerator));
+    data.push_back(static_cast<char>(denominatorPower));
+    data.push_back(static_cast<char>(clocksPerClick));
+    data.push_back(static_cast<char>(num32ndsPerQuarter));
+    metaEvent(tick, 0x58, data);
+}
+
+void SmfTrackEncoder::endOfTrack(int tick) {
+    metaEvent(tick, 0x2F, std::string());
+}
+
+/**
+ * Encodes a recorded event
+ * 
+ * Note-offs are written as note-ons with velocity 0 so they share
+ * running status with the note-ons around them
+ * 
+ * @param event Event to encode
+ * @param endMarkerText Text used for EventType::EndMarker
+ */
+void SmfTrackEncoder::trackEvent(const TrackEvent& event, const std::string& endMarkerText) {
+    switch (event.type) {
+        case EventType::NoteOn:
+            channelMessage(event.tick, 0x90 | (event.channel & 0x0F), event.pitch, event.velocity);
+            break;
+        case EventType::NoteOff:
+            channelMessage(event.tick, 0x90 | (event.channel & 0x0F), event.pitch, 0);
+            break;
+        case EventType::PhaseMarker:
+            marker(event.tick, "Phase " + std::to_string(event.pitch + 1));
+            break;
+        case EventType::EndMarker:
+            marker(event.tick, endMarkerText);
+            break;
+    }
+}
@@ -0,0 +1,99 @@
+#include "../../include/Conductor.h"
+#include "../../include/Constants.h"
+#include <cmath>
+#include <thread>
+
+// Ticks per minute at the fixed tempo; ticks are counted in integers from here on
+static const long long TICKS_PER_MINUTE = static_cast<long long>(TPQ) * TEMPO;
+static const long long NS_PER_MINUTE = 60000000000LL;
+
+Conductor::Conductor(const PhaseGrid& grid) : grid(grid) {}
+
+/**
+ * Sets tick 0 and publishes the first beat
+ * 
+ * @param originNs Monotonic time of tick 0
+ */
+void Conductor::start(long long originNs) {
+    this->originNs = originNs;
+    endNs = originNs + std::llround(grid.durationSec * 1e9);
+    line.epoch.store(0, std::memory_order_relaxed);
+    line.phase.store(-1, std::memory_order_relaxed);
+    publish(originNs);
+}
+
+/**
+ * Writes the beat of a moment to the shared line
+ * 
+ * Only one thread writes at a time: a writer claims the line by moving the
+ * sequence to an odd value, and readers retry while it is odd or changed.
+ * 
+ * @param nowNs Monotonic time
+ */
+void Conductor::publish(long long nowNs) {
+    unsigned sequence = line.sequence.load(std::memory_order_relaxed);
+    if ((sequence & 1) != 0 ||
+        !line.sequence.compare_exchange_strong(sequence, sequence + 1, std::memory_order_acquire)) {
+        return; // Another voice is publishing this tick
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+
+    // Another voice may have published between our check and the claim
+    if (nowNs >= line.nextTickNs.load(std::memory_order_relaxed)) {
+        // In 64-bit nanoseconds this is exact for runs of over a day
+        long long elapsedNs = nowNs > originNs ? nowNs - originNs : 0;
+        int tick = static_cast<int>(elapsedNs * TICKS_PER_MINUTE / NS_PER_MINUTE);
+        int phase = phaseAtTick(grid, tick);
+
+        line.tick.store(tick, std::memory_order_relaxed);
+        if (phase != line.phase.load(std::memory_order_relaxed)) {
+            line.phase.store(phase, std::memory_order_relaxed);
+            line.nextPhaseTick.store((phase + 1) * grid.ticksPerPhase, std::memory_order_relaxed);
+            if (tick > 0) line.epoch.store(line.epoch.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        // First nanosecond of the next tick
+        long long nextTickNs = ((tick + 1LL) * NS_PER_MINUTE + TICKS_PER_MINUTE - 1) / TICKS_PER_MINUTE;
+        line.nextTickNs.store(originNs + nextTickNs, std::memory_order_relaxed);
+        publishCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    line.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+/**
+ * Returns the beat at a moment, publishing it first if the clock is behind
+ * 
+ * @param nowNs Monotonic time
+ * @return Current beat (never earlier than the last published one)
+ */
+Beat Conductor::observe(long long nowNs) {
+    if (nowNs >= line.nextTickNs.load(std::memory_order_relaxed)) {
+        publish(nowNs);
+    }
+    return read();
+}
+
+/**
+ * Returns the last published beat without advancing the clock
+ * 
+ * @return Published beat
+ */
+Beat Conductor::read() const {
+    Beat beat;
+    unsigned before;
+    unsigned after;
+    int retries = 0;
+    do {
+        // A writer preempted mid-publish must get the CPU back
+        if (retries++ > CONDUCTOR_SPIN_RETRIES) std::this_thread::yield();
+        before = line.sequence.load(std::memory_order_acquire);
+        beat.tick = line.tick.load(std::memory_order_relaxed);
+        beat.phase = line.phase.load(std::memory_order_relaxed);
+        beat.nextPhaseTick = line.nextPhaseTick.load(std::memory_order_relaxed);
+        beat.epoch = line.epoch.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = line.sequence.load(std::memory_order_relaxed);
+    } while ((before & 1) != 0 || before != after);
+    return beat;
+}
@@ -1,32 +1,44 @@
 #include "../../include/MusicGeneration.h"
 #include "../../include/Utils.h"
 #include "../../include/Constants.h"
+#include "../../include/Voice.h"
+#include "../../include/Conductor.h"
+#include "../../include/Timing.h"
+#include "../../include/Affinity.h"
+#include "../../include/Priority.h"
+#include "../../include/StartGate.h"
+#include "../../include/Workload.h"
+#include "../../include/Bench.h"
+#include "../../include/Counters.h"
+#include "../../include/Detector.h"
+#include "../../include/ScheduleTrace.h"
+#include "../../include/AllocationCounter.h"
 #include <random>
 #include <cmath>
 #include <iostream>
 #include <chrono>
 #include <thread>
 #include <algorithm>
+#include <limits>
 #include <vector>
-#include <MidiFile.h>
 
-using namespace smf;
-
-// Global variables for thread synchronization
-std::mutex midi_mutex;
+// Global flag for stopping all threads
 std::atomic<bool> running(true);
-extern MidiFile midifile;  // Defined in main.cpp
+
+// Every voice plays until the control server mutes some
+std::atomic<int> activeVoices(std::numeric_limits<int>::max());
+WorkloadSelection liveWorkload;
 
 /**
  * Creates a note within a musical scale at a specific octave and position
  * 
- * @param scale Vector of scale intervals (semitones from root)
+ * @param scale Scale intervals (semitones from root)
  * @param octave Base octave number
  * @param scaleIndex Position within the scale
  * @param rootNote Root note pitch class (0-11, where 0 is C)
  * @return MIDI note number
  */
-int createNoteInScale(const std::vector<int>& scale, int octave, int scaleIndex, int rootNote) {
+int createNoteInScale(const Scale& scale, int octave, int scaleIndex, int rootNote) {
     return (octave * 12) + rootNote + scale[scaleIndex % scale.size()];
 }
 
@@ -34,46 +46,41 @@ int createNoteInScale(const std::vector<int>& scale, int octave, int scaleIndex,
  * Helper function to select a note duration based on weighted probabilities
  * 
  * @param gen Random number generator
- * @param weights Map of duration values to their probability weights
+ * @param weights Precomputed cumulative weight table
  * @return Selected duration value in MIDI ticks
  */
-int selectDuration(std::mt19937& gen, const std::map<int, double>& weights) {
-    std::vector<double> weightValues;
-    std::vector<int> durationValues;
-    for (const auto& pair : weights) {
-        if (pair.second > 0) { // Only include durations with positive weight
-            durationValues.push_back(pair.first);
-            weightValues.push_back(pair.second);
-        }
-    }
-
-    if (durationValues.empty()) {
+int selectDuration(std::mt19937& gen, const DurationTable& weights) {
+    if (weights.count == 0) {
         return TPQ; // Default to quarter note if no valid weights
     }
 
-    std::discrete_distribution<> dist(weightValues.begin(), weightValues.end());
-    return durationValues[dist(gen)];
+    // Tables are tiny, so a linear scan of the cumulative weights beats a binary search
+    std::uniform_real_distribution<double> dist(0.0, weights.total());
+    double pick = dist(gen);
+    for (int i = 0; i < weights.count - 1; i++) {
+        if (pick < weights.cumulative[i]) return weights.ticks[i];
+    }
+    return weights.ticks[weights.count - 1];
 }
 
 /**
  * Generates a musical snippet (phrase) for a thread based on its range and role
  * 
+ * @param table Snippet table that receives the phrase as its next snippet
+ * @param gen Random number generator
  * @param lowNote Lower bound of note range
  * @param highNote Upper bound of note range
  * @param scale Musical scale to use
  * @param rootNote Root note of the scale
  * @param isBass Whether this snippet is for a bass instrument
- * @return Snippet containing a sequence of musical notes
  */
-Snippet generateSnippet(int lowNote, int highNote, const std::vector<int>& scale, int rootNote, bool isBass) {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    
+void generateSnippet(SnippetTable& table, std::mt19937& gen, int lowNote, int highNote,
+                     const Scale& scale, int rootNote, bool isBass) {
     // Generate snippet with consistent length for musical coherence
-    std::uniform_int_distribution<> lenDist(4, 8);
+    std::uniform_int_distribution<> lenDist(SNIPPET_MIN_NOTES, SNIPPET_MAX_NOTES);
     int length = lenDist(gen);
     
-    Snippet snippet;
+    table.beginSnippet();
     int lowOctave = lowNote / 12;
     int highOctave = highNote / 12;
     
@@ -84,17 +91,16 @@ Snippet generateSnippet(int lowNote, int highNote, const std::vector<int>& scale
         int scaleIndex = gen() % scale.size();
         
         for (int i = 0; i < length; i++) {
-            Note note;
-            note.pitch = createNoteInScale(scale, octave, scaleIndex, rootNote);
+            int pitch = createNoteInScale(scale, octave, scaleIndex, rootNote);
             
             // Ensure note stays within the specified range
-            while (note.pitch < lowNote) {
+            while (pitch < lowNote) {
                 octave++;
-                note.pitch = createNoteInScale(scale, octave, scaleIndex, rootNote);
+                pitch = createNoteInScale(scale, octave, scaleIndex, rootNote);
             }
-            while (note.pitch > highNote) {
+            while (pitch > highNote) {
                 octave--;
-                note.pitch = createNoteInScale(scale, octave, scaleIndex, rootNote);
+                pitch = createNoteInScale(scale, octave, scaleIndex, rootNote);
             }
             
             // Create melodic contour: ascending first half, descending second half
@@ -117,13 +123,11 @@ Snippet generateSnippet(int lowNote, int highNote, const std::vector<int>& scale
             }
             
             // Select duration using weighted distribution
-            note.duration = selectDuration(gen, MELODY_DURATION_WEIGHTS);
+            int duration = selectDuration(gen, MELODY_DURATION_WEIGHTS);
             
             // Varied velocity for expressive dynamics
             std::uniform_int_distribution<> velDist(80, 110);
-            note.velocity = velDist(gen);
-            
-            snippet.notes.push_back(note);
+            table.addNote(pitch, velDist(gen), duration);
         }
     } 
     // For bass instruments: create simpler, harmonically focused patterns
@@ -132,37 +136,31 @@ Snippet generateSnippet(int lowNote, int highNote, const std::vector<int>& scale
         int octave = lowOctave;
 
         for (int i = 0; i < length; i++) {
-            Note note;
-            
             // Bass emphasizes root, fifth, and other chord tones
             int scaleIndex;
             if (i % 4 == 0) scaleIndex = 0;                  // Root note
             else if (i % 4 == 2) scaleIndex = 4 % scale.size(); // Fifth if available
             else scaleIndex = gen() % scale.size();              // Other scale tones
             
-            note.pitch = createNoteInScale(scale, octave, scaleIndex, rootNote);
+            int pitch = createNoteInScale(scale, octave, scaleIndex, rootNote);
             
             // Ensure note stays within the specified range
-            while (note.pitch < lowNote) {
+            while (pitch < lowNote) {
                 octave++;
-                note.pitch = createNoteInScale(scale, octave, scaleIndex, rootNote);
+                pitch = createNoteInScale(scale, octave, scaleIndex, rootNote);
             }
-            while (note.pitch > highNote) {
+            while (pitch > highNote) {
                 octave--;
-                note.pitch = createNoteInScale(scale, octave, scaleIndex, rootNote);
+                pitch = createNoteInScale(scale, octave, scaleIndex, rootNote);
             }
             
             // Longer note durations for bass parts
-            note.duration = selectDuration(gen, BASS_DURATION_WEIGHTS);
+            int duration = selectDuration(gen, BASS_DURATION_WEIGHTS);
             
             // Consistent velocity for bass stability
-            note.velocity = 100;
-            
-            snippet.notes.push_back(note);
+            table.addNote(pitch, 100, duration);
         }
     }
-    
-    return snippet;
 }
 
 /**
@@ -237,132 +235,108 @@ DrumPattern generateDrumPattern(int phaseNumber) {
     return pattern;
 }
 
+/**
+ * Pins the calling thread to its assigned CPU, if any
+ * 
+ * @param data Thread configuration data (cpu is -1 when unpinned)
+ */
+static void applyAffinity(const ThreadData& data) {
+    if (data.cpu >= 0 && !pinCurrentThread(data.cpu)) {
+        std::cerr << "Thread " << data.id << ": could not pin to CPU " << data.cpu << std::endl;
+    }
+    std::string error;
+    if (data.sched && !applySchedPolicy(*data.sched, error)) {
+        std::cerr << "Thread " << data.id << ": could not apply " << schedPolicyName(*data.sched) << " (" << error << ")" << std::endl;
+    }
+}
+
+/**
+ * Waits for every other voice thread to finish its setup
+ * 
+ * The conductor is started while the threads wait, so it may only be
+ * read after this returns
+ * 
+ * @param data Thread configuration data
+ */
+static void waitForStart(const ThreadData& data) {
+    if (data.startGate) data.startGate->arriveAndWait();
+}
+
 /**
  * Thread function for the dedicated drum/rhythm thread
  * 
  * Provides steady rhythmic foundation and establishes phase transitions
  * 
  * @param data Thread configuration data
- * @param durationSec Total duration in seconds
- * @param numPhases Number of musical phases
+ * @param conductor Shared tick clock and phase grid
  */
-void drumThreadFunction(ThreadData data, int durationSec, int numPhases) {
-    // Phase length calculations - drum phases aren't aligned to bar boundaries
-    int ticksPerPhase = (numPhases > 0) ? static_cast<int>(durationSec * (TPQ * (TEMPO / 60.0)) / numPhases) : static_cast<int>(durationSec * (TPQ * (TEMPO / 60.0)));
-    if (durationSec > 0 && ticksPerPhase <= 0) ticksPerPhase = 1;
-    int totalTicks = static_cast<int>(durationSec * (TPQ * (TEMPO / 60.0)));
-
-    // Calculate musical grid divisions
-    int ticksPerBar = BEATS_PER_BAR * TPQ;
-    int ticksPerStep = ticksPerBar / 4; // 16 steps per bar (16th notes)
-
-    // Initialize timing
-    auto startWallTime = std::chrono::high_resolution_clock::now();
-    int currentPhase = -1;
-
-    // Add track metadata
-    {
-        std::lock_guard<std::mutex> lock(midi_mutex);
-        midifile.addTrackName(data.track, 0, "Drum Track");
-    }
+void drumThreadFunction(ThreadData data, Conductor* conductor) {
+    applyAffinity(data);
+
+    DrumVoice voice(data, conductor->getGrid());
+
+    // Allocate the busy-work working set before the first deadline
+    Workload workload(data.workload, data.workloadRate, data.counters);
+
+    // Initialize timing - each step is played at an absolute deadline on the grid
+    TimerEngine timer(data.timerMode);
+    long long stepNs = voice.getStepNs();
+    waitForStart(data);
+    long long startNs = conductor->getOriginNs();
 
     // Loop state variables
-    int currentTick = 0;
-    int currentStep = -1; // Start at -1 so first comparison triggers
+    long long step = 0;
 
     // Random number generation for thread activity simulation
     std::random_device rd;
     std::mt19937 gen(rd());
-    std::uniform_int_distribution<> busyWorkDist(BUSY_WORK_MIN, BUSY_WORK_MAX);
+    std::uniform_int_distribution<> busyWorkDist(BUSY_WORK_MIN_US, BUSY_WORK_MAX_US);
+    long long allocationsAtStart = threadAllocationCount();
 
     // Main timing loop
     while (running) {
-        // Update timing
-        auto nowWall = std::chrono::high_resolution_clock::now();
-        double currentWallTime = std::chrono::duration_cast<std::chrono::milliseconds>(nowWall - startWallTime).count() / 1000.0;
-        // TODO: the awakeness check and timestep check all needs to happen atomically to prevent re-deschedule
         // Check if finished
-        if (currentWallTime >= durationSec) {
+        if (step >= voice.getStepCount()) {
             break;
         }
 
-        // Calculate current musical position
-        currentTick = static_cast<int>(currentWallTime * (TPQ * (TEMPO / 60.0)));
-
-        // Handle phase transitions
-        int newPhase = (ticksPerPhase > 0) ? (currentTick / ticksPerPhase) : 0;
-        if (newPhase >= numPhases) newPhase = numPhases - 1;
-
-        if (newPhase != currentPhase) {
-            std::lock_guard<std::mutex> lock(midi_mutex);
-
-            // Mark phase transition in MIDI file
-            int phaseEventTick = newPhase * ticksPerPhase;
-            midifile.addMarker(data.track, phaseEventTick, "Phase " + std::to_string(newPhase + 1));
-
-            // Add crash cymbal at phase transitions for musical emphasis
-            midifile.addNoteOn(data.track, phaseEventTick, 9, CRASH, 110);
-            midifile.addNoteOff(data.track, phaseEventTick + std::max(1, ticksPerStep), 9, CRASH);
-
-            currentPhase = newPhase;
+        // Wait for this step's deadline
+        long long deadlineNs = startNs + step * stepNs;
+        long long latenessNs = timer.sleepUntil(deadlineNs);
+        if (data.timing) data.timing->record(latenessNs);
+        if (data.bench) {
+            data.bench->loopStarted(deadlineNs + latenessNs);
+            data.bench->overshootNs.record(latenessNs);
         }
-
-        // Calculate rhythmic grid position
-        int stepPosition = (ticksPerStep > 0) ? (currentTick / ticksPerStep) % 16 : 0;
-
-        // Add drum notes when moving to a new step
-        if (stepPosition != currentStep) {
-            currentStep = stepPosition;
-
-            // Ensure valid phase
-            if (currentPhase < 0) currentPhase = 0;
-            const DrumPattern& pattern = data.drumPatterns[currentPhase % data.drumPatterns.size()];
-
-            // Quantize timing to grid
-            int stepTick = (ticksPerStep > 0) ? (currentTick / ticksPerStep) * ticksPerStep : currentTick;
-
-            // Add drum hits based on pattern
-            std::lock_guard<std::mutex> lock(midi_mutex);
-
-            // Add kick drum if pattern indicates
-            if (pattern.kick[stepPosition]) {
-                midifile.addNoteOn(data.track, stepTick, 9, KICK, pattern.velocities[stepPosition]);
-                midifile.addNoteOff(data.track, stepTick + std::max(1, ticksPerStep - 1), 9, KICK);
-            }
-
-            // Add snare drum if pattern indicates
-            if (pattern.snare[stepPosition]) {
-                midifile.addNoteOn(data.track, stepTick, 9, SNARE, pattern.velocities[stepPosition]);
-                midifile.addNoteOff(data.track, stepTick + std::max(1, ticksPerStep - 1), 9, SNARE);
-            }
-
-            // Add hi-hat if pattern indicates
-            if (pattern.hihat[stepPosition]) {
-                // Open hi-hat on strong beats, closed on others
-                int hihat = (stepPosition % 8 == 0) ? OPEN_HAT : CLOSED_HAT;
-                midifile.addNoteOn(data.track, stepTick, 9, hihat, pattern.velocities[stepPosition]);
-                midifile.addNoteOff(data.track, stepTick + std::max(1, ticksPerStep - 1), 9, hihat);
+        if (data.counters) ThreadCounters::add(data.counters->loops);
+
+        // Skip steps whose deadlines passed while the thread was not running
+        long long dueStep = (deadlineNs + latenessNs - startNs) / stepNs;
+        if (dueStep > step) {
+            if (data.timing) data.timing->missedSteps += dueStep - step;
+            if (data.timeline) {
+                data.timeline->record(step * stepNs, false);
+                data.timeline->record(dueStep * stepNs, true);
             }
+            step = dueStep;
+            if (step >= voice.getStepCount()) break;
         }
 
+        long long recordStartNs = data.bench ? getMonotonicNs() : 0;
+        data.events->setClock(deadlineNs + latenessNs - conductor->getOriginNs(), std::llround(getCpuTime() * 1e9));
+        voice.playStep(step);
+        if (data.bench) data.bench->recordNs.record(getMonotonicNs() - recordStartNs);
+
         // Simulate CPU work to trigger scheduling events
-        int busyWorkAmount = busyWorkDist(gen);
-        volatile double sum = 0;
-        for (int i = 0; i < busyWorkAmount; i++) {
-            sum += sin(i) * cos(i); // TODO: I swear, the compiler better not optimize this out
-        }
+        workload.follow(liveWorkload);
+        workload.runFor(busyWorkDist(gen));
+        if (data.counters) data.counters->allocations.store(threadAllocationCount() - allocationsAtStart, std::memory_order_relaxed);
 
-        // Sleep to prevent excessive CPU usage
-        std::this_thread::sleep_for(std::chrono::milliseconds(THREAD_SLEEP_MS));
+        step++;
     }
 
     // Add final marker
-    {
-        std::lock_guard<std::mutex> lock(midi_mutex);
-        int originalEndTick = totalTicks;
-        int finalMarkerTick = std::max(currentTick, originalEndTick);
-        midifile.addMarker(data.track, finalMarkerTick, "Original End");
-    }
+    voice.finish();
 }
 
 /**
@@ -372,202 +346,122 @@ void drumThreadFunction(ThreadData data, int durationSec, int numPhases) {
  * Each thread detects its own scheduling and plays notes accordingly
  * 
  * @param data Thread configuration data
- * @param durationSec Total duration in seconds
- * @param numPhases Number of musical phases
+ * @param conductor Shared tick clock and phase grid
  */
-void melodicThreadFunction(ThreadData data, int durationSec, int numPhases) {
-    // Phase calculations with bar alignment for musical coherence
-    int ticksPerBar = BEATS_PER_BAR * TPQ;
-    double initialTotalTicks = durationSec * (TPQ * (TEMPO / 60.0));
-    double initialTicksPerPhase = (numPhases > 0) ? initialTotalTicks / numPhases : initialTotalTicks;
-    
-    // Align phase boundaries to complete bars
-    int adjustedTicksPerPhase = 0;
-    if (ticksPerBar > 0 && initialTicksPerPhase > 0) {
-        adjustedTicksPerPhase = static_cast<int>(std::round(initialTicksPerPhase / static_cast<double>(ticksPerBar))) * ticksPerBar;
-        // Ensure minimum phase length of one bar
-        if (adjustedTicksPerPhase == 0) adjustedTicksPerPhase = ticksPerBar;
-    } else {
-        adjustedTicksPerPhase = static_cast<int>(initialTicksPerPhase);
-    }
-    if (adjustedTicksPerPhase < 0) adjustedTicksPerPhase = 0;
-
-    // Calculate adjusted total duration
-    int adjustedTotalTicks = adjustedTicksPerPhase * numPhases;
-    double adjustedDurationSec = (TPQ > 0 && TEMPO > 0) ? adjustedTotalTicks / (TPQ * (TEMPO / 60.0)) : 0.0;
-
-    // Time tracking variables
-    auto startWallTime = std::chrono::high_resolution_clock::now();
-    double lastWallTime = 0;
-    double lastCpuTime = getCpuTime();
-    int currentPhase = -1;
-
-    // Add track metadata
-    {
-        std::lock_guard<std::mutex> lock(midi_mutex);
-        midifile.addTrackName(data.track, 0, "Thread " + std::to_string(data.id));
-    }
+void melodicThreadFunction(ThreadData data, Conductor* conductor) {
+    applyAffinity(data);
+
+    MelodicVoice voice(data, conductor->getGrid());
+    TimerEngine timer(data.timerMode);
 
     // Random number generation for thread activity simulation
     std::random_device rd;
     std::mt19937 gen(rd());
-    std::uniform_int_distribution<> busyWorkDist(BUSY_WORK_MIN, BUSY_WORK_MAX);
-
-    // Thread state variables
-    bool wasScheduled = false;
-    bool noteIsOn = false;
-    int currentNote = -1;
-    int noteStartTick = 0;
-    int noteDuration = 0;
+    std::uniform_int_distribution<> busyWorkDist(BUSY_WORK_MIN_US, BUSY_WORK_MAX_US);
+    Workload workload(data.workload, data.workloadRate, data.counters);
+
     int currentTick = 0;
+    bool timelineState = true; // Rendering starts scheduled, like playScheduleEdges()
+
+    // Publish the kernel thread ID so a benchmark run can trace this thread
+    if (data.osTid) data.osTid->store(getCurrentThreadId());
+    waitForStart(data);
+
+    // Scheduling detection starts from the moment this thread starts sampling
+    SchedulingDetector detector(data.detector, getMonotonicNs() - conductor->getOriginNs(), getCpuTime());
+    long long allocationsAtStart = threadAllocationCount();
+    long long sleptNs = 0; // Time in the last sleep call, which the detector does not count as off-CPU
 
     // Main timing loop
     while (running) {
         // Update timing
-        auto nowWall = std::chrono::high_resolution_clock::now();
-        double currentWallTime = std::chrono::duration_cast<std::chrono::milliseconds>(nowWall - startWallTime).count() / 1000.0;
+        long long nowNs = getMonotonicNs();
         double currentCpuTime = getCpuTime();
 
         // Check if finished
-        if (currentWallTime >= adjustedDurationSec) {
-            // Clean up any active notes
-            if (noteIsOn) {
-                std::lock_guard<std::mutex> lock(midi_mutex);
-                int endTick = adjustedTotalTicks;
-                midifile.addNoteOff(data.track, endTick, data.channel, currentNote);
-            }
+        if (nowNs >= conductor->getEndNs()) {
             break;
         }
 
-        // Calculate time deltas
-        double wallTimeDelta = currentWallTime - lastWallTime;
-        double cpuTimeDelta = currentCpuTime - lastCpuTime;
-
-        // Calculate thread scheduling ratio
-        double schedulingRatio = (wallTimeDelta > 0) ? cpuTimeDelta / wallTimeDelta : 0;
-
-        // Detect if thread is being scheduled by OS
-        bool isScheduled = (schedulingRatio > SCHEDULE_THRESHOLD);
-
-        // Calculate current musical position
-        currentTick = static_cast<int>(currentWallTime * (TPQ * (TEMPO / 60.0)));
+        // Detect if thread is being scheduled by OS; a muted voice rests as if it were not
+        bool isScheduled = detector.sample(nowNs - conductor->getOriginNs(), currentCpuTime, sleptNs) && isVoiceActive(data);
+        data.events->setClock(nowNs - conductor->getOriginNs(), std::llround(currentCpuTime * 1e9));
+        if (data.counters) {
+            data.counters->detectorChanges.store(detector.getChanges(), std::memory_order_relaxed);
+            data.counters->legacyChanges.store(detector.getLegacyChanges(), std::memory_order_relaxed);
+            data.counters->adaptiveChanges.store(detector.getAdaptiveChanges(), std::memory_order_relaxed);
+        }
 
-        // Handle phase transitions
-        int newPhase = (adjustedTicksPerPhase > 0) ? (currentTick / adjustedTicksPerPhase) : 0;
-        if (newPhase >= numPhases) newPhase = numPhases - 1;
+        // Record detector changes at the time the voice sees them, for offline rendering
+        if (data.timeline && isScheduled != timelineState) {
+            data.timeline->record(nowNs - conductor->getOriginNs(), isScheduled);
+            timelineState = isScheduled;
+        }
 
-        if (newPhase != currentPhase) {
-            std::lock_guard<std::mutex> lock(midi_mutex);
+        // Current musical position and phase, as published by the conductor
+        Beat beat = conductor->observe(nowNs);
+        currentTick = beat.tick;
+
+        // Handle phase transitions and scheduling state changes
+        long long recordStartNs = data.bench ? getMonotonicNs() : 0;
+        voice.update(beat, isScheduled);
+        if (data.counters) ThreadCounters::add(data.counters->loops);
+        if (data.bench) {
+            long long probeNs = getMonotonicNs();
+            data.bench->recordNs.record(probeNs - recordStartNs);
+            data.bench->loopStarted(probeNs);
+            data.bench->detected(probeNs, isScheduled);
+        }
 
-            // Mark phase transition in MIDI file
-            int phaseEventTick = newPhase * adjustedTicksPerPhase;
+        // Simulate CPU work to trigger scheduling events
+        if (data.bench) data.bench->busyStarted();
+        workload.follow(liveWorkload);
+        workload.runFor(busyWorkDist(gen));
+        if (data.bench) data.bench->busyFinished();
+        if (data.counters) data.counters->allocations.store(threadAllocationCount() - allocationsAtStart, std::memory_order_relaxed);
 
-            // End any active note at phase boundary
-            if (noteIsOn) {
-                int endTick = std::max(noteStartTick, phaseEventTick);
-                midifile.addNoteOff(data.track, endTick, data.channel, currentNote);
-                noteIsOn = false;
-                wasScheduled = false;
-            }
+        // Sleep to prevent excessive CPU usage
+        long long overshootNs = timer.sleepUntil(getMonotonicNs() + THREAD_SLEEP_MS * 1000000LL);
+        sleptNs = THREAD_SLEEP_MS * 1000000LL + overshootNs;
+        if (data.bench) data.bench->overshootNs.record(overshootNs);
+    }
 
-            // Add phase marker
-            midifile.addMarker(data.track, phaseEventTick, "Phase " + std::to_string(newPhase + 1));
+    // Clean up any active notes and add final marker
+    voice.finish(currentTick);
+}
 
-            currentPhase = newPhase;
+/**
+ * Thread function for melodic threads when scheduling is traced by the kernel
+ * 
+ * Only performs the busy work; notes are rendered afterwards from the
+ * recorded sched_switch edges, so the loop does no timing bookkeeping
+ * 
+ * @param data Thread configuration data (osTid receives this thread's ID)
+ * @param conductor Shared tick clock and phase grid (sets the end of the run)
+ */
+void tracedMelodicThreadFunction(ThreadData data, Conductor* conductor) {
+    applyAffinity(data);
 
-            // Reset snippet to start of phrase at phase change
-            if (currentPhase >= 0 && currentPhase < data.snippets.size()) {
-                Snippet& snippetToReset = data.snippets[currentPhase % data.snippets.size()];
-                snippetToReset.reset();
-            }
-        }
+    TimerEngine timer(data.timerMode);
 
-        // Handle scheduling state changes
-        if (isScheduled != wasScheduled) {
-            std::lock_guard<std::mutex> lock(midi_mutex);
-
-            if (isScheduled) {
-                // Thread just became scheduled - start playing a note
-                int nextPhaseTick = (currentPhase + 1) * adjustedTicksPerPhase;
-                if (!noteIsOn && currentPhase >= 0 && currentPhase < data.snippets.size() && 
-                   (adjustedTicksPerPhase == 0 || currentTick < nextPhaseTick)) {
-                    Snippet& snippet = data.snippets[currentPhase % data.snippets.size()];
-                    Note* note = snippet.getNextNote();
-
-                    if (note) {
-                        currentNote = note->pitch;
-                        noteDuration = note->duration;
-                        midifile.addNoteOn(data.track, currentTick, data.channel, currentNote, note->velocity);
-                        noteStartTick = currentTick;
-                        noteIsOn = true;
-                    }
-                }
-            } else {
-                // Thread just became descheduled - stop playing note
-                if (noteIsOn) {
-                    int nextPhaseTick = (currentPhase + 1) * adjustedTicksPerPhase;
-                    int endTick = (adjustedTicksPerPhase > 0 && currentTick >= nextPhaseTick) ? nextPhaseTick : currentTick;
-                    midifile.addNoteOff(data.track, endTick, data.channel, currentNote);
-                    noteIsOn = false;
-                }
-            }
+    // Let the tracer find this thread
+    data.osTid->store(getCurrentThreadId());
 
-            wasScheduled = isScheduled;
-        }
-        // Continue to next note if current note has finished its duration
-        else if (isScheduled && noteIsOn && currentTick - noteStartTick >= noteDuration) {
-            std::lock_guard<std::mutex> lock(midi_mutex);
-
-            int intendedEndTick = noteStartTick + noteDuration;
-            int nextPhaseTick = (currentPhase + 1) * adjustedTicksPerPhase;
-            int endTick = (adjustedTicksPerPhase > 0 && intendedEndTick >= nextPhaseTick) ? 
-                          nextPhaseTick : intendedEndTick;
-
-            midifile.addNoteOff(data.track, endTick, data.channel, currentNote);
-
-            // Start next note if still within current phase
-            if (adjustedTicksPerPhase == 0 || endTick < nextPhaseTick) {
-                if (currentPhase >= 0 && currentPhase < data.snippets.size()) {
-                    Snippet& snippet = data.snippets[currentPhase % data.snippets.size()];
-                    Note* note = snippet.getNextNote();
-
-                    if (note) {
-                        currentNote = note->pitch;
-                        noteDuration = note->duration;
-                        midifile.addNoteOn(data.track, endTick, data.channel, currentNote, note->velocity);
-                        noteStartTick = endTick;
-                        noteIsOn = true;
-                    } else {
-                        noteIsOn = false;
-                    }
-                } else {
-                    noteIsOn = false;
-                }
-            } else {
-                noteIsOn = false;
-            }
-        }
+    // Random number generation for thread activity simulation
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_int_distribution<> busyWorkDist(BUSY_WORK_MIN_US, BUSY_WORK_MAX_US);
+    Workload workload(data.workload, data.workloadRate, data.counters);
+    waitForStart(data);
 
-        // Update timing values for next iteration
-        lastWallTime = currentWallTime;
-        lastCpuTime = currentCpuTime;
+    while (running && getMonotonicNs() < conductor->getEndNs()) {
+        if (data.counters) ThreadCounters::add(data.counters->loops);
 
         // Simulate CPU work to trigger scheduling events
-        int busyWorkAmount = busyWorkDist(gen);
-        volatile double sum = 0;
-        for (int i = 0; i < busyWorkAmount; i++) {
-            sum += sin(i) * cos(i);
-        }
+        workload.follow(liveWorkload);
+        workload.runFor(busyWorkDist(gen));
 
         // Sleep to prevent excessive CPU usage
-        std::this_thread::sleep_for(std::chrono::milliseconds(THREAD_SLEEP_MS));
+        timer.sleepUntil(getMonotonicNs() + THREAD_SLEEP_MS * 1000000LL);
     }
-
-    // Add final marker
-    {
-        std::lock_guard<std::mutex> lock(midi_mutex);
-        int alignedEndTick = adjustedTotalTicks;
-        int finalMarkerTick = std::max(currentTick, alignedEndTick);
-        midifile.addMarker(data.track, finalMarkerTick, "Aligned End");
-    }
-}
\ No newline at end of file
+}
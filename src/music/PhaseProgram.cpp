@@ -0,0 +1,305 @@
+#include "../../include/PhaseProgram.h"
+#include "../../include/Constants.h"
+#include "../../include/MusicGeneration.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Cache file layout: magic, fingerprint, seed, entry count, then entries
+static const char CACHE_MAGIC[8] = {'T', 'M', 'P', 'R', 'O', 'G', '0', '1'};
+static const unsigned char ENTRY_SNIPPET = 0;
+static const unsigned char ENTRY_DRUM = 1;
+
+// Bump when the generator changes in a way the constants do not capture
+static const unsigned int GENERATOR_VERSION = 1;
+
+/**
+ * Mixes a value into an FNV-1a hash
+ * 
+ * @param hash Running hash
+ * @param value Value to mix in
+ */
+static void mixHash(unsigned long long& hash, long long value) {
+    for (int i = 0; i < 8; i++) {
+        hash ^= static_cast<unsigned char>(value >> (8 * i));
+        hash *= 1099511628211ULL;
+    }
+}
+
+/**
+ * Returns a fingerprint of everything the generator depends on
+ * 
+ * @return Hash of the generator version and the Constants.h musical values
+ */
+static unsigned long long generatorFingerprint() {
+    unsigned long long hash = 14695981039346656037ULL;
+    for (long long value : {static_cast<long long>(GENERATOR_VERSION), static_cast<long long>(TPQ),
+                            static_cast<long long>(TEMPO), static_cast<long long>(BEATS_PER_BAR),
+                            static_cast<long long>(BARS_PER_PHASE), static_cast<long long>(SNIPPET_MIN_NOTES),
+                            static_cast<long long>(SNIPPET_MAX_NOTES), static_cast<long long>(BASS_LOW),
+                            static_cast<long long>(BASS_HIGH), static_cast<long long>(MID_LOW),
+                            static_cast<long long>(MID_HIGH), static_cast<long long>(HIGH_LOW),
+                            static_cast<long long>(HIGH_HIGH)}) {
+        mixHash(hash, value);
+    }
+    for (const DurationTable* table : {&MELODY_DURATION_WEIGHTS, &BASS_DURATION_WEIGHTS}) {
+        for (int i = 0; i < table->count; i++) {
+            mixHash(hash, table->ticks[i]);
+            mixHash(hash, static_cast<long long>(table->cumulative[i] * 1000000));
+        }
+    }
+    for (const Scale* scale : {&MAJOR_SCALE, &MINOR_SCALE, &PENTA_SCALE}) {
+        for (int i = 0; i < scale->size(); i++) mixHash(hash, (*scale)[i]);
+    }
+    for (int root : PHASE_ROOTS) mixHash(hash, root);
+    return hash;
+}
+
+/**
+ * Appends a little-endian integer
+ * 
+ * @param out Destination bytes
+ * @param value Value to encode
+ * @param bytes Width in bytes
+ */
+static void writeLittleEndian(std::vector<unsigned char>& out, unsigned long long value, int bytes) {
+    for (int i = 0; i < bytes; i++) out.push_back(static_cast<unsigned char>(value >> (8 * i)));
+}
+
+/**
+ * Reads a little-endian integer from a file
+ * 
+ * @param in Source file
+ * @param bytes Width in bytes
+ * @param value Receives the value
+ * @return False at end of file
+ */
+static bool readLittleEndian(std::FILE* in, int bytes, unsigned long long& value) {
+    unsigned char buffer[8];
+    if (std::fread(buffer, 1, bytes, in) != static_cast<std::size_t>(bytes)) return false;
+    value = 0;
+    for (int i = 0; i < bytes; i++) value |= static_cast<unsigned long long>(buffer[i]) << (8 * i);
+    return true;
+}
+
+/**
+ * @param seed Phrase generator seed
+ */
+PhaseProgram::PhaseProgram(unsigned int seed) : seed(seed) {}
+
+/**
+ * Returns the default cache directory
+ * 
+ * @return $XDG_CACHE_HOME/thread-music, ~/.cache/thread-music, or "" without a home directory
+ */
+std::string PhaseProgram::defaultCacheDirectory() {
+    const char* xdg = std::getenv("XDG_CACHE_HOME");
+    if (xdg && xdg[0]) return std::string(xdg) + "/thread-music";
+    const char* home = std::getenv("HOME");
+    if (home && home[0]) return std::string(home) + "/.cache/thread-music";
+    return "";
+}
+
+/**
+ * Returns the cache file of this seed
+ * 
+ * @param directory Cache directory
+ * @return File path
+ */
+std::string PhaseProgram::cachePath(const std::string& directory) const {
+    return directory + "/program-" + std::to_string(seed) + ".bin";
+}
+
+/**
+ * Loads cached entries for this seed
+ * 
+ * @param directory Cache directory
+ * @return True if a matching cache file was read
+ */
+bool PhaseProgram::load(const std::string& directory) {
+    std::FILE* in = std::fopen(cachePath(directory).c_str(), "rb");
+    if (!in) return false;
+
+    char magic[sizeof(CACHE_MAGIC)];
+    unsigned long long fingerprint = 0, fileSeed = 0, entries = 0;
+    bool ok = std::fread(magic, 1, sizeof(magic), in) == sizeof(magic) &&
+              std::equal(magic, magic + sizeof(magic), CACHE_MAGIC) &&
+              readLittleEndian(in, 8, fingerprint) && fingerprint == generatorFingerprint() &&
+              readLittleEndian(in, 4, fileSeed) && fileSeed == seed &&
+              readLittleEndian(in, 4, entries);
+
+    // Entries are only kept once the whole file has been read
+    std::map<Key, std::vector<ProgramNote>> loadedSnippets;
+    std::map<int, DrumPattern> loadedDrums;
+    for (unsigned long long e = 0; ok && e < entries; e++) {
+        unsigned long long kind = 0, thread = 0, role = 0, phase = 0;
+        ok = readLittleEndian(in, 1, kind) && readLittleEndian(in, 2, thread) &&
+             readLittleEndian(in, 1, role) && readLittleEndian(in, 2, phase);
+        if (ok && kind == ENTRY_SNIPPET) {
+            unsigned long long count = 0;
+            ok = readLittleEndian(in, 1, count);
+            std::vector<ProgramNote>& notes = loadedSnippets[Key(static_cast<int>(thread), static_cast<int>(role), static_cast<int>(phase))];
+            for (unsigned long long n = 0; ok && n < count; n++) {
+                unsigned long long pitch = 0, velocity = 0, duration = 0;
+                ok = readLittleEndian(in, 1, pitch) && readLittleEndian(in, 1, velocity) && readLittleEndian(in, 2, duration);
+                notes.push_back({static_cast<int>(pitch), static_cast<int>(velocity), static_cast<int>(duration)});
+            }
+        } else if (ok && kind == ENTRY_DRUM) {
+            DrumPattern pattern;
+            unsigned long long kick = 0, snare = 0, hihat = 0;
+            ok = readLittleEndian(in, 2, kick) && readLittleEndian(in, 2, snare) && readLittleEndian(in, 2, hihat);
+            for (int step = 0; ok && step < 16; step++) {
+                unsigned long long velocity = 0;
+                ok = readLittleEndian(in, 1, velocity);
+                pattern.kick[step] = (kick >> step) & 1;
+                pattern.snare[step] = (snare >> step) & 1;
+                pattern.hihat[step] = (hihat >> step) & 1;
+                pattern.velocities[step] = static_cast<int>(velocity);
+            }
+            loadedDrums[static_cast<int>(phase)] = pattern;
+        } else {
+            ok = false;
+        }
+    }
+    std::fclose(in);
+    if (!ok) return false;
+
+    snippets.insert(loadedSnippets.begin(), loadedSnippets.end());
+    drumPatterns.insert(loadedDrums.begin(), loadedDrums.end());
+    return true;
+}
+
+/**
+ * Writes every entry to the cache file if any were generated
+ * 
+ * @param directory Cache directory (created if missing)
+ * @return True if the cache is up to date
+ */
+bool PhaseProgram::save(const std::string& directory) const {
+    if (generatedCount == 0) return true;
+    if (directory.empty()) return false;
+
+    // Create the directory and its parent (~/.cache may not exist yet)
+    std::size_t slash = directory.rfind('/');
+    if (slash != std::string::npos && slash > 0) mkdir(directory.substr(0, slash).c_str(), 0755);
+    mkdir(directory.c_str(), 0755);
+
+    std::vector<unsigned char> bytes(CACHE_MAGIC, CACHE_MAGIC + sizeof(CACHE_MAGIC));
+    writeLittleEndian(bytes, generatorFingerprint(), 8);
+    writeLittleEndian(bytes, seed, 4);
+    writeLittleEndian(bytes, snippets.size() + drumPatterns.size(), 4);
+    for (const auto& entry : snippets) {
+        bytes.push_back(ENTRY_SNIPPET);
+        writeLittleEndian(bytes, std::get<0>(entry.first), 2);
+        writeLittleEndian(bytes, std::get<1>(entry.first), 1);
+        writeLittleEndian(bytes, std::get<2>(entry.first), 2);
+        writeLittleEndian(bytes, entry.second.size(), 1);
+        for (const ProgramNote& note : entry.second) {
+            writeLittleEndian(bytes, note.pitch, 1);
+            writeLittleEndian(bytes, note.velocity, 1);
+            writeLittleEndian(bytes, note.duration, 2);
+        }
+    }
+    for (const auto& entry : drumPatterns) {
+        bytes.push_back(ENTRY_DRUM);
+        writeLittleEndian(bytes, 0, 2);
+        writeLittleEndian(bytes, static_cast<int>(VoiceRole::Drum), 1);
+        writeLittleEndian(bytes, entry.first, 2);
+        unsigned int kick = 0, snare = 0, hihat = 0;
+        for (int step = 0; step < 16; step++) {
+            kick |= entry.second.kick[step] ? 1u << step : 0;
+            snare |= entry.second.snare[step] ? 1u << step : 0;
+            hihat |= entry.second.hihat[step] ? 1u << step : 0;
+        }
+        writeLittleEndian(bytes, kick, 2);
+        writeLittleEndian(bytes, snare, 2);
+        writeLittleEndian(bytes, hihat, 2);
+        for (int step = 0; step < 16; step++) writeLittleEndian(bytes, entry.second.velocities[step], 1);
+    }
+
+    std::string path = cachePath(directory);
+    std::string temporary = path + "." + std::to_string(getpid()) + ".tmp";
+    std::FILE* out = std::fopen(temporary.c_str(), "wb");
+    if (!out) return false;
+    bool ok = std::fwrite(bytes.data(), 1, bytes.size(), out) == bytes.size();
+    ok = (std::fclose(out) == 0) && ok;
+    ok = ok && std::rename(temporary.c_str(), path.c_str()) == 0;
+    if (!ok) std::remove(temporary.c_str());
+    return ok;
+}
+
+/**
+ * Appends the snippet of one thread and phase to its snippet table
+ * 
+ * @param table Snippet table that receives the phrase as its next snippet
+ * @param thread Thread ID
+ * @param role Musical role (selects register, scale and rhythm)
+ * @param phase Phase number
+ */
+void PhaseProgram::appendSnippet(SnippetTable& table, int thread, VoiceRole role, int phase) {
+    Key key(thread, static_cast<int>(role), phase);
+    const std::vector<ProgramNote>* notes = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(snippetMutex);
+        auto cached = snippets.find(key);
+        if (cached != snippets.end()) {
+            notes = &cached->second;
+            cachedCount++;
+        }
+    }
+    if (!notes) {
+        // A generator of its own, so the phrase only depends on its key
+        std::seed_seq sequence{seed, static_cast<unsigned int>(thread), static_cast<unsigned int>(role),
+                               static_cast<unsigned int>(phase)};
+        std::mt19937 gen(sequence);
+        int rootNote = PHASE_ROOTS[phase % PHASE_ROOTS.size()];
+        SnippetTable generated;
+        if (role == VoiceRole::Bass) {
+            // Bass phrases - provide harmonic foundation
+            const Scale& scale = (phase % 2 == 0) ? MAJOR_SCALE : MINOR_SCALE;
+            generateSnippet(generated, gen, BASS_LOW, BASS_HIGH, scale, rootNote, true);
+        } else if (role == VoiceRole::Mid) {
+            // Mid-range phrases - provide harmonic context
+            const Scale& scale = (phase % 3 == 0) ? MAJOR_SCALE :
+                                     (phase % 3 == 1) ? MINOR_SCALE : PENTA_SCALE;
+            generateSnippet(generated, gen, MID_LOW, MID_HIGH, scale, rootNote, false);
+        } else {
+            // Lead phrases - provide melodic interest
+            const Scale& scale = (phase % 3 == 0) ? PENTA_SCALE :
+                                     (phase % 3 == 1) ? MAJOR_SCALE : MINOR_SCALE;
+            generateSnippet(generated, gen, HIGH_LOW, HIGH_HIGH, scale, rootNote, false);
+        }
+
+        std::vector<ProgramNote> phrase;
+        for (std::size_t n = 0; n < generated.pitch.size(); n++) {
+            phrase.push_back({generated.pitch[n], generated.velocity[n], generated.duration[n]});
+        }
+        std::lock_guard<std::mutex> lock(snippetMutex);
+        notes = &snippets.emplace(key, phrase).first->second;
+        generatedCount++;
+    }
+
+    table.beginSnippet();
+    for (const ProgramNote& note : *notes) {
+        table.addNote(note.pitch, note.velocity, note.duration);
+    }
+}
+
+/**
+ * Returns the drum pattern of a phase
+ * 
+ * @param phase Phase number
+ * @return Pattern for the drum thread
+ */
+DrumPattern PhaseProgram::drumPattern(int phase) {
+    auto cached = drumPatterns.find(phase);
+    if (cached != drumPatterns.end()) {
+        cachedCount++;
+        return cached->second;
+    }
+    generatedCount++;
+    return drumPatterns.emplace(phase, generateDrumPattern(phase)).first->second;
+}
@@ -0,0 +1,367 @@
+#include "../../include/Voice.h"
+#include "../../include/Constants.h"
+#include "../../include/Counters.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+/**
+ * Computes the bar-aligned phase grid
+ * 
+ * @param durationSec Requested duration in seconds
+ * @param numPhases Number of musical phases
+ * @return Phase layout with phase boundaries on complete bars
+ */
+PhaseGrid computePhaseGrid(int durationSec, int numPhases) {
+    // Phase calculations with bar alignment for musical coherence
+    int ticksPerBar = BEATS_PER_BAR * TPQ;
+    double initialTotalTicks = durationSec * (TPQ * (TEMPO / 60.0));
+    double initialTicksPerPhase = (numPhases > 0) ? initialTotalTicks / numPhases : initialTotalTicks;
+
+    // Align phase boundaries to complete bars
+    int adjustedTicksPerPhase = 0;
+    if (ticksPerBar > 0 && initialTicksPerPhase > 0) {
+        adjustedTicksPerPhase = static_cast<int>(std::round(initialTicksPerPhase / static_cast<double>(ticksPerBar))) * ticksPerBar;
+        // Ensure minimum phase length of one bar
+        if (adjustedTicksPerPhase == 0) adjustedTicksPerPhase = ticksPerBar;
+    } else {
+        adjustedTicksPerPhase = static_cast<int>(initialTicksPerPhase);
+    }
+    if (adjustedTicksPerPhase < 0) adjustedTicksPerPhase = 0;
+
+    // Calculate adjusted total duration
+    PhaseGrid grid;
+    grid.ticksPerPhase = adjustedTicksPerPhase;
+    grid.numPhases = numPhases;
+    grid.totalTicks = adjustedTicksPerPhase * numPhases;
+    grid.durationSec = (TPQ > 0 && TEMPO > 0) ? grid.totalTicks / (TPQ * (TEMPO / 60.0)) : 0.0;
+    return grid;
+}
+
+/**
+ * Returns the phase containing a tick
+ * 
+ * @param grid Phase layout
+ * @param tick Absolute MIDI tick
+ * @return Phase number, clamped to the last phase
+ */
+int phaseAtTick(const PhaseGrid& grid, int tick) {
+    int phase = (grid.ticksPerPhase > 0) ? (tick / grid.ticksPerPhase) : 0;
+    if (phase >= grid.numPhases) phase = grid.numPhases - 1;
+    return phase;
+}
+
+/**
+ * Converts a wall-clock offset to a MIDI tick at the fixed tempo
+ * 
+ * @param ns Nanoseconds since the start of the piece
+ * @return Absolute MIDI tick
+ */
+int ticksFromNanoseconds(long long ns) {
+    return static_cast<int>(ns / 1e9 * (TPQ * (TEMPO / 60.0)));
+}
+
+MelodicVoice::MelodicVoice(ThreadData& data, const PhaseGrid& grid)
+    : data(data), events(*data.events), grid(grid) {}
+
+/**
+ * Starts the next snippet note of the current phase at a tick
+ * 
+ * @param tick Note start tick
+ */
+void MelodicVoice::startNote(int tick) {
+    SnippetTable& snippets = data.snippets;
+    if (currentPhase < 0 || currentPhase >= snippets.count()) {
+        noteIsOn = false;
+        return;
+    }
+
+    int note = snippets.nextNote(currentPhase % snippets.count());
+
+    if (note >= 0) {
+        currentNote = snippets.pitch[note];
+        noteDuration = snippets.duration[note];
+        events.noteOn(tick, data.channel, currentNote, snippets.velocity[note]);
+        if (data.counters) ThreadCounters::add(data.counters->notesStarted);
+        noteStartTick = tick;
+        noteIsOn = true;
+    } else {
+        noteIsOn = false;
+    }
+}
+
+/**
+ * Applies one observation of the thread's scheduling state
+ * 
+ * @param currentTick Current musical position in ticks
+ * @param isScheduled Whether the thread is currently scheduled
+ */
+void MelodicVoice::update(int currentTick, bool isScheduled) {
+    int newPhase = phaseAtTick(grid, currentTick);
+    advance(currentTick, newPhase, (newPhase + 1) * grid.ticksPerPhase, isScheduled);
+}
+
+/**
+ * Applies one observation at a beat published by the conductor
+ * 
+ * @param beat Current tick and phase
+ * @param isScheduled Whether the thread is currently scheduled
+ */
+void MelodicVoice::update(const Beat& beat, bool isScheduled) {
+    advance(beat.tick, beat.phase, beat.nextPhaseTick, isScheduled);
+}
+
+/**
+ * Handles phase transitions and scheduling state changes at one tick
+ * 
+ * @param currentTick Current musical position in ticks
+ * @param newPhase Phase containing currentTick
+ * @param nextPhaseTick First tick after newPhase
+ * @param isScheduled Whether the thread is currently scheduled
+ */
+void MelodicVoice::advance(int currentTick, int newPhase, int nextPhaseTick, bool isScheduled) {
+    int adjustedTicksPerPhase = grid.ticksPerPhase;
+
+    // Handle phase transitions
+    if (newPhase != currentPhase) {
+        // Mark phase transition in MIDI file
+        int phaseEventTick = newPhase * adjustedTicksPerPhase;
+
+        // End any active note at phase boundary
+        if (noteIsOn) {
+            int endTick = std::max(noteStartTick, phaseEventTick);
+            events.noteOff(endTick, data.channel, currentNote);
+            noteIsOn = false;
+            wasScheduled = false;
+            if (data.counters) ThreadCounters::add(data.counters->notesTruncated);
+        }
+
+        // Add phase marker
+        events.phaseMarker(phaseEventTick, newPhase);
+
+        currentPhase = newPhase;
+
+        // Reset snippet to start of phrase at phase change
+        if (currentPhase >= 0 && currentPhase < data.snippets.count()) {
+            data.snippets.reset(currentPhase % data.snippets.count());
+        }
+    }
+
+    // Handle scheduling state changes
+    if (isScheduled != wasScheduled) {
+        if (data.counters) ThreadCounters::add(data.counters->transitions);
+        if (isScheduled) {
+            // Thread just became scheduled - start playing a note
+            if (!noteIsOn && (adjustedTicksPerPhase == 0 || currentTick < nextPhaseTick)) {
+                startNote(currentTick);
+            }
+        } else {
+            // Thread just became descheduled - stop playing note
+            if (noteIsOn) {
+                int endTick = (adjustedTicksPerPhase > 0 && currentTick >= nextPhaseTick) ? nextPhaseTick : currentTick;
+                events.noteOff(endTick, data.channel, currentNote);
+                noteIsOn = false;
+                if (data.counters && endTick == nextPhaseTick && endTick < currentTick) {
+                    ThreadCounters::add(data.counters->notesTruncated);
+                }
+            }
+        }
+
+        wasScheduled = isScheduled;
+    }
+    // Continue to next note if current note has finished its duration
+    else if (isScheduled && noteIsOn && currentTick - noteStartTick >= noteDuration) {
+        int intendedEndTick = noteStartTick + noteDuration;
+        int endTick = (adjustedTicksPerPhase > 0 && intendedEndTick >= nextPhaseTick) ? 
+                      nextPhaseTick : intendedEndTick;
+
+        events.noteOff(endTick, data.channel, currentNote);
+        if (data.counters && endTick < intendedEndTick) ThreadCounters::add(data.counters->notesTruncated);
+
+        // Start next note if still within current phase
+        if (adjustedTicksPerPhase == 0 || endTick < nextPhaseTick) {
+            startNote(endTick);
+        } else {
+            noteIsOn = false;
+        }
+    }
+}
+
+/**
+ * Returns the next tick at which the voice changes on its own
+ * 
+ * @return Tick of the next internal transition, or INT_MAX if none
+ */
+int MelodicVoice::nextTransitionTick() const {
+    int next = INT_MAX;
+    if (currentPhase < 0) {
+        next = 0;
+    } else if (grid.ticksPerPhase > 0 && currentPhase < grid.numPhases - 1) {
+        next = (currentPhase + 1) * grid.ticksPerPhase;
+    }
+    if (noteIsOn && wasScheduled) {
+        next = std::min(next, noteStartTick + noteDuration);
+    }
+    return next;
+}
+
+/**
+ * Ends any sounding note and writes the final marker
+ * 
+ * @param lastTick Last tick observed by the caller
+ */
+void MelodicVoice::finish(int lastTick) {
+    // Clean up any active notes
+    if (noteIsOn) {
+        events.noteOff(grid.totalTicks, data.channel, currentNote);
+        noteIsOn = false;
+    }
+
+    // Add final marker
+    int finalMarkerTick = std::max(lastTick, grid.totalTicks);
+    events.endMarker(finalMarkerTick);
+}
+
+/**
+ * Plays a melodic voice from exact scheduling edges
+ * 
+ * Off-CPU gaps shorter than one tick cannot be represented in the MIDI
+ * grid and are skipped, so the current note carries on through them.
+ * 
+ * @param voice Voice to drive
+ * @param edges Scheduling edges in nanoseconds since the start, in time order
+ * @param grid Phase layout (defines where the piece ends)
+ */
+void playScheduleEdges(MelodicVoice& voice, const std::vector<SchedEdge>& edges, const PhaseGrid& grid) {
+    bool scheduled = true;
+    int lastTick = 0;
+
+    // Advance through note and phase transitions up to (not including) a tick
+    auto advanceTo = [&](int tick) {
+        int next;
+        while ((next = voice.nextTransitionTick()) < tick) {
+            voice.update(next, scheduled);
+            lastTick = next;
+        }
+    };
+
+    for (std::size_t i = 0; i < edges.size(); i++) {
+        int tick = ticksFromNanoseconds(edges[i].timeNs);
+        if (tick >= grid.totalTicks) break;
+        if (edges[i].onCpu == scheduled) continue;
+
+        // Skip sub-tick gaps: this edge is undone by the next one in the same tick
+        if (i + 1 < edges.size() && edges[i + 1].onCpu == scheduled &&
+            ticksFromNanoseconds(edges[i + 1].timeNs) == tick) {
+            i++;
+            continue;
+        }
+
+        advanceTo(tick + 1);
+        scheduled = edges[i].onCpu;
+        voice.update(tick, scheduled);
+        lastTick = tick;
+    }
+
+    advanceTo(grid.totalTicks);
+    voice.finish(lastTick);
+}
+
+DrumVoice::DrumVoice(ThreadData& data, const PhaseGrid& grid)
+    : data(data), events(*data.events), grid(grid) {
+    // Calculate musical grid divisions
+    int ticksPerBar = BEATS_PER_BAR * TPQ;
+    ticksPerStep = ticksPerBar / 4; // 16 steps per bar (16th notes)
+
+    // Each step is played at an absolute deadline on the grid
+    int stepTicks = std::max(1, ticksPerStep);
+    stepNs = static_cast<long long>(stepTicks * 60e9 / (TPQ * TEMPO));
+
+    // Steps run to the end of the last phase, like the melodic voices
+    stepCount = (grid.totalTicks + stepTicks - 1) / stepTicks;
+}
+
+/**
+ * Plays one grid step, marking a phase change first if it starts one
+ * 
+ * @param step Step number (steps may be skipped, but not replayed)
+ */
+void DrumVoice::playStep(long long step) {
+    // Calculate current musical position
+    currentTick = static_cast<int>(step * ticksPerStep);
+
+    // Handle phase transitions
+    int newPhase = phaseAtTick(grid, currentTick);
+
+    if (newPhase != currentPhase) {
+        // Mark phase transition in MIDI file
+        int phaseEventTick = newPhase * grid.ticksPerPhase;
+        events.phaseMarker(phaseEventTick, newPhase);
+
+        // Add crash cymbal at phase transitions for musical emphasis
+        events.noteOn(phaseEventTick, 9, CRASH, 110);
+        if (data.counters) ThreadCounters::add(data.counters->notesStarted);
+        events.noteOffLater(phaseEventTick + std::max(1, ticksPerStep), 9, CRASH);
+
+        currentPhase = newPhase;
+    }
+
+    // Calculate rhythmic grid position
+    int stepPosition = static_cast<int>(step % 16);
+    const DrumPattern& pattern = data.drumPatterns[currentPhase % data.drumPatterns.size()];
+
+    // Steps are already on the grid
+    int stepTick = currentTick;
+    if (data.counters) {
+        ThreadCounters::add(data.counters->notesStarted,
+                            pattern.kick[stepPosition] + pattern.snare[stepPosition] + pattern.hihat[stepPosition]);
+    }
+
+    // Add kick drum if pattern indicates
+    if (pattern.kick[stepPosition]) {
+        events.noteOn(stepTick, 9, KICK, pattern.velocities[stepPosition]);
+        events.noteOffLater(stepTick + std::max(1, ticksPerStep - 1), 9, KICK);
+    }
+
+    // Add snare drum if pattern indicates
+    if (pattern.snare[stepPosition]) {
+        events.noteOn(stepTick, 9, SNARE, pattern.velocities[stepPosition]);
+        events.noteOffLater(stepTick + std::max(1, ticksPerStep - 1), 9, SNARE);
+    }
+
+    // Add hi-hat if pattern indicates
+    if (pattern.hihat[stepPosition]) {
+        // Open hi-hat on strong beats, closed on others
+        int hihat = (stepPosition % 8 == 0) ? OPEN_HAT : CLOSED_HAT;
+        events.noteOn(stepTick, 9, hihat, pattern.velocities[stepPosition]);
+        events.noteOffLater(stepTick + std::max(1, ticksPerStep - 1), 9, hihat);
+    }
+}
+
+/**
+ * Writes the final marker
+ */
+void DrumVoice::finish() {
+    int finalMarkerTick = std::max(currentTick, grid.totalTicks);
+    events.endMarker(finalMarkerTick);
+}
+
+/**
+ * Plays a drum voice from a recorded timeline of missed steps
+ * 
+ * @param voice Voice to drive
+ * @param edges Off/on edges in nanoseconds since the start, in time order
+ */
+void playDrumSchedule(DrumVoice& voice, const std::vector<SchedEdge>& edges) {
+    std::size_t next = 0;
+    bool playing = true;
+    for (long long step = 0; step < voice.getStepCount(); step++) {
+        long long stepStartNs = step * voice.getStepNs();
+        while (next < edges.size() && edges[next].timeNs <= stepStartNs) {
+            playing = edges[next].onCpu;
+            next++;
+        }
+        if (playing) voice.playStep(step);
+    }
+    voice.finish();
+}
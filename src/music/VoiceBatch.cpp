@@ -0,0 +1,348 @@
+#include "../../include/VoiceBatch.h"
+#include "../../include/Constants.h"
+#include "../../include/Counters.h"
+#include <algorithm>
+#include <climits>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define THREAD_MUSIC_X86_LANES 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+const int LANE_WIDTH = 8; // int32 lanes per AVX2 register; batches are padded to a multiple
+
+// Event flag bits written by the lane pass
+const int32_t EVENT_OFF = 1;        // The sounding note ends at offTick
+const int32_t EVENT_ON = 2;         // A new note starts at onTick
+const int32_t EVENT_TRUNCATED = 4;  // The ended note was cut short by the phase end
+const int32_t EVENT_TRANSITION = 8; // The scheduling state changed
+
+// LaneArrays: The lane state and outputs one pass works on
+struct LaneArrays {
+    const int32_t* scheduled;
+    int32_t* wasScheduled;
+    int32_t* noteIsOn;
+    int32_t* currentNote;
+    int32_t* noteStartTick;
+    int32_t* noteDuration;
+    const int32_t* snippetBase;
+    const int32_t* snippetLength;
+    int32_t* cursor;
+    const int32_t* pitchTable;
+    const int32_t* velocityTable;
+    const int32_t* durationTable;
+    unsigned char* blockActive;
+    int32_t* offTick;
+    int32_t* offNote;
+    int32_t* onTick;
+    int32_t* onVelocity;
+    int32_t* eventFlags;
+};
+
+/**
+ * Advances lanes one at a time, without branches on lane state
+ * 
+ * @param a Lane arrays
+ * @param lanes Number of lanes
+ * @param tick Current tick
+ * @param limit First tick after the phase (INT_MAX without phases)
+ */
+void advanceLanesScalar(const LaneArrays& a, int lanes, int tick, int limit) {
+    for (int i = 0; i < lanes; i++) {
+        int32_t scheduled = a.scheduled[i];
+        int32_t was = a.wasScheduled[i];
+        int32_t on = a.noteIsOn[i];
+        int32_t start = a.noteStartTick[i];
+        int32_t duration = a.noteDuration[i];
+
+        bool changed = was != scheduled;
+        bool becameOff = changed && !scheduled;
+        bool becameOn = changed && scheduled;
+        bool steadyDone = !changed && scheduled && on && tick - start >= duration;
+
+        // A descheduled note ends now; a finished note ends on time; both stop at the phase end
+        int32_t intended = start + duration;
+        int32_t endOff = std::min(tick, limit);
+        int32_t endDone = std::min(intended, limit);
+        bool emitOff = (becameOff && on) || steadyDone;
+        int32_t end = becameOff ? endOff : endDone;
+        bool truncated = becameOff ? endOff < tick : endDone < intended;
+
+        // A newly scheduled voice starts a note now; a finished note chains to the next one
+        bool wantNote = (becameOn && !on && tick < limit) || (steadyDone && endDone < limit);
+        bool hasNote = wantNote && a.snippetLength[i] > 0;
+        int32_t index = hasNote ? a.snippetBase[i] + a.cursor[i] : 0;
+        int32_t nextCursor = a.cursor[i] + 1;
+
+        a.offTick[i] = end;
+        a.offNote[i] = a.currentNote[i];
+        a.onTick[i] = becameOn ? tick : endDone;
+        a.onVelocity[i] = hasNote ? a.velocityTable[index] : 0;
+        a.eventFlags[i] = (emitOff ? EVENT_OFF : 0) | (hasNote ? EVENT_ON : 0) |
+                          (emitOff && truncated ? EVENT_TRUNCATED : 0) | (changed ? EVENT_TRANSITION : 0);
+        if (i % LANE_WIDTH == 0) a.blockActive[i / LANE_WIDTH] = 0;
+        if (a.eventFlags[i] != 0) a.blockActive[i / LANE_WIDTH] = 1;
+
+        if (hasNote) {
+            a.currentNote[i] = a.pitchTable[index];
+            a.noteDuration[i] = a.durationTable[index];
+            a.noteStartTick[i] = a.onTick[i];
+            a.cursor[i] = nextCursor == a.snippetLength[i] ? 0 : nextCursor;
+        }
+        a.noteIsOn[i] = (emitOff || wantNote) ? (hasNote ? -1 : 0) : on;
+        a.wasScheduled[i] = scheduled;
+    }
+}
+
+#ifdef THREAD_MUSIC_X86_LANES
+/**
+ * Advances eight lanes per instruction; matches advanceLanesScalar()
+ * 
+ * @param a Lane arrays
+ * @param lanes Number of lanes (a multiple of LANE_WIDTH)
+ * @param tick Current tick
+ * @param limit First tick after the phase (INT_MAX without phases)
+ */
+__attribute__((target("avx2"))) void advanceLanesAvx2(const LaneArrays& a, int lanes, int tick, int limit) {
+    const __m256i now = _mm256_set1_epi32(tick);
+    const __m256i phaseEnd = _mm256_set1_epi32(limit);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i endOff = _mm256_min_epi32(now, phaseEnd);
+    const __m256i startable = _mm256_cmpgt_epi32(phaseEnd, now); // tick < limit
+
+    for (int i = 0; i < lanes; i += LANE_WIDTH) {
+        __m256i sched = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a.scheduled + i));
+        __m256i was = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a.wasScheduled + i));
+        __m256i on = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a.noteIsOn + i));
+        __m256i start = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a.noteStartTick + i));
+        __m256i duration = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a.noteDuration + i));
+
+        __m256i changed = _mm256_xor_si256(was, sched);
+        __m256i becameOff = _mm256_andnot_si256(sched, changed);
+        __m256i becameOn = _mm256_and_si256(sched, changed);
+        __m256i elapsed = _mm256_sub_epi32(now, start);
+        __m256i stillPlaying = _mm256_cmpgt_epi32(duration, elapsed);
+        __m256i steadyDone = _mm256_andnot_si256(_mm256_or_si256(changed, stillPlaying), _mm256_and_si256(sched, on));
+
+        // Most steps change nothing: skip the gathers and state stores of idle lanes
+        __m256i active = _mm256_or_si256(changed, steadyDone);
+        a.blockActive[i / LANE_WIDTH] = !_mm256_testz_si256(active, active);
+        if (!a.blockActive[i / LANE_WIDTH]) continue;
+        __m256i note = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a.currentNote + i));
+        __m256i cursor = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a.cursor + i));
+        __m256i base = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a.snippetBase + i));
+        __m256i length = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a.snippetLength + i));
+
+        __m256i intended = _mm256_add_epi32(start, duration);
+        __m256i endDone = _mm256_min_epi32(intended, phaseEnd);
+        __m256i emitOff = _mm256_or_si256(_mm256_and_si256(becameOff, on), steadyDone);
+        __m256i end = _mm256_blendv_epi8(endDone, endOff, becameOff);
+        __m256i truncated = _mm256_blendv_epi8(_mm256_cmpgt_epi32(intended, endDone),
+                                               _mm256_cmpgt_epi32(now, endOff), becameOff);
+
+        __m256i wantNote = _mm256_or_si256(_mm256_and_si256(becameOn, _mm256_andnot_si256(on, startable)),
+                                           _mm256_and_si256(steadyDone, _mm256_cmpgt_epi32(phaseEnd, endDone)));
+        __m256i hasNote = _mm256_and_si256(wantNote, _mm256_cmpgt_epi32(length, zero));
+        __m256i index = _mm256_add_epi32(base, cursor);
+        __m256i pitch = _mm256_mask_i32gather_epi32(note, reinterpret_cast<const int*>(a.pitchTable), index, hasNote, 4);
+        __m256i velocity = _mm256_mask_i32gather_epi32(zero, reinterpret_cast<const int*>(a.velocityTable), index, hasNote, 4);
+        __m256i nextDuration = _mm256_mask_i32gather_epi32(duration, reinterpret_cast<const int*>(a.durationTable), index, hasNote, 4);
+        __m256i onAt = _mm256_blendv_epi8(endDone, now, becameOn);
+
+        __m256i nextCursor = _mm256_add_epi32(cursor, one);
+        nextCursor = _mm256_andnot_si256(_mm256_cmpeq_epi32(nextCursor, length), nextCursor);
+        __m256i flags = _mm256_or_si256(
+            _mm256_or_si256(_mm256_and_si256(emitOff, _mm256_set1_epi32(EVENT_OFF)), _mm256_and_si256(hasNote, _mm256_set1_epi32(EVENT_ON))),
+            _mm256_or_si256(_mm256_and_si256(_mm256_and_si256(emitOff, truncated), _mm256_set1_epi32(EVENT_TRUNCATED)),
+                            _mm256_and_si256(changed, _mm256_set1_epi32(EVENT_TRANSITION))));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(a.offTick + i), end);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(a.offNote + i), note);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(a.onTick + i), onAt);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(a.onVelocity + i), velocity);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(a.eventFlags + i), flags);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(a.currentNote + i), pitch);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(a.noteDuration + i), nextDuration);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(a.noteStartTick + i), _mm256_blendv_epi8(start, onAt, hasNote));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(a.cursor + i), _mm256_blendv_epi8(cursor, nextCursor, hasNote));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(a.noteIsOn + i),
+                            _mm256_blendv_epi8(on, hasNote, _mm256_or_si256(emitOff, wantNote)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(a.wasScheduled + i), sched);
+    }
+}
+#endif
+
+/**
+ * Returns whether the lane pass can use AVX2 on this CPU
+ * 
+ * @return True if AVX2 is supported
+ */
+bool detectAvx2Lanes() {
+#ifdef THREAD_MUSIC_X86_LANES
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+bool avx2LanesInUse = detectAvx2Lanes();
+
+} // namespace
+
+VoiceBatch::VoiceBatch(const std::vector<ThreadData*>& voices, const PhaseGrid& grid)
+    : voices(voices), grid(grid), count(static_cast<int>(voices.size())) {
+    padded = (count + LANE_WIDTH - 1) / LANE_WIDTH * LANE_WIDTH;
+
+    // Copy every snippet table into the flat tables the lane pass gathers from
+    for (ThreadData* data : voices) {
+        tableBase.push_back(static_cast<int>(pitchTable.size()));
+        pitchTable.insert(pitchTable.end(), data->snippets.pitch.begin(), data->snippets.pitch.end());
+        velocityTable.insert(velocityTable.end(), data->snippets.velocity.begin(), data->snippets.velocity.end());
+        durationTable.insert(durationTable.end(), data->snippets.duration.begin(), data->snippets.duration.end());
+    }
+
+    // Padding lanes never have a note or a snippet, so the pass leaves them silent
+    for (std::vector<int32_t>* lane : {&scheduled, &wasScheduled, &noteIsOn, &currentNote, &noteStartTick, &noteDuration,
+                                       &snippetBase, &snippetLength, &cursor,
+                                       &offTick, &offNote, &onTick, &onVelocity, &eventFlags}) {
+        lane->assign(padded, 0);
+    }
+    std::fill(currentNote.begin(), currentNote.end(), -1);
+    blockActive.assign(padded / LANE_WIDTH, 0);
+}
+
+/**
+ * Returns the instruction set of the lane pass
+ * 
+ * @return "avx2" or "scalar"
+ */
+const char* VoiceBatch::variant() {
+    return avx2LanesInUse ? "avx2" : "scalar";
+}
+
+/**
+ * Selects the instruction set of the lane pass, so a check can compare them
+ * 
+ * Call before any batch is updated; batches are not synchronized with it
+ * 
+ * @param avx2 True for AVX2, false for the scalar pass
+ * @return False if AVX2 was requested and the CPU does not support it
+ */
+bool VoiceBatch::selectVariant(bool avx2) {
+    if (avx2 && !detectAvx2Lanes()) return false;
+    avx2LanesInUse = avx2;
+    return true;
+}
+
+/**
+ * Moves one voice to a new phase, ending its note at the phase boundary
+ * 
+ * @param lane Voice index
+ * @param newPhase Phase to enter
+ */
+void VoiceBatch::changePhase(int lane, int newPhase) {
+    ThreadData& data = *voices[lane];
+    SnippetTable& snippets = data.snippets;
+    int phaseEventTick = newPhase * grid.ticksPerPhase;
+
+    // End any active note at phase boundary
+    if (noteIsOn[lane]) {
+        data.events->noteOff(std::max(static_cast<int>(noteStartTick[lane]), phaseEventTick), data.channel, currentNote[lane]);
+        noteIsOn[lane] = 0;
+        wasScheduled[lane] = 0;
+        if (data.counters) ThreadCounters::add(data.counters->notesTruncated);
+    }
+
+    data.events->phaseMarker(phaseEventTick, newPhase);
+
+    // Keep the cursor of the snippet being left, and start the new one from its first note
+    if (currentPhase >= 0 && currentPhase < snippets.count()) snippets.cursor[currentPhase] = cursor[lane];
+    cursor[lane] = 0;
+    if (newPhase >= 0 && newPhase < snippets.count()) {
+        snippets.reset(newPhase);
+        snippetBase[lane] = tableBase[lane] + snippets.offset[newPhase];
+        snippetLength[lane] = snippets.offset[newPhase + 1] - snippets.offset[newPhase];
+    } else {
+        snippetLength[lane] = 0;
+    }
+}
+
+/**
+ * Applies one observation to every voice of the batch
+ * 
+ * @param currentTick Current musical position in ticks
+ * @param isScheduled Whether each voice is currently scheduled (nonzero), one entry per voice
+ */
+void VoiceBatch::update(int currentTick, const std::vector<unsigned char>& isScheduled) {
+    if (count == 0) return;
+    for (int lane = 0; lane < count; lane++) {
+        scheduled[lane] = isScheduled[lane] ? -1 : 0;
+    }
+
+    // Every voice sees the same tick, so they all change phase together
+    int newPhase = phaseAtTick(grid, currentTick);
+    if (newPhase != currentPhase) {
+        for (int lane = 0; lane < count; lane++) {
+            changePhase(lane, newPhase);
+        }
+        currentPhase = newPhase;
+    }
+
+    int limit = (grid.ticksPerPhase > 0) ? (newPhase + 1) * grid.ticksPerPhase : INT_MAX;
+    LaneArrays arrays = {scheduled.data(), wasScheduled.data(), noteIsOn.data(), currentNote.data(), noteStartTick.data(),
+                         noteDuration.data(), snippetBase.data(), snippetLength.data(), cursor.data(),
+                         pitchTable.data(), velocityTable.data(), durationTable.data(), blockActive.data(),
+                         offTick.data(), offNote.data(), onTick.data(), onVelocity.data(), eventFlags.data()};
+#ifdef THREAD_MUSIC_X86_LANES
+    if (avx2LanesInUse) {
+        advanceLanesAvx2(arrays, padded, currentTick, limit);
+        emit();
+        return;
+    }
+#endif
+    advanceLanesScalar(arrays, padded, currentTick, limit);
+    emit();
+}
+
+/**
+ * Copies the events of the last lane pass into each voice's buffer
+ */
+void VoiceBatch::emit() {
+    for (int lane = 0; lane < count; lane++) {
+        if (!blockActive[lane / LANE_WIDTH]) {
+            lane += LANE_WIDTH - 1;
+            continue;
+        }
+        int32_t flags = eventFlags[lane];
+        if (flags == 0) continue;
+        ThreadData& data = *voices[lane];
+        if (flags & EVENT_OFF) data.events->noteOff(offTick[lane], data.channel, offNote[lane]);
+        if (flags & EVENT_ON) data.events->noteOn(onTick[lane], data.channel, currentNote[lane], onVelocity[lane]);
+        if (data.counters) {
+            if (flags & EVENT_TRANSITION) ThreadCounters::add(data.counters->transitions);
+            if (flags & EVENT_ON) ThreadCounters::add(data.counters->notesStarted);
+            if (flags & EVENT_TRUNCATED) ThreadCounters::add(data.counters->notesTruncated);
+        }
+    }
+}
+
+/**
+ * Ends any sounding notes and writes the final markers
+ * 
+ * @param lastTick Last tick observed by the caller
+ */
+void VoiceBatch::finish(int lastTick) {
+    for (int lane = 0; lane < count; lane++) {
+        ThreadData& data = *voices[lane];
+        if (noteIsOn[lane]) {
+            data.events->noteOff(grid.totalTicks, data.channel, currentNote[lane]);
+            noteIsOn[lane] = 0;
+        }
+        if (currentPhase >= 0 && currentPhase < data.snippets.count()) data.snippets.cursor[currentPhase] = cursor[lane];
+        data.events->endMarker(std::max(lastTick, grid.totalTicks));
+    }
+}
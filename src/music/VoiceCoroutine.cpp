@@ -0,0 +1,310 @@
+#include "../../include/VoiceCoroutine.h"
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <new>
+#include <queue>
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define THREAD_MUSIC_HAVE_COROUTINES 1
+#endif
+
+/**
+ * Parses a voice engine name from the command line
+ * 
+ * @param name "thread", "coroutine", or "batch"
+ * @param engine Receives the engine
+ * @return True if the name was recognized
+ */
+bool parseVoiceEngine(const std::string& name, VoiceEngine& engine) {
+    if (name == "thread") engine = VoiceEngine::Thread;
+    else if (name == "coroutine") engine = VoiceEngine::Coroutine;
+    else if (name == "batch") engine = VoiceEngine::Batch;
+    else return false;
+    return true;
+}
+
+#ifdef THREAD_MUSIC_HAVE_COROUTINES
+
+// Heap bytes of every voice coroutine frame created so far
+static std::atomic<std::size_t> allocatedFrameBytes{0};
+
+/**
+ * VoiceTask: Owning handle of a voice coroutine
+ * 
+ * The coroutine starts suspended and stays suspended at its end, so the
+ * owner decides when it first runs and when its frame is freed.
+ */
+class VoiceTask {
+public:
+    struct promise_type {
+        VoiceTask get_return_object() {
+            return VoiceTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+
+        // Frames are counted so the per-voice cost can be reported
+        static void* operator new(std::size_t size) {
+            allocatedFrameBytes.fetch_add(size, std::memory_order_relaxed);
+            return ::operator new(size);
+        }
+        static void operator delete(void* frame) { ::operator delete(frame); }
+    };
+
+    explicit VoiceTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+    VoiceTask(VoiceTask&& other) noexcept : handle(other.handle) { other.handle = nullptr; }
+    ~VoiceTask() {
+        if (handle) handle.destroy();
+    }
+
+    VoiceTask(const VoiceTask&) = delete;
+    VoiceTask& operator=(const VoiceTask&) = delete;
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+/**
+ * VoiceLoop: Single-threaded event loop that resumes voices in tick order
+ * 
+ * Voices suspend with sleepUntil(tick); awaiting a tick that has already
+ * been reached continues without suspending.
+ */
+class VoiceLoop {
+public:
+    // Sleep: Awaitable that wakes the voice at a tick
+    struct Sleep {
+        VoiceLoop& loop;
+        int tick;
+
+        bool await_ready() const noexcept { return tick <= loop.currentTick; }
+        void await_suspend(std::coroutine_handle<> handle) { loop.schedule(tick, handle); }
+        void await_resume() const noexcept {}
+    };
+
+    Sleep sleepUntil(int tick) { return {*this, tick}; }
+
+    void schedule(int tick, std::coroutine_handle<> handle) {
+        wakes.push({tick, order++, handle});
+    }
+
+    /**
+     * Resumes voices until none is waiting
+     * 
+     * @return Number of resumptions
+     */
+    long long run() {
+        long long resumes = 0;
+        while (!wakes.empty()) {
+            Wake wake = wakes.top();
+            wakes.pop();
+            currentTick = wake.tick;
+            wake.handle.resume();
+            resumes++;
+        }
+        return resumes;
+    }
+
+private:
+    struct Wake {
+        int tick;
+        long long order; // Keeps voices waking at the same tick in scheduling order
+        std::coroutine_handle<> handle;
+
+        bool operator>(const Wake& other) const {
+            return tick != other.tick ? tick > other.tick : order > other.order;
+        }
+    };
+
+    std::priority_queue<Wake, std::vector<Wake>, std::greater<Wake>> wakes;
+    long long order = 0;
+    int currentTick = -1;
+};
+
+/**
+ * Plays one voice from scheduling edges, following the same steps as
+ * playScheduleEdges() but sleeping between them instead of looping
+ * 
+ * @param loop Event loop that resumes the voice
+ * @param data Thread configuration of the voice
+ * @param edges Scheduling edges in nanoseconds since the start, in time order
+ * @param grid Phase layout (defines where the piece ends)
+ */
+static VoiceTask edgeDrivenVoice(VoiceLoop& loop, ThreadData& data, const std::vector<SchedEdge>& edges, PhaseGrid grid) {
+    MelodicVoice voice(data, grid);
+    bool scheduled = true;
+    int lastTick = 0;
+    int next;
+
+    for (std::size_t i = 0; i < edges.size(); i++) {
+        int tick = ticksFromNanoseconds(edges[i].timeNs);
+        if (tick >= grid.totalTicks) break;
+        if (edges[i].onCpu == scheduled) continue;
+
+        // Skip sub-tick gaps: this edge is undone by the next one in the same tick
+        if (i + 1 < edges.size() && edges[i + 1].onCpu == scheduled &&
+            ticksFromNanoseconds(edges[i + 1].timeNs) == tick) {
+            i++;
+            continue;
+        }
+
+        // Timer expiries (note ends, phase starts) up to the edge
+        while ((next = voice.nextTransitionTick()) < tick + 1) {
+            co_await loop.sleepUntil(next);
+            voice.update(next, scheduled);
+            lastTick = next;
+        }
+
+        co_await loop.sleepUntil(tick);
+        scheduled = edges[i].onCpu;
+        voice.update(tick, scheduled);
+        lastTick = tick;
+    }
+
+    while ((next = voice.nextTransitionTick()) < grid.totalTicks) {
+        co_await loop.sleepUntil(next);
+        voice.update(next, scheduled);
+        lastTick = next;
+    }
+    voice.finish(lastTick);
+}
+
+// Observation: One scheduling observation handed to a resumed voice
+struct Observation {
+    int tick = 0;
+    bool scheduled = false;
+    bool finish = false;
+};
+
+// Receive: Awaitable that suspends until the owner resumes the voice with an observation
+struct Receive {
+    const Observation& inbox;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<>) const noexcept {}
+    Observation await_resume() const noexcept { return inbox; }
+};
+
+/**
+ * Applies observations to a voice until told to finish
+ * 
+ * @param data Thread configuration of the voice
+ * @param grid Phase layout shared by all melodic threads
+ * @param inbox Observation written by the owner before each resume
+ */
+static VoiceTask observedVoice(ThreadData& data, PhaseGrid grid, const Observation& inbox) {
+    MelodicVoice voice(data, grid);
+    while (true) {
+        Observation observation = co_await Receive{inbox};
+        if (observation.finish) {
+            voice.finish(observation.tick);
+            co_return;
+        }
+        voice.update(observation.tick, observation.scheduled);
+    }
+}
+
+bool coroutineEngineAvailable() {
+    return true;
+}
+
+/**
+ * Renders melodic voices from scheduling edges on a single event loop
+ * 
+ * @param voices Melodic thread configurations
+ * @param edges Scheduling edges of each voice, in nanoseconds since the start
+ * @param grid Phase layout shared by all melodic voices
+ * @return Coroutine counts and frame memory
+ */
+CoroutineStats renderWithCoroutines(const std::vector<ThreadData*>& voices,
+                                    const std::vector<const std::vector<SchedEdge>*>& edges,
+                                    const PhaseGrid& grid) {
+    CoroutineStats stats;
+    std::size_t bytesBefore = allocatedFrameBytes.load(std::memory_order_relaxed);
+    VoiceLoop loop;
+    std::vector<VoiceTask> tasks;
+    tasks.reserve(voices.size());
+    for (std::size_t i = 0; i < voices.size(); i++) {
+        tasks.push_back(edgeDrivenVoice(loop, *voices[i], *edges[i], grid));
+        loop.schedule(0, tasks.back().handle);
+    }
+    stats.voices = static_cast<long long>(tasks.size());
+    stats.resumes = loop.run();
+    stats.frameBytes = allocatedFrameBytes.load(std::memory_order_relaxed) - bytesBefore;
+    return stats;
+}
+
+// CoroutineVoice::State: The suspended voice and the observation it receives next
+struct CoroutineVoice::State {
+    Observation inbox;
+    VoiceTask task;
+
+    State(ThreadData& data, const PhaseGrid& grid) : task(observedVoice(data, grid, inbox)) {
+        task.handle.resume(); // Run up to the first co_await
+    }
+
+    void resume(const Observation& observation) {
+        if (task.handle.done()) return;
+        inbox = observation;
+        task.handle.resume();
+    }
+};
+
+CoroutineVoice::CoroutineVoice(ThreadData& data, const PhaseGrid& grid) : state(new State(data, grid)) {}
+
+CoroutineVoice::~CoroutineVoice() = default;
+
+void CoroutineVoice::update(int currentTick, bool isScheduled) {
+    state->resume({currentTick, isScheduled, false});
+}
+
+void CoroutineVoice::finish(int lastTick) {
+    state->resume({lastTick, false, true});
+}
+
+std::size_t CoroutineVoice::totalFrameBytes() {
+    return allocatedFrameBytes.load(std::memory_order_relaxed);
+}
+
+#else // Without coroutine support the same entry points run the thread engine
+
+bool coroutineEngineAvailable() {
+    return false;
+}
+
+CoroutineStats renderWithCoroutines(const std::vector<ThreadData*>& voices,
+                                    const std::vector<const std::vector<SchedEdge>*>& edges,
+                                    const PhaseGrid& grid) {
+    for (std::size_t i = 0; i < voices.size(); i++) {
+        MelodicVoice voice(*voices[i], grid);
+        playScheduleEdges(voice, *edges[i], grid);
+    }
+    return CoroutineStats();
+}
+
+struct CoroutineVoice::State {
+    MelodicVoice voice;
+
+    State(ThreadData& data, const PhaseGrid& grid) : voice(data, grid) {}
+};
+
+CoroutineVoice::CoroutineVoice(ThreadData& data, const PhaseGrid& grid) : state(new State(data, grid)) {}
+
+CoroutineVoice::~CoroutineVoice() = default;
+
+void CoroutineVoice::update(int currentTick, bool isScheduled) {
+    state->voice.update(currentTick, isScheduled);
+}
+
+void CoroutineVoice::finish(int lastTick) {
+    state->voice.finish(lastTick);
+}
+
+std::size_t CoroutineVoice::totalFrameBytes() {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,102 @@
+#include "../../include/Detector.h"
+#include <algorithm>
+#include <cmath>
+
+/**
+ * Parses a detector name from the command line
+ * 
+ * @param name "legacy" or "adaptive"
+ * @param kind Receives the detector
+ * @return True if the name was recognized
+ */
+bool parseDetectorKind(const std::string& name, DetectorKind& kind) {
+    if (name == "legacy") kind = DetectorKind::Legacy;
+    else if (name == "adaptive") kind = DetectorKind::Adaptive;
+    else return false;
+    return true;
+}
+
+/**
+ * Returns the command-line name of a detector
+ * 
+ * @param kind Detector
+ * @return "legacy" or "adaptive"
+ */
+const char* detectorKindName(DetectorKind kind) {
+    return kind == DetectorKind::Legacy ? "legacy" : "adaptive";
+}
+
+/**
+ * @param kind Policy that decides the reported state
+ * @param startNs Time of the first sample's predecessor, in nanoseconds since the start
+ * @param startCpuSec CPU time at startNs, in seconds
+ */
+SchedulingDetector::SchedulingDetector(DetectorKind kind, long long startNs, double startCpuSec)
+    : kind(kind), lastNs(startNs), lastWallSec(startNs / 1000000 / 1000.0), lastCpuSec(startCpuSec),
+      lastChangeNs(startNs) {}
+
+/**
+ * Takes one sample and returns the detected state
+ * 
+ * @param nowNs Nanoseconds since the start of the piece
+ * @param cpuSec CPU time of the thread, in seconds
+ * @param sleptNs Time spent in sleep calls since the previous sample, in nanoseconds
+ * @return True if the thread is considered scheduled
+ */
+bool SchedulingDetector::sample(long long nowNs, double cpuSec, long long sleptNs) {
+    double cpuDeltaSec = cpuSec - lastCpuSec;
+
+    // Legacy policy: ratio of the last sample, wall time in whole milliseconds
+    double wallSec = nowNs / 1000000 / 1000.0;
+    double wallDeltaSec = wallSec - lastWallSec;
+    double schedulingRatio = (wallDeltaSec > 0) ? cpuDeltaSec / wallDeltaSec : 0;
+    bool legacy = schedulingRatio > SCHEDULE_THRESHOLD;
+    if (legacy != legacyScheduled) {
+        legacyScheduled = legacy;
+        legacyChanges++;
+    }
+
+    adaptiveSample(nowNs - lastNs, cpuDeltaSec, sleptNs, nowNs);
+
+    lastNs = nowNs;
+    lastWallSec = wallSec;
+    lastCpuSec = cpuSec;
+    return kind == DetectorKind::Legacy ? legacyScheduled : adaptiveScheduled;
+}
+
+/**
+ * Applies one sample to the adaptive policy
+ * 
+ * @param wallDeltaNs Wall time since the previous sample
+ * @param cpuDeltaSec CPU time since the previous sample
+ * @param sleptNs Time spent in sleep calls since the previous sample
+ * @param nowNs Nanoseconds since the start of the piece
+ */
+void SchedulingDetector::adaptiveSample(long long wallDeltaNs, double cpuDeltaSec, long long sleptNs, long long nowNs) {
+    // Whatever the thread neither ran nor slept, it waited for the CPU; a sample without elapsed time carries no information
+    if (wallDeltaNs <= 0) return;
+    long long gapNs = wallDeltaNs - std::llround(cpuDeltaSec * 1e9) - sleptNs;
+    double fraction = std::max(0LL, gapNs) / static_cast<double>(wallDeltaNs);
+    smoothed = (samples == 0) ? fraction : smoothed + DETECTOR_EWMA_ALPHA * (fraction - smoothed);
+    samples++;
+
+    // Measure the fraction's noise, then place the thresholds above its mean
+    if (samples <= DETECTOR_CALIBRATION_SAMPLES) {
+        double delta = fraction - mean;
+        mean += delta / samples;
+        squares += delta * (fraction - mean);
+        if (samples == DETECTOR_CALIBRATION_SAMPLES) {
+            double deviation = std::sqrt(squares / (DETECTOR_CALIBRATION_SAMPLES - 1));
+            offThreshold = std::min(mean + DETECTOR_NOISE_DEVIATIONS * deviation, 1.0);
+            onThreshold = mean + (offThreshold - mean) / 2;
+        }
+    }
+
+    // Hysteresis: leave a state only past its own threshold, and only after the minimum length
+    bool wanted = adaptiveScheduled ? smoothed < offThreshold : smoothed <= onThreshold;
+    if (wanted != adaptiveScheduled && nowNs - lastChangeNs >= DETECTOR_MIN_STATE_MS * 1000000LL) {
+        adaptiveScheduled = wanted;
+        lastChangeNs = nowNs;
+        adaptiveChanges++;
+    }
+}
@@ -0,0 +1,267 @@
+#include "../../include/Priority.h"
+#include "../../include/Utils.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Per-run cgroup state, undone by removeCgroups()
+static std::vector<std::string> createdCgroups;    // Directories this run created
+static std::vector<std::string> cpuEnabledParents; // Parents where this run enabled the cpu controller
+
+/**
+ * Parses a whole decimal integer
+ * 
+ * @param text Digits with an optional sign
+ * @param value Receives the number
+ * @return True if the text was a number
+ */
+static bool parseInteger(const std::string& text, int& value) {
+    if (text.empty()) return false;
+    char* end = nullptr;
+    long parsed = std::strtol(text.c_str(), &end, 10);
+    if (*end != '\0') return false;
+    value = static_cast<int>(parsed);
+    return true;
+}
+
+/**
+ * Parses a scheduling policy from the command line
+ * 
+ * @param text Policy text
+ * @param policy Receives the parsed policy
+ * @return True if the text was recognized
+ */
+bool parseSchedPolicy(const std::string& text, SchedPolicy& policy) {
+    SchedPolicy parsed;
+    std::size_t start = 0;
+    while (start <= text.size()) {
+        std::size_t end = text.find(',', start);
+        if (end == std::string::npos) end = text.size();
+        std::string item = text.substr(start, end - start);
+        std::string name = item.substr(0, item.find(':'));
+        std::string argument = (item.find(':') != std::string::npos) ? item.substr(item.find(':') + 1) : "";
+        start = end + 1;
+
+        if ((name == "default" || name == "other") && argument.empty()) {
+            parsed.kind = SchedPolicy::Default;
+        } else if (name == "fifo" || name == "rr") {
+            parsed.kind = (name == "fifo") ? SchedPolicy::Fifo : SchedPolicy::RoundRobin;
+            if (!parseInteger(argument, parsed.priority) || parsed.priority < 1 || parsed.priority > 99) return false;
+        } else if (name == "batch" && argument.empty()) {
+            parsed.kind = SchedPolicy::Batch;
+        } else if (name == "idle" && argument.empty()) {
+            parsed.kind = SchedPolicy::Idle;
+        } else if (name == "nice") {
+            if (!parseInteger(argument, parsed.nice) || parsed.nice < -20 || parsed.nice > 19) return false;
+            parsed.setNice = true;
+        } else if (name == "cgroup") {
+            std::size_t colon = argument.find(':');
+            parsed.cgroup = argument.substr(0, colon);
+            if (parsed.cgroup.empty() || parsed.cgroup.find('/') != std::string::npos) return false;
+            if (colon != std::string::npos &&
+                (!parseInteger(argument.substr(colon + 1), parsed.cpuQuotaPercent) || parsed.cpuQuotaPercent <= 0)) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    policy = parsed;
+    return true;
+}
+
+/**
+ * Formats a policy the way parseSchedPolicy() reads it
+ * 
+ * @param policy Scheduling policy
+ * @return Policy text ("default" when nothing is changed)
+ */
+std::string schedPolicyName(const SchedPolicy& policy) {
+    std::string text;
+    switch (policy.kind) {
+        case SchedPolicy::Default: break;
+        case SchedPolicy::Fifo: text = "fifo:" + std::to_string(policy.priority); break;
+        case SchedPolicy::RoundRobin: text = "rr:" + std::to_string(policy.priority); break;
+        case SchedPolicy::Batch: text = "batch"; break;
+        case SchedPolicy::Idle: text = "idle"; break;
+    }
+    auto append = [&](const std::string& item) {
+        text += (text.empty() ? "" : ",") + item;
+    };
+    if (policy.setNice) append("nice:" + std::to_string(policy.nice));
+    if (!policy.cgroup.empty()) {
+        append("cgroup:" + policy.cgroup +
+               (policy.cpuQuotaPercent > 0 ? ":" + std::to_string(policy.cpuQuotaPercent) : ""));
+    }
+    return text.empty() ? "default" : text;
+}
+
+/**
+ * Returns whether a policy changes anything about a thread
+ * 
+ * @param policy Scheduling policy
+ * @return False for the default policy without nice or cgroup
+ */
+bool isCustomSchedPolicy(const SchedPolicy& policy) {
+    return policy.kind != SchedPolicy::Default || policy.setNice || !policy.cgroup.empty();
+}
+
+/**
+ * Writes a value to a cgroup control file
+ * 
+ * @param path Control file
+ * @param value Text to write
+ * @return True on success
+ */
+static bool writeControl(const std::string& path, const std::string& value) {
+    std::ofstream out(path);
+    out << value;
+    out.flush();
+    return static_cast<bool>(out);
+}
+
+/**
+ * Creates the cgroup of a policy below this process's cgroup and sets its quota
+ * 
+ * @param policy Policy whose cgroup to prepare
+ * @param error Receives the reason on failure
+ * @return True on success (always false where cgroup v2 is unavailable)
+ */
+bool prepareCgroup(SchedPolicy& policy, std::string& error) {
+#if defined(__linux__)
+    // cgroup v2 lists a single "0::/path" entry
+    std::ifstream self("/proc/self/cgroup");
+    std::string line, current;
+    while (std::getline(self, line)) {
+        if (line.compare(0, 3, "0::") == 0) current = line.substr(3);
+    }
+    if (current.empty() || !std::ifstream("/sys/fs/cgroup/cgroup.controllers")) {
+        error = "cgroup v2 is not mounted at /sys/fs/cgroup";
+        return false;
+    }
+    std::string parent = "/sys/fs/cgroup" + (current == "/" ? std::string() : current);
+    std::string path = parent + "/thread-music-" + policy.cgroup;
+
+    if (mkdir(path.c_str(), 0755) == 0) {
+        createdCgroups.push_back(path);
+    } else if (errno != EEXIST) {
+        error = "cannot create " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    if (!writeControl(path + "/cgroup.type", "threaded")) {
+        error = "cannot make " + path + " threaded";
+        return false;
+    }
+    if (policy.cpuQuotaPercent > 0) {
+        // The cpu controller must be enabled for the children; it may already be
+        std::ifstream controlIn(parent + "/cgroup.subtree_control");
+        std::string controller;
+        bool enabled = false;
+        while (controlIn >> controller) enabled = enabled || controller == "cpu";
+        if (!enabled && writeControl(parent + "/cgroup.subtree_control", "+cpu")) {
+            cpuEnabledParents.push_back(parent);
+        }
+        long periodUs = 100000;
+        long quotaUs = periodUs * policy.cpuQuotaPercent / 100;
+        if (!writeControl(path + "/cpu.max", std::to_string(quotaUs) + " " + std::to_string(periodUs))) {
+            error = "cannot set cpu.max of " + path;
+            return false;
+        }
+    }
+    policy.cgroupPath = path;
+    return true;
+#else
+    (void)policy;
+    error = "cgroups are Linux-only";
+    return false;
+#endif
+}
+
+/**
+ * Removes the cgroups prepareCgroup() created in this run
+ * 
+ * @param error Receives the groups that could not be removed
+ * @return True if everything created was removed
+ */
+bool removeCgroups(std::string& error) {
+    bool ok = true;
+#if defined(__linux__)
+    // Children first, then the controllers their parents only enabled for them
+    for (auto it = createdCgroups.rbegin(); it != createdCgroups.rend(); ++it) {
+        if (rmdir(it->c_str()) != 0 && errno != ENOENT) {
+            error += (error.empty() ? "" : "; ") + std::string("cannot remove ") + *it + ": " + std::strerror(errno);
+            ok = false;
+        }
+    }
+    for (const auto& parent : cpuEnabledParents) {
+        if (!writeControl(parent + "/cgroup.subtree_control", "-cpu")) {
+            error += (error.empty() ? "" : "; ") + std::string("cannot disable cpu in ") + parent;
+            ok = false;
+        }
+    }
+#endif
+    createdCgroups.clear();
+    cpuEnabledParents.clear();
+    return ok;
+}
+
+/**
+ * Applies a policy to the calling thread
+ * 
+ * @param policy Scheduling policy
+ * @param error Receives the reasons of any settings that failed
+ * @return True if every setting was applied (always false where unsupported)
+ */
+bool applySchedPolicy(const SchedPolicy& policy, std::string& error) {
+    bool ok = true;
+    auto fail = [&](const std::string& what, int code) {
+        error += (error.empty() ? "" : "; ") + what + ": " + std::strerror(code);
+        ok = false;
+    };
+
+    if (policy.kind == SchedPolicy::Fifo || policy.kind == SchedPolicy::RoundRobin) {
+        sched_param param;
+        std::memset(&param, 0, sizeof(param));
+        param.sched_priority = policy.priority;
+        int code = pthread_setschedparam(pthread_self(), policy.kind == SchedPolicy::Fifo ? SCHED_FIFO : SCHED_RR, &param);
+        if (code != 0) fail(schedPolicyName(policy), code);
+    } else if (policy.kind == SchedPolicy::Batch || policy.kind == SchedPolicy::Idle) {
+#if defined(__linux__)
+        sched_param param;
+        std::memset(&param, 0, sizeof(param));
+        int code = pthread_setschedparam(pthread_self(), policy.kind == SchedPolicy::Batch ? SCHED_BATCH : SCHED_IDLE, &param);
+        if (code != 0) fail(policy.kind == SchedPolicy::Batch ? "batch" : "idle", code);
+#else
+        fail(policy.kind == SchedPolicy::Batch ? "batch" : "idle", ENOTSUP);
+#endif
+    }
+
+#if defined(__linux__)
+    // Linux applies nice and cgroup membership per thread
+    long tid = getCurrentThreadId();
+    if (policy.setNice && setpriority(PRIO_PROCESS, static_cast<id_t>(tid), policy.nice) != 0) {
+        fail("nice:" + std::to_string(policy.nice), errno);
+    }
+    if (!policy.cgroup.empty()) {
+        if (policy.cgroupPath.empty()) {
+            fail("cgroup:" + policy.cgroup + " was not prepared", ENOENT);
+        } else if (!writeControl(policy.cgroupPath + "/cgroup.threads", std::to_string(tid))) {
+            fail("joining " + policy.cgroupPath, EACCES);
+        }
+    }
+#else
+    if (policy.setNice) fail("nice:" + std::to_string(policy.nice), ENOTSUP);
+    if (!policy.cgroup.empty()) fail("cgroup:" + policy.cgroup, ENOTSUP);
+#endif
+    return ok;
+}
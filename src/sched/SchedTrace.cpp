@@ -0,0 +1,204 @@
+#include "../../include/SchedTrace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <ctime>
+
+#ifndef PERF_RECORD_MISC_SWITCH_OUT_PREEMPT
+#define PERF_RECORD_MISC_SWITCH_OUT_PREEMPT (1 << 14)
+#endif
+
+// Ring buffer data pages per traced thread (must be a power of two)
+static const std::size_t RING_PAGES = 64;
+
+// Layout of a PERF_RECORD_SWITCH record with sample_id_all and TID|TIME
+struct SwitchRecord {
+    perf_event_header header;
+    uint32_t pid;
+    uint32_t tid;
+    uint64_t time;
+};
+
+/**
+ * Opens a context-switch perf event for one thread
+ * 
+ * @param tid Kernel thread ID (0 for the calling thread)
+ * @return File descriptor, or -1 on failure
+ */
+static int openSwitchEvent(long tid) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_SOFTWARE;
+    attr.config = PERF_COUNT_SW_DUMMY;
+    attr.context_switch = 1;
+    attr.sample_id_all = 1;
+    attr.sample_type = PERF_SAMPLE_TID | PERF_SAMPLE_TIME;
+    attr.use_clockid = 1;
+    attr.clockid = CLOCK_MONOTONIC;  // Same clock as steady_clock
+    attr.exclude_kernel = 1;          // Allowed at perf_event_paranoid <= 2
+    attr.exclude_hv = 1;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, static_cast<pid_t>(tid), -1, -1, PERF_FLAG_FD_CLOEXEC));
+}
+#endif
+
+SchedTracer::SchedTracer(long long originNs) : originNs(originNs) {}
+
+SchedTracer::~SchedTracer() {
+    stop();
+#if defined(__linux__)
+    for (Stream& stream : streams) {
+        if (stream.ring) munmap(stream.ring, stream.ringSize);
+        if (stream.fd >= 0) close(stream.fd);
+    }
+#endif
+}
+
+/**
+ * Checks whether context-switch tracing can be used in this process
+ * 
+ * @return True if a per-thread perf event can be opened
+ */
+bool SchedTracer::isAvailable() {
+#if defined(__linux__)
+    int fd = openSwitchEvent(0);
+    if (fd < 0) return false;
+    close(fd);
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Starts tracing a thread
+ * 
+ * @param tid Kernel thread ID
+ * @return Stream index for edgesFor(), or -1 on failure
+ */
+int SchedTracer::attach(long tid) {
+#if defined(__linux__)
+    int fd = openSwitchEvent(tid);
+    if (fd < 0) return -1;
+
+    std::size_t pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    std::size_t ringSize = (RING_PAGES + 1) * pageSize;
+    void* ring = mmap(nullptr, ringSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ring == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+
+    // Threads are running when they are attached
+    streams.push_back({tid, fd, ring, ringSize, true, {}});
+    return static_cast<int>(streams.size()) - 1;
+#else
+    (void)tid;
+    return -1;
+#endif
+}
+
+/**
+ * Starts the polling thread
+ */
+void SchedTracer::start() {
+    if (polling || streams.empty()) return;
+    polling = true;
+    poller = std::thread(&SchedTracer::pollLoop, this);
+}
+
+/**
+ * Stops the polling thread and drains all remaining records
+ */
+void SchedTracer::stop() {
+    if (!polling) return;
+    polling = false;
+    poller.join();
+    for (Stream& stream : streams) {
+        drain(stream);
+    }
+}
+
+/**
+ * Returns the scheduling edges recorded for a stream
+ * 
+ * @param index Value returned by attach()
+ * @return Edges in time order, relative to the origin
+ */
+const std::vector<SchedEdge>& SchedTracer::edgesFor(int index) const {
+    return streams[index].edges;
+}
+
+/**
+ * Drains every ring buffer roughly once per millisecond until stopped
+ */
+void SchedTracer::pollLoop() {
+    while (polling) {
+        for (Stream& stream : streams) {
+            drain(stream);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+/**
+ * Converts the pending records of one ring buffer into scheduling edges
+ * 
+ * @param stream Traced thread to drain
+ */
+void SchedTracer::drain(Stream& stream) {
+#if defined(__linux__)
+    perf_event_mmap_page* meta = static_cast<perf_event_mmap_page*>(stream.ring);
+    char* data = static_cast<char*>(stream.ring) + (stream.ringSize / (RING_PAGES + 1));
+    std::size_t dataSize = stream.ringSize - (stream.ringSize / (RING_PAGES + 1));
+
+    uint64_t head = __atomic_load_n(&meta->data_head, __ATOMIC_ACQUIRE);
+    uint64_t tail = meta->data_tail;
+
+    while (tail < head) {
+        // Records may wrap around the end of the ring, so copy them out first
+        perf_event_header header;
+        std::size_t offset = tail % dataSize;
+        char record[sizeof(SwitchRecord)];
+        auto copyOut = [&](void* dst, std::size_t len) {
+            std::size_t first = std::min(len, dataSize - offset);
+            std::memcpy(dst, data + offset, first);
+            std::memcpy(static_cast<char*>(dst) + first, data, len - first);
+        };
+        copyOut(&header, sizeof(header));
+
+        if (header.type == PERF_RECORD_SWITCH && header.size >= sizeof(SwitchRecord)) {
+            copyOut(record, sizeof(SwitchRecord));
+            const SwitchRecord* sw = reinterpret_cast<const SwitchRecord*>(record);
+            long long timeNs = static_cast<long long>(sw->time) - originNs;
+            bool switchOut = (header.misc & PERF_RECORD_MISC_SWITCH_OUT) != 0;
+            bool preempted = (header.misc & PERF_RECORD_MISC_SWITCH_OUT_PREEMPT) != 0;
+
+            if (switchOut && preempted && stream.onCpu) {
+                stream.edges.push_back({timeNs, false});
+                stream.onCpu = false;
+            } else if (!switchOut && !stream.onCpu) {
+                stream.edges.push_back({timeNs, true});
+                stream.onCpu = true;
+            }
+        } else if (header.type == PERF_RECORD_LOST && header.size >= sizeof(header) + 2 * sizeof(uint64_t)) {
+            uint64_t lostRecord[3];
+            copyOut(lostRecord, sizeof(lostRecord));
+            lost += lostRecord[2];  // header, id, lost
+        }
+
+        if (header.size == 0) break;  // Corrupt ring; stop rather than spin
+        tail += header.size;
+    }
+
+    __atomic_store_n(&meta->data_tail, tail, __ATOMIC_RELEASE);
+#else
+    (void)stream;
+#endif
+}
@@ -0,0 +1,505 @@
+#include "../../include/ScheduleTrace.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char TRACE_MAGIC_V1[8] = {'T', 'M', 'T', 'R', 'A', 'C', 'E', '1'};
+static const char TRACE_MAGIC_V2[8] = {'T', 'M', 'T', 'R', 'A', 'C', 'E', '2'};
+static const unsigned int TRACE_FLAG_KERNEL = 1;
+static const unsigned long long TRACE_MAX_THREADS = 65536;
+
+/**
+ * Appends a little-endian integer
+ * 
+ * @param out Destination buffer
+ * @param value Value to append
+ * @param bytes Width in bytes
+ */
+static void writeLittleEndian(std::vector<unsigned char>& out, unsigned long long value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out.push_back(static_cast<unsigned char>(value >> (8 * i)));
+    }
+}
+
+/**
+ * Encodes an unsigned LEB128 varint
+ * 
+ * @param out Destination (at least 10 bytes)
+ * @param value Value to encode
+ * @return Number of bytes written
+ */
+static int encodeVarint(unsigned char* out, unsigned long long value) {
+    int length = 0;
+    while (value >= 0x80) {
+        out[length++] = static_cast<unsigned char>(value | 0x80);
+        value >>= 7;
+    }
+    out[length++] = static_cast<unsigned char>(value);
+    return length;
+}
+
+/**
+ * Decodes a little-endian integer from memory
+ * 
+ * @param data Mapped bytes
+ * @param size Number of mapped bytes
+ * @param position Read position, advanced past the value
+ * @param bytes Width in bytes
+ * @param value Receives the value
+ * @return False if the value runs past the end
+ */
+static bool decodeLittleEndian(const unsigned char* data, std::size_t size, std::size_t& position,
+                               int bytes, unsigned long long& value) {
+    if (size - position < static_cast<std::size_t>(bytes)) return false;
+    value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= static_cast<unsigned long long>(data[position + i]) << (8 * i);
+    }
+    position += bytes;
+    return true;
+}
+
+/**
+ * Decodes an unsigned LEB128 varint from memory
+ * 
+ * @param data Mapped bytes
+ * @param size Number of mapped bytes
+ * @param position Read position, advanced past the value
+ * @param value Receives the value
+ * @return False if the varint is truncated or longer than 64 bits
+ */
+static bool decodeVarint(const unsigned char* data, std::size_t size, std::size_t& position,
+                         unsigned long long& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && position < size; shift += 7) {
+        unsigned char byte = data[position++];
+        value |= static_cast<unsigned long long>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+/**
+ * Reads a little-endian integer from a file
+ * 
+ * @param in Source file
+ * @param bytes Width in bytes
+ * @param value Receives the value
+ * @return False at end of file
+ */
+static bool readLittleEndian(std::FILE* in, int bytes, unsigned long long& value) {
+    unsigned char buffer[8];
+    if (std::fread(buffer, 1, bytes, in) != static_cast<std::size_t>(bytes)) return false;
+    value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= static_cast<unsigned long long>(buffer[i]) << (8 * i);
+    }
+    return true;
+}
+
+ScheduleTraceWriter::~ScheduleTraceWriter() {
+    close();
+}
+
+/**
+ * Creates the file and writes the header
+ * 
+ * @param path Output file
+ * @param trace Run metadata and voices (threads is ignored)
+ * @return True on success
+ */
+bool ScheduleTraceWriter::open(const std::string& path, const ScheduleTrace& trace) {
+    close();
+    std::vector<unsigned char> bytes(TRACE_MAGIC_V2, TRACE_MAGIC_V2 + sizeof(TRACE_MAGIC_V2));
+    writeLittleEndian(bytes, trace.voices.size(), 4);
+    writeLittleEndian(bytes, trace.durationSec, 4);
+    writeLittleEndian(bytes, trace.numPhases, 4);
+    writeLittleEndian(bytes, trace.seed, 4);
+    writeLittleEndian(bytes, trace.kernelTraced ? TRACE_FLAG_KERNEL : 0, 4);
+    for (const TraceVoice& voice : trace.voices) {
+        const SnippetTable& snippets = voice.snippets;
+        writeLittleEndian(bytes, voice.channel, 1);
+        writeLittleEndian(bytes, voice.instrument, 1);
+        writeLittleEndian(bytes, static_cast<int>(voice.role), 1);
+        writeLittleEndian(bytes, snippets.count(), 2);
+        for (int s = 0; s < snippets.count(); s++) {
+            writeLittleEndian(bytes, snippets.offset[s + 1] - snippets.offset[s], 1);
+            for (int n = snippets.offset[s]; n < snippets.offset[s + 1]; n++) {
+                writeLittleEndian(bytes, snippets.pitch[n], 1);
+                writeLittleEndian(bytes, snippets.velocity[n], 1);
+                writeLittleEndian(bytes, snippets.duration[n], 2);
+            }
+        }
+    }
+
+    out = std::fopen(path.c_str(), "wb");
+    if (!out) return false;
+    ok = std::fwrite(bytes.data(), 1, bytes.size(), out) == bytes.size();
+    lastEndNs.assign(trace.voices.size(), 0);
+    return ok;
+}
+
+/**
+ * Appends one off-CPU interval
+ * 
+ * @param thread Thread ID
+ * @param startNs Descheduled at (not before the thread's previous record ends)
+ * @param endNs Scheduled again at, or -1 if it stayed off until the end
+ */
+void ScheduleTraceWriter::append(int thread, long long startNs, long long endNs) {
+    if (!out || thread < 0 || thread >= static_cast<int>(lastEndNs.size())) return;
+    startNs = std::max(startNs, lastEndNs[thread]);
+    unsigned char record[30];
+    int length = encodeVarint(record, thread);
+    length += encodeVarint(record + length, startNs - lastEndNs[thread]);
+    length += encodeVarint(record + length, endNs < 0 ? 0 : std::max(endNs, startNs) - startNs + 1);
+    lastEndNs[thread] = endNs < 0 ? startNs : std::max(endNs, startNs);
+    ok = (std::fwrite(record, 1, length, out) == static_cast<std::size_t>(length)) && ok;
+}
+
+/**
+ * Hands the records appended so far to the operating system
+ * 
+ * @return True if every write succeeded
+ */
+bool ScheduleTraceWriter::flush() {
+    if (out) ok = (std::fflush(out) == 0) && ok;
+    return ok;
+}
+
+/**
+ * Flushes and closes the file
+ * 
+ * @return True if every write succeeded
+ */
+bool ScheduleTraceWriter::close() {
+    if (!out) return ok;
+    ok = (std::fclose(out) == 0) && ok;
+    out = nullptr;
+    return ok;
+}
+
+MappedScheduleTrace::~MappedScheduleTrace() {
+    if (data) munmap(const_cast<unsigned char*>(data), size);
+}
+
+/**
+ * Maps a trace and parses its header
+ * 
+ * @param path Input file
+ * @return False if the file is missing or not a version 2 trace
+ */
+bool MappedScheduleTrace::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(TRACE_MAGIC_V2))) {
+        ::close(fd);
+        return false;
+    }
+    void* mapping = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) return false;
+    data = static_cast<const unsigned char*>(mapping);
+    size = static_cast<std::size_t>(status.st_size);
+    if (std::memcmp(data, TRACE_MAGIC_V2, sizeof(TRACE_MAGIC_V2)) != 0) return false;
+
+    std::size_t at = sizeof(TRACE_MAGIC_V2);
+    unsigned long long threadCount, durationSec, numPhases, seed, flags;
+    if (!decodeLittleEndian(data, size, at, 4, threadCount) || !decodeLittleEndian(data, size, at, 4, durationSec) ||
+        !decodeLittleEndian(data, size, at, 4, numPhases) || !decodeLittleEndian(data, size, at, 4, seed) ||
+        !decodeLittleEndian(data, size, at, 4, flags) || threadCount == 0 || threadCount > TRACE_MAX_THREADS) {
+        return false;
+    }
+    info.durationSec = static_cast<int>(durationSec);
+    info.numPhases = static_cast<int>(numPhases);
+    info.seed = static_cast<unsigned int>(seed);
+    info.kernelTraced = (flags & TRACE_FLAG_KERNEL) != 0;
+    info.voices.assign(threadCount, {});
+
+    for (TraceVoice& voice : info.voices) {
+        unsigned long long channel, instrument, role, snippetCount;
+        if (!decodeLittleEndian(data, size, at, 1, channel) || !decodeLittleEndian(data, size, at, 1, instrument) ||
+            !decodeLittleEndian(data, size, at, 1, role) || !decodeLittleEndian(data, size, at, 2, snippetCount) ||
+            role > static_cast<unsigned long long>(VoiceRole::Lead)) {
+            return false;
+        }
+        voice.channel = static_cast<int>(channel);
+        voice.instrument = static_cast<int>(instrument);
+        voice.role = static_cast<VoiceRole>(role);
+        for (unsigned long long s = 0; s < snippetCount; s++) {
+            unsigned long long noteCount, pitch, velocity, duration;
+            if (!decodeLittleEndian(data, size, at, 1, noteCount)) return false;
+            voice.snippets.beginSnippet();
+            for (unsigned long long n = 0; n < noteCount; n++) {
+                if (!decodeLittleEndian(data, size, at, 1, pitch) || !decodeLittleEndian(data, size, at, 1, velocity) ||
+                    !decodeLittleEndian(data, size, at, 2, duration)) {
+                    return false;
+                }
+                voice.snippets.addNote(static_cast<int>(pitch), static_cast<int>(velocity), static_cast<int>(duration));
+            }
+        }
+    }
+
+    recordsOffset = at;
+    rewind();
+    return true;
+}
+
+/**
+ * Decodes the next record
+ * 
+ * @param record Receives the record
+ * @return False at the end of the records or on a corrupt record
+ */
+bool MappedScheduleTrace::next(TraceRecord& record) {
+    if (!data || position >= size) return false;
+    unsigned long long thread = 0, gap = 0, length = 0;
+    if (!decodeVarint(data, size, position, thread) || !decodeVarint(data, size, position, gap) ||
+        !decodeVarint(data, size, position, length) || thread >= lastEndNs.size()) {
+        // A record cut off at the end of the file is an interrupted append, not corruption
+        corrupt = position < size || thread >= lastEndNs.size();
+        position = size;
+        return false;
+    }
+    record.thread = static_cast<int>(thread);
+    record.startNs = lastEndNs[thread] + static_cast<long long>(gap);
+    record.endNs = length == 0 ? -1 : record.startNs + static_cast<long long>(length - 1);
+    lastEndNs[thread] = length == 0 ? record.startNs : record.endNs;
+    return true;
+}
+
+/**
+ * Restarts iteration at the first record
+ */
+void MappedScheduleTrace::rewind() {
+    position = recordsOffset;
+    lastEndNs.assign(info.voices.size(), 0);
+    corrupt = false;
+}
+
+/**
+ * Converts scheduling edges to off-CPU intervals and appends them
+ * 
+ * Repeated states are dropped. An interval whose end is not among the edges
+ * stays open in onCpu and offSinceNs for the next call.
+ * 
+ * @param writer Open trace writer
+ * @param thread Thread ID
+ * @param edges Edges in time order
+ * @param onCpu Thread state before the first edge; receives the state after the last
+ * @param offSinceNs Start of the open interval; updated when one starts
+ */
+static void appendIntervals(ScheduleTraceWriter& writer, int thread, const std::vector<SchedEdge>& edges, bool& onCpu,
+                            long long& offSinceNs) {
+    for (const SchedEdge& edge : edges) {
+        if (edge.onCpu == onCpu) continue;
+        if (!edge.onCpu) {
+            offSinceNs = edge.timeNs;
+        } else {
+            writer.append(thread, offSinceNs, edge.timeNs);
+        }
+        onCpu = edge.onCpu;
+    }
+}
+
+/**
+ * Writes a version 2 scheduling trace, converting each timeline to off-CPU intervals
+ * 
+ * @param path Output file
+ * @param trace Trace to write
+ * @return True on success
+ */
+bool writeScheduleTrace(const std::string& path, const ScheduleTrace& trace) {
+    ScheduleTrace header = trace;
+    header.threads.clear();
+    header.voices.resize(trace.threads.size());
+
+    ScheduleTraceWriter writer;
+    if (!writer.open(path, header)) return false;
+    for (std::size_t t = 0; t < trace.threads.size(); t++) {
+        // Every timeline starts on the CPU
+        bool onCpu = true;
+        long long offSinceNs = 0;
+        appendIntervals(writer, static_cast<int>(t), trace.threads[t], onCpu, offSinceNs);
+        if (!onCpu) writer.append(static_cast<int>(t), offSinceNs, -1);
+    }
+    return writer.close();
+}
+
+/**
+ * @param count Edges to make room for
+ */
+void ScheduleTimeline::reserve(std::size_t count) {
+    std::lock_guard<std::mutex> guard(lock);
+    edges.reserve(count);
+}
+
+/**
+ * Records one change; called by the thread the timeline belongs to
+ * 
+ * @param timeNs Nanoseconds since the start of the piece
+ * @param onCpu True when the thread starts running
+ */
+void ScheduleTimeline::record(long long timeNs, bool onCpu) {
+    std::lock_guard<std::mutex> guard(lock);
+    edges.push_back({timeNs, onCpu});
+}
+
+/**
+ * Moves the recorded edges out, leaving the timeline empty
+ * 
+ * The buffers are swapped, so the recording thread keeps an empty one
+ * with the capacity of the last take and rarely allocates.
+ * 
+ * @param out Receives the edges in recording order (previous contents are dropped)
+ */
+void ScheduleTimeline::take(std::vector<SchedEdge>& out) {
+    out.clear();
+    std::lock_guard<std::mutex> guard(lock);
+    out.swap(edges);
+}
+
+/**
+ * Creates the file and writes the header
+ * 
+ * @param path Output file
+ * @param header Run metadata and voices (threads is ignored)
+ * @param timelines Timelines to drain, indexed by thread ID; must outlive the recorder
+ * @return True on success
+ */
+bool ScheduleTraceRecorder::open(const std::string& path, const ScheduleTrace& header,
+                                 std::vector<ScheduleTimeline>& timelines) {
+    std::lock_guard<std::mutex> guard(lock);
+    ScheduleTrace voices = header;
+    voices.threads.clear();
+    voices.voices.resize(timelines.size());
+    ok = writer.open(path, voices);
+    if (!ok) return false;
+    this->timelines = &timelines;
+    onCpu.assign(timelines.size(), 1);
+    offSinceNs.assign(timelines.size(), 0);
+    return true;
+}
+
+/**
+ * Appends every timeline's new edges; the caller holds the lock
+ */
+void ScheduleTraceRecorder::drain() {
+    for (std::size_t t = 0; t < timelines->size(); t++) {
+        (*timelines)[t].take(taken);
+        bool state = onCpu[t] != 0;
+        appendIntervals(writer, static_cast<int>(t), taken, state, offSinceNs[t]);
+        onCpu[t] = state;
+    }
+}
+
+/**
+ * Appends the edges recorded since the last flush; safe to call from any thread
+ * 
+ * @return True if every write succeeded
+ */
+bool ScheduleTraceRecorder::flush() {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!timelines) return false;
+    drain();
+    ok = writer.flush() && ok;
+    flushes.fetch_add(1, std::memory_order_relaxed);
+    return ok;
+}
+
+/**
+ * Appends a complete timeline of a thread that did not record into its ScheduleTimeline
+ * 
+ * @param thread Thread ID
+ * @param edges Edges in time order, e.g. from the kernel tracer
+ */
+void ScheduleTraceRecorder::appendEdges(int thread, const std::vector<SchedEdge>& edges) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!timelines || thread < 0 || thread >= static_cast<int>(onCpu.size())) return;
+    bool state = onCpu[thread] != 0;
+    appendIntervals(writer, thread, edges, state, offSinceNs[thread]);
+    onCpu[thread] = state;
+}
+
+/**
+ * Flushes, ends the intervals that are still open and closes the file
+ * 
+ * @return True if every write succeeded
+ */
+bool ScheduleTraceRecorder::close() {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!timelines) return ok;
+    drain();
+    for (std::size_t t = 0; t < onCpu.size(); t++) {
+        if (!onCpu[t]) writer.append(static_cast<int>(t), offSinceNs[t], -1);
+    }
+    ok = writer.close() && ok;
+    timelines = nullptr;
+    return ok;
+}
+
+/**
+ * Reads a version 1 trace
+ * 
+ * @param path Input file
+ * @param trace Receives the trace
+ * @return False if the file is missing, truncated, or not a version 1 trace
+ */
+static bool readScheduleTraceV1(const std::string& path, ScheduleTrace& trace) {
+    std::FILE* in = std::fopen(path.c_str(), "rb");
+    if (!in) return false;
+
+    char magic[sizeof(TRACE_MAGIC_V1)];
+    unsigned long long threadCount, durationSec, numPhases, seed, flags;
+    bool ok = std::fread(magic, 1, sizeof(magic), in) == sizeof(magic) &&
+              std::memcmp(magic, TRACE_MAGIC_V1, sizeof(magic)) == 0 &&
+              readLittleEndian(in, 4, threadCount) && readLittleEndian(in, 4, durationSec) &&
+              readLittleEndian(in, 4, numPhases) && readLittleEndian(in, 4, seed) &&
+              readLittleEndian(in, 4, flags) && threadCount > 0 && threadCount <= TRACE_MAX_THREADS;
+
+    if (ok) {
+        trace.durationSec = static_cast<int>(durationSec);
+        trace.numPhases = static_cast<int>(numPhases);
+        trace.seed = static_cast<unsigned int>(seed);
+        trace.kernelTraced = (flags & TRACE_FLAG_KERNEL) != 0;
+        trace.voices.clear();
+        trace.threads.assign(threadCount, {});
+    }
+    for (std::size_t t = 0; ok && t < trace.threads.size(); t++) {
+        unsigned long long edgeCount, packed;
+        ok = readLittleEndian(in, 4, edgeCount);
+        for (unsigned long long e = 0; ok && e < edgeCount; e++) {
+            ok = readLittleEndian(in, 8, packed);
+            if (ok) trace.threads[t].push_back({static_cast<long long>(packed >> 1), (packed & 1) != 0});
+        }
+    }
+
+    std::fclose(in);
+    return ok;
+}
+
+/**
+ * Reads a scheduling trace of either version into timelines
+ * 
+ * @param path Input file
+ * @param trace Receives the trace
+ * @return False if the file is missing, truncated, or not a trace
+ */
+bool readScheduleTrace(const std::string& path, ScheduleTrace& trace) {
+    MappedScheduleTrace mapped;
+    if (!mapped.open(path)) return readScheduleTraceV1(path, trace);
+
+    trace = mapped.header();
+    trace.threads.assign(trace.voices.size(), {});
+    TraceRecord record;
+    while (mapped.next(record)) {
+        std::vector<SchedEdge>& edges = trace.threads[record.thread];
+        edges.push_back({record.startNs, false});
+        if (record.endNs >= 0) edges.push_back({record.endNs, true});
+    }
+    return !mapped.isCorrupt();
+}
@@ -0,0 +1,265 @@
+#include "../../include/VoicePool.h"
+#include "../../include/AllocationCounter.h"
+#include "../../include/Conductor.h"
+#include "../../include/Constants.h"
+#include "../../include/Counters.h"
+#include "../../include/MusicGeneration.h"
+#include "../../include/ScheduleTrace.h"
+#include "../../include/ThreadPool.h"
+#include "../../include/Timing.h"
+#include "../../include/Utils.h"
+#include "../../include/Voice.h"
+#include "../../include/VoiceBatch.h"
+#include "../../include/VoiceCoroutine.h"
+#include "../../include/Workload.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+
+// LogicalVoice: One voice, or one batch of voices, multiplexed onto the pool
+struct LogicalVoice {
+    std::vector<ThreadData*> members;           // The voice, or every voice of the batch
+    std::unique_ptr<MelodicVoice> voice;        // Thread engine: note state lives here
+    std::unique_ptr<CoroutineVoice> coroutine;  // Coroutine engine: note state lives in the frame
+    std::unique_ptr<VoiceBatch> batch;          // Batch engine: note state lives in vector lanes
+    long long dueNs = 0;   // When the next step should start
+    int lastWorker = -1;   // Worker that ran the previous step
+    int lastTick = 0;      // Tick of the previous step
+    std::size_t firstBusy = 0; // Member whose busy work runs first in the next step
+
+    // Per member
+    std::vector<unsigned char> scheduled;  // State passed to the last update
+    std::vector<unsigned char> timelineOn; // Last state written to the timeline
+    std::vector<unsigned char> onTime;     // False while resting after a late step
+    std::vector<long long> lastChangeNs;   // When onTime last changed
+    std::vector<long long> waitNs;         // Time from the step start to the member's busy work
+
+    LogicalVoice(ThreadData* data, const PhaseGrid& grid, VoiceEngine engine) : members{data} {
+        if (engine == VoiceEngine::Coroutine) coroutine.reset(new CoroutineVoice(*data, grid));
+        else voice.reset(new MelodicVoice(*data, grid));
+        initMembers();
+    }
+
+    LogicalVoice(const std::vector<ThreadData*>& voices, const PhaseGrid& grid)
+        : members(voices), batch(new VoiceBatch(voices, grid)) {
+        initMembers();
+    }
+
+    void initMembers() {
+        scheduled.assign(members.size(), 1);
+        timelineOn.assign(members.size(), 1);
+        onTime.assign(members.size(), 1);
+        lastChangeNs.assign(members.size(), 0);
+        waitNs.assign(members.size(), 0);
+    }
+
+    // Applies the scheduled states to every member
+    void update(int tick) {
+        if (batch) batch->update(tick, scheduled);
+        else if (coroutine) coroutine->update(tick, scheduled[0] != 0);
+        else voice->update(tick, scheduled[0] != 0);
+    }
+
+    void finish(int tick) {
+        if (batch) batch->finish(tick);
+        else if (coroutine) coroutine->finish(tick);
+        else voice->finish(tick);
+    }
+};
+
+// WorkerState: Per-worker kernel, random source, and statistics, merged after the run
+struct alignas(64) WorkerState {
+    std::unique_ptr<Workload> workload;
+    std::mt19937 gen;
+    std::uniform_int_distribution<> busyWorkDist{BUSY_WORK_MIN_US, BUSY_WORK_MAX_US};
+    long long steps = 0;
+    long long lateSteps = 0;
+    long long migrations = 0;
+    Histogram queueDelayNs;
+};
+
+// DueVoice: Heap entry of a voice waiting for its next step
+struct DueVoice {
+    long long dueNs;
+    int index;
+
+    bool operator<(const DueVoice& other) const { return dueNs > other.dueNs; } // Earliest on top
+};
+
+/**
+ * @param workerCount Worker threads (0 or less uses every hardware thread)
+ * @param timerMode Sleeping strategy of the dispatcher
+ * @param engine How each voice keeps its note state between steps
+ */
+VoicePool::VoicePool(int workerCount, TimerMode timerMode, VoiceEngine engine)
+    : workerCount(workerCount > 0 ? workerCount : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()))),
+      timerMode(timerMode), engine(engine) {}
+
+/**
+ * Plays the voices until the piece ends, then writes their final events
+ * 
+ * @param voices Melodic thread configurations (events, counters and timelines are used)
+ * @param conductor Shared tick clock and phase grid
+ */
+void VoicePool::run(const std::vector<ThreadData*>& voices, Conductor& conductor) {
+    if (voices.empty()) return;
+    const PhaseGrid& grid = conductor.getGrid();
+    long long periodNs = THREAD_SLEEP_MS * 1000000LL;
+    long long lateNs = POOL_LATE_THRESHOLD_US * 1000LL;
+    long long minStateNs = DETECTOR_MIN_STATE_MS * 1000000LL;
+
+    // Kernels run per worker: a stream or chase working set per voice would not fit in memory
+    std::vector<WorkerState> workers(workerCount);
+    std::random_device rd;
+    for (auto& worker : workers) {
+        WorkloadKind kind = voices[0]->workload;
+        worker.workload.reset(new Workload(kind, voices[0]->workloadRate));
+        worker.gen.seed(rd());
+    }
+
+    // The batch engine steps POOL_BATCH_VOICES voices at a time as one logical voice
+    std::vector<std::unique_ptr<LogicalVoice>> logical;
+    if (engine == VoiceEngine::Batch) {
+        for (std::size_t first = 0; first < voices.size(); first += POOL_BATCH_VOICES) {
+            std::size_t last = std::min(voices.size(), first + POOL_BATCH_VOICES);
+            logical.emplace_back(new LogicalVoice(std::vector<ThreadData*>(voices.begin() + first, voices.begin() + last), grid));
+        }
+    } else {
+        logical.reserve(voices.size());
+        for (ThreadData* data : voices) {
+            logical.emplace_back(new LogicalVoice(data, grid, engine));
+        }
+    }
+
+    std::mutex dueMutex;
+    std::vector<DueVoice> due;
+    due.reserve(logical.size());
+    std::atomic<int> remaining(static_cast<int>(logical.size()));
+
+    ThreadPool pool(workerCount);
+    long long originNs = conductor.getOriginNs();
+    long long endNs = conductor.getEndNs();
+
+    // Spread the first steps over one period instead of starting every voice at once
+    long long firstDueNs = getMonotonicNs();
+    for (std::size_t i = 0; i < logical.size(); i++) {
+        logical[i]->dueNs = firstDueNs + periodNs * static_cast<long long>(i) / static_cast<long long>(logical.size());
+        due.push_back({logical[i]->dueNs, static_cast<int>(i)});
+    }
+    std::make_heap(due.begin(), due.end());
+
+    // One melodic loop iteration of one voice (or of every voice of a batch)
+    auto step = [&](int index) {
+        LogicalVoice& voice = *logical[index];
+        int workerIndex = std::max(ThreadPool::currentWorker(), 0);
+        WorkerState& worker = workers[workerIndex];
+        long long nowNs = getMonotonicNs();
+        long long members = static_cast<long long>(voice.members.size());
+
+        if (nowNs >= endNs || !running) {
+            voice.finish(voice.lastTick);
+            remaining.fetch_sub(1, std::memory_order_release);
+            return;
+        }
+
+        long long delayNs = std::max(0LL, nowNs - voice.dueNs);
+        worker.steps += members;
+        worker.queueDelayNs.record(delayNs);
+        if (voice.lastWorker >= 0 && voice.lastWorker != workerIndex) worker.migrations++;
+        voice.lastWorker = workerIndex;
+
+        // Simulate CPU work, one slice per voice. A voice of a batch also waits for the
+        // slices before its own, so the order rotates and no voice is always last
+        long long allocationsBefore = threadAllocationCount();
+        worker.workload->follow(liveWorkload);
+        for (std::size_t k = 0; k < voice.members.size(); k++) {
+            std::size_t member = (voice.firstBusy + k) % voice.members.size();
+            voice.waitNs[member] = getMonotonicNs() - nowNs;
+            worker.workload->setCounters(voice.members[member]->counters);
+            worker.workload->runFor(worker.busyWorkDist(worker.gen));
+        }
+        voice.firstBusy = (voice.firstBusy + 1) % voice.members.size();
+
+        // A late voice waited for a worker: silent from its due time. Like the detector, a
+        // rest or a run lasts at least DETECTOR_MIN_STATE_MS, so a backlogged pool makes
+        // rests instead of a note-off and note-on on every late step
+        bool resting = false;
+        for (std::size_t member = 0; member < voice.members.size(); member++) {
+            bool late = delayNs + voice.waitNs[member] > lateNs;
+            if (late) worker.lateSteps++;
+            if (late != static_cast<bool>(voice.onTime[member]) || nowNs - voice.lastChangeNs[member] < minStateNs) continue;
+            voice.onTime[member] = !late;
+            voice.lastChangeNs[member] = late ? voice.dueNs : nowNs;
+            if (!late) continue;
+            ThreadData* data = voice.members[member];
+            if (data->timeline && voice.timelineOn[member]) data->timeline->record(voice.dueNs - originNs, false);
+            voice.timelineOn[member] = 0;
+            voice.scheduled[member] = 0;
+            resting = true;
+        }
+        if (resting) voice.update(ticksFromNanoseconds(voice.dueNs - originNs));
+
+        // Each voice plays while it is on time and not muted
+        long long observedNs = getMonotonicNs();
+        long long cpuNs = std::llround(getCpuTime() * 1e9);
+        for (std::size_t member = 0; member < voice.members.size(); member++) {
+            ThreadData* data = voice.members[member];
+            unsigned char active = voice.onTime[member] && isVoiceActive(*data);
+            if (data->timeline && voice.timelineOn[member] != active) data->timeline->record(observedNs - originNs, active != 0);
+            voice.timelineOn[member] = active;
+            voice.scheduled[member] = active;
+            data->events->setClock(observedNs - originNs, cpuNs);
+        }
+        voice.lastTick = conductor.observe(observedNs).tick;
+        voice.update(voice.lastTick);
+        for (ThreadData* data : voice.members) {
+            if (data->counters) ThreadCounters::add(data->counters->loops);
+        }
+        ThreadData& data = *voice.members[0];
+        if (data.counters) ThreadCounters::add(data.counters->allocations, threadAllocationCount() - allocationsBefore);
+
+        voice.dueNs = getMonotonicNs() + periodNs;
+        std::lock_guard<std::mutex> lock(dueMutex);
+        due.push_back({voice.dueNs, index});
+        std::push_heap(due.begin(), due.end());
+    };
+
+    // Dispatcher: hand due voices to the worker that ran them last
+    TimerEngine timer(timerMode);
+    std::vector<int> ready;
+    ready.reserve(voices.size());
+    while (remaining.load(std::memory_order_acquire) > 0) {
+        long long nowNs = getMonotonicNs();
+        long long wakeNs = nowNs + POOL_DISPATCH_INTERVAL_US * 1000LL;
+        {
+            std::lock_guard<std::mutex> lock(dueMutex);
+            while (!due.empty() && (due.front().dueNs <= nowNs || nowNs >= endNs)) {
+                ready.push_back(due.front().index);
+                std::pop_heap(due.begin(), due.end());
+                due.pop_back();
+            }
+            if (!due.empty()) wakeNs = std::min(wakeNs, due.front().dueNs);
+        }
+        for (int index : ready) {
+            pool.submitTo(logical[index]->lastWorker >= 0 ? logical[index]->lastWorker : index % workerCount,
+                          [&step, index]() { step(index); });
+        }
+        ready.clear();
+        stats.queueDepth.record(static_cast<long long>(pool.queueDepth()));
+        timer.sleepUntil(wakeNs);
+    }
+    pool.wait();
+
+    for (const auto& worker : workers) {
+        stats.steps += worker.steps;
+        stats.lateSteps += worker.lateSteps;
+        stats.migrations += worker.migrations;
+        stats.queueDelayNs.merge(worker.queueDelayNs);
+    }
+    stats.steals = pool.getStealCount();
+}
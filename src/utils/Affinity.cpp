@@ -0,0 +1,245 @@
+#include "../../include/Affinity.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+#include <utility>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#if defined(__linux__)
+/**
+ * Reads the first integer from a sysfs file
+ * 
+ * @param path File to read
+ * @param fallback Value returned if the file is missing
+ * @return Parsed value
+ */
+static int readSysInt(const std::string& path, int fallback) {
+    std::ifstream in(path);
+    int value;
+    return (in >> value) ? value : fallback;
+}
+
+/**
+ * Returns the cache domain key of a CPU: the first CPU sharing its last-level cache
+ * 
+ * @param cpu Logical CPU number
+ * @return First CPU of the shared_cpu_list of the highest cache level
+ */
+static int lastLevelCacheKey(int cpu) {
+    std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/cache/";
+    int bestLevel = -1;
+    int key = 0;
+    for (int index = 0; index < 8; index++) {
+        std::string dir = base + "index" + std::to_string(index) + "/";
+        int level = readSysInt(dir + "level", -1);
+        if (level <= bestLevel) continue;
+        std::ifstream shared(dir + "shared_cpu_list");
+        int first;
+        if (shared >> first) {
+            bestLevel = level;
+            key = first;
+        }
+    }
+    return key;
+}
+
+/**
+ * Returns the NUMA node of a CPU from its nodeN link in sysfs
+ * 
+ * @param cpu Logical CPU number
+ * @return Node number (0 if unknown)
+ */
+static int numaNodeOf(int cpu) {
+    std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    DIR* dir = opendir(path.c_str());
+    if (!dir) return 0;
+    int node = 0;
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() > 4 && name.compare(0, 4, "node") == 0 && std::isdigit(static_cast<unsigned char>(name[4]))) {
+            node = std::atoi(name.c_str() + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+#endif
+
+/**
+ * Renumbers keys (in order of first appearance) to 0..n-1
+ * 
+ * @param keys Per-CPU keys, replaced by dense indices
+ */
+static void densify(std::vector<int>& keys) {
+    std::vector<int> seen;
+    for (int& key : keys) {
+        auto it = std::find(seen.begin(), seen.end(), key);
+        if (it == seen.end()) {
+            seen.push_back(key);
+            key = static_cast<int>(seen.size()) - 1;
+        } else {
+            key = static_cast<int>(it - seen.begin());
+        }
+    }
+}
+
+/**
+ * Reads the topology of the CPUs this process may run on
+ * 
+ * @return One entry per usable logical CPU, in CPU order
+ */
+std::vector<CpuInfo> detectCpuTopology() {
+    std::vector<CpuInfo> topology;
+
+#if defined(__linux__)
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        std::vector<std::pair<int, int>> coreKeys;  // (package, core_id)
+        std::vector<int> cacheKeys;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (!CPU_ISSET(cpu, &allowed)) continue;
+            std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+            int package = readSysInt(base + "physical_package_id", 0);
+            int coreId = readSysInt(base + "core_id", cpu);
+            coreKeys.push_back({package, coreId});
+            cacheKeys.push_back(lastLevelCacheKey(cpu));
+            topology.push_back({cpu, 0, 0, 0, numaNodeOf(cpu)});
+        }
+
+        // Dense core indices, and each CPU's position among its siblings
+        std::vector<std::pair<int, int>> cores;
+        for (std::size_t i = 0; i < topology.size(); i++) {
+            auto it = std::find(cores.begin(), cores.end(), coreKeys[i]);
+            topology[i].core = static_cast<int>(it - cores.begin());
+            if (it == cores.end()) cores.push_back(coreKeys[i]);
+            topology[i].smtIndex = static_cast<int>(std::count(coreKeys.begin(), coreKeys.begin() + i, coreKeys[i]));
+        }
+
+        densify(cacheKeys);
+        for (std::size_t i = 0; i < topology.size(); i++) {
+            topology[i].l3 = cacheKeys[i];
+        }
+    }
+#endif
+
+    if (topology.empty()) {
+        int count = std::max(1u, std::thread::hardware_concurrency());
+        for (int cpu = 0; cpu < count; cpu++) {
+            topology.push_back({cpu, cpu, 0, 0, 0});
+        }
+    }
+    return topology;
+}
+
+/**
+ * Parses an affinity policy from the command line
+ * 
+ * @param text "none", "spread", "compact", "cpu:N", "l3:N", or "numa:N"
+ * @param policy Receives the parsed policy
+ * @return True if the text was recognized
+ */
+bool parseAffinityPolicy(const std::string& text, AffinityPolicy& policy) {
+    std::string name = text.substr(0, text.find(':'));
+    bool hasIndex = text.find(':') != std::string::npos;
+    int index = hasIndex ? std::atoi(text.c_str() + text.find(':') + 1) : 0;
+
+    if (name == "none" && !hasIndex) policy.kind = AffinityPolicy::None;
+    else if (name == "spread" && !hasIndex) policy.kind = AffinityPolicy::Spread;
+    else if (name == "compact" && !hasIndex) policy.kind = AffinityPolicy::Compact;
+    else if (name == "cpu" && hasIndex) policy.kind = AffinityPolicy::Cpu;
+    else if (name == "l3" && hasIndex) policy.kind = AffinityPolicy::L3;
+    else if (name == "numa" && hasIndex) policy.kind = AffinityPolicy::Numa;
+    else return false;
+
+    policy.index = index;
+    return true;
+}
+
+AffinityPlanner::AffinityPlanner(const std::vector<CpuInfo>& topology) : topology(topology) {}
+
+/**
+ * Lists the CPUs a policy may use, in the order they are handed out
+ * 
+ * @param policy Placement policy
+ * @return Logical CPU numbers (empty if none match)
+ */
+std::vector<int> AffinityPlanner::candidates(const AffinityPolicy& policy) const {
+    std::vector<CpuInfo> matching;
+    for (const CpuInfo& info : topology) {
+        bool match = true;
+        switch (policy.kind) {
+            case AffinityPolicy::Cpu: match = info.cpu == policy.index; break;
+            case AffinityPolicy::L3: match = info.l3 == policy.index; break;
+            case AffinityPolicy::Numa: match = info.numaNode == policy.index; break;
+            default: break;
+        }
+        if (match) matching.push_back(info);
+    }
+
+    if (policy.kind == AffinityPolicy::Spread) {
+        // First sibling of every core before any second sibling; alternate cache domains
+        std::map<int, int> seenPerDomain;
+        std::vector<std::pair<std::pair<int, int>, CpuInfo>> keyed;
+        for (const CpuInfo& info : matching) {
+            int rank = seenPerDomain[info.l3 * 64 + info.smtIndex]++;
+            keyed.push_back({{info.smtIndex, rank}, info});
+        }
+        std::stable_sort(keyed.begin(), keyed.end(),
+                         [](const std::pair<std::pair<int, int>, CpuInfo>& a, const std::pair<std::pair<int, int>, CpuInfo>& b) {
+                             if (a.first != b.first) return a.first < b.first;
+                             return a.second.l3 < b.second.l3;
+                         });
+        matching.clear();
+        for (const auto& entry : keyed) matching.push_back(entry.second);
+    } else {
+        // Siblings of a core are adjacent, so consecutive threads share cores
+        std::stable_sort(matching.begin(), matching.end(), [](const CpuInfo& a, const CpuInfo& b) {
+            return a.core != b.core ? a.core < b.core : a.smtIndex < b.smtIndex;
+        });
+    }
+
+    std::vector<int> cpus;
+    for (const CpuInfo& info : matching) cpus.push_back(info.cpu);
+    return cpus;
+}
+
+/**
+ * Chooses the CPU for the next thread placed with a policy
+ * 
+ * @param policy Placement policy for the thread's role
+ * @return Logical CPU number, or -1 to leave the thread unpinned
+ */
+int AffinityPlanner::assign(const AffinityPolicy& policy) {
+    if (policy.kind == AffinityPolicy::None) return -1;
+    std::vector<int> cpus = candidates(policy);
+    if (cpus.empty()) return -1;
+    int& next = nextIndex[{policy.kind, policy.index}];
+    return cpus[next++ % cpus.size()];
+}
+
+/**
+ * Pins the calling thread to one CPU
+ * 
+ * @param cpu Logical CPU number
+ * @return True on success (always false where pinning is unsupported)
+ */
+bool pinCurrentThread(int cpu) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
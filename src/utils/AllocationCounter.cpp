@@ -0,0 +1,76 @@
+#include "../../include/AllocationCounter.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<long long> processAllocations{0};
+static thread_local long long threadAllocations = 0;
+
+long long threadAllocationCount() {
+    return threadAllocations;
+}
+
+long long processAllocationCount() {
+    return processAllocations.load(std::memory_order_relaxed);
+}
+
+/**
+ * Counts and performs one allocation
+ * 
+ * @param size Requested bytes
+ * @param alignment Required alignment (0 for the default)
+ * @return Allocated memory, or nullptr if the allocation failed
+ */
+static void* countedAllocate(std::size_t size, std::size_t alignment) {
+    threadAllocations++;
+    processAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0) size = 1;
+    if (alignment <= alignof(std::max_align_t)) return std::malloc(size);
+    void* memory = nullptr;
+    return (posix_memalign(&memory, alignment, size) == 0) ? memory : nullptr;
+}
+
+/**
+ * Allocates or throws std::bad_alloc
+ * 
+ * @param size Requested bytes
+ * @param alignment Required alignment (0 for the default)
+ * @return Allocated memory
+ */
+static void* countedAllocateOrThrow(std::size_t size, std::size_t alignment) {
+    void* memory = countedAllocate(size, alignment);
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+// Replacements of the global allocation functions; all memory comes from malloc, so free() releases it
+void* operator new(std::size_t size) { return countedAllocateOrThrow(size, 0); }
+void* operator new[](std::size_t size) { return countedAllocateOrThrow(size, 0); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return countedAllocate(size, 0); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return countedAllocate(size, 0); }
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return countedAllocateOrThrow(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return countedAllocateOrThrow(size, static_cast<std::size_t>(alignment));
+}
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { std::free(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept { std::free(memory); }
@@ -0,0 +1,179 @@
+#include "../../include/Bench.h"
+#include "../../include/Constants.h"
+#include "../../include/Utils.h"
+#include <fstream>
+#include <thread>
+#include <unistd.h>
+#include <sys/utsname.h>
+
+/**
+ * Marks the start of a loop iteration
+ * 
+ * @param nowNs Current monotonic time
+ */
+void BenchProbe::loopStarted(long long nowNs) {
+    if (lastLoopNs >= 0) loopPeriodNs.record(nowNs - lastLoopNs);
+    lastLoopNs = nowNs;
+}
+
+/**
+ * Records the detector's output for this iteration
+ * 
+ * @param nowNs Time the decision was made
+ * @param isScheduled Detector output
+ */
+void BenchProbe::detected(long long nowNs, bool isScheduled) {
+    if (isScheduled == lastDetected) return;
+    detections.push_back({nowNs - originNs, isScheduled});
+    lastDetected = isScheduled;
+}
+
+/**
+ * Samples the clocks before busy work
+ */
+void BenchProbe::busyStarted() {
+    busyWallNs = getMonotonicNs();
+    busyCpuNs = static_cast<long long>(getThreadCpuTime() * 1e9);
+}
+
+/**
+ * Samples the clocks after busy work and records any off-CPU gap as a preemption
+ * 
+ * The thread cannot see where in the busy work it was preempted, so the
+ * switch-out is placed after the CPU time it did receive.
+ */
+void BenchProbe::busyFinished() {
+    long long wallNs = getMonotonicNs();
+    long long cpuNs = static_cast<long long>(getThreadCpuTime() * 1e9);
+    long long ranNs = cpuNs - busyCpuNs;
+    long long offNs = (wallNs - busyWallNs) - ranNs;
+    if (offNs >= BENCH_OFFCPU_MIN_US * 1000LL) {
+        cpuClockEdges.push_back({busyWallNs + ranNs - originNs, false});
+        cpuClockEdges.push_back({wallNs - originNs, true});
+    }
+}
+
+/**
+ * Matches detector changes against ground-truth scheduling edges
+ * 
+ * @param truth Ground-truth edges in time order (tracer or cpuClockEdges)
+ */
+void BenchProbe::computeDetectionLatency(const std::vector<SchedEdge>& truth) {
+    truthEdges = static_cast<long long>(truth.size());
+    std::size_t next = 0;
+    long long previousNs = -1;
+    for (const SchedEdge& detection : detections) {
+        // Latest edge of the same direction since the previous detector change
+        long long matchNs = -1;
+        while (next < truth.size() && truth[next].timeNs <= detection.timeNs) {
+            if (truth[next].onCpu == detection.onCpu && truth[next].timeNs > previousNs) {
+                matchNs = truth[next].timeNs;
+            }
+            next++;
+        }
+        if (matchNs < 0) {
+            falseDetections++;
+        } else if (detection.onCpu) {
+            reschedLatencyNs.record(detection.timeNs - matchNs);
+        } else {
+            deschedLatencyNs.record(detection.timeNs - matchNs);
+        }
+        previousNs = detection.timeNs;
+    }
+}
+
+/**
+ * Writes a string as a JSON string literal
+ * 
+ * @param out Destination stream
+ * @param text Text to quote
+ */
+static void writeJsonString(std::ostream& out, const std::string& text) {
+    out << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') out << '\\';
+        if (static_cast<unsigned char>(c) >= 0x20) out << c;
+    }
+    out << '"';
+}
+
+/**
+ * Writes the histograms of one probe as JSON members
+ * 
+ * @param out Destination stream
+ * @param probe Probe to write
+ * @param indent Leading whitespace for each member
+ */
+static void writeProbeJson(std::ostream& out, const BenchProbe& probe, const std::string& indent) {
+    out << indent << "\"loop_period_ns\": ";
+    probe.loopPeriodNs.writeJson(out);
+    out << ",\n" << indent << "\"sleep_overshoot_ns\": ";
+    probe.overshootNs.writeJson(out);
+    out << ",\n" << indent << "\"record_ns\": ";
+    probe.recordNs.writeJson(out);
+    out << ",\n" << indent << "\"deschedule_latency_ns\": ";
+    probe.deschedLatencyNs.writeJson(out);
+    out << ",\n" << indent << "\"reschedule_latency_ns\": ";
+    probe.reschedLatencyNs.writeJson(out);
+    out << ",\n" << indent << "\"detector_changes\": " << probe.detections.size()
+        << ",\n" << indent << "\"false_detections\": " << probe.falseDetections
+        << ",\n" << indent << "\"truth_edges\": " << probe.truthEdges << "\n";
+}
+
+/**
+ * Writes the benchmark report as JSON
+ * 
+ * @param path Output file
+ * @param run Run configuration
+ * @param threads Threads to report
+ * @return True if the file was written
+ */
+bool writeBenchReport(const std::string& path, const BenchRunInfo& run, const std::vector<BenchThreadInfo>& threads) {
+    std::ofstream out(path);
+    if (!out) return false;
+
+    char hostname[256] = "unknown";
+    gethostname(hostname, sizeof(hostname) - 1);
+    utsname system;
+    std::string kernel = (uname(&system) == 0) ? std::string(system.sysname) + " " + system.release : "unknown";
+
+    out << "{\n  \"host\": {\"name\": ";
+    writeJsonString(out, hostname);
+    out << ", \"kernel\": ";
+    writeJsonString(out, kernel);
+    out << ", \"cpus\": " << std::thread::hardware_concurrency() << "},\n";
+
+    out << "  \"run\": {\"threads\": " << run.threadCount << ", \"duration_sec\": " << run.durationSec << ", \"timer\": ";
+    writeJsonString(out, run.timer);
+    out << ", \"workload\": ";
+    writeJsonString(out, run.workload);
+    out << ", \"ground_truth\": ";
+    writeJsonString(out, run.groundTruth);
+    out << "},\n";
+
+    // Merged view over melodic threads (the drum thread has no detector)
+    BenchProbe melodic;
+    for (const BenchThreadInfo& thread : threads) {
+        if (thread.role == VoiceRole::Drum) continue;
+        melodic.loopPeriodNs.merge(thread.probe->loopPeriodNs);
+        melodic.overshootNs.merge(thread.probe->overshootNs);
+        melodic.recordNs.merge(thread.probe->recordNs);
+        melodic.deschedLatencyNs.merge(thread.probe->deschedLatencyNs);
+        melodic.reschedLatencyNs.merge(thread.probe->reschedLatencyNs);
+        melodic.detections.insert(melodic.detections.end(), thread.probe->detections.begin(), thread.probe->detections.end());
+        melodic.falseDetections += thread.probe->falseDetections;
+        melodic.truthEdges += thread.probe->truthEdges;
+    }
+    out << "  \"melodic\": {\n";
+    writeProbeJson(out, melodic, "    ");
+    out << "  },\n";
+
+    out << "  \"threads\": [\n";
+    for (std::size_t i = 0; i < threads.size(); i++) {
+        out << "    {\n      \"id\": " << threads[i].id << ",\n      \"role\": \"" << voiceRoleName(threads[i].role) << "\",\n";
+        writeProbeJson(out, *threads[i].probe, "      ");
+        out << "    }" << (i + 1 < threads.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return static_cast<bool>(out);
+}
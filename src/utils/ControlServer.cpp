@@ -0,0 +1,320 @@
+#include "../../include/ControlServer.h"
+#include "../../include/Conductor.h"
+#include "../../include/Constants.h"
+#include "../../include/MidiStream.h"
+#include "../../include/MusicGeneration.h"
+#include "../../include/ScheduleTrace.h"
+#include "../../include/Utils.h"
+#include "../../include/Workload.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define THREAD_MUSIC_HAVE_UNIX_SOCKETS 1
+#endif
+
+// Client: One connection and the part of a command line read so far
+struct Client {
+    int fd;
+    std::string pending;
+};
+
+/**
+ * Writes all bytes to a connection
+ * 
+ * @param fd Connected socket
+ * @param text Bytes to write
+ * @return False if the connection failed
+ */
+static bool sendAll(int fd, const std::string& text) {
+#ifdef THREAD_MUSIC_HAVE_UNIX_SOCKETS
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL; // A closed peer is reported as an error, not SIGPIPE
+#else
+    const int flags = 0;
+#endif
+    const char* data = text.data();
+    std::size_t size = text.size();
+    while (size > 0) {
+        ssize_t written = ::send(fd, data, size, flags);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        data += written;
+        size -= static_cast<std::size_t>(written);
+    }
+    return true;
+#else
+    (void)fd;
+    (void)text;
+    return false;
+#endif
+}
+
+/**
+ * @param path Socket path
+ * @param target State the commands read and change
+ */
+ControlServer::ControlServer(const std::string& path, const ControlTarget& target)
+    : path(path), target(target), workload(target.workload) {
+    for (const ThreadData& data : *target.threads) {
+        if (!data.isDrumThread) melodicVoices++;
+    }
+}
+
+ControlServer::~ControlServer() {
+    stop();
+}
+
+/**
+ * Creates and binds the socket, replacing a stale socket at the path
+ * 
+ * @param error Receives the reason on failure
+ * @return True on success (always false where Unix sockets are unavailable)
+ */
+bool ControlServer::open(std::string& error) {
+#ifdef THREAD_MUSIC_HAVE_UNIX_SOCKETS
+    sockaddr_un local;
+    std::memset(&local, 0, sizeof(local));
+    local.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(local.sun_path)) {
+        error = "socket path must be 1 to " + std::to_string(sizeof(local.sun_path) - 1) + " bytes";
+        return false;
+    }
+    std::memcpy(local.sun_path, path.c_str(), path.size());
+
+    // Only a socket left behind by an earlier run is replaced, never another file
+    struct stat existing;
+    if (::lstat(path.c_str(), &existing) == 0) {
+        if (!S_ISSOCK(existing.st_mode)) {
+            error = path + " exists and is not a socket";
+            return false;
+        }
+        ::unlink(path.c_str());
+    }
+
+    listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        error = std::string("socket: ") + std::strerror(errno);
+        return false;
+    }
+    if (::bind(listenFd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0 ||
+        ::listen(listenFd, CONTROL_MAX_CLIENTS) != 0) {
+        error = "cannot listen on " + path + ": " + std::strerror(errno);
+        ::close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+    return true;
+#else
+    error = "Unix sockets are unavailable on this platform";
+    return false;
+#endif
+}
+
+/**
+ * Starts serving on the control thread
+ */
+void ControlServer::start() {
+    if (listenFd < 0 || serving.exchange(true)) return;
+    server = std::thread(&ControlServer::serveLoop, this);
+}
+
+/**
+ * Stops the control thread, closes every connection and removes the socket
+ */
+void ControlServer::stop() {
+    if (serving.exchange(false)) server.join();
+#ifdef THREAD_MUSIC_HAVE_UNIX_SOCKETS
+    if (listenFd >= 0) {
+        ::close(listenFd);
+        ::unlink(path.c_str());
+        listenFd = -1;
+    }
+#endif
+}
+
+/**
+ * Accepts connections and answers command lines until stopped
+ */
+void ControlServer::serveLoop() {
+#ifdef THREAD_MUSIC_HAVE_UNIX_SOCKETS
+    std::vector<Client> clients;
+    std::vector<pollfd> polled;
+    while (serving.load(std::memory_order_acquire)) {
+        polled.clear();
+        polled.push_back({listenFd, POLLIN, 0});
+        for (const Client& client : clients) {
+            polled.push_back({client.fd, POLLIN, 0});
+        }
+        if (::poll(polled.data(), polled.size(), CONTROL_POLL_INTERVAL_MS) <= 0) continue;
+
+        // Existing connections first, so indices still match the poll set
+        for (std::size_t i = clients.size(); i-- > 0;) {
+            short events = polled[i + 1].revents;
+            if (events == 0) continue;
+            char chunk[256];
+            ssize_t received = (events & POLLIN) ? ::recv(clients[i].fd, chunk, sizeof(chunk), 0) : 0;
+            if (received < 0 && errno == EINTR) continue;
+            bool open = received > 0;
+            if (open) clients[i].pending.append(chunk, static_cast<std::size_t>(received));
+
+            // Answer every complete line
+            std::size_t newline;
+            while (open && (newline = clients[i].pending.find('\n')) != std::string::npos) {
+                std::string line = clients[i].pending.substr(0, newline);
+                clients[i].pending.erase(0, newline + 1);
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                if (line.empty()) continue;
+                open = sendAll(clients[i].fd, handle(line) + "\n");
+            }
+            if (clients[i].pending.size() > CONTROL_MAX_LINE_BYTES) {
+                sendAll(clients[i].fd, "error command line too long\n");
+                open = false;
+            }
+            if (!open) {
+                ::close(clients[i].fd);
+                clients.erase(clients.begin() + static_cast<long>(i));
+            }
+        }
+
+        if (polled[0].revents & POLLIN) {
+            int fd = ::accept(listenFd, nullptr, nullptr);
+            if (fd >= 0 && clients.size() >= static_cast<std::size_t>(CONTROL_MAX_CLIENTS)) {
+                sendAll(fd, "error too many connections\n");
+                ::close(fd);
+            } else if (fd >= 0) {
+                clients.push_back({fd, std::string()});
+            }
+        }
+    }
+    for (const Client& client : clients) {
+        ::close(client.fd);
+    }
+#endif
+}
+
+/**
+ * Runs one command
+ * 
+ * @param line Command and its optional argument
+ * @return Reply line without the newline
+ */
+std::string ControlServer::handle(const std::string& line) {
+    commandCount.fetch_add(1, std::memory_order_relaxed);
+    std::istringstream words(line);
+    std::string command, argument, extra;
+    words >> command >> argument >> extra;
+    if (!extra.empty()) return "error too many arguments";
+
+    if (command == "status" && argument.empty()) return statusJson();
+    if (command == "counters" && argument.empty()) return countersJson();
+
+    if (command == "voices") {
+        if (!argument.empty()) {
+            char* end = nullptr;
+            long count = std::strtol(argument.c_str(), &end, 10);
+            if (*end != '\0' || count < 0) return "error voices takes a count from 0 to " + std::to_string(melodicVoices);
+            activeVoices.store(static_cast<int>(std::min<long>(count, melodicVoices)), std::memory_order_relaxed);
+        }
+        int active = std::min(activeVoices.load(std::memory_order_relaxed), melodicVoices);
+        return "ok voices " + std::to_string(active) + " of " + std::to_string(melodicVoices);
+    }
+
+    if (command == "workload") {
+        if (!argument.empty()) {
+            WorkloadKind kind;
+            if (!parseWorkloadKind(argument, kind)) return "error unknown workload '" + argument + "'";
+
+            // Calibrated here, so the voice threads only swap kernels
+            liveWorkload.publish(kind, Workload::calibrate(kind));
+            workload = kind;
+        }
+        return std::string("ok workload ") + workloadKindName(workload);
+    }
+
+    if (command == "flush" && argument.empty()) {
+        if (!target.stream && !target.trace) {
+            return "error flush needs --stream or --record-trace; other outputs are written when the run ends";
+        }
+        std::string reply = "ok";
+        if (target.stream) {
+            target.stream->requestFlush();
+            reply += " flush requested (" + std::to_string(target.stream->getFlushCount()) + " flushes so far)";
+        }
+        if (target.trace) {
+            // Kernel-traced melodic edges only arrive when the run ends
+            bool written = target.trace->flush();
+            reply += std::string(target.stream ? ";" : "") + (written ? " trace flushed" : " trace write failed") + " (" +
+                     std::to_string(target.trace->getFlushCount()) + " trace flushes)";
+        }
+        return reply;
+    }
+
+    if (command == "stop" && argument.empty()) {
+        running = false;
+        return "ok stopping";
+    }
+
+    if (command == "tempo" || command == "phases") {
+        std::string value = (command == "tempo") ? std::to_string(TEMPO)
+                                                 : std::to_string(target.conductor->getGrid().numPhases);
+        if (!argument.empty()) return "error " + command + " is fixed for the run (" + value + ")";
+        return "ok " + command + " " + value;
+    }
+
+    if (command == "help" && argument.empty()) {
+        return "ok commands: status, counters, voices [N], workload [KIND], flush, stop, tempo, phases";
+    }
+    return "error unknown command '" + line + "' (try help)";
+}
+
+/**
+ * Formats the clock position and the live settings as JSON
+ * 
+ * @return One-line JSON object
+ */
+std::string ControlServer::statusJson() const {
+    const Conductor& conductor = *target.conductor;
+    Beat beat = conductor.read();
+    long long elapsedNs = std::max(0LL, getMonotonicNs() - conductor.getOriginNs());
+    std::ostringstream out;
+    out << "{\"elapsed_ns\": " << elapsedNs
+        << ", \"duration_ns\": " << conductor.getEndNs() - conductor.getOriginNs()
+        << ", \"tick\": " << beat.tick
+        << ", \"phase\": " << beat.phase
+        << ", \"phases\": " << conductor.getGrid().numPhases
+        << ", \"tempo\": " << TEMPO
+        << ", \"voices\": " << std::min(activeVoices.load(std::memory_order_relaxed), melodicVoices)
+        << ", \"melodic_voices\": " << melodicVoices
+        << ", \"workload\": \"" << workloadKindName(workload) << "\""
+        << ", \"flushes\": " << (target.stream ? target.stream->getFlushCount() : 0)
+        << ", \"trace_flushes\": " << (target.trace ? target.trace->getFlushCount() : 0)
+        << ", \"running\": " << (running ? "true" : "false") << "}";
+    return out.str();
+}
+
+/**
+ * Formats the current counters of every thread as JSON
+ * 
+ * @return One-line JSON object
+ */
+std::string ControlServer::countersJson() const {
+    std::ostringstream out;
+    out << "{\"time_ns\": " << std::max(0LL, getMonotonicNs() - target.conductor->getOriginNs()) << ", \"threads\": [";
+    for (const ThreadData& data : *target.threads) {
+        out << (data.id ? ", " : "") << "{\"id\": " << data.id << ", \"role\": \"" << voiceRoleName(data.role)
+            << "\", \"counters\": ";
+        writeCountersJson(out, readCounters((*target.counters)[data.id]));
+        out << "}";
+    }
+    out << "]}";
+    return out.str();
+}
@@ -0,0 +1,137 @@
+#include "../../include/Counters.h"
+#include "../../include/Utils.h"
+#include <chrono>
+#include <fstream>
+
+/**
+ * Reads every counter of a thread
+ * 
+ * @param counters Counters to read
+ * @return Current values
+ */
+CounterValues readCounters(const ThreadCounters& counters) {
+    return {counters.loops.load(std::memory_order_relaxed),
+            counters.transitions.load(std::memory_order_relaxed),
+            counters.notesStarted.load(std::memory_order_relaxed),
+            counters.notesTruncated.load(std::memory_order_relaxed),
+            counters.mutexWaitNs.load(std::memory_order_relaxed),
+            counters.busyNs.load(std::memory_order_relaxed),
+            counters.allocations.load(std::memory_order_relaxed),
+            counters.detectorChanges.load(std::memory_order_relaxed),
+            counters.legacyChanges.load(std::memory_order_relaxed),
+            counters.adaptiveChanges.load(std::memory_order_relaxed)};
+}
+
+/**
+ * Formats counter values as a compact "name=value" text line
+ * 
+ * @param values Counter values
+ * @return Text suitable for a MIDI text event
+ */
+std::string formatCounters(const CounterValues& values) {
+    return "loops=" + std::to_string(values.loops) +
+           " transitions=" + std::to_string(values.transitions) +
+           " notes=" + std::to_string(values.notesStarted) +
+           " truncated=" + std::to_string(values.notesTruncated) +
+           " mutex_wait_us=" + std::to_string(values.mutexWaitNs / 1000) +
+           " busy_us=" + std::to_string(values.busyNs / 1000) +
+           " allocations=" + std::to_string(values.allocations) +
+           " detector_changes=" + std::to_string(values.detectorChanges) +
+           " legacy_changes=" + std::to_string(values.legacyChanges) +
+           " adaptive_changes=" + std::to_string(values.adaptiveChanges);
+}
+
+CounterRecorder::CounterRecorder(const std::vector<ThreadCounters>& counters, long long originNs)
+    : counters(counters), originNs(originNs) {}
+
+CounterRecorder::~CounterRecorder() {
+    if (sampler.joinable()) stop();
+}
+
+/**
+ * Appends the current values of all threads to the snapshot list
+ */
+void CounterRecorder::takeSnapshot() {
+    CounterSnapshot snapshot;
+    snapshot.timeNs = getMonotonicNs() - originNs;
+    for (const ThreadCounters& thread : counters) {
+        snapshot.threads.push_back(readCounters(thread));
+    }
+    snapshots.push_back(snapshot);
+}
+
+/**
+ * Starts periodic snapshots
+ * 
+ * @param intervalSec Seconds between snapshots (0 records only the final one)
+ */
+void CounterRecorder::start(int intervalSec) {
+    if (intervalSec <= 0) return;
+    sampler = std::thread([this, intervalSec]() {
+        std::unique_lock<std::mutex> lock(stopMutex);
+        while (!stopSignal.wait_for(lock, std::chrono::seconds(intervalSec), [this]() { return stopping; })) {
+            takeSnapshot();
+        }
+    });
+}
+
+/**
+ * Stops the snapshot thread and records the final snapshot
+ */
+void CounterRecorder::stop() {
+    {
+        std::lock_guard<std::mutex> lock(stopMutex);
+        stopping = true;
+    }
+    stopSignal.notify_all();
+    if (sampler.joinable()) sampler.join();
+    takeSnapshot();
+}
+
+/**
+ * Writes counter values as a JSON object
+ * 
+ * @param out Destination stream
+ * @param values Counter values
+ */
+void writeCountersJson(std::ostream& out, const CounterValues& values) {
+    out << "{\"loops\": " << values.loops
+        << ", \"transitions\": " << values.transitions
+        << ", \"notes_started\": " << values.notesStarted
+        << ", \"notes_truncated\": " << values.notesTruncated
+        << ", \"mutex_wait_ns\": " << values.mutexWaitNs
+        << ", \"busy_ns\": " << values.busyNs
+        << ", \"allocations\": " << values.allocations
+        << ", \"detector_changes\": " << values.detectorChanges
+        << ", \"legacy_changes\": " << values.legacyChanges
+        << ", \"adaptive_changes\": " << values.adaptiveChanges << "}";
+}
+
+/**
+ * Writes all snapshots as JSON
+ * 
+ * @param path Output file
+ * @param threads Thread configurations (for IDs and roles)
+ * @return True if the file was written
+ */
+bool CounterRecorder::writeJson(const std::string& path, const std::vector<ThreadData>& threads) const {
+    std::ofstream out(path);
+    if (!out) return false;
+
+    out << "{\n  \"threads\": [";
+    for (std::size_t i = 0; i < threads.size(); i++) {
+        out << (i ? ", " : "") << "{\"id\": " << threads[i].id << ", \"role\": \"" << voiceRoleName(threads[i].role)
+            << "\", \"cpu\": " << threads[i].cpu << "}";
+    }
+    out << "],\n  \"snapshots\": [\n";
+    for (std::size_t s = 0; s < snapshots.size(); s++) {
+        out << "    {\"time_ns\": " << snapshots[s].timeNs << ", \"counters\": [";
+        for (std::size_t i = 0; i < snapshots[s].threads.size(); i++) {
+            out << (i ? ", " : "");
+            writeCountersJson(out, snapshots[s].threads[i]);
+        }
+        out << "]}" << (s + 1 < snapshots.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,95 @@
+#include "../../include/Histogram.h"
+#include <algorithm>
+
+/**
+ * Maps a value to its bucket: exact below SUB_BUCKETS, log-linear above
+ * 
+ * @param value Non-negative sample
+ * @return Bucket index
+ */
+int Histogram::bucketFor(long long value) {
+    if (value < SUB_BUCKETS) return static_cast<int>(value);
+    int exponent = 63 - __builtin_clzll(static_cast<unsigned long long>(value));
+    int sub = static_cast<int>((value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+    return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+/**
+ * Returns the smallest value that maps to a bucket
+ * 
+ * @param bucket Bucket index
+ * @return Lower bound of the bucket
+ */
+long long Histogram::bucketLowerBound(int bucket) {
+    if (bucket < SUB_BUCKETS) return bucket;
+    int exponent = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    long long sub = bucket % SUB_BUCKETS;
+    return (SUB_BUCKETS + sub) << (exponent - SUB_BUCKET_BITS);
+}
+
+/**
+ * Adds a sample (negative values count as zero)
+ * 
+ * @param value Sample, typically nanoseconds
+ */
+void Histogram::record(long long value) {
+    value = std::max(0LL, value);
+    counts[bucketFor(value)]++;
+    total++;
+    largest = std::max(largest, value);
+}
+
+/**
+ * Adds every sample of another histogram
+ * 
+ * @param other Histogram to merge
+ */
+void Histogram::merge(const Histogram& other) {
+    for (std::size_t i = 0; i < counts.size(); i++) {
+        counts[i] += other.counts[i];
+    }
+    total += other.total;
+    largest = std::max(largest, other.largest);
+}
+
+/**
+ * Returns an estimate of a percentile
+ * 
+ * @param fraction Percentile as a fraction (0.99 for p99)
+ * @return Midpoint of the bucket holding that rank, clamped to the maximum (0 if empty)
+ */
+long long Histogram::percentile(double fraction) const {
+    if (total == 0) return 0;
+    long long rank = std::max(1LL, static_cast<long long>(fraction * total + 0.5));
+    long long seen = 0;
+    for (int bucket = 0; bucket < static_cast<int>(counts.size()); bucket++) {
+        seen += counts[bucket];
+        if (seen >= rank) {
+            long long lower = bucketLowerBound(bucket);
+            long long upper = bucketLowerBound(bucket + 1);
+            return std::min(largest, (lower + upper - 1) / 2);
+        }
+    }
+    return largest;
+}
+
+/**
+ * Writes the histogram as a JSON object
+ * 
+ * @param out Destination stream
+ */
+void Histogram::writeJson(std::ostream& out) const {
+    out << "{\"count\": " << total
+        << ", \"p50\": " << percentile(0.50)
+        << ", \"p99\": " << percentile(0.99)
+        << ", \"p999\": " << percentile(0.999)
+        << ", \"max\": " << largest
+        << ", \"buckets\": [";
+    bool first = true;
+    for (int bucket = 0; bucket < static_cast<int>(counts.size()); bucket++) {
+        if (counts[bucket] == 0) continue;
+        out << (first ? "" : ", ") << "[" << bucketLowerBound(bucket) << ", " << counts[bucket] << "]";
+        first = false;
+    }
+    out << "]}";
+}
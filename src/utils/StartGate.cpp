@@ -0,0 +1,35 @@
+#include "../../include/StartGate.h"
+#include "../../include/Utils.h"
+
+/**
+ * Arrives at the gate and waits until it opens
+ */
+void StartGate::arriveAndWait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    arrived++;
+    lastArrivalNs = getMonotonicNs();
+    changed.notify_all();
+    changed.wait(lock, [this]() { return opened; });
+}
+
+/**
+ * Waits until every party has arrived
+ * 
+ * @return Monotonic time the last party arrived
+ */
+long long StartGate::waitForArrivals() {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this]() { return arrived >= parties; });
+    return lastArrivalNs;
+}
+
+/**
+ * Opens the gate
+ */
+void StartGate::open() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        opened = true;
+    }
+    changed.notify_all();
+}
@@ -0,0 +1,170 @@
+#include "../../include/ThreadPool.h"
+#include <algorithm>
+
+// Index of the worker running on this thread (-1 on other threads)
+static thread_local int workerIndex = -1;
+
+/**
+ * Starts the workers
+ * 
+ * @param workerCount Number of workers (0 or less uses every hardware thread)
+ */
+ThreadPool::ThreadPool(int workerCount) {
+    if (workerCount <= 0) workerCount = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 0; i < workerCount; i++) {
+        queues.emplace_back(new WorkerQueue());
+    }
+    for (int i = 0; i < workerCount; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+/**
+ * Finishes queued tasks and joins the workers
+ */
+ThreadPool::~ThreadPool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+/**
+ * Queues a task
+ * 
+ * @param task Work to run on some worker
+ */
+void ThreadPool::submit(std::function<void()> task) {
+    enqueue(nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size(), std::move(task));
+}
+
+/**
+ * Queues a task on one worker's deque (other workers may still steal it)
+ * 
+ * @param worker Preferred worker index (wrapped into range)
+ * @param task Work to run
+ */
+void ThreadPool::submitTo(int worker, std::function<void()> task) {
+    enqueue(static_cast<std::size_t>(std::max(worker, 0)) % queues.size(), std::move(task));
+}
+
+/**
+ * Adds a task to a deque and wakes a worker
+ * 
+ * @param queue Deque index
+ * @param task Work to run
+ */
+void ThreadPool::enqueue(std::size_t queue, std::function<void()> task) {
+    WorkerQueue& target = *queues[queue];
+    {
+        std::lock_guard<std::mutex> lock(target.mutex);
+        target.tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        queued++;
+        pending++;
+    }
+    workAvailable.notify_one();
+}
+
+/**
+ * Blocks until every submitted task has finished
+ */
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(stateMutex);
+    allDone.wait(lock, [this]() { return pending == 0; });
+}
+
+/**
+ * Returns how many tasks wait in all deques
+ * 
+ * @return Queued tasks, not counting running ones
+ */
+std::size_t ThreadPool::queueDepth() const {
+    std::size_t depth = 0;
+    for (const auto& queue : queues) {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        depth += queue->tasks.size();
+    }
+    return depth;
+}
+
+/**
+ * Returns the index of the calling worker
+ * 
+ * @return Worker index, or -1 if the caller is not a worker of any pool
+ */
+int ThreadPool::currentWorker() {
+    return workerIndex;
+}
+
+/**
+ * Takes the newest task from a worker's own deque
+ * 
+ * @param index Worker index
+ * @param task Receives the task
+ * @return True if a task was taken
+ */
+bool ThreadPool::popOwn(int index, std::function<void()>& task) {
+    WorkerQueue& queue = *queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) return false;
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+/**
+ * Takes the oldest task from another worker's deque
+ * 
+ * @param thief Index of the stealing worker
+ * @param task Receives the task
+ * @return True if a task was stolen
+ */
+bool ThreadPool::steal(int thief, std::function<void()>& task) {
+    int count = static_cast<int>(queues.size());
+    for (int offset = 1; offset < count; offset++) {
+        WorkerQueue& queue = *queues[(thief + offset) % count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) continue;
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        steals.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Runs tasks until the pool is destroyed
+ * 
+ * @param index Worker index
+ */
+void ThreadPool::workerLoop(int index) {
+    workerIndex = index;
+    while (true) {
+        {
+            // Sleep until some deque holds a task that nobody has taken yet
+            std::unique_lock<std::mutex> lock(stateMutex);
+            workAvailable.wait(lock, [this]() { return stopping || queued > 0; });
+            if (queued == 0) return;
+            queued--;
+        }
+
+        // The reserved task is in some deque; it may take a moment to find it
+        std::function<void()> task;
+        while (!popOwn(index, task) && !steal(index, task)) {
+            std::this_thread::yield();
+        }
+        task();
+
+        std::lock_guard<std::mutex> lock(stateMutex);
+        if (--pending == 0) allDone.notify_all();
+    }
+}
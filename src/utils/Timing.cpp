@@ -0,0 +1,156 @@
+#include "../../include/Timing.h"
+#include "../../include/Constants.h"
+#include "../../include/Utils.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#if defined(__linux__)
+#include <sys/prctl.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <ctime>
+#endif
+
+/**
+ * Parses a timer mode name from the command line
+ * 
+ * @param name One of "sleep", "deadline", "timerfd", "spin"
+ * @param mode Receives the parsed mode
+ * @return True if the name was recognized
+ */
+bool parseTimerMode(const std::string& name, TimerMode& mode) {
+    if (name == "sleep") mode = TimerMode::Sleep;
+    else if (name == "deadline") mode = TimerMode::Deadline;
+    else if (name == "timerfd") mode = TimerMode::TimerFd;
+    else if (name == "spin") mode = TimerMode::Spin;
+    else return false;
+    return true;
+}
+
+/**
+ * Returns the command-line name of a timer mode
+ * 
+ * @param mode Timer mode
+ * @return Mode name
+ */
+const char* timerModeName(TimerMode mode) {
+    switch (mode) {
+        case TimerMode::Sleep: return "sleep";
+        case TimerMode::Deadline: return "deadline";
+        case TimerMode::TimerFd: return "timerfd";
+        case TimerMode::Spin: return "spin";
+    }
+    return "unknown";
+}
+
+/**
+ * Returns a one-line summary of the recorded lateness
+ * 
+ * @return Human-readable report
+ */
+std::string TimingStats::summary() const {
+    if (latenessNs.empty()) return "no samples";
+
+    std::vector<long long> sorted(latenessNs);
+    std::sort(sorted.begin(), sorted.end());
+    auto percentileUs = [&](double p) {
+        std::size_t index = static_cast<std::size_t>(p * (sorted.size() - 1));
+        return sorted[index] / 1000.0;
+    };
+
+    char line[160];
+    std::snprintf(line, sizeof(line), "%zu wake-ups, lateness p50 %.1f us, p99 %.1f us, max %.1f us, %lld missed steps",
+                  sorted.size(), percentileUs(0.5), percentileUs(0.99), sorted.back() / 1000.0, missedSteps);
+    return line;
+}
+
+TimerEngine::TimerEngine(TimerMode mode) : mode(mode) {
+#if defined(__linux__)
+    // Precise modes also drop the default 50 us timer slack for this thread
+    if (mode != TimerMode::Sleep) {
+        prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+    }
+    if (mode == TimerMode::TimerFd) {
+        timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (timerFd < 0) this->mode = TimerMode::Deadline;
+    }
+#else
+    // clock_nanosleep and timerfd are Linux-only; sleep_until is the closest equivalent
+    if (mode == TimerMode::TimerFd) this->mode = TimerMode::Deadline;
+#endif
+}
+
+TimerEngine::~TimerEngine() {
+#if defined(__linux__)
+    if (timerFd >= 0) close(timerFd);
+#endif
+}
+
+/**
+ * Blocks the thread until a deadline using the selected mode's primitive
+ * 
+ * @param deadlineNs Absolute CLOCK_MONOTONIC deadline in nanoseconds
+ */
+void TimerEngine::blockUntil(long long deadlineNs) {
+#if defined(__linux__)
+    timespec ts;
+    ts.tv_sec = deadlineNs / 1000000000LL;
+    ts.tv_nsec = deadlineNs % 1000000000LL;
+
+    if (mode == TimerMode::TimerFd) {
+        itimerspec spec = {};
+        spec.it_value = ts;
+        uint64_t expirations;
+        if (timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, nullptr) == 0 &&
+            read(timerFd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+            return;
+        }
+        // Fall back to clock_nanosleep if the timer could not be armed or read
+    }
+
+    if (mode != TimerMode::Sleep) {
+        // Restart after signals until the absolute deadline has passed
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) != 0 && getMonotonicNs() < deadlineNs) {
+        }
+        return;
+    }
+#else
+    if (mode != TimerMode::Sleep) {
+        std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::nanoseconds(deadlineNs)));
+        return;
+    }
+#endif
+
+    // Relative sleep, subject to the same slack as the original sleep_for polling
+    long long remainingNs = deadlineNs - getMonotonicNs();
+    if (remainingNs > 0) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(remainingNs));
+    }
+}
+
+/**
+ * Sleeps until a deadline
+ * 
+ * Spin mode sleeps until TIMER_SPIN_WINDOW_US before the deadline and
+ * yields in a loop for the rest, trading CPU time for wake-up precision.
+ * 
+ * @param deadlineNs Absolute CLOCK_MONOTONIC deadline in nanoseconds
+ * @return How late the thread woke up, in nanoseconds (0 if not late)
+ */
+long long TimerEngine::sleepUntil(long long deadlineNs) {
+    if (mode == TimerMode::Spin) {
+        long long spinStartNs = deadlineNs - TIMER_SPIN_WINDOW_US * 1000LL;
+        if (getMonotonicNs() < spinStartNs) {
+            blockUntil(spinStartNs);
+        }
+        while (getMonotonicNs() < deadlineNs) {
+            std::this_thread::yield();
+        }
+    } else {
+        blockUntil(deadlineNs);
+    }
+
+    return std::max(0LL, getMonotonicNs() - deadlineNs);
+}
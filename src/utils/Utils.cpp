@@ -1,15 +1,152 @@
 #include "../../include/Utils.h"
+#include <chrono>
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/thread_info.h>
+#elif defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Selected once at startup, before worker threads exist
+static CpuClockMode cpuClockMode = CpuClockMode::Thread;
+
+#if defined(__APPLE__)
+/**
+ * Reads user + system time of a Mach thread
+ * 
+ * @param thread Mach thread port
+ * @return CPU time in seconds, or -1 on failure
+ */
+static double machThreadCpuTime(thread_act_t thread) {
+    thread_basic_info_data_t info;
+    mach_msg_type_number_t count = THREAD_BASIC_INFO_COUNT;
+    if (thread_info(thread, THREAD_BASIC_INFO, reinterpret_cast<thread_info_t>(&info), &count) != KERN_SUCCESS) {
+        return -1.0;
+    }
+    return info.user_time.seconds + info.system_time.seconds +
+           (info.user_time.microseconds + info.system_time.microseconds) / 1e6;
+}
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+/**
+ * Reads a POSIX clock
+ * 
+ * @param clock Clock to read
+ * @return Clock value in seconds, or -1 on failure
+ */
+static double readClock(clockid_t clock) {
+    timespec ts;
+    if (clock_gettime(clock, &ts) != 0) return -1.0;
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+#endif
+
+/**
+ * Selects the clock used by getCpuTime()
+ * 
+ * @param mode Per-thread or process-wide CPU time
+ */
+void setCpuClockMode(CpuClockMode mode) {
+    cpuClockMode = mode;
+}
+
+/**
+ * Returns the clock currently used by getCpuTime()
+ * 
+ * @return Active CPU clock mode
+ */
+CpuClockMode getCpuClockMode() {
+    return cpuClockMode;
+}
 
 /**
- * Returns the CPU time used by the current process
+ * Returns the CPU time used by the current thread or process
  * 
  * This function is key to the thread scheduling detection mechanism.
  * By comparing CPU time (which only advances when a thread is actively running)
  * with wall clock time (which always advances), threads can detect when 
- * they're being scheduled by the operating system.
+ * they're being scheduled by the operating system. Per-thread time keeps
+ * siblings from making each other look scheduled.
  * 
  * @return CPU time in seconds as a double
  */
 double getCpuTime() {
+    return (cpuClockMode == CpuClockMode::Thread) ? getThreadCpuTime() : getProcessCpuTime();
+}
+
+/**
+ * Returns the CPU time used by the calling thread
+ * 
+ * @return CPU time in seconds as a double
+ */
+double getThreadCpuTime() {
+#if defined(__APPLE__)
+    return machThreadCpuTime(pthread_mach_thread_np(pthread_self()));
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+    return readClock(CLOCK_THREAD_CPUTIME_ID);
+#else
+    return getProcessCpuTime();
+#endif
+}
+
+/**
+ * Returns the CPU time used by another thread of this process
+ * 
+ * @param thread Native handle of the thread to sample
+ * @return CPU time in seconds as a double, or -1 if it cannot be read
+ */
+double getThreadCpuTime(pthread_t thread) {
+#if defined(__APPLE__)
+    return machThreadCpuTime(pthread_mach_thread_np(thread));
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+    clockid_t clock;
+    if (pthread_getcpuclockid(thread, &clock) != 0) return -1.0;
+    return readClock(clock);
+#else
+    (void)thread;
+    return -1.0;
+#endif
+}
+
+/**
+ * Returns the CPU time used by the whole process
+ * 
+ * @return CPU time in seconds as a double
+ */
+double getProcessCpuTime() {
+#if defined(CLOCK_PROCESS_CPUTIME_ID)
+    timespec ts;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) == 0) {
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+    }
+#endif
     return static_cast<double>(clock()) / CLOCKS_PER_SEC;  // thank you xcode
-}
\ No newline at end of file
+}
+
+/**
+ * Returns the kernel thread ID of the calling thread
+ * 
+ * @return OS thread ID (gettid on Linux)
+ */
+long getCurrentThreadId() {
+#if defined(__linux__)
+    return static_cast<long>(syscall(SYS_gettid));
+#elif defined(__APPLE__)
+    uint64_t tid = 0;
+    pthread_threadid_np(nullptr, &tid);
+    return static_cast<long>(tid);
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Returns the current CLOCK_MONOTONIC time
+ * 
+ * @return Monotonic time in nanoseconds
+ */
+long long getMonotonicNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
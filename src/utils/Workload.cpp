@@ -0,0 +1,339 @@
+#include "../../include/Workload.h"
+#include "../../include/Constants.h"
+#include "../../include/Utils.h"
+#include "../../include/Counters.h"
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <random>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define THREAD_MUSIC_X86_FMA 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Shared by every thread running the lock kernel, so they contend for it
+std::mutex contendedMutex;
+volatile long contendedCounter = 0;
+
+const std::size_t STREAM_CHUNK = 512;  // Doubles per stream iteration (4 KiB of each buffer)
+const std::size_t CHASE_STRIDE = 8;    // size_t slots per cache line
+const int FMA_CHAIN = 8;               // Dependent FMAs per accumulator per iteration
+
+/**
+ * Runs FMA iterations with scalar arithmetic
+ * 
+ * @param iterations Iteration count
+ * @return Reduced result
+ */
+double fmaScalar(long long iterations) {
+    double acc[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    for (long long n = 0; n < iterations; n++) {
+        for (int k = 0; k < FMA_CHAIN; k++) {
+            for (double& a : acc) a = a * 0.999999 + 1e-7;
+        }
+    }
+    double sum = 0;
+    for (double a : acc) sum += a;
+    return sum;
+}
+
+#ifdef THREAD_MUSIC_X86_FMA
+/**
+ * Runs FMA iterations on eight 256-bit accumulators
+ * 
+ * @param iterations Iteration count
+ * @return Reduced result
+ */
+__attribute__((target("avx2,fma"))) double fmaAvx2(long long iterations) {
+    __m256d acc[8];
+    for (int i = 0; i < 8; i++) acc[i] = _mm256_set1_pd(i + 1.0);
+    const __m256d mul = _mm256_set1_pd(0.999999);
+    const __m256d add = _mm256_set1_pd(1e-7);
+    for (long long n = 0; n < iterations; n++) {
+        for (int k = 0; k < FMA_CHAIN; k++) {
+            for (int i = 0; i < 8; i++) acc[i] = _mm256_fmadd_pd(acc[i], mul, add);
+        }
+    }
+    __m256d total = acc[0];
+    for (int i = 1; i < 8; i++) total = _mm256_add_pd(total, acc[i]);
+    double lanes[4];
+    _mm256_storeu_pd(lanes, total);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+/**
+ * Runs FMA iterations on eight 512-bit accumulators (the license drop is the point)
+ * 
+ * @param iterations Iteration count
+ * @return Reduced result
+ */
+__attribute__((target("avx512f"))) double fmaAvx512(long long iterations) {
+    __m512d acc[8];
+    for (int i = 0; i < 8; i++) acc[i] = _mm512_set1_pd(i + 1.0);
+    const __m512d mul = _mm512_set1_pd(0.999999);
+    const __m512d add = _mm512_set1_pd(1e-7);
+    for (long long n = 0; n < iterations; n++) {
+        for (int k = 0; k < FMA_CHAIN; k++) {
+            for (int i = 0; i < 8; i++) acc[i] = _mm512_fmadd_pd(acc[i], mul, add);
+        }
+    }
+    __m512d total = acc[0];
+    for (int i = 1; i < 8; i++) total = _mm512_add_pd(total, acc[i]);
+    double lanes[8];
+    _mm512_storeu_pd(lanes, total);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] + lanes[6] + lanes[7];
+}
+#endif
+
+// FmaVariant: Instruction set used by the FMA kernel
+enum class FmaVariant { Scalar, Avx2, Avx512 };
+
+/**
+ * Picks the widest FMA variant the CPU supports
+ * 
+ * @return Selected variant
+ */
+FmaVariant detectFmaVariant() {
+#ifdef THREAD_MUSIC_X86_FMA
+    if (__builtin_cpu_supports("avx512f")) return FmaVariant::Avx512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return FmaVariant::Avx2;
+#endif
+    return FmaVariant::Scalar;
+}
+
+const FmaVariant fmaVariantInUse = detectFmaVariant();
+
+} // namespace
+
+/**
+ * Parses a workload name from the command line
+ * 
+ * @param name "sincos", "stream", "chase", "fma", "syscall", or "lock"
+ * @param kind Receives the parsed kind
+ * @return True if the name was recognized
+ */
+bool parseWorkloadKind(const std::string& name, WorkloadKind& kind) {
+    if (name == "sincos") kind = WorkloadKind::SinCos;
+    else if (name == "stream") kind = WorkloadKind::Stream;
+    else if (name == "chase") kind = WorkloadKind::PointerChase;
+    else if (name == "fma") kind = WorkloadKind::Fma;
+    else if (name == "syscall") kind = WorkloadKind::Syscall;
+    else if (name == "lock") kind = WorkloadKind::Lock;
+    else return false;
+    return true;
+}
+
+/**
+ * Returns the command-line name of a workload kind
+ * 
+ * @param kind Workload kind
+ * @return Name accepted by parseWorkloadKind()
+ */
+const char* workloadKindName(WorkloadKind kind) {
+    switch (kind) {
+        case WorkloadKind::SinCos: return "sincos";
+        case WorkloadKind::Stream: return "stream";
+        case WorkloadKind::PointerChase: return "chase";
+        case WorkloadKind::Fma: return "fma";
+        case WorkloadKind::Syscall: return "syscall";
+        case WorkloadKind::Lock: return "lock";
+    }
+    return "unknown";
+}
+
+/**
+ * Allocates the working set for a kernel
+ * 
+ * @param kind Kernel to run
+ * @param iterationsPerUs Calibrated rate (see calibrate())
+ * @param counters Optional counters receiving busy time and mutex wait time
+ */
+Workload::Workload(WorkloadKind kind, double iterationsPerUs, ThreadCounters* counters)
+    : kind(kind), iterationsPerUs(iterationsPerUs), counters(counters) {
+    if (kind == WorkloadKind::Stream) {
+        std::size_t count = std::max(STREAM_CHUNK, WORKLOAD_BUFFER_BYTES / 2 / sizeof(double));
+        count -= count % STREAM_CHUNK;
+        streamA.assign(count, 1.0);
+        streamB.assign(count, 2.0);
+    } else if (kind == WorkloadKind::PointerChase) {
+        // Sattolo's algorithm gives a single cycle through every cache line
+        std::size_t lines = std::max<std::size_t>(2, WORKLOAD_BUFFER_BYTES / (CHASE_STRIDE * sizeof(std::size_t)));
+        std::vector<std::size_t> order(lines);
+        for (std::size_t i = 0; i < lines; i++) order[i] = i;
+        std::mt19937_64 gen(lines);
+        for (std::size_t i = lines - 1; i > 0; i--) {
+            std::uniform_int_distribution<std::size_t> pick(0, i - 1);
+            std::swap(order[i], order[pick(gen)]);
+        }
+        chaseNext.assign(lines * CHASE_STRIDE, 0);
+        for (std::size_t i = 0; i < lines; i++) {
+            chaseNext[i * CHASE_STRIDE] = order[i] * CHASE_STRIDE;
+        }
+    }
+}
+
+/**
+ * Switches to the kernel last published to a selection, if it changed
+ * 
+ * @param selection Published kernel and rate
+ * @return True if the kernel was switched
+ */
+bool Workload::follow(const WorkloadSelection& selection) {
+    if (selection.getGeneration() == selectionGeneration) return false;
+    WorkloadKind nextKind;
+    double nextRate;
+    unsigned generation = selection.read(nextKind, nextRate);
+    *this = Workload(nextKind, nextRate, counters);
+    selectionGeneration = generation;
+    return true;
+}
+
+/**
+ * Publishes a kernel for every thread to switch to
+ * 
+ * @param kind Kernel to run
+ * @param iterationsPerUs Calibrated rate of the kernel
+ */
+void WorkloadSelection::publish(WorkloadKind kind, double iterationsPerUs) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->kind = kind;
+    this->iterationsPerUs = iterationsPerUs;
+    generation.fetch_add(1, std::memory_order_release);
+}
+
+/**
+ * Reads the published kernel
+ * 
+ * @param kind Receives the kernel
+ * @param iterationsPerUs Receives its rate
+ * @return Generation of the selection (0 = nothing published)
+ */
+unsigned WorkloadSelection::read(WorkloadKind& kind, double& iterationsPerUs) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    kind = this->kind;
+    iterationsPerUs = this->iterationsPerUs;
+    return generation.load(std::memory_order_relaxed);
+}
+
+/**
+ * Runs the kernel for roughly the given time
+ * 
+ * @param targetUs Target duration in microseconds when uncontended
+ */
+void Workload::runFor(int targetUs) {
+    long long startNs = counters ? getMonotonicNs() : 0;
+    run(std::max(1LL, std::llround(targetUs * iterationsPerUs)));
+    if (counters) ThreadCounters::add(counters->busyNs, getMonotonicNs() - startNs);
+}
+
+/**
+ * Runs a fixed number of kernel iterations
+ * 
+ * @param iterations Iteration count (the unit of work differs per kernel)
+ */
+void Workload::run(long long iterations) {
+    switch (kind) {
+        case WorkloadKind::SinCos: {
+            volatile double sum = 0;
+            for (long long i = 0; i < iterations; i++) {
+                sum = sum + sin(i) * cos(i);
+            }
+            break;
+        }
+        case WorkloadKind::Stream: {
+            double* a = streamA.data();
+            const double* b = streamB.data();
+            for (long long n = 0; n < iterations; n++) {
+                for (std::size_t i = streamCursor; i < streamCursor + STREAM_CHUNK; i++) {
+                    a[i] = b[i] * 1.000001 + a[i];
+                }
+                streamCursor += STREAM_CHUNK;
+                if (streamCursor >= streamA.size()) streamCursor = 0;
+            }
+            sink += a[0];
+            break;
+        }
+        case WorkloadKind::PointerChase: {
+            std::size_t cursor = chaseCursor;
+            for (long long n = 0; n < iterations; n++) {
+                cursor = chaseNext[cursor];
+            }
+            chaseCursor = cursor;
+            break;
+        }
+        case WorkloadKind::Fma:
+#ifdef THREAD_MUSIC_X86_FMA
+            if (fmaVariantInUse == FmaVariant::Avx512) { sink += fmaAvx512(iterations); break; }
+            if (fmaVariantInUse == FmaVariant::Avx2) { sink += fmaAvx2(iterations); break; }
+#endif
+            sink += fmaScalar(iterations);
+            break;
+        case WorkloadKind::Syscall:
+            for (long long n = 0; n < iterations; n++) {
+#if defined(__linux__)
+                syscall(SYS_getppid); // Not cached by libc, unlike getpid() on some versions
+#else
+                getppid();
+#endif
+            }
+            break;
+        case WorkloadKind::Lock:
+            for (long long n = 0; n < iterations; n++) {
+                // Only a failed try_lock is timed, so uncontended iterations stay cheap
+                std::unique_lock<std::mutex> lock(contendedMutex, std::try_to_lock);
+                if (!lock.owns_lock()) {
+                    long long waitStartNs = getMonotonicNs();
+                    lock.lock();
+                    if (counters) ThreadCounters::add(counters->mutexWaitNs, getMonotonicNs() - waitStartNs);
+                }
+                for (int i = 0; i < 16; i++) contendedCounter = contendedCounter + 1;
+            }
+            break;
+    }
+}
+
+/**
+ * Measures how many iterations of a kernel fit in one microsecond
+ * 
+ * @param kind Kernel to measure
+ * @return Iterations per microsecond
+ */
+double Workload::calibrate(WorkloadKind kind) {
+    Workload workload(kind, 1.0);
+    workload.run(16); // Touch code and the start of the working set
+
+    // Double the batch until one batch takes a quarter of the calibration time
+    long long targetNs = WORKLOAD_CALIBRATION_MS * 1000000LL / 4;
+    long long iterations = 16;
+    while (true) {
+        long long startNs = getMonotonicNs();
+        workload.run(iterations);
+        long long elapsedNs = getMonotonicNs() - startNs;
+        if (elapsedNs >= targetNs || iterations >= (1LL << 40)) {
+            return iterations * 1000.0 / std::max(1LL, elapsedNs);
+        }
+        iterations *= 2;
+    }
+}
+
+/**
+ * Returns the FMA instruction set selected on this CPU
+ * 
+ * @return "avx512", "avx2", or "scalar"
+ */
+const char* Workload::fmaVariant() {
+    switch (fmaVariantInUse) {
+        case FmaVariant::Avx512: return "avx512";
+        case FmaVariant::Avx2: return "avx2";
+        case FmaVariant::Scalar: break;
+    }
+    return "scalar";
+}